@@ -0,0 +1,108 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <vector>
+#include <ckcore/types.hh>
+#include "ckfilesystem/filetree.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Page cache hints given while copying file data.
+     *
+     * Source files are read once, sequentially, and the image is never read
+     * back. On hosts running other workloads it can therefore be desirable
+     * to keep the data out of the page cache. The default policy does not
+     * give any hints.
+     */
+    class CachePolicy
+    {
+    public:
+        ckcore::tuint64 read_ahead_;    ///< Number of source bytes to request ahead of the read position, zero disables read-ahead.
+        ckcore::tuint32 window_size_;   ///< Granularity in bytes of all hints.
+        bool drop_source_;              ///< Evict source data from the page cache once it has been copied.
+        bool drop_output_;              ///< Evict image data from the page cache once it has been written back (CloneOutStream only).
+
+        CachePolicy() :
+            read_ahead_(0),window_size_(0x800000),drop_source_(false),
+            drop_output_(false)
+        {
+        }
+
+        /**
+         * Returns true if any hints should be given.
+         */
+        bool enabled() const
+        {
+            return read_ahead_ > 0 || drop_source_ || drop_output_;
+        }
+    };
+
+    /**
+     * @brief Gives page cache hints for source files while they're copied.
+     *
+     * The advisor knows the order in which all files will be read. Read-ahead
+     * requests are issued in that order across file boundaries so that the
+     * next files are already in the page cache when the current file has
+     * been copied. The hints are given using separate file descriptors since
+     * the advice applies to the cached file data and not to a descriptor.
+     */
+    class CacheAdvisor
+    {
+    private:
+        const CachePolicy &policy_;
+        const std::vector<FileTreeNode *> &files_;
+
+        size_t cur_file_;
+        ckcore::tuint64 cur_start_;     // Position of the current file in the read order.
+        ckcore::tuint64 drop_pos_;      // Source data before this position has been evicted.
+
+        size_t hint_file_;
+        ckcore::tuint64 hint_start_;    // Position of hint_file_ in the read order.
+        ckcore::tuint64 hint_pos_;      // Read-ahead has been requested up to this position in hint_file_.
+
+#ifndef _WINDOWS
+        int cur_handle_;
+        int hint_handle_;
+#endif
+
+        void close_handles();
+
+        CacheAdvisor(const CacheAdvisor &);
+        CacheAdvisor &operator=(const CacheAdvisor &);
+
+    public:
+        CacheAdvisor(const CachePolicy &policy,const std::vector<FileTreeNode *> &files);
+        ~CacheAdvisor();
+
+        void begin_file(size_t index);
+        void read(ckcore::tuint64 pos);
+        void end_file();
+
+        /**
+         * Returns the number of bytes that should be read between calls to
+         * read(), or zero if the file can be read in one go.
+         */
+        ckcore::tuint64 get_read_size() const
+        {
+            return policy_.read_ahead_ > 0 || policy_.drop_source_ ? policy_.window_size_ : 0;
+        }
+    };
+};
@@ -0,0 +1,47 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stddef.h>
+
+namespace ckfilesystem
+{
+    /**
+     * Character classification of ISO9660 and Joliet identifiers. The
+     * functions process 16 or 32 bytes per step using SSE2, AVX2 or NEON
+     * depending on what the processor supports, with a portable fallback
+     * for everything else. The implementation is selected once at start-up.
+     */
+    namespace charclass
+    {
+        enum CharClass
+        {
+            CHARCLASS_A,        ///< a-characters, ECMA 119: 7.4.1.
+            CHARCLASS_A_SAFE,   ///< a-characters except : ; < = > and ?.
+            CHARCLASS_D,        ///< d-characters, ECMA 119: 7.4.1.
+            CHARCLASS_D_SEP,    ///< d-characters, SEPARATOR 1 and SEPARATOR 2.
+            CHARCLASS_J         ///< Bytes allowed in Joliet identifiers.
+        };
+
+        size_t find_invalid(CharClass char_class,const unsigned char *str,size_t len);
+        void make_valid(CharClass char_class,unsigned char *dst,const char *src,size_t len);
+
+        const char *kernel_name();
+        bool set_kernel(const char *name);
+    };
+};
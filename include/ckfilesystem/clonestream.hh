@@ -0,0 +1,148 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <ckcore/types.hh>
+#include <ckcore/stream.hh>
+#include "ckfilesystem/sectorstream.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Output stream writing a disc image to a file, capable of cloning
+     *        file data instead of copying it.
+     *
+     * Regular writes are buffered. File data written using write_file() is
+     * shared with the source file using FICLONERANGE where the file system
+     * supports it (for example btrfs and XFS) and the image offset is aligned
+     * to a file system block. Data that can't be cloned, such as unaligned
+     * files and the tail of each file, is copied with copy_file_range(2) and
+     * as a last resort through a memory buffer.
+     *
+     * Passing a CloneOutStream to FileSystemWriter::write makes the writer
+     * use write_file() for all file data. Aligning the file extents to the
+     * file system block size using FileSystemWriter::set_data_alignment
+     * allows all files to be cloned.
+     */
+    class CloneOutStream : public ExtentOutStream
+    {
+    private:
+        ckcore::tstring file_path_;
+#ifdef _WINDOWS
+        void *file_handle_;
+#else
+        int file_handle_;
+#endif
+        ckcore::tuint64 pos_;               // File position of the first byte in the buffer.
+
+        unsigned char *buffer_;
+        ckcore::tuint32 buffer_size_;
+        ckcore::tuint32 buffer_used_;
+
+        ckcore::tuint32 block_size_;        // Clone granularity of the output file system.
+        bool clone_supported_;
+        bool copy_range_supported_;
+
+        ckcore::tuint64 cloned_bytes_;
+        ckcore::tuint64 copied_bytes_;
+        ckcore::tuint64 buffered_bytes_;
+
+        ckcore::tuint32 drop_window_;       // Granularity of page cache eviction, zero to keep the data cached.
+        ckcore::tuint64 sync_pos_;          // Write-back has been started up to this position.
+        ckcore::tuint64 drop_pos_;          // Data before this position has been evicted.
+
+        void drop_cache(bool all);
+        bool write_at(const void *buffer,ckcore::tuint32 count,ckcore::tuint64 offset);
+
+#ifdef _WINDOWS
+        ckcore::tuint64 copy_buffered(void *src_handle,ckcore::tuint64 src_offset,
+                                      ckcore::tuint64 dst_offset,ckcore::tuint64 count);
+        ckcore::tuint64 copy(void *src_handle,ckcore::tuint64 src_offset,
+                             ckcore::tuint64 dst_offset,ckcore::tuint64 count);
+#else
+        ckcore::tuint64 clone_range(int src_handle,ckcore::tuint64 src_offset,
+                                    ckcore::tuint64 dst_offset,ckcore::tuint64 count);
+        ckcore::tuint64 copy_range(int src_handle,ckcore::tuint64 src_offset,
+                                   ckcore::tuint64 dst_offset,ckcore::tuint64 count);
+        ckcore::tuint64 copy_buffered(int src_handle,ckcore::tuint64 src_offset,
+                                      ckcore::tuint64 dst_offset,ckcore::tuint64 count);
+        ckcore::tuint64 copy(int src_handle,ckcore::tuint64 src_offset,
+                             ckcore::tuint64 dst_offset,ckcore::tuint64 count);
+#endif
+
+        CloneOutStream(const CloneOutStream &);
+        CloneOutStream &operator=(const CloneOutStream &);
+
+    public:
+        CloneOutStream(const ckcore::tchar *file_path,ckcore::tuint32 buffer_size = 0x10000);
+        virtual ~CloneOutStream();
+
+        bool open();
+        bool close();
+        bool flush();
+
+        ckcore::tint64 write(const void *buffer,ckcore::tuint32 count);
+        void write_file(const ckcore::tchar *file_path,ckcore::tuint64 file_offset,
+                        ckcore::tuint64 file_size);
+
+        /**
+         * Enables eviction of written data from the page cache. Data is
+         * evicted once it has been written back to the disk, one window
+         * behind the write position.
+         * @param [in] window_size The eviction granularity in bytes, zero to
+         *                         keep the written data cached.
+         */
+        void set_drop_cache(ckcore::tuint32 window_size)
+        {
+            drop_window_ = window_size;
+        }
+
+        /**
+         * Returns the number of bytes written so far.
+         */
+        ckcore::tuint64 get_pos() const
+        {
+            return pos_ + buffer_used_;
+        }
+
+        /**
+         * Returns the number of file data bytes shared with source files.
+         */
+        ckcore::tuint64 get_cloned_bytes() const
+        {
+            return cloned_bytes_;
+        }
+
+        /**
+         * Returns the number of file data bytes copied by the kernel.
+         */
+        ckcore::tuint64 get_copied_bytes() const
+        {
+            return copied_bytes_;
+        }
+
+        /**
+         * Returns the number of file data bytes copied through memory.
+         */
+        ckcore::tuint64 get_buffered_bytes() const
+        {
+            return buffered_bytes_;
+        }
+    };
+};
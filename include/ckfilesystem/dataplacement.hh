@@ -0,0 +1,72 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <map>
+#include <vector>
+#include <ckcore/types.hh>
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Access profile used for ordering file data in the data area.
+     *
+     * By default file data is placed in directory hierarchy order. A profile
+     * assigns weights to files and files with higher weights are placed
+     * first, directly after the directory extents. Files with the same
+     * weight, including all files not in the profile, keep their default
+     * order.
+     *
+     * Profiles can be loaded from text files in one of two formats, which
+     * may be mixed:
+     * - Sort-weight lines, "path weight", where the weight is a signed
+     *   integer. Files not listed have weight zero so negative weights
+     *   place files last.
+     * - Access trace lines containing only a path, listed in the order the
+     *   files are read. Traced files are placed in trace order before all
+     *   files with a weight of zero. Files traced more than once are placed
+     *   by their first access.
+     *
+     * Paths are matched against both the path in the disc image, for
+     * example "/setup/data1.cab", and the path of the source file. Empty
+     * lines and lines starting with '#' are
+     * ignored.
+     */
+    class DataPlacement
+    {
+    private:
+        std::map<ckcore::tstring,ckcore::tint32> weights_;
+
+    public:
+        void clear();
+        bool load(const ckcore::tchar *file_path);
+
+        void set_weight(const ckcore::tstring &file_path,ckcore::tint32 weight);
+        ckcore::tint32 get_weight(const ckcore::tstring &internal_path,
+                                  const ckcore::tstring &external_path) const;
+
+        /**
+         * Returns true if the profile does not contain any files.
+         */
+        bool empty() const
+        {
+            return weights_.empty();
+        }
+    };
+};
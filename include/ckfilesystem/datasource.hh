@@ -0,0 +1,173 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <functional>
+#include <vector>
+#include <ckcore/types.hh>
+#include <ckcore/stream.hh>
+#include <ckcore/filestream.hh>
+#include "ckfilesystem/filestat.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Provides the contents of a file that is not read from a file
+     *        of its own on the hard drive.
+     *
+     * Data sources are attached to file descriptors, the writer then reads
+     * the file data from the source instead of opening the external path.
+     * The size of the data must be known before the source is opened, it is
+     * used when laying out the file system. Unless the source provides its
+     * own meta data snapshot its time stamps are the image creation time.
+     *
+     * A source has a read position and can therefore only be used by one
+     * writer at a time. It must be kept alive until the writer has
+     * finished, file descriptors do not take ownership of their sources.
+     */
+    class DataSource : public ckcore::InStream
+    {
+    public:
+        virtual ~DataSource() {}
+
+        /**
+         * Prepares the source for reading from the beginning.
+         * @return If successful true is returned, otherwise false.
+         */
+        virtual bool open() = 0;
+
+        /**
+         * Releases any resources held while reading.
+         */
+        virtual bool close() = 0;
+
+        /**
+         * Returns true if the source is open.
+         */
+        virtual bool test() = 0;
+
+        /**
+         * Returns the file on the hard drive containing the data, if any.
+         * This allows the data to be shared with the source file rather
+         * than copied when writing to a CloneOutStream or a VirtualImage.
+         * @param [out] file_path The path of the file.
+         * @param [out] file_offset The offset of the data in the file.
+         * @return If the data is a byte range of a file true is returned,
+         *         otherwise false.
+         */
+        virtual bool get_file_range(ckcore::tstring & /*file_path*/,ckcore::tuint64 & /*file_offset*/)
+        {
+            return false;
+        }
+
+        /**
+         * Provides the meta data snapshot of the file, it is taken when the
+         * file tree is created.
+         * @param [out] stat The snapshot.
+         * @return If the source has a snapshot true is returned, otherwise
+         *         false.
+         */
+        virtual bool stat(FileStat & /*stat*/)
+        {
+            return false;
+        }
+    };
+
+    /**
+     * @brief Data source reading from a memory buffer.
+     */
+    class MemoryDataSource : public DataSource
+    {
+    private:
+        std::vector<unsigned char> data_;
+        size_t pos_;
+        bool open_;
+
+    public:
+        MemoryDataSource(const void *data,size_t size);
+
+        bool open();
+        bool close();
+        bool test();
+
+        bool end();
+        bool seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence);
+        ckcore::tint64 read(void *buffer,ckcore::tuint32 count);
+        ckcore::tint64 size();
+    };
+
+    /**
+     * @brief Data source reading from a callback function.
+     *
+     * The callback is asked for the data at increasing offsets, starting
+     * from zero each time the source is opened. It must return the number
+     * of bytes it has provided, at least one, or a negative value on error.
+     */
+    class CallbackDataSource : public DataSource
+    {
+    public:
+        typedef std::function<ckcore::tint64(ckcore::tuint64 offset,void *buffer,
+                                             ckcore::tuint32 count)> ReadFunction;
+
+    private:
+        ckcore::tuint64 size_;
+        ReadFunction read_func_;
+        ckcore::tuint64 pos_;
+        bool open_;
+
+    public:
+        CallbackDataSource(ckcore::tuint64 size,ReadFunction read_func);
+
+        bool open();
+        bool close();
+        bool test();
+
+        bool end();
+        bool seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence);
+        ckcore::tint64 read(void *buffer,ckcore::tuint32 count);
+        ckcore::tint64 size();
+    };
+
+    /**
+     * @brief Data source reading a byte range of a file on the hard drive.
+     */
+    class FileRangeDataSource : public DataSource
+    {
+    private:
+        ckcore::tstring file_path_;
+        ckcore::tuint64 file_offset_;
+        ckcore::tuint64 size_;
+        ckcore::tuint64 pos_;
+        ckcore::FileInStream stream_;
+
+    public:
+        FileRangeDataSource(const ckcore::tchar *file_path,ckcore::tuint64 file_offset,
+                            ckcore::tuint64 size);
+
+        bool open();
+        bool close();
+        bool test();
+
+        bool end();
+        bool seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence);
+        ckcore::tint64 read(void *buffer,ckcore::tuint32 count);
+        ckcore::tint64 size();
+
+        bool get_file_range(ckcore::tstring &file_path,ckcore::tuint64 &file_offset);
+    };
+};
@@ -0,0 +1,123 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <cstddef>
+#include <ckcore/types.hh>
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Interface for executing tasks on behalf of the library.
+     *
+     * All parallel stages schedule their work through an executor, this
+     * makes it possible to run several builds on a thread pool owned by the
+     * application instead of having each stage start its own threads. The
+     * library provides ThreadPool as the default implementation.
+     *
+     * Work should be submitted through a TaskGroup rather than directly,
+     * the group keeps track of completion and enforces concurrency limits.
+     */
+    class Executor
+    {
+    public:
+        /**
+         * @brief Interface for work items executed by an executor.
+         */
+        class Task
+        {
+        public:
+            virtual ~Task() {}
+
+            /**
+             * Executes the task. When run through a TaskGroup the first
+             * exception escaping from run() is rethrown by
+             * TaskGroup::wait(), other tasks of the group still run. The
+             * thread pool discards exceptions of tasks submitted to it
+             * directly.
+             */
+            virtual void run() = 0;
+        };
+
+        /**
+         * @brief Interface for work split over index ranges.
+         */
+        class RangeTask
+        {
+        public:
+            virtual ~RangeTask() {}
+
+            /**
+             * Processes the indices in [begin,end). Called concurrently for
+             * disjoint ranges.
+             */
+            virtual void run(size_t begin,size_t end) = 0;
+        };
+
+        virtual ~Executor() {}
+
+        /**
+         * Schedules a task for execution. The task may be executed directly
+         * by the calling thread. The executor must not access the task after
+         * its run() function has returned.
+         * @param [in] task The task to execute.
+         */
+        virtual void submit(Task *task) = 0;
+
+        /**
+         * Returns the number of tasks the executor can run at the same time,
+         * zero if tasks are executed by the submitting thread.
+         */
+        virtual ckcore::tuint32 concurrency() const = 0;
+    };
+
+    /**
+     * @brief Set of tasks executed on an executor that can be waited for
+     *        as a unit.
+     *
+     * A group runs at most a fixed number of its tasks at the same time,
+     * this is used to cap how much of a shared executor a single build may
+     * occupy. The thread waiting for the group executes queued tasks itself
+     * while waiting, groups may therefore be waited for from tasks running
+     * on the same executor without risking a deadlock.
+     */
+    class TaskGroup
+    {
+    private:
+        class State;
+        class Runner;
+
+        Executor &executor_;
+        State *state_;
+
+        TaskGroup(const TaskGroup &);
+        TaskGroup &operator=(const TaskGroup &);
+
+    public:
+        TaskGroup(Executor &executor,ckcore::tuint32 max_concurrency = 0);
+        ~TaskGroup();
+
+        void submit(Executor::Task *task);
+        void wait();
+
+        ckcore::tuint64 get_cpu_time() const;
+
+        void parallel_for(size_t begin,size_t end,size_t grain,
+                          Executor::RangeTask &body);
+    };
+};
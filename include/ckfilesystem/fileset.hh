@@ -20,6 +20,7 @@
 #include <set>
 #include <ckcore/types.hh>
 #include <ckcore/string.hh>
+#include "ckfilesystem/datasource.hh"
 
 namespace ckfilesystem
 {
@@ -38,6 +39,7 @@ namespace ckfilesystem
         unsigned char flags_;
         ckcore::tstring internal_path_;     // Path in disc image.
         ckcore::tstring external_path_;     // Path on hard drive.
+        DataSource *data_source_;           // Source of the file data, NULL to read external_path_.
 
         void *data_ptr_;                    // Pointer to a user-defined structure, designed for IsoTreeNode.
 
@@ -45,7 +47,23 @@ namespace ckfilesystem
                        unsigned char flags = 0,void *data_ptr = NULL) :
             flags_(flags),
             internal_path_(internal_path),external_path_(external_path),
-            data_ptr_(data_ptr)
+            data_source_(NULL),data_ptr_(data_ptr)
+        {
+        }
+
+        /**
+         * Creates a descriptor of a file whose data is provided by a data
+         * source. The internal path is used as external path, it identifies
+         * the file in messages.
+         * @param [in] internal_path The path in the disc image.
+         * @param [in] data_source The source of the file data, it must be
+         *                         kept alive until the file system has been
+         *                         written.
+         */
+        FileDescriptor(const ckcore::tchar *internal_path,DataSource *data_source) :
+            flags_(0),
+            internal_path_(internal_path),external_path_(internal_path),
+            data_source_(data_source),data_ptr_(NULL)
         {
         }
     };
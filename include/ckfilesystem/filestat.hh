@@ -0,0 +1,75 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <time.h>
+#include <ckcore/types.hh>
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Snapshot of the file system meta data of a source file or
+     *        directory.
+     *
+     * The snapshot is taken once when the file tree is created. All writers
+     * use the same snapshot, this avoids repeated system calls and makes
+     * the time stamps consistent between the ISO9660, Joliet and UDF file
+     * systems.
+     */
+    class FileStat
+    {
+    public:
+        enum
+        {
+            FLAG_VALID = 0x01,      ///< The snapshot has been taken successfully.
+            FLAG_HIDDEN = 0x02      ///< The file is hidden.
+        };
+
+        ckcore::tuint64 size_;
+        ckcore::tint64 access_time_;    ///< Seconds since the epoch.
+        ckcore::tint64 modify_time_;
+        ckcore::tint64 create_time_;    ///< Status change time on Unix systems.
+        ckcore::tuint64 inode_;
+        ckcore::tuint64 dev_;
+        unsigned char flags_;
+
+        FileStat() : size_(0),access_time_(0),modify_time_(0),create_time_(0),
+            inode_(0),dev_(0),flags_(0)
+        {
+        }
+
+        bool read(const ckcore::tchar *file_path,bool check_readable = false,
+                  ckcore::tuint64 *stat_count = NULL);
+
+        /**
+         * Returns true if the snapshot has been taken successfully.
+         */
+        bool valid() const
+        {
+            return (flags_ & FLAG_VALID) != 0;
+        }
+
+        bool hidden() const
+        {
+            return (flags_ & FLAG_HIDDEN) != 0;
+        }
+
+        bool get_times(struct tm &access_time,struct tm &modify_time,
+                       struct tm &create_time) const;
+    };
+};
@@ -17,6 +17,7 @@
  */
 
 #pragma once
+#include <time.h>
 #include <ckcore/types.hh>
 #include <ckcore/log.hh>
 #include "ckfilesystem/fileset.hh"
@@ -24,9 +25,18 @@
 #include "ckfilesystem/joliet.hh"
 #include "ckfilesystem/eltorito.hh"
 #include "ckfilesystem/udf.hh"
+#include "ckfilesystem/stringtable.hh"
 
 namespace ckfilesystem
 {
+    /**
+     * @brief Describes the file system to create.
+     *
+     * All state used while building, including the string table, belongs to
+     * the object. Separate FileSystem objects, each with its own file set,
+     * can be used from different threads at the same time. A single object
+     * must not be used by more than one thread at a time.
+     */
     class FileSystem
     {
     public:
@@ -58,6 +68,12 @@ namespace ckfilesystem
         // File set.
         const FileSet &file_set_;
 
+        // Messages reported while writing the file system.
+        StringTable string_table_;
+
+        // Creation time of the file system, zero for the time of writing.
+        time_t create_time_;
+
     public:
         FileSystem(Type type,const FileSet &file_set);
         ~FileSystem();
@@ -77,12 +93,23 @@ namespace ckfilesystem
         void set_part_access_type(Udf::PartAccessType access_type);
         void set_relax_max_dir_level(bool relax);
         void set_long_joliet_names(bool enable);
+        void set_embed_udf_data(bool enable);
+        void set_create_time(time_t create_time);
 
         bool add_boot_image_no_emu(const ckcore::tchar *full_path,bool bootable,
                                    ckcore::tuint16 load_segment,ckcore::tuint16 sec_count);
         bool add_boot_image_floppy(const ckcore::tchar *full_path,bool bootable);
         bool add_boot_image_hard_disk(const ckcore::tchar *full_path,bool bootable);
 
+        /**
+         * Returns the messages reported while writing this file system, the
+         * returned table may be modified to translate them.
+         */
+        StringTable &get_string_table()
+        {
+            return string_table_;
+        }
+
         // Information output routines.
         const FileSet &files();
 
@@ -93,5 +120,7 @@ namespace ckfilesystem
 
         bool allows_fragmentation();
         unsigned char get_max_dir_level();
+        ckcore::tuint32 get_max_embedded_file_size();
+        void get_create_time(struct tm &create_time) const;
     };
 };
@@ -24,9 +24,16 @@
 #include <ckcore/progress.hh>
 #include <ckcore/log.hh>
 #include <ckcore/stream.hh>
+#include <ckcore/filestream.hh>
 #include "ckfilesystem/fileset.hh"
 #include "ckfilesystem/filetree.hh"
 #include "ckfilesystem/sectorstream.hh"
+#include "ckfilesystem/sectormanager.hh"
+#include "ckfilesystem/clonestream.hh"
+#include "ckfilesystem/cacheadvisor.hh"
+#include "ckfilesystem/dataplacement.hh"
+#include "ckfilesystem/layoutmap.hh"
+#include "ckfilesystem/writestats.hh"
 #include "ckfilesystem/iso.hh"
 #include "ckfilesystem/joliet.hh"
 #include "ckfilesystem/eltorito.hh"
@@ -35,6 +42,19 @@
 
 namespace ckfilesystem
 {
+    /**
+     * @brief Writes a file system to an output stream.
+     *
+     * Writers do not share any mutable state with each other. Any number of
+     * writers can run concurrently in one process as long as each one has
+     * its own FileSystem object, file set, output stream, log and progress
+     * object. Given the same input and creation time (see
+     * FileSystem::set_create_time) the output is identical regardless of
+     * what else the process is doing. The only process wide settings are the
+     * character conversion kernel (charclass::set_kernel) which must be
+     * selected before any writer starts, and the trace log which is
+     * internally synchronized.
+     */
     class FileSystemWriter
     {
     private:
@@ -42,29 +62,51 @@ namespace ckfilesystem
         FileSystem &file_sys_;      ///< What file system should be created.
         FileTree file_tree_;        ///< File tree for caching between the write and file_path_map functions.
         const bool fail_on_error_;  ///< Set to true in order to abort the operation if an error occurs.
+        bool verify_output_;        ///< Set to true in order to verify the file system while writing.
+        ckcore::tuint32 data_align_boundary_;   ///< Boundary in bytes to align large file extents to.
+        ckcore::tuint64 data_align_min_size_;   ///< Files smaller than this are not aligned.
+        CachePolicy cache_policy_;              ///< Page cache hints to give while copying file data.
+        DataPlacement data_placement_;          ///< Access profile for ordering file data.
+        LayoutMap prev_layout_;                 ///< Layout of the previous image, for incremental builds.
+        ckcore::tstring prev_image_path_;       ///< Path to the previous image.
+        ckcore::tuint32 sec_offset_;            ///< Sector offset of the last written image.
+        WriteStats stats_;                      ///< Statistics of the last write operation.
 
         /**
          * Calculates file system specific data such as extent location and size for a
-         * single file.
+         * single directory. Files with data in the data area are added to file_nodes.
          * @throw Exception If advertised multi-session data can not be found.
          */
         void calc_local_filesys_data(std::vector<std::pair<FileTreeNode *,int> > &dir_node_stack,
-                                     FileTreeNode *local_node,int level,ckcore::tuint64 &sec_offset,
+                                     FileTreeNode *local_node,int level,
+                                     std::vector<FileTreeNode *> &file_nodes,
                                      ckcore::Progress &progress);
         /**
          * Calculates file system specific data such as location of extents and sizes of
-         * extents.
+         * extents. All files with data in the data area are returned in file_nodes in
+         * the order they're placed.
          * @throw Exception If advertised multi-session data can not be found.
          */
         void calc_filesys_data(FileTree &file_tree,ckcore::Progress &progress,
-                               ckcore::tuint64 start_sec,ckcore::tuint64 &last_sec);
+                               SectorManager &sec_manager,ckcore::tuint64 start_sec,
+                               ckcore::tuint64 &last_sec,std::vector<FileTreeNode *> &file_nodes);
+        void place_file_data(std::vector<FileTreeNode *> &file_nodes);
+        bool place_incremental_file_data(std::vector<FileTreeNode *> &file_nodes,
+                                         SectorManager &sec_manager,ckcore::tuint64 start_sec,
+                                         ckcore::tuint64 &last_sec);
+        void print_data_alignment(FileTree &file_tree);
 
-        void write_file_node(SectorOutStream &out_stream,FileTreeNode *node,
+        void write_zero_sectors(SectorOutStream &out_stream,ckcore::tuint32 num_sec);
+
+        void write_file_node(SectorOutStream &out_stream,ExtentOutStream *extent_stream,
+                             ckcore::FileInStream *prev_image,CacheAdvisor &cache_advisor,
+                             FileTreeNode *node,ckcore::Progresser &progresser);
+        void write_reused_file_node(SectorOutStream &out_stream,ExtentOutStream *extent_stream,
+                                    ckcore::FileInStream *prev_image,FileTreeNode *node,
+                                    ckcore::Progresser &progresser);
+        void write_file_data(SectorOutStream &out_stream,ExtentOutStream *extent_stream,
+                             const std::vector<FileTreeNode *> &file_nodes,
                              ckcore::Progresser &progresser);
-        void write_local_file_data(SectorOutStream &out_stream,
-                                   std::vector<std::pair<FileTreeNode *,int> > &dir_node_stack,
-                                   FileTreeNode *local_node,int level,ckcore::Progresser &progresser);
-        void write_file_data(SectorOutStream &out_stream,FileTree &file_tree,ckcore::Progresser &progresser);
 
         void get_internal_path(FileTreeNode *child_node,ckcore::tstring &node_path,
                                bool ext_path,bool joliet);
@@ -85,7 +127,136 @@ namespace ckfilesystem
         ~FileSystemWriter();    
 
         /**
-         * Writes the file system to the specified output stream.
+         * Enables or disables verification of the file system while it's
+         * being written. The verification runs on a separate thread and any
+         * problems are reported as errors by the write function, the
+         * verifier does not print a report of its own.
+         * Multi-session images are never verified. While verification is
+         * enabled all file data is copied through the verifier, extents are
+         * never cloned or copied by the kernel (reflink, copy_file_range).
+         * @param [in] verify_output Set to true to enable verification.
+         */
+        void set_verify_output(bool verify_output)
+        {
+            verify_output_ = verify_output;
+        }
+
+        /**
+         * Returns true if the file system is verified while it's written.
+         */
+        bool get_verify_output() const
+        {
+            return verify_output_;
+        }
+
+        /**
+         * Sets the number of threads used for reading the meta data of all
+         * source files before writing.
+         * @param [in] thread_count The number of threads, zero or one to
+         *                          read everything from the calling thread.
+         */
+        void set_stat_thread_count(ckcore::tuint32 thread_count)
+        {
+            file_tree_.set_stat_thread_count(thread_count);
+        }
+
+        /**
+         * Makes the writer check that all source files can be read while
+         * reading their meta data, before anything is written. By default
+         * an unreadable file is reported when its data is copied.
+         * @param [in] check_readable Set to true to check all files up front.
+         */
+        void set_check_readable(bool check_readable)
+        {
+            file_tree_.set_check_readable(check_readable);
+        }
+
+        /**
+         * Makes the parallel stages of the writer schedule their work on the
+         * specified executor instead of starting threads of their own. This
+         * allows several writers to share a thread pool owned by the
+         * application. Output verification, which is a pipeline stage
+         * blocking on the writer, always runs on a thread of its own.
+         * @param [in] executor The executor, NULL to let the writer manage
+         *                      its own threads.
+         * @param [in] max_concurrency The maximum number of tasks of this
+         *                             writer running at the same time on
+         *                             the executor, zero for no limit.
+         */
+        void set_executor(Executor *executor,ckcore::tuint32 max_concurrency = 0)
+        {
+            file_tree_.set_executor(executor,max_concurrency);
+        }
+
+        /**
+         * Enables alignment of large file extents in the data area. Files
+         * that are at least min_size bytes large are placed on a multiple of
+         * boundary bytes, smaller files are packed tightly. The alignment
+         * padding is reported in the log. Alignment is never used for
+         * DVD-Video file systems since their layout is fixed.
+         * @param [in] boundary The alignment boundary in bytes, for example
+         *                      32 KiB for optical media ECC blocks. Zero or
+         *                      one sector disables alignment.
+         * @param [in] min_size The minimum file size in bytes for a file to
+         *                      be aligned.
+         */
+        void set_data_alignment(ckcore::tuint32 boundary,ckcore::tuint64 min_size)
+        {
+            data_align_boundary_ = boundary;
+            data_align_min_size_ = min_size;
+        }
+
+        /**
+         * Sets the access profile used for ordering the file data. Files
+         * read early or often are placed first, directly after the directory
+         * extents. An empty profile keeps the default hierarchy order.
+         * @param [in] data_placement The access profile.
+         */
+        void set_data_placement(const DataPlacement &data_placement)
+        {
+            data_placement_ = data_placement;
+        }
+
+        /**
+         * Enables incremental building from a previously written image.
+         * Files with the same path, size and modification time as in the
+         * layout map of the previous image keep their extents and their data
+         * is copied from the previous image instead of from the source file.
+         * When writing to a CloneOutStream the data is cloned, making the
+         * amount of data written proportional to the changes. New and
+         * modified files are placed in the free space between the kept
+         * extents or after them. All meta data is regenerated. Incremental
+         * building is never used for DVD-Video file systems.
+         * @param [in] image_path Path to the previous image, this must not
+         *                        be the file being written.
+         * @param [in] layout_map The layout map saved after writing the
+         *                        previous image, an empty map disables
+         *                        incremental building.
+         */
+        void set_previous_image(const ckcore::tchar *image_path,const LayoutMap &layout_map)
+        {
+            prev_image_path_ = image_path;
+            prev_layout_ = layout_map;
+        }
+
+        /**
+         * Sets the page cache hints to give while copying file data. By
+         * default no hints are given. Eviction of image data is only
+         * possible when writing to a CloneOutStream.
+         * @param [in] cache_policy The hints to give.
+         */
+        void set_cache_policy(const CachePolicy &cache_policy)
+        {
+            cache_policy_ = cache_policy;
+            if (cache_policy_.window_size_ < ISO_SECTOR_SIZE)
+                cache_policy_.window_size_ = ISO_SECTOR_SIZE;
+        }
+
+        /**
+         * Writes the file system to the specified output stream. If the
+         * stream is an ExtentOutStream, such as CloneOutStream, the file data
+         * is passed to it by reference instead of being copied, unless the
+         * output is verified.
          * @param [out] out_stream Stream to write to.
          * @param [out] progress Object to report progress to.
          * @param [in] sec_offset Space assumed to be allocated before this
@@ -102,5 +273,35 @@ namespace ckfilesystem
          * @pre Must be called after the write function.
          */
         int file_path_map(std::map<ckcore::tstring,ckcore::tstring> &file_path_map);
+
+        /**
+         * Returns the location of the data of all files in the last written
+         * image. The map should be saved together with the image to make it
+         * possible to use it for incremental building later.
+         * @pre Must be called after the write function.
+         */
+        int layout_map(LayoutMap &layout_map);
+
+        /**
+         * Sets the number of slowest source files to report in the
+         * statistics, the default is ten.
+         * @param [in] count The number of files, zero disables reporting.
+         */
+        void set_slow_file_count(size_t count)
+        {
+            stats_.set_slow_file_count(count);
+        }
+
+        /**
+         * Returns timing and counters of the last write operation, per
+         * phase, together with latency histograms and the slowest source
+         * files. The statistics are also printed to the log when the write
+         * operation succeeds.
+         * @pre Must be called after the write function.
+         */
+        const WriteStats &get_stats() const
+        {
+            return stats_;
+        }
     };
 };
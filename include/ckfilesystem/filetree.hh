@@ -22,8 +22,11 @@
 #include <ckcore/types.hh>
 #include <ckcore/log.hh>
 #include <ckcore/filestream.hh>
+#include "ckfilesystem/datasource.hh"
 #include "ckfilesystem/exception.hh"
+#include "ckfilesystem/executor.hh"
 #include "ckfilesystem/fileset.hh"
+#include "ckfilesystem/filestat.hh"
 
 namespace ckfilesystem
 {
@@ -39,20 +42,29 @@ namespace ckfilesystem
         enum
         {
             FLAG_DIRECTORY = 0x01,
-            FLAG_IMPORTED = 0x02
+            FLAG_IMPORTED = 0x02,
+            FLAG_EMBEDDED = 0x04,           // The file data is embedded in the UDF file entry.
+            FLAG_REUSED = 0x08              // The file data is copied from the previous image.
         };
 
         ckcore::FileInStream file_stream_;  // File stream for reading.
+        DataSource *data_source_;           // Source of the data if not read from file_path_.
 
         unsigned char file_flags_;
         ckcore::tuint64 file_size_;
         ckcore::tstring file_name_;         // File name in disc image (requested name not actual, using ISO9660 may cripple the name).
         ckcore::tstring file_path_;         // Place on hard drive.
+        FileStat stat_;                     // Meta data snapshot, taken when the tree is created.
 
         // I am not sure this is the best way, this uses lots of memory.
         std::string file_name_iso_;
         std::wstring file_name_joliet_;
 
+        // File identifiers exactly as recorded on disc, encoded once and then
+        // copied by all later phases. The ISO9660 identifier is file_name_iso_.
+        std::string file_ident_joliet_;     // UCS-2 big-endian.
+        std::string file_ident_udf_;        // OSTA CS0 compressed.
+
         // File system information (not set by the routines in this file).
         ckcore::tuint64 data_pos_normal_;   // Sector number of first sector containing data.
         ckcore::tuint64 data_pos_joliet_;
@@ -60,6 +72,7 @@ namespace ckfilesystem
         ckcore::tuint64 data_size_joliet_;
 
         ckcore::tuint32 data_pad_len_;      // The number of sectors to pad with zeroes after the file.
+        ckcore::tuint32 data_align_len_;    // The number of sectors to pad with zeroes before the file, to align it or to skip free space.
 
         // Sector size of UDF partition entry (all data) for an node and all it's children.
         ckcore::tuint64 udf_size_;
@@ -82,33 +95,23 @@ namespace ckfilesystem
          * @param [in] fragment_index FIXME.
          * @param [in] file_flags File flags.
          * @param [in] data_ptr Pointer to IsoTreeNode data structure.
-         * @throw FileOpenException Thrown when file stream cannot be opened for
-         *                          reading.
          */
         FileTreeNode(FileTreeNode *parent_node,const ckcore::tchar *file_name,
                      const ckcore::tchar *file_path,
                      bool /* last_fragment */, ckcore::tuint32 /* fragment_index */,
                      unsigned char file_flags = 0,void *data_ptr = NULL) :
             parent_node_(parent_node),
-            file_stream_(file_path),
+            file_stream_(file_path),data_source_(NULL),
             file_flags_(file_flags),file_size_(0),
             file_name_(file_name),file_path_(file_path),
             data_pos_normal_(0),data_pos_joliet_(0),
-            data_size_normal_(0),data_size_joliet_(0),data_pad_len_(0),
+            data_size_normal_(0),data_size_joliet_(0),data_pad_len_(0),data_align_len_(0),
             udf_size_(0),udf_size_tot_(0),udf_link_tot_(0),udf_part_loc_(0),
             data_ptr_(data_ptr)
 #ifdef _DEBUG
             ,data_pos_actual_(0)
 #endif
         {
-            // If not a directory, try to open the file stream.
-            if (!(file_flags & FLAG_DIRECTORY) && !(file_flags & FLAG_IMPORTED))
-            {
-                if (!file_stream_.open())
-                    throw FileOpenException(file_path_);
-
-                file_size_ = file_stream_.size();
-            }
         }
 
         ~FileTreeNode()
@@ -126,6 +129,60 @@ namespace ckfilesystem
             return parent_node_;
         }
 
+        /**
+         * Opens the file data for reading from the beginning.
+         * @return If successful true is returned, otherwise false.
+         */
+        bool open_data()
+        {
+            return data_source_ != NULL ? data_source_->open() : file_stream_.open();
+        }
+
+        void close_data()
+        {
+            if (data_source_ != NULL)
+                data_source_->close();
+            else
+                file_stream_.close();
+        }
+
+        /**
+         * Returns true if the file data is open.
+         */
+        bool data_open()
+        {
+            return data_source_ != NULL ? data_source_->test() : file_stream_.test();
+        }
+
+        /**
+         * Returns the stream to read the file data from, it must have been
+         * opened using open_data().
+         */
+        ckcore::InStream &data_stream()
+        {
+            if (data_source_ != NULL)
+                return *data_source_;
+
+            return file_stream_;
+        }
+
+        /**
+         * Returns the file on the hard drive containing the file data.
+         * @param [out] file_path The path of the file.
+         * @param [out] file_offset The offset of the data in the file.
+         * @return If the data is not stored in a file on the hard drive false
+         *         is returned, otherwise true.
+         */
+        bool get_data_range(ckcore::tstring &file_path,ckcore::tuint64 &file_offset)
+        {
+            if (data_source_ != NULL)
+                return data_source_->get_file_range(file_path,file_offset);
+
+            file_path = file_path_;
+            file_offset = 0;
+            return true;
+        }
+
         /**
          * Visists this node and its parents in bottom-up order.
          * @param [in] func Function to call for each visited node.
@@ -161,15 +218,58 @@ namespace ckfilesystem
         ckcore::tuint32 dir_count_;
         ckcore::tuint32 file_count_;
 
+        // Nodes waiting for their meta data snapshot.
+        std::vector<FileTreeNode *> stat_nodes_;
+        ckcore::tuint32 stat_thread_count_;
+        bool check_readable_;
+        Executor *executor_;
+        ckcore::tuint32 max_concurrency_;
+        ckcore::tuint64 stat_count_;
+        ckcore::tuint64 stat_cpu_time_;
+
+        class StatTask;
+
         FileTreeNode *get_child_from_file_name(FileTreeNode *parent_node,
                                                const ckcore::tchar *file_name);
         bool add_file_from_path(const FileDescriptor &file);
+        void stat_nodes();
 
     public:
         FileTree(ckcore::Log &log);
         ~FileTree();
 
         FileTreeNode *get_root();
+
+        /**
+         * Sets the number of threads used for taking the meta data snapshots
+         * of all files when creating the tree. Zero or one means that the
+         * calling thread takes all snapshots.
+         */
+        void set_stat_thread_count(ckcore::tuint32 thread_count)
+        {
+            stat_thread_count_ = thread_count;
+        }
+
+        /**
+         * Makes creating the tree fail if any file can't be read, rather
+         * than when its data is opened. Disabled by default since it costs
+         * an additional system call per file.
+         */
+        void set_check_readable(bool check_readable)
+        {
+            check_readable_ = check_readable;
+        }
+
+        /**
+         * Makes the meta data snapshots run on the specified executor rather
+         * than on threads owned by the tree. The stat thread count is not
+         * used when an executor is set.
+         */
+        void set_executor(Executor *executor,ckcore::tuint32 max_concurrency)
+        {
+            executor_ = executor;
+            max_concurrency_ = max_concurrency;
+        }
         
         bool create_from_file_set(const FileSet &files);
         FileTreeNode *get_node_from_path(const ckcore::tchar *internal_path);
@@ -190,5 +290,25 @@ namespace ckfilesystem
         // For obtaining file tree information.
         ckcore::tuint32 get_dir_count();
         ckcore::tuint32 get_file_count();
+        ckcore::tuint64 get_mem_usage();
+
+        /**
+         * Returns the number of stat calls made taking the meta data
+         * snapshots when the tree was created.
+         */
+        ckcore::tuint64 get_stat_count() const
+        {
+            return stat_count_;
+        }
+
+        /**
+         * Returns the processor time in microseconds used by other threads
+         * than the calling one taking the meta data snapshots when the tree
+         * was created.
+         */
+        ckcore::tuint64 get_stat_cpu_time() const
+        {
+            return stat_cpu_time_;
+        }
     };
 };
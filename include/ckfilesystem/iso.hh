@@ -353,6 +353,8 @@ namespace ckfilesystem
     void iso_make_dosdatetime(tiso_dir_record_datetime &iso_time,
                               ckcore::tuint16 &date, ckcore::tuint16 &time);
 
+    bool iso_is_joliet(const tiso_voldesc_suppl &voldesc_suppl);
+
     /**
      * Implements functionallity for creating parts of ISO9660 file systems.
      * For example writing certain descriptors and for generating ISO9660
@@ -0,0 +1,58 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <vector>
+#include <ckcore/types.hh>
+#include <ckcore/log.hh>
+#include "ckfilesystem/datasource.hh"
+#include "ckfilesystem/fileset.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Provides the files of an existing ISO9660 image for inclusion
+     *        in a new image.
+     *
+     * The directory hierarchy of the image is added to a file set without
+     * extracting anything. Each file is backed by a data source referencing
+     * its extent in the image, the writer copies the data straight from the
+     * image file or shares it when writing to a CloneOutStream or a
+     * VirtualImage. The recorded time stamps and hidden flags are kept.
+     *
+     * Only single session images are supported. The Joliet names are used
+     * if present, Rock Ridge attributes and El Torito boot records are not
+     * preserved. Directories receive the creation time of
+     * the new image. The image must not be modified until the new image has
+     * been written and the data sources are owned by this object, it must be
+     * kept alive until then.
+     */
+    class IsoImageSource
+    {
+    private:
+        ckcore::Log &log_;
+        ckcore::tstring image_path_;
+        std::vector<DataSource *> data_sources_;
+
+    public:
+        IsoImageSource(ckcore::Log &log,const ckcore::tchar *image_path);
+        ~IsoImageSource();
+
+        bool add_files(FileSet &file_set,const ckcore::tchar *internal_path = ckT(""));
+    };
+};
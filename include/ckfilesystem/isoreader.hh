@@ -22,11 +22,15 @@
 #include <ckcore/log.hh>
 #include <ckcore/stream.hh>
 #include "ckfilesystem/iso.hh"
+#include "ckfilesystem/isotree.hh"
 
 namespace ckfilesystem
 {
     /**
      * @brief Contains every information needed to write an ISO9660 directory record.
+     *
+     * This pointer based representation is only created on demand from an
+     * IsoTree, new code should use IsoTree directly.
      */
     class IsoTreeNode
     {
@@ -83,27 +87,49 @@ namespace ckfilesystem
     private:
         ckcore::Log &log_;
 
+        IsoTree tree_;
         IsoTreeNode *root_node_;
 
+        // Set if the tree was read from the Joliet hierarchy.
+        bool joliet_;
+
         bool read_dir_entry(ckcore::InStream &in_stream,
-                            std::vector<IsoTreeNode *> &dir_entries,
-                            IsoTreeNode *parent_node,
+                            std::vector<ckcore::tuint32> &dir_entries,
+                            ckcore::tuint32 parent_index,
                             bool joliet);
 
+        IsoTreeNode *make_node_tree() const;
+
     public:
         IsoReader(ckcore::Log &log);
         ~IsoReader();
 
-        IsoTreeNode *get_root()
+        /**
+         * Returns the imported directory hierarchy.
+         */
+        const IsoTree &get_tree() const
+        {
+            return tree_;
+        }
+
+        /**
+         * Returns true if the tree was read from the Joliet hierarchy rather
+         * than the ISO9660 one.
+         */
+        bool is_joliet() const
         {
-            return root_node_;
+            return joliet_;
         }
 
-        bool read(ckcore::InStream &in_stream,ckcore::tuint32 start_sec);
+        IsoTreeNode *get_root();
+
+        bool read(ckcore::InStream &in_stream,ckcore::tuint32 start_sec,
+                  bool recursive = true);
+        bool read_dir(ckcore::InStream &in_stream,ckcore::tuint32 index);
 
     #ifdef _DEBUG
-        void print_local_tree(std::vector<std::pair<IsoTreeNode *,int> > &dir_node_stack,
-                              IsoTreeNode *local_node,int indent);
+        void print_local_tree(std::vector<std::pair<ckcore::tuint32,int> > &dir_node_stack,
+                              ckcore::tuint32 local_index,int indent);
         void print_tree();
     #endif
     };
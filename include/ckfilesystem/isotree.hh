@@ -0,0 +1,156 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <vector>
+#include <ckcore/types.hh>
+#include "ckfilesystem/iso.hh"
+#include "ckfilesystem/fileset.hh"
+
+namespace ckfilesystem
+{
+    class IsoImportData;
+
+    /**
+     * @brief Compact representation of a directory hierarchy imported from an
+     *        ISO9660 file system.
+     *
+     * All nodes live in one contiguous array and refer to each other using
+     * indices instead of pointers. File names are interned in a shared name
+     * pool so identical names (common on multi-session and DVD-Video discs)
+     * are stored only once. The tree is released as a whole, there is no
+     * per-node destruction.
+     */
+    class IsoTree
+    {
+    public:
+        static const ckcore::tuint32 INVALID_INDEX = 0xffffffff;
+        static const ckcore::tuint32 ROOT_INDEX = 0;
+
+        /**
+         * @brief A single directory record in the imported tree.
+         */
+        class Node
+        {
+        public:
+            ckcore::tuint32 parent_;
+            ckcore::tuint32 first_child_;
+            ckcore::tuint32 next_sibling_;
+            ckcore::tuint32 name_off_;          // Offset into the name pool.
+            ckcore::tuint32 extent_loc_;
+            ckcore::tuint32 extent_len_;
+            ckcore::tuint16 volseq_num_;
+            unsigned char name_len_;            // Length in characters, excluding terminator.
+            unsigned char file_flags_;
+            unsigned char file_unit_size_;
+            unsigned char interleave_gap_size_;
+
+            tiso_dir_record_datetime rec_timestamp_;
+        };
+
+    private:
+        std::vector<Node> nodes_;
+        std::vector<ckcore::tchar> names_;
+
+        // Open addressing hash table of name pool offsets (plus one, zero
+        // marks an empty slot) used for interning.
+        std::vector<ckcore::tuint32> name_slots_;
+        ckcore::tuint32 name_count_;
+
+        // Cache of the most recently appended child, the reader adds all
+        // children of one directory in sequence.
+        ckcore::tuint32 tail_parent_;
+        ckcore::tuint32 tail_child_;
+
+        static ckcore::tuint32 hash_name(const ckcore::tchar *name,size_t name_len);
+
+        ckcore::tuint32 intern_name(const ckcore::tchar *name,size_t name_len);
+        void grow_name_slots();
+
+    public:
+        IsoTree();
+
+        void clear();
+        void reserve(size_t node_count,size_t name_chars);
+
+        ckcore::tuint32 add_root(ckcore::tuint32 extent_loc,ckcore::tuint32 extent_len,
+                                 ckcore::tuint16 volseq_num,unsigned char file_flags,
+                                 unsigned char file_unit_size,unsigned char interleave_gap_size,
+                                 const tiso_dir_record_datetime &rec_timestamp);
+        ckcore::tuint32 add_node(ckcore::tuint32 parent,const ckcore::tchar *file_name,
+                                 ckcore::tuint32 extent_loc,ckcore::tuint32 extent_len,
+                                 ckcore::tuint16 volseq_num,unsigned char file_flags,
+                                 unsigned char file_unit_size,unsigned char interleave_gap_size,
+                                 const tiso_dir_record_datetime &rec_timestamp);
+
+        /**
+         * Returns true if the tree does not contain any nodes, not even a
+         * root node.
+         */
+        bool empty() const
+        {
+            return nodes_.empty();
+        }
+
+        /**
+         * Returns the number of nodes in the tree, including the root.
+         */
+        ckcore::tuint32 size() const
+        {
+            return static_cast<ckcore::tuint32>(nodes_.size());
+        }
+
+        const Node &node(ckcore::tuint32 index) const
+        {
+            return nodes_[index];
+        }
+
+        Node &node(ckcore::tuint32 index)
+        {
+            return nodes_[index];
+        }
+
+        /**
+         * Returns the null-terminated name of the specified node. The returned
+         * pointer is invalidated when more nodes are added to the tree.
+         */
+        const ckcore::tchar *name(ckcore::tuint32 index) const
+        {
+            return &names_[nodes_[index].name_off_];
+        }
+
+        bool is_dir(ckcore::tuint32 index) const
+        {
+            return (nodes_[index].file_flags_ & DIRRECORD_FILEFLAG_DIRECTORY) != 0;
+        }
+
+        /**
+         * Returns the number of bytes occupied by the tree storage.
+         */
+        size_t mem_usage() const
+        {
+            return nodes_.capacity() * sizeof(Node) +
+                   names_.capacity() * sizeof(ckcore::tchar) +
+                   name_slots_.capacity() * sizeof(ckcore::tuint32);
+        }
+
+        void make_import_data(std::vector<IsoImportData> &import_data) const;
+        void make_file_set(FileSet &file_set,std::vector<IsoImportData> &import_data,
+                           const ckcore::tchar *internal_path = ckT("")) const;
+    };
+};
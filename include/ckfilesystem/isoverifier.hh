@@ -18,8 +18,15 @@
 
 #pragma once
 #include <vector>
+#include <map>
+#include <queue>
+#include <functional>
 #include <ckcore/types.hh>
 #include <ckcore/canexstream.hh>
+#include <ckcore/log.hh>
+#include "ckfilesystem/iso.hh"
+#include "ckfilesystem/sectorstream.hh"
+#include "ckfilesystem/threadpool.hh"
 
 namespace ckfilesystem
 {
@@ -58,6 +65,8 @@ namespace ckfilesystem
     class IsoVolDescSet
     {
     private:
+        ckcore::Log &log_;
+
         tiso_voldesc_primary voldesc_primary_;
         std::vector<tiso_voldesc_suppl> voldesc_suppl_;
         std::vector<tiso_voldesc_part> voldesc_part_;
@@ -70,24 +79,254 @@ namespace ckfilesystem
         void verify(const tiso_voldesc_suppl &voldesc_suppl,int index) const;
 
     public:
-        IsoVolDescSet();
+        IsoVolDescSet(ckcore::Log &log);
 
         void read(SectorInStream &in_stream);
         void verify();
+
+        const tiso_voldesc_primary &primary() const
+        {
+            return voldesc_primary_;
+        }
+
+        const std::vector<tiso_voldesc_suppl> &supplementary() const
+        {
+            return voldesc_suppl_;
+        }
+    };
+
+    /**
+     * @brief Class for verifying path tables and directory hierarchies.
+     *
+     * The verifier can operate in two modes. In the sequential mode all
+     * structures are visited in a single forward pass in sector order, the
+     * input stream is never seeked backwards. This makes it possible to
+     * verify images arriving through pipes. Directory extents are processed
+     * one sector at a time. Memory use is not bounded, it grows linearly with
+     * the number of directories and files: the path tables, a record per
+     * directory and the location of every extent are kept until the end for
+     * the overlap and agreement checks.
+     *
+     * In the parallel mode all path tables, and then all directories listed
+     * in the path tables, are read using positional reads from a pool of
+     * threads. The results are merged and cross-checked on the calling
+     * thread, making the outcome independent of the number of threads.
+     */
+    class IsoHierarchyVerifier
+    {
+    private:
+        enum ItemType
+        {
+            ITEM_PATH_TABLE_L,
+            ITEM_PATH_TABLE_M,
+            ITEM_DIRECTORY
+        };
+
+        /**
+         * @brief A structure waiting to be read from the stream.
+         */
+        class WorkItem
+        {
+        public:
+            ckcore::tuint32 sector_;
+            ItemType type_;
+            size_t hierarchy_;
+
+            WorkItem(ckcore::tuint32 sector,ItemType type,size_t hierarchy) :
+                sector_(sector),type_(type),hierarchy_(hierarchy)
+            {
+            }
+
+            bool operator>(const WorkItem &other) const
+            {
+                if (sector_ != other.sector_)
+                    return sector_ > other.sector_;
+
+                return type_ > other.type_;
+            }
+        };
+
+        class PathTableRecord
+        {
+        public:
+            ckcore::tuint32 extent_loc_;
+            ckcore::tuint16 parent_num_;
+            ckcore::tuint32 ident_off_;
+            unsigned char ident_len_;
+        };
+
+        class DirInfo
+        {
+        public:
+            ckcore::tuint32 parent_loc_;        // 0 if not yet known.
+            ckcore::tuint32 data_len_;          // 0 if not yet known.
+            ckcore::tuint32 path_num_;          // 0 if not in path table.
+            bool queued_;
+            bool read_;
+
+            DirInfo() : parent_loc_(0),data_len_(0),path_num_(0),
+                queued_(false),read_(false)
+            {
+            }
+        };
+
+        /**
+         * @brief A directory record found in a directory extent, other than
+         *        the '.' and '..' records.
+         */
+        class DirEntry
+        {
+        public:
+            ckcore::tuint32 extent_loc_;
+            ckcore::tuint32 data_len_;
+            bool dir_;
+        };
+
+        /**
+         * @brief The verified contents of a single directory extent. The
+         *        scan only depends on the extent itself, it's merged into the
+         *        hierarchy once the complete extent has been read.
+         */
+        class DirScan
+        {
+        public:
+            ckcore::tuint32 extent_loc_;
+            ckcore::tuint32 sec_count_;
+            ckcore::tuint32 rec_count_;
+            ckcore::tuint32 data_len_;          // According to the '.' record.
+            ckcore::tuint32 parent_loc_;        // According to the '..' record.
+            std::vector<DirEntry> entries_;
+
+            ckcore::tuint32 ident_warnings_;
+            ckcore::tstring ident_warning_;
+            ckcore::tstring ident_warning_ref_;
+
+            DirScan(ckcore::tuint32 extent_loc) : extent_loc_(extent_loc),
+                sec_count_(1),rec_count_(0),data_len_(0),parent_loc_(0),
+                ident_warnings_(0)
+            {
+            }
+        };
+
+        /**
+         * @brief State of one directory hierarchy (ISO9660 or Joliet).
+         */
+        class Hierarchy
+        {
+        public:
+            bool joliet_;
+            ckcore::tuint32 root_loc_;
+            ckcore::tuint32 path_table_size_;
+            bool path_table_read_;
+
+            std::vector<PathTableRecord> path_table_;
+            std::vector<unsigned char> path_table_idents_;
+            std::map<ckcore::tuint32,DirInfo> dirs_;
+
+            // Extent location and length of all non-empty files.
+            std::vector<std::pair<ckcore::tuint32,ckcore::tuint32> > files_;
+
+            ckcore::tuint32 dir_count_;
+            ckcore::tuint32 file_count_;
+            ckcore::tuint32 ident_warnings_;
+
+            Hierarchy(bool joliet) : joliet_(joliet),root_loc_(0),
+                path_table_size_(0),path_table_read_(false),
+                dir_count_(0),file_count_(0),ident_warnings_(0)
+            {
+            }
+        };
+
+        class VerifyTask;
+        class PathTableTask;
+        class DirTask;
+
+        ckcore::Log &log_;
+
+        ckcore::tuint32 vol_space_size_;
+        std::vector<Hierarchy> hierarchies_;
+        std::priority_queue<WorkItem,std::vector<WorkItem>,std::greater<WorkItem> > queue_;
+
+        // Sector ranges (first sector, sector count) of all extents.
+        std::vector<std::pair<ckcore::tuint32,ckcore::tuint32> > extents_;
+
+        unsigned char buffer_[ISO_SECTOR_SIZE];
+
+        const ckcore::tchar *label(const Hierarchy &hierarchy) const;
+
+        void add_hierarchy(const tiso_dir_record &root_dir_record,
+                           const unsigned char *path_table_size,
+                           const unsigned char *path_table_type_l,
+                           const unsigned char *opt_path_table_type_l,
+                           const unsigned char *path_table_type_m,
+                           const unsigned char *opt_path_table_type_m,
+                           bool joliet);
+        void add_extent(ckcore::tuint32 extent_loc,ckcore::tuint64 extent_len,
+                        const ckcore::tchar *label);
+        void queue_dir(size_t hierarchy,ckcore::tuint32 extent_loc);
+
+        bool skip_to(SectorInStream &in_stream,ckcore::tuint32 sector);
+        void read_sector(SectorInStream &in_stream);
+
+        void read_path_table(SectorInStream &in_stream,size_t hierarchy,
+                             ckcore::tuint32 sector,bool type_l);
+        void add_path_table(size_t hierarchy,ckcore::tuint32 sector,bool type_l,
+                            std::vector<PathTableRecord> &records,
+                            std::vector<unsigned char> &idents);
+        void read_dir(SectorInStream &in_stream,size_t hierarchy,
+                      ckcore::tuint32 extent_loc);
+        void merge_dir(size_t hierarchy,const DirScan &scan);
+
+        static void verify_extent(ckcore::tuint32 extent_loc,ckcore::tuint64 extent_len,
+                                  ckcore::tuint32 vol_space_size,const ckcore::tchar *label);
+        static void parse_path_table(const std::vector<unsigned char> &table,
+                                     ckcore::tuint32 sector,bool type_l,
+                                     std::vector<PathTableRecord> &records,
+                                     std::vector<unsigned char> &idents);
+        static void scan_dir_sector(DirScan &scan,const unsigned char *buffer,
+                                    ckcore::tuint32 sector_index,bool joliet);
+        static void scan_dir_end(const DirScan &scan);
+        static void verify_ident(DirScan &scan,const tiso_dir_record &dr,
+                                 const unsigned char *file_ident,bool joliet);
+
+        void begin(const IsoVolDescSet &voldesc_set,ckcore::tuint32 voldesc_end);
+        void end();
+        void take_items(std::vector<WorkItem> &items);
+        void throw_errors(const std::vector<VerifyTask *> &tasks) const;
+
+        void verify_hierarchy(const Hierarchy &hierarchy) const;
+        void verify_agreement();
+        void verify_extents();
+
+    public:
+        IsoHierarchyVerifier(ckcore::Log &log);
+
+        void verify(SectorInStream &in_stream,const IsoVolDescSet &voldesc_set);
+        void verify(SectorReader &reader,TaskGroup &group,
+                    const IsoVolDescSet &voldesc_set,ckcore::tuint32 voldesc_end);
+
+        static void verify(const tiso_dir_record_datetime &datetime);
+        static void verify_file_flags(unsigned char file_flags);
     };
 
     class IsoVerifier
     {
     private:
-        //tiso_voldesc_primary *voldesc_primary_;
+        ckcore::Log &log_;
+
         void read_vol_desc(SectorInStream &in_stream);
 
     public:
         IsoVerifier();
+        IsoVerifier(ckcore::Log &log);
         ~IsoVerifier();
 
         void reset();
         void verify(SectorInStream &in_stream);
+        void verify(SectorInStream &in_stream,SectorReader &reader,
+                    ckcore::tuint32 thread_count);
+        void verify(SectorInStream &in_stream,SectorReader &reader,
+                    Executor &executor,ckcore::tuint32 max_concurrency = 0);
 
         static void verify_a_chars(const unsigned char *str,size_t len);
         static void verify_d_chars(const unsigned char *str,size_t len,bool allow_sep = false);
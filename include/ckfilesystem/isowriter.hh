@@ -101,6 +101,8 @@ namespace ckfilesystem
                                 unsigned char file_name_size);
         void make_unique_iso(FileTreeNode *node,unsigned char *file_name_ptr,
                              unsigned char file_name_size);
+        const unsigned char *get_file_ident(FileTreeNode *node,bool joliet,
+                                            unsigned char &ident_len);
 
         bool compare_strings(const char *str1,const ckcore::tchar *str2,
                              unsigned char len);
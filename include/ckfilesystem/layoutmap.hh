@@ -0,0 +1,97 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <map>
+#include <ckcore/types.hh>
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Location of the file data in a disc image.
+     *
+     * The layout map of an image is used for rebuilding the image
+     * incrementally, see FileSystemWriter::set_previous_image. It is stored
+     * in a text file, one file per line:
+     * "sector size modification-time path". The path is the path in the disc
+     * image and the sector is absolute, the sector offset of the image
+     * (non-zero for multi-session images) is stored separately. Paths are
+     * stored as UTF-8 in Unicode builds and unconverted otherwise, there is
+     * no limit on their length.
+     */
+    class LayoutMap
+    {
+    public:
+        /**
+         * @brief Location and identity of the data of a single file.
+         */
+        class Entry
+        {
+        public:
+            ckcore::tuint64 sector_;        ///< First sector of the file data.
+            ckcore::tuint64 size_;          ///< File size in bytes.
+            ckcore::tint64 modify_time_;    ///< Modification time of the source file, seconds since the epoch.
+        };
+
+    private:
+        std::map<ckcore::tstring,Entry> entries_;
+        ckcore::tuint32 sec_offset_;
+
+    public:
+        LayoutMap();
+
+        void clear();
+        bool load(const ckcore::tchar *file_path);
+        bool save(const ckcore::tchar *file_path) const;
+
+        void add(const ckcore::tstring &internal_path,ckcore::tuint64 sector,
+                 ckcore::tuint64 size,ckcore::tint64 modify_time);
+        const Entry *find(const ckcore::tstring &internal_path) const;
+
+        /**
+         * Returns true if the map does not contain any files.
+         */
+        bool empty() const
+        {
+            return entries_.empty();
+        }
+
+        /**
+         * Returns the number of files in the map.
+         */
+        size_t size() const
+        {
+            return entries_.size();
+        }
+
+        /**
+         * Returns the sector offset of the image, the first sector of the
+         * image file has this sector number.
+         */
+        ckcore::tuint32 get_sec_offset() const
+        {
+            return sec_offset_;
+        }
+
+        void set_sec_offset(ckcore::tuint32 sec_offset)
+        {
+            sec_offset_ = sec_offset;
+        }
+    };
+};
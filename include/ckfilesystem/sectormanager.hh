@@ -34,6 +34,10 @@ namespace ckfilesystem
         ckcore::tuint64 next_free_sec_;
         ckcore::tuint64 data_start_;
         ckcore::tuint64 data_len_;
+
+        // Data extent alignment policy.
+        ckcore::tuint32 align_sec_;         // Alignment boundary in sectors, 1 means no alignment.
+        ckcore::tuint64 align_min_bytes_;   // Extents smaller than this are not aligned.
         std::map<std::pair<SectorClient *,unsigned char>,ckcore::tuint64> client_map_;
 
     public:
@@ -48,6 +52,10 @@ namespace ckfilesystem
         void alloc_data_sectors(ckcore::tuint64 num_sec);
         void alloc_data_bytes(ckcore::tuint64 num_bytes);
 
+        void set_data_alignment(ckcore::tuint32 boundary,ckcore::tuint64 min_bytes);
+        ckcore::tuint32 calc_data_align_len(ckcore::tuint64 sec,ckcore::tuint64 num_bytes);
+        ckcore::tuint32 get_data_alignment();
+
         ckcore::tuint64 get_start(SectorClient *client,unsigned char identifier);
         ckcore::tuint64 get_next_free();
 
@@ -18,6 +18,7 @@
 
 #pragma once
 #include <ckcore/types.hh>
+#include <ckcore/string.hh>
 #include <ckcore/stream.hh>
 #include <ckcore/bufferedstream.hh>
 #include <ckcore/canexstream.hh>
@@ -57,6 +58,7 @@ namespace ckfilesystem
         virtual ~SectorOutStream();
 
         void write(void *buffer,ckcore::tuint32 count);
+        void skip(ckcore::tuint64 count);
 
         ckcore::tuint64 get_sector();
         ckcore::tuint32 get_allocated();
@@ -64,4 +66,74 @@ namespace ckfilesystem
 
         void pad_sector();
     };
+
+    /**
+     * @brief Output stream that can receive file data by reference.
+     *
+     * When the file system writer writes to an ExtentOutStream the data of
+     * each file is passed using write_file() instead of being copied through
+     * write(), this allows the stream to clone or record the file data.
+     */
+    class ExtentOutStream : public ckcore::OutStream
+    {
+    public:
+        virtual ~ExtentOutStream() {}
+
+        /**
+         * Writes a range of a file at the current position.
+         * @param [in] file_path Path to the source file.
+         * @param [in] file_offset Offset in the source file of the data.
+         * @param [in] file_size The number of bytes to write from the file.
+         * @throw Exception If the data could not be written.
+         */
+        virtual void write_file(const ckcore::tchar *file_path,ckcore::tuint64 file_offset,
+                                ckcore::tuint64 file_size) = 0;
+    };
+
+    /**
+     * @brief Interface for random access sector reads.
+     *
+     * In contrast to SectorInStream the reader does not have a current
+     * position, all reads are positional. Implementations must allow reads
+     * to be issued from multiple threads at the same time.
+     */
+    class SectorReader
+    {
+    public:
+        virtual ~SectorReader() {}
+
+        /**
+         * Reads data starting at the beginning of a sector.
+         * @param [in] sector The sector to start reading from.
+         * @param [out] buffer The buffer to read into.
+         * @param [in] count The number of bytes to read.
+         * @throw Exception If the requested data could not be read.
+         */
+        virtual void read(ckcore::tuint64 sector,void *buffer,ckcore::tuint32 count) = 0;
+    };
+
+    /**
+     * @brief Positional sector reader operating directly on a file.
+     */
+    class FileSectorReader : public SectorReader
+    {
+    private:
+        ckcore::tstring file_path_;
+        ckcore::tuint32 sector_size_;
+#ifdef _WINDOWS
+        void *file_handle_;
+#else
+        int file_handle_;
+#endif
+
+    public:
+        FileSectorReader(const ckcore::tchar *file_path,
+                         ckcore::tuint32 sector_size = ISO_SECTOR_SIZE);
+        virtual ~FileSectorReader();
+
+        bool open();
+        void close();
+
+        void read(ckcore::tuint64 sector,void *buffer,ckcore::tuint32 count);
+    };
 };
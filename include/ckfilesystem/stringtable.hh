@@ -17,11 +17,17 @@
  */
 
 #pragma once
-#include <map>
 #include <ckcore/types.hh>
 
 namespace ckfilesystem
 {
+    /**
+     * @brief Messages reported through ckcore::Progress while writing.
+     *
+     * Every FileSystem object has its own table, the strings can be replaced
+     * for translation purposes before writing. The table only stores
+     * pointers, replacement strings must outlive the file system.
+     */
     class StringTable
     {
     public:
@@ -39,22 +45,17 @@ namespace ckfilesystem
             STATUS_WRITEISOTABLE,
             STATUS_WRITEJOLIETTABLE,
             STATUS_WRITEDIRENTRIES,
-            ERROR_DVDVIDEO
+            ERROR_DVDVIDEO,
+            STRING_COUNT
         };
 
     private:
-        std::map<StringId,const ckcore::tchar *> strings_;
-
-        StringTable();
-        StringTable(const StringTable &obj);
-        ~StringTable();
-        StringTable &operator=(const StringTable &obj); 
+        const ckcore::tchar *strings_[STRING_COUNT];
 
     public:
+        StringTable();
 
-        static StringTable &instance();
-
-        const ckcore::tchar *get_string(StringId id);
+        const ckcore::tchar *get_string(StringId id) const;
         void set_string(StringId id,const ckcore::tchar *str);
     };
 };
@@ -0,0 +1,171 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <deque>
+#include <vector>
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include <ckcore/types.hh>
+#include "ckfilesystem/executor.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Simple non-recursive mutex.
+     */
+    class Mutex
+    {
+    private:
+#ifdef _WINDOWS
+        CRITICAL_SECTION mutex_;
+#else
+        pthread_mutex_t mutex_;
+#endif
+
+        friend class Condition;
+
+        // Not copyable.
+        Mutex(const Mutex &);
+        Mutex &operator=(const Mutex &);
+
+    public:
+        Mutex();
+        ~Mutex();
+
+        void lock();
+        void unlock();
+    };
+
+    /**
+     * @brief Locks a mutex for the lifetime of the object.
+     */
+    class MutexLock
+    {
+    private:
+        Mutex &mutex_;
+
+        MutexLock(const MutexLock &);
+        MutexLock &operator=(const MutexLock &);
+
+    public:
+        MutexLock(Mutex &mutex) : mutex_(mutex)
+        {
+            mutex_.lock();
+        }
+
+        ~MutexLock()
+        {
+            mutex_.unlock();
+        }
+    };
+
+    /**
+     * @brief Condition variable to be used together with Mutex.
+     */
+    class Condition
+    {
+    private:
+#ifdef _WINDOWS
+        CONDITION_VARIABLE cond_;
+#else
+        pthread_cond_t cond_;
+#endif
+
+        Condition(const Condition &);
+        Condition &operator=(const Condition &);
+
+    public:
+        Condition();
+        ~Condition();
+
+        void wait(Mutex &mutex);
+        void signal();
+        void broadcast();
+    };
+
+    /**
+     * @brief Fixed size pool of worker threads, the default executor.
+     *
+     * Each worker has its own task queue. Tasks submitted by a task running
+     * on a worker are put in the queue of that worker and executed newest
+     * first, tasks submitted by other threads are put in a shared queue.
+     * Idle workers steal the oldest tasks from the queues of other workers.
+     * A pool created without any threads executes each task directly in
+     * submit(), this makes it possible to use the same code path for serial
+     * and parallel operation.
+     */
+    class ThreadPool : public Executor
+    {
+    private:
+        class Worker;
+
+        Mutex mutex_;
+        Condition work_cond_;
+        Condition idle_cond_;
+
+        // Tasks submitted by threads not belonging to the pool.
+        std::deque<Task *> tasks_;
+        std::vector<Worker *> workers_;
+
+        // Number of queued tasks and number of running tasks.
+        ckcore::tint32 pending_;
+        ckcore::tuint32 busy_;
+        bool stop_;
+
+#ifdef _WINDOWS
+        static DWORD WINAPI thread_main(LPVOID param);
+#else
+        static void *thread_main(void *param);
+#endif
+
+        bool take(Worker *worker,Task *&task);
+        bool steal(Worker *worker,Task *&task);
+        void work(Worker *worker);
+        void stop();
+
+        ThreadPool(const ThreadPool &);
+        ThreadPool &operator=(const ThreadPool &);
+
+    public:
+        ThreadPool(ckcore::tuint32 thread_count);
+        ~ThreadPool();
+
+        void submit(Task *task);
+        void wait();
+
+        /**
+         * Returns the number of worker threads in the pool.
+         */
+        ckcore::tuint32 size() const
+        {
+            return static_cast<ckcore::tuint32>(workers_.size());
+        }
+
+        ckcore::tuint32 concurrency() const
+        {
+            return size();
+        }
+
+        static ckcore::tuint32 hardware_concurrency();
+        static ckcore::tuint64 thread_cpu_time();
+    };
+};
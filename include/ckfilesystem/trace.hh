@@ -0,0 +1,120 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+/*
+ * The trace log is always declared and built, the library only records its
+ * own events when it is compiled with CKFILESYSTEM_TRACE defined, for example
+ * by configuring with --enable-trace. Otherwise all trace macros expand to
+ * nothing. Applications don't need the define to use the trace log.
+ */
+#include <vector>
+#include <string>
+#include <ckcore/types.hh>
+#include "ckfilesystem/threadpool.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Recorder of trace events in the Chrome Trace Event format.
+     *
+     * The saved file can be loaded into Perfetto or chrome://tracing. Events
+     * are recorded from all threads into the trace log that is active when
+     * they occur, at most one trace log is active per process.
+     */
+    class TraceLog
+    {
+    private:
+        class Event
+        {
+        public:
+            char phase_;            ///< 'X' for spans, 'C' for counters.
+            const char *category_;
+            const char *name_;
+            std::string arg_;       ///< File name of spans, UTF-8.
+            ckcore::tuint64 time_;
+            ckcore::tuint64 duration_;
+            ckcore::tint64 value_;  ///< Value of counters.
+            ckcore::tuint64 thread_id_;
+        };
+
+        static Mutex active_mutex_;
+        static TraceLog *active_;
+
+        Mutex mutex_;
+        std::vector<Event> events_;
+
+        void add(const Event &event);
+
+        TraceLog(const TraceLog &);
+        TraceLog &operator=(const TraceLog &);
+
+    public:
+        TraceLog();
+        ~TraceLog();
+
+        void clear();
+        bool save(const ckcore::tchar *file_path);
+
+        static void set_active(TraceLog *trace_log);
+        static bool enabled();
+
+        static ckcore::tuint64 get_thread_id();
+        static void span(const char *category,const char *name,
+                         ckcore::tuint64 start_time,ckcore::tuint64 end_time,
+                         const ckcore::tchar *arg = NULL);
+        static void counter(const char *category,const char *name,ckcore::tint64 value);
+    };
+
+    /**
+     * @brief Records a span covering the lifetime of the object.
+     */
+    class TraceScope
+    {
+    private:
+        const char *category_;
+        const char *name_;
+        const ckcore::tchar *arg_;
+        ckcore::tuint64 start_time_;
+
+        TraceScope(const TraceScope &);
+        TraceScope &operator=(const TraceScope &);
+
+    public:
+        TraceScope(const char *category,const char *name,const ckcore::tchar *arg = NULL);
+        ~TraceScope();
+    };
+};
+
+#ifdef CKFILESYSTEM_TRACE
+#define CKFS_TRACE_SCOPE(category,name) \
+    ckfilesystem::TraceScope ckfs_trace_scope_(category,name)
+#define CKFS_TRACE_SCOPE_ARG(category,name,arg) \
+    ckfilesystem::TraceScope ckfs_trace_scope_(category,name,arg)
+#define CKFS_TRACE_SPAN(category,name,start_time,end_time) \
+    ckfilesystem::TraceLog::span(category,name,start_time,end_time)
+#define CKFS_TRACE_COUNTER(category,name,value) \
+    ckfilesystem::TraceLog::counter(category,name,value)
+#else
+#define CKFS_TRACE_SCOPE(category,name)
+#define CKFS_TRACE_SCOPE_ARG(category,name,arg)
+#define CKFS_TRACE_SPAN(category,name,start_time,end_time)
+#define CKFS_TRACE_COUNTER(category,name,value)
+#endif
@@ -24,6 +24,7 @@
 
 #define UDF_SECTOR_SIZE                         2048
 #define UDF_UNIQUEIDENT_MIN                     16
+#define UDF_SCRATCH_FLUSH_SIZE                  0x10000     // Number of pending file identifier bytes to collect before writing.
 
 // Tag identifiers.
 #define UDF_TAGIDENT_PRIMVOLDESC                1
@@ -643,11 +644,22 @@ namespace ckfilesystem
         // Set to true of writing a DVD-Video compatible file system.
         bool dvd_video_;
 
-        // Buffer used for various data storage. This is used for performance reasons.
-        unsigned char *byte_buffer_;
-        ckcore::tuint32 byte_buffer_size_;
+        // Set to true to embed small files and directories in their file entries.
+        bool embed_data_;
 
-        void alloc_byte_buffer(ckcore::tuint32 min_size);
+        // Scratch arena used for assembling descriptors before writing them
+        // as whole sectors. It is aligned to the sector size and reused for
+        // all descriptors to avoid heap allocations and small writes.
+        unsigned char *scratch_mem_;
+        unsigned char *scratch_;
+        ckcore::tuint32 scratch_size_;
+        ckcore::tuint32 scratch_pending_;   // Bytes of file identifier descriptors not yet written.
+
+        unsigned char *alloc_scratch(ckcore::tuint32 min_size);
+        unsigned char *begin_sectors(ckcore::CanexOutStream &out_stream,ckcore::tuint32 desc_len);
+        void end_sectors(ckcore::CanexOutStream &out_stream,ckcore::tuint32 desc_len);
+        void write_sector(ckcore::CanexOutStream &out_stream,const void *desc,ckcore::tuint32 desc_len);
+        unsigned char *append_file_ident(ckcore::CanexOutStream &out_stream,ckcore::tuint32 desc_len);
 
         size_t compress_unicode_str(size_t num_chars,unsigned char comp_id,
                                     const wchar_t *in_str,unsigned char *out_str);
@@ -660,14 +672,20 @@ namespace ckfilesystem
         void make_ident(tudf_intity_ident &impl_ident,IdentType ident_type);
         void make_tag(tudf_tag &tag,ckcore::tuint16 ident);
         void make_tag_checksums(tudf_tag &tag,unsigned char *buffer);
-        void make_vol_set_ident(unsigned char *volset_ident,size_t volset_ident_size);
+        void make_vol_set_ident(unsigned char *volset_ident,size_t volset_ident_size,
+                                const struct tm &create_time);
         void make_date_time(struct tm &time,tudf_timestamp &udf_time);
         void make_os_identifiers(unsigned char &os_class,unsigned char &os_ident);
 
-        unsigned char make_file_ident(unsigned char *out_buffer,const ckcore::tchar *file_name);
-
         ckcore::tuint16 make_ext_addr_checksum(unsigned char *buffer);
 
+        void write_file_entry(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
+                              bool is_dir,ckcore::tuint16 file_link_count,
+                              ckcore::tuint64 unique_ident,ckcore::tuint32 info_loc,
+                              ckcore::tuint64 info_len,const unsigned char *embedded_data,
+                              struct tm &access_time,struct tm &modify_time,
+                              struct tm &create_time);
+
     public:
         Udf(bool dvd_video);
         ~Udf();
@@ -675,6 +693,7 @@ namespace ckfilesystem
         // Change of internal state functions.
         void set_volume_label(const ckcore::tchar *label);
         void set_part_access_type(PartAccessType access_type);
+        void set_embed_data(bool embed);
 
         // Write functions.
         void write_vol_desc_initial(ckcore::CanexOutStream &out_stream);
@@ -705,16 +724,32 @@ namespace ckfilesystem
         void write_file_ident(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
                               ckcore::tuint32 file_entry_sec_loc,bool is_dir,
                               const ckcore::tchar *file_name);
+        void write_file_ident(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
+                              ckcore::tuint32 file_entry_sec_loc,bool is_dir,
+                              const unsigned char *file_ident,unsigned char file_ident_len);
+        void flush_file_idents(ckcore::CanexOutStream &out_stream);
         void write_file_entry(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
                               bool is_dir,ckcore::tuint16 file_link_count,
                               ckcore::tuint64 unique_ident,ckcore::tuint32 info_loc,
                               ckcore::tuint64 info_len,struct tm &access_time,
                               struct tm &modify_time,struct tm &create_time);
+        void write_file_entry_embedded(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
+                                       ckcore::tuint64 unique_ident,const unsigned char *data,
+                                       ckcore::tuint32 data_len,struct tm &access_time,
+                                       struct tm &modify_time,struct tm &create_time);
+        void write_dir_entry_embedded(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
+                                      ckcore::tuint16 file_link_count,ckcore::tuint64 unique_ident,
+                                      struct tm &access_time,struct tm &modify_time,
+                                      struct tm &create_time);
 
         // Helper functions.
+        unsigned char make_file_ident(unsigned char *out_buffer,const ckcore::tchar *file_name);
+
         ckcore::tuint32 calc_file_ident_parent_size();
         ckcore::tuint32 calc_file_ident_size(const ckcore::tchar *file_name);
+        ckcore::tuint32 calc_file_ident_size(unsigned char file_ident_len);
         ckcore::tuint32 calc_file_entry_size();
+        ckcore::tuint32 get_max_embedded_size();
 
         ckcore::tuint32 get_vol_desc_initial_size();
     };
@@ -0,0 +1,62 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <ckcore/types.hh>
+#include <ckcore/crcstream.hh>
+#include "ckfilesystem/udf.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Incremental verifier of UDF descriptor tags.
+     *
+     * Sectors are fed to the verifier one at a time in increasing order.
+     * Every sector starting with a valid descriptor tag is checked for a
+     * correct descriptor CRC and tag location. Partition relative tag
+     * locations are verified once the partition descriptor has been seen.
+     * Sectors containing file data should not be passed to the verifier
+     * since they may contain anything, including other disc images.
+     */
+    class UdfVerifier
+    {
+    private:
+        ckcore::CrcStream crc_stream_;
+
+        ckcore::tuint32 part_start_;
+        bool part_found_;
+        bool anchor_found_;
+        ckcore::tuint32 desc_count_;
+
+        static bool is_tag(const tudf_tag &tag);
+
+    public:
+        UdfVerifier();
+
+        void verify_sector(ckcore::tuint32 sector,const unsigned char *buffer);
+        void verify_end();
+
+        /**
+         * Returns the number of descriptors verified so far.
+         */
+        ckcore::tuint32 desc_count() const
+        {
+            return desc_count_;
+        }
+    };
+};
@@ -63,6 +63,8 @@ namespace ckfilesystem
                                      FileTreeNode *local_node);
         void calc_node_lengths(FileTree &file_tree);
 
+        const std::string &get_file_ident(FileTreeNode *node);
+        bool is_embedded_dir(ckcore::tuint64 ident_size);
         ckcore::tuint64 calc_ident_size(FileTreeNode *local_node);
         ckcore::tuint64 calc_node_size_total(FileTreeNode *local_node);
         ckcore::tuint64 calc_node_links_total(FileTreeNode *local_node);
@@ -73,6 +75,7 @@ namespace ckfilesystem
                                        FileTreeNode *local_node,
                                        ckcore::tuint32 &cur_part_sec,
                                        ckcore::tuint64 &unique_ident);
+        void read_embedded_data(FileTreeNode *node,std::vector<unsigned char> &data);
         void write_partition_entries(FileTree &file_tree);
 
     public:
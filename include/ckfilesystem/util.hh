@@ -17,6 +17,7 @@
  */
 
 #pragma once
+#include <time.h>
 #include <ckcore/types.hh>
 #include <ckcore/stream.hh>
 
@@ -40,6 +41,8 @@ namespace ckfilesystem
         ckcore::tuint32 read731(const unsigned char *buffer);
         ckcore::tuint32 read732(const unsigned char *buffer);
         ckcore::tuint32 read733(const unsigned char *buffer);
+
+        ckcore::tint64 make_time(const struct tm &time);
     };
 };
 
@@ -0,0 +1,156 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <vector>
+#include <ckcore/types.hh>
+#include <ckcore/stream.hh>
+#include "ckfilesystem/threadpool.hh"
+#include "ckfilesystem/udfverifier.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Output stream verifying the file system while it's being written.
+     *
+     * All data written to the tap is passed on to the underlying stream and
+     * copied into a bounded buffer. A separate thread consumes the buffer and
+     * runs the ISO9660 verifier and the UDF descriptor verifier on the data
+     * as it arrives, this keeps the verification off the critical path of
+     * the writer. The writer is only blocked when the verifier lags behind by
+     * more than the buffer size.
+     *
+     * The verifiers require the complete image starting with sector zero,
+     * the tap can not be used for multi-session images.
+     */
+    class VerificationTap : public ckcore::OutStream
+    {
+    private:
+        /**
+         * @brief Input stream reading from the tap buffer on the consumer
+         *        thread.
+         */
+        class TapInStream : public ckcore::InStream
+        {
+        private:
+            VerificationTap &tap_;
+
+        public:
+            TapInStream(VerificationTap &tap) : tap_(tap) {}
+
+            bool end();
+            bool seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence);
+            ckcore::tint64 read(void *buffer,ckcore::tuint32 count);
+            ckcore::tint64 size();
+        };
+
+        /**
+         * @brief Task running the verifiers.
+         */
+        class Consumer : public ThreadPool::Task
+        {
+        private:
+            VerificationTap &tap_;
+
+        public:
+            Consumer(VerificationTap &tap) : tap_(tap) {}
+
+            void run();
+        };
+
+        /**
+         * @brief First error reported by one of the verifiers.
+         */
+        class Error
+        {
+        public:
+            bool set_;
+            bool verification_;
+            ckcore::tstring message_;
+            ckcore::tstring reference_;
+
+            Error() : set_(false),verification_(false) {}
+
+            void set(const std::exception &e);
+            void raise() const;
+        };
+
+        ckcore::OutStream &out_stream_;
+        const bool verify_iso_;
+        const bool verify_udf_;
+
+        // Shared between the writer and the consumer thread.
+        Mutex mutex_;
+        Condition data_cond_;
+        Condition space_cond_;
+        std::vector<unsigned char> ring_;
+        size_t ring_pos_;
+        size_t ring_used_;
+        bool closed_;
+        ckcore::tuint64 data_start_;
+        ckcore::tuint64 data_end_;
+
+        // Only accessed by the consumer thread until it has finished.
+        UdfVerifier udf_verifier_;
+        std::vector<unsigned char> sector_buf_;
+        size_t sector_fill_;
+        ckcore::tuint32 sector_;
+        Error iso_error_;
+        Error udf_error_;
+        ckcore::tuint64 cpu_time_;
+
+        Consumer consumer_;
+        ThreadPool pool_;
+
+        ckcore::tuint32 pull(unsigned char *buffer,ckcore::tuint32 count);
+        bool pull_end();
+        void feed(const unsigned char *buffer,size_t count,
+                  ckcore::tuint64 data_start,ckcore::tuint64 data_end);
+        void consume();
+        void close();
+
+        VerificationTap(const VerificationTap &);
+        VerificationTap &operator=(const VerificationTap &);
+
+    public:
+        VerificationTap(ckcore::OutStream &out_stream,bool verify_iso,bool verify_udf);
+        ~VerificationTap();
+
+        ckcore::tint64 write(const void *buffer,ckcore::tuint32 count);
+
+        void set_data_area(ckcore::tuint64 start,ckcore::tuint64 length);
+        void finish();
+
+        /**
+         * Returns true if any verifier is running on the written data.
+         */
+        bool active() const
+        {
+            return verify_iso_ || verify_udf_;
+        }
+
+        /**
+         * Returns the processor time used by the verification thread in
+         * microseconds. Only valid after finish() has returned.
+         */
+        ckcore::tuint64 get_cpu_time() const
+        {
+            return cpu_time_;
+        }
+    };
+};
@@ -0,0 +1,137 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <vector>
+#include <ckcore/types.hh>
+#include <ckcore/progress.hh>
+#include "ckfilesystem/sectorstream.hh"
+#include "ckfilesystem/filesystemwriter.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Disc image that is generated on demand.
+     *
+     * The image is built by running the file system writer once without
+     * copying any file data. All descriptors, path tables, directories and
+     * other meta data are kept in memory while file data is referenced by
+     * source path. Any byte range of the image can then be read without the
+     * image ever being stored, file data is read directly from the source
+     * files. Zero filled sectors, such as the system area and padding, do
+     * not occupy any memory.
+     *
+     * The source files must not be modified while the image is in use.
+     * read() may be called from multiple threads at the same time.
+     */
+    class VirtualImage
+    {
+    private:
+        enum SegmentType
+        {
+            SEGMENT_META,
+            SEGMENT_ZERO,
+            SEGMENT_FILE
+        };
+
+        /**
+         * @brief Contiguous range of the image with the same origin.
+         */
+        class Segment
+        {
+        public:
+            ckcore::tuint64 pos_;
+            ckcore::tuint64 len_;
+            ckcore::tuint64 ref_;   // Offset into the meta data or index of the source file.
+            SegmentType type_;
+        };
+
+        /**
+         * @brief Source of a file data segment.
+         */
+        class FileRef
+        {
+        public:
+            ckcore::tstring file_path_;
+            ckcore::tuint64 file_offset_;
+        };
+
+        /**
+         * @brief Output stream recording the image layout.
+         */
+        class Recorder : public ExtentOutStream
+        {
+        private:
+            VirtualImage &image_;
+
+        public:
+            Recorder(VirtualImage &image) : image_(image) {}
+
+            ckcore::tint64 write(const void *buffer,ckcore::tuint32 count);
+            void write_file(const ckcore::tchar *file_path,ckcore::tuint64 file_offset,
+                            ckcore::tuint64 file_size);
+        };
+
+        friend class Recorder;
+
+        std::vector<Segment> segments_;
+        std::vector<unsigned char> meta_;
+        std::vector<FileRef> files_;
+        ckcore::tuint64 size_;
+
+        void clear();
+        void append(SegmentType type,ckcore::tuint64 len,ckcore::tuint64 ref);
+        void record(const void *buffer,ckcore::tuint32 count);
+        void record_file(const ckcore::tchar *file_path,ckcore::tuint64 file_offset,
+                         ckcore::tuint64 file_size);
+
+        VirtualImage(const VirtualImage &);
+        VirtualImage &operator=(const VirtualImage &);
+
+    public:
+        VirtualImage();
+
+        int build(FileSystemWriter &writer,ckcore::Progress &progress,
+                  ckcore::tuint32 sec_offset = 0);
+
+        ckcore::tuint32 read(ckcore::tuint64 offset,void *buffer,ckcore::tuint32 count) const;
+
+        /**
+         * Returns the size of the image in bytes.
+         */
+        ckcore::tuint64 size() const
+        {
+            return size_;
+        }
+
+        /**
+         * Returns the number of bytes of memory used for describing the
+         * image.
+         */
+        size_t mem_usage() const
+        {
+            size_t file_mem = 0;
+            for (size_t i = 0; i < files_.size(); i++)
+                file_mem += files_[i].file_path_.capacity() * sizeof(ckcore::tchar);
+
+            return segments_.capacity() * sizeof(Segment) + meta_.capacity() +
+                   files_.capacity() * sizeof(FileRef) + file_mem;
+        }
+    };
+};
@@ -0,0 +1,271 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <vector>
+#include <ckcore/types.hh>
+#include <ckcore/stream.hh>
+#include <ckcore/log.hh>
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Histogram with logarithmic buckets of constant relative
+     *        precision.
+     *
+     * Values are recorded in buckets of 16 linear sub-buckets per power of
+     * two, in the style of HDR histograms. All values up to 2^64 can be
+     * recorded with a relative error below 1/16 using a fixed amount of
+     * memory.
+     */
+    class LatencyHistogram
+    {
+    private:
+        enum
+        {
+            SUB_BUCKET_BITS = 4,
+            SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS,
+            BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT
+        };
+
+        std::vector<ckcore::tuint64> buckets_;
+        ckcore::tuint64 count_;
+        ckcore::tuint64 min_;
+        ckcore::tuint64 max_;
+        ckcore::tuint64 sum_;
+
+        static size_t get_bucket(ckcore::tuint64 value);
+        static ckcore::tuint64 get_bucket_max(size_t bucket);
+
+    public:
+        LatencyHistogram();
+
+        void clear();
+        void record(ckcore::tuint64 value);
+
+        ckcore::tuint64 get_percentile(double percentile) const;
+
+        /**
+         * Returns the number of recorded values.
+         */
+        ckcore::tuint64 get_count() const
+        {
+            return count_;
+        }
+
+        /**
+         * Returns the smallest recorded value, zero if no values have been
+         * recorded.
+         */
+        ckcore::tuint64 get_min() const
+        {
+            return count_ > 0 ? min_ : 0;
+        }
+
+        /**
+         * Returns the largest recorded value.
+         */
+        ckcore::tuint64 get_max() const
+        {
+            return max_;
+        }
+
+        /**
+         * Returns the mean of all recorded values.
+         */
+        ckcore::tuint64 get_mean() const
+        {
+            return count_ > 0 ? sum_ / count_ : 0;
+        }
+    };
+
+    /**
+     * @brief Timing and counters collected by FileSystemWriter::write.
+     *
+     * The write operation is divided into phases. For each phase the wall
+     * clock time, the processor time and the number of sectors written are
+     * recorded. Processor time is measured per thread, it is the time of
+     * the writing thread plus the time of the threads working for it, such
+     * as the meta data snapshot tasks and the verification consumer. The
+     * time of a helper thread is added to the phase in which it is reported,
+     * other work in the process is not included. The system call counters
+     * count the calls made by the writer itself; streams passed file data
+     * by reference, such as CloneOutStream, make additional calls of their
+     * own.
+     */
+    class WriteStats
+    {
+    public:
+        enum Phase
+        {
+            PHASE_TREE,             ///< Building the file tree and reading meta data.
+            PHASE_DVDVIDEO,         ///< Calculating DVD-Video padding.
+            PHASE_NAMES,            ///< Making ISO9660 and Joliet names.
+            PHASE_PATH_TABLES,      ///< Populating and sorting the path tables.
+            PHASE_ALLOC,            ///< Allocating the meta data.
+            PHASE_ALLOC_DATA,       ///< Allocating the file data.
+            PHASE_HEADER,           ///< Writing the volume descriptors.
+            PHASE_UDF_PARTITION,    ///< Writing the UDF partition.
+            PHASE_WRITE_PATH_TABLES,///< Writing the path tables.
+            PHASE_DIR_ENTRIES,      ///< Writing the ISO9660 and Joliet directories.
+            PHASE_DATA,             ///< Writing the file data.
+            PHASE_UDF_TAIL,         ///< Writing the UDF tail.
+            PHASE_COUNT
+        };
+
+        /**
+         * @brief Statistics of a single phase.
+         */
+        class PhaseStats
+        {
+        public:
+            ckcore::tuint64 wall_time_;     ///< Wall clock time in microseconds.
+            ckcore::tuint64 cpu_time_;      ///< Processor time in microseconds.
+            ckcore::tuint64 sectors_;       ///< Number of sectors written.
+
+            PhaseStats() : wall_time_(0),cpu_time_(0),sectors_(0) {}
+        };
+
+    private:
+        PhaseStats phases_[PHASE_COUNT];
+
+        Phase cur_phase_;
+        bool in_phase_;
+        ckcore::tuint64 phase_wall_start_;
+        ckcore::tuint64 phase_cpu_start_;
+        ckcore::tuint64 phase_sec_start_;
+        size_t slow_file_count_;
+
+        static void print_histogram(ckcore::Log &log,const ckcore::tchar *name,
+                                    const LatencyHistogram &histogram);
+
+    public:
+        /**
+         * @brief Time spent reading a single source file.
+         */
+        class FileTiming
+        {
+        public:
+            ckcore::tstring file_path_;
+            ckcore::tuint64 file_size_;
+            ckcore::tuint64 open_time_;     ///< Time to open the file in microseconds.
+            ckcore::tuint64 read_time_;     ///< Time blocked in read calls in microseconds.
+
+            FileTiming() : file_size_(0),open_time_(0),read_time_(0) {}
+
+            ckcore::tuint64 get_total_time() const
+            {
+                return open_time_ + read_time_;
+            }
+        };
+
+        LatencyHistogram open_latency_;     ///< Time to open each source file, in microseconds.
+        LatencyHistogram read_latency_;     ///< Duration of each read call, in microseconds.
+        LatencyHistogram read_rate_;        ///< Read throughput of each source file, in KiB/s.
+
+        /**
+         * The slowest source files, slowest first. The number of files kept
+         * is set using set_slow_file_count.
+         */
+        std::vector<FileTiming> slow_files_;
+
+        ckcore::tuint32 file_count_;        ///< Number of files in the file system.
+        ckcore::tuint32 dir_count_;         ///< Number of directories, excluding the root.
+        ckcore::tuint64 stat_count_;        ///< Number of stat calls made taking meta data snapshots.
+        ckcore::tuint64 open_count_;        ///< Number of files opened for reading.
+        ckcore::tuint64 read_count_;        ///< Number of read calls on source files.
+        ckcore::tuint64 write_count_;       ///< Number of write calls on the output stream.
+        ckcore::tuint64 data_bytes_;        ///< Number of file data bytes written.
+        ckcore::tuint64 tree_mem_usage_;    ///< Peak estimated memory used by the file tree.
+
+        WriteStats();
+
+        void clear();
+
+        static ckcore::tuint64 get_wall_time();
+
+        void set_slow_file_count(size_t count);
+        void record_file(const ckcore::tstring &file_path,ckcore::tuint64 file_size,
+                         ckcore::tuint64 open_time,ckcore::tuint64 read_time);
+
+        void begin_phase(Phase phase,ckcore::tuint64 sector);
+        void end_phase(ckcore::tuint64 sector);
+        void add_cpu_time(ckcore::tuint64 cpu_time);
+
+        /**
+         * Returns the statistics of a phase.
+         * @param [in] phase The phase.
+         */
+        const PhaseStats &get_phase(Phase phase) const
+        {
+            return phases_[phase];
+        }
+
+        PhaseStats get_total() const;
+
+        static const ckcore::tchar *get_phase_name(Phase phase);
+
+        void print(ckcore::Log &log) const;
+    };
+
+    /**
+     * @brief Input stream counting the read calls of another stream.
+     */
+    class StatsInStream : public ckcore::InStream
+    {
+    private:
+        ckcore::InStream &stream_;
+        WriteStats &stats_;
+        ckcore::tuint64 read_time_;
+
+    public:
+        StatsInStream(ckcore::InStream &stream,WriteStats &stats) :
+            stream_(stream),stats_(stats),read_time_(0) {}
+
+        /**
+         * Returns the total time spent in read calls on this stream, in
+         * microseconds.
+         */
+        ckcore::tuint64 get_read_time() const
+        {
+            return read_time_;
+        }
+
+        bool end();
+        bool seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence);
+        ckcore::tint64 read(void *buffer,ckcore::tuint32 count);
+        ckcore::tint64 size();
+    };
+
+    /**
+     * @brief Output stream counting the write calls to another stream.
+     */
+    class StatsOutStream : public ckcore::OutStream
+    {
+    private:
+        ckcore::OutStream &stream_;
+        WriteStats &stats_;
+
+    public:
+        StatsOutStream(ckcore::OutStream &stream,WriteStats &stats) :
+            stream_(stream),stats_(stats) {}
+
+        ckcore::tint64 write(const void *buffer,ckcore::tuint32 count);
+    };
+};
@@ -0,0 +1,189 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "ckfilesystem/cacheadvisor.hh"
+
+// posix_fadvise(2) is not available on all platforms.
+#if !defined(_WINDOWS) && defined(POSIX_FADV_WILLNEED)
+#define CACHEADVISOR_FADVISE
+#endif
+
+namespace ckfilesystem
+{
+#ifdef CACHEADVISOR_FADVISE
+    /**
+     * Returns true if the data of the file is copied from its source file.
+     * Data sources, files kept from a previous image and files embedded in
+     * their UDF file entries are not given any hints.
+     */
+    static bool reads_source_file(const FileTreeNode *node)
+    {
+        return node->data_source_ == NULL &&
+            !(node->file_flags_ & (FileTreeNode::FLAG_REUSED | FileTreeNode::FLAG_EMBEDDED));
+    }
+#endif
+
+    /**
+     * Constructs a CacheAdvisor object.
+     * @param [in] policy The hints to give.
+     * @param [in] files All files that will be read, in read order.
+     */
+    CacheAdvisor::CacheAdvisor(const CachePolicy &policy,
+                               const std::vector<FileTreeNode *> &files) :
+        policy_(policy),files_(files),cur_file_(0),cur_start_(0),drop_pos_(0),
+        hint_file_(0),hint_start_(0),hint_pos_(0)
+#ifndef _WINDOWS
+        ,cur_handle_(-1),hint_handle_(-1)
+#endif
+    {
+    }
+
+    CacheAdvisor::~CacheAdvisor()
+    {
+        close_handles();
+    }
+
+    void CacheAdvisor::close_handles()
+    {
+#ifndef _WINDOWS
+        if (cur_handle_ != -1)
+        {
+            close(cur_handle_);
+            cur_handle_ = -1;
+        }
+
+        if (hint_handle_ != -1)
+        {
+            close(hint_handle_);
+            hint_handle_ = -1;
+        }
+#endif
+    }
+
+    /**
+     * Must be called before a file is read.
+     * @param [in] index Index of the file in the read order.
+     */
+    void CacheAdvisor::begin_file(size_t index)
+    {
+        cur_file_ = index;
+        drop_pos_ = 0;
+
+#ifdef CACHEADVISOR_FADVISE
+        if (policy_.drop_source_ && reads_source_file(files_[cur_file_]))
+            cur_handle_ = open(files_[cur_file_]->file_path_.c_str(),O_RDONLY);
+#endif
+
+        read(0);
+    }
+
+    /**
+     * Updates the read position in the current file. Data before the
+     * position is evicted and read-ahead is requested beyond it.
+     * @param [in] pos The read position in the current file.
+     */
+    void CacheAdvisor::read(ckcore::tuint64 pos)
+    {
+#ifdef CACHEADVISOR_FADVISE
+        if (cur_handle_ != -1 && pos > drop_pos_)
+        {
+            posix_fadvise(cur_handle_,drop_pos_,pos - drop_pos_,POSIX_FADV_DONTNEED);
+            drop_pos_ = pos;
+        }
+
+        if (policy_.read_ahead_ == 0)
+            return;
+
+        // Never request data that has already been read.
+        ckcore::tuint64 read_pos = cur_start_ + pos;
+        if (hint_start_ + hint_pos_ < read_pos)
+        {
+            if (hint_file_ != cur_file_ && hint_handle_ != -1)
+            {
+                close(hint_handle_);
+                hint_handle_ = -1;
+            }
+
+            hint_file_ = cur_file_;
+            hint_start_ = cur_start_;
+            hint_pos_ = pos;
+        }
+
+        ckcore::tuint64 hint_end = read_pos + policy_.read_ahead_;
+        while (hint_file_ < files_.size() && hint_start_ + hint_pos_ < hint_end)
+        {
+            ckcore::tuint64 file_size = files_[hint_file_]->file_size_;
+            if (hint_pos_ >= file_size)
+            {
+                if (hint_handle_ != -1)
+                {
+                    close(hint_handle_);
+                    hint_handle_ = -1;
+                }
+
+                hint_start_ += file_size;
+                hint_pos_ = 0;
+                hint_file_++;
+                continue;
+            }
+
+            if (hint_handle_ == -1)
+            {
+                // Errors are reported when the file is copied.
+                if (reads_source_file(files_[hint_file_]))
+                    hint_handle_ = open(files_[hint_file_]->file_path_.c_str(),O_RDONLY);
+
+                if (hint_handle_ == -1)
+                {
+                    hint_pos_ = file_size;
+                    continue;
+                }
+            }
+
+            ckcore::tuint64 len = file_size - hint_pos_;
+            if (len > policy_.window_size_)
+                len = policy_.window_size_;
+
+            posix_fadvise(hint_handle_,hint_pos_,len,POSIX_FADV_WILLNEED);
+            hint_pos_ += len;
+        }
+#endif
+    }
+
+    /**
+     * Must be called when the current file has been read.
+     */
+    void CacheAdvisor::end_file()
+    {
+#ifdef CACHEADVISOR_FADVISE
+        if (cur_handle_ != -1)
+        {
+            posix_fadvise(cur_handle_,0,0,POSIX_FADV_DONTNEED);
+            close(cur_handle_);
+            cur_handle_ = -1;
+        }
+#endif
+
+        cur_start_ += files_[cur_file_]->file_size_;
+    }
+};
@@ -0,0 +1,418 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHARCLASS_SSE2
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define CHARCLASS_AVX2
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define CHARCLASS_AVX2
+#define CHARCLASS_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CHARCLASS_NEON
+#include <arm_neon.h>
+#endif
+#ifndef CHARCLASS_TARGET_AVX2
+#define CHARCLASS_TARGET_AVX2
+#endif
+#include "ckfilesystem/charclass.hh"
+
+namespace ckfilesystem
+{
+    namespace charclass
+    {
+        /**
+         * @brief Character class described as a set of inclusive byte ranges.
+         */
+        struct Ranges
+        {
+            unsigned char count;
+            unsigned char lo[6];
+            unsigned char hi[6];
+            bool invert;        ///< If true the ranges describe invalid bytes.
+        };
+
+        static const Ranges classes[] =
+        {
+            // CHARCLASS_A
+            { 4,{ 0x20,0x25,0x41,0x5f },{ 0x22,0x3f,0x5a,0x5f },false },
+            // CHARCLASS_A_SAFE
+            { 4,{ 0x20,0x25,0x41,0x5f },{ 0x22,0x39,0x5a,0x5f },false },
+            // CHARCLASS_D
+            { 3,{ 0x30,0x41,0x5f },{ 0x39,0x5a,0x5f },false },
+            // CHARCLASS_D_SEP
+            { 5,{ 0x30,0x41,0x5f,0x2e,0x3b },{ 0x39,0x5a,0x5f,0x2e,0x3b },false },
+            // CHARCLASS_J
+            { 6,{ '*','/',':',';','?','\\' },{ '*','/',':',';','?','\\' },true }
+        };
+
+        static inline bool scalar_valid(const Ranges &r,unsigned char c)
+        {
+            for (unsigned char i = 0; i < r.count; i++)
+            {
+                if (c >= r.lo[i] && c <= r.hi[i])
+                    return !r.invert;
+            }
+
+            return r.invert;
+        }
+
+        static size_t scalar_find_invalid(const Ranges &r,const unsigned char *str,
+                                          size_t len,size_t pos)
+        {
+            for (; pos < len; pos++)
+            {
+                if (!scalar_valid(r,str[pos]))
+                    return pos;
+            }
+
+            return len;
+        }
+
+        static void scalar_make_valid(const Ranges &r,unsigned char *dst,const char *src,
+                                      size_t len,size_t pos)
+        {
+            for (; pos < len; pos++)
+            {
+                unsigned char c = static_cast<unsigned char>(src[pos]);
+                if (c >= 'a' && c <= 'z')
+                    c -= 'a' - 'A';
+
+                dst[pos] = scalar_valid(r,c) ? c : '_';
+            }
+        }
+
+        static size_t find_invalid_scalar(const Ranges &r,const unsigned char *str,size_t len)
+        {
+            return scalar_find_invalid(r,str,len,0);
+        }
+
+        static void make_valid_scalar(const Ranges &r,unsigned char *dst,const char *src,size_t len)
+        {
+            scalar_make_valid(r,dst,src,len,0);
+        }
+
+#ifdef CHARCLASS_SSE2
+        /*
+            SSE2
+        */
+        static inline __m128i sse2_in_range(__m128i v,unsigned char lo,unsigned char hi)
+        {
+            // Unsigned v - lo <= hi - lo.
+            __m128i d = _mm_sub_epi8(v,_mm_set1_epi8(static_cast<char>(lo)));
+            return _mm_cmpeq_epi8(_mm_min_epu8(d,_mm_set1_epi8(static_cast<char>(hi - lo))),d);
+        }
+
+        static inline __m128i sse2_valid(const Ranges &r,__m128i v)
+        {
+            __m128i mask = _mm_setzero_si128();
+            for (unsigned char i = 0; i < r.count; i++)
+                mask = _mm_or_si128(mask,sse2_in_range(v,r.lo[i],r.hi[i]));
+
+            return r.invert ? _mm_xor_si128(mask,_mm_set1_epi8(-1)) : mask;
+        }
+
+        static inline __m128i sse2_upper(__m128i v)
+        {
+            __m128i lower = sse2_in_range(v,'a','z');
+            return _mm_sub_epi8(v,_mm_and_si128(lower,_mm_set1_epi8('a' - 'A')));
+        }
+
+        static size_t find_invalid_sse2(const Ranges &r,const unsigned char *str,size_t len)
+        {
+            size_t pos = 0;
+            for (; pos + 16 <= len; pos += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + pos));
+                int valid = _mm_movemask_epi8(sse2_valid(r,v));
+                if (valid != 0xffff)
+                    return scalar_find_invalid(r,str,pos + 16,pos);
+            }
+
+            return scalar_find_invalid(r,str,len,pos);
+        }
+
+        static void make_valid_sse2(const Ranges &r,unsigned char *dst,const char *src,size_t len)
+        {
+            const __m128i repl = _mm_set1_epi8('_');
+
+            size_t pos = 0;
+            for (; pos + 16 <= len; pos += 16)
+            {
+                __m128i v = sse2_upper(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos)));
+                __m128i mask = sse2_valid(r,v);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + pos),
+                                 _mm_or_si128(_mm_and_si128(mask,v),_mm_andnot_si128(mask,repl)));
+            }
+
+            scalar_make_valid(r,dst,src,len,pos);
+        }
+#endif
+
+#ifdef CHARCLASS_AVX2
+        /*
+            AVX2
+        */
+        CHARCLASS_TARGET_AVX2
+        static inline __m256i avx2_in_range(__m256i v,unsigned char lo,unsigned char hi)
+        {
+            __m256i d = _mm256_sub_epi8(v,_mm256_set1_epi8(static_cast<char>(lo)));
+            return _mm256_cmpeq_epi8(_mm256_min_epu8(d,_mm256_set1_epi8(static_cast<char>(hi - lo))),d);
+        }
+
+        CHARCLASS_TARGET_AVX2
+        static inline __m256i avx2_valid(const Ranges &r,__m256i v)
+        {
+            __m256i mask = _mm256_setzero_si256();
+            for (unsigned char i = 0; i < r.count; i++)
+                mask = _mm256_or_si256(mask,avx2_in_range(v,r.lo[i],r.hi[i]));
+
+            return r.invert ? _mm256_xor_si256(mask,_mm256_set1_epi8(-1)) : mask;
+        }
+
+        CHARCLASS_TARGET_AVX2
+        static size_t find_invalid_avx2(const Ranges &r,const unsigned char *str,size_t len)
+        {
+            size_t pos = 0;
+            for (; pos + 32 <= len; pos += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(str + pos));
+                unsigned int valid = static_cast<unsigned int>(_mm256_movemask_epi8(avx2_valid(r,v)));
+                if (valid != 0xffffffff)
+                    return scalar_find_invalid(r,str,pos + 32,pos);
+            }
+
+            // Process the remaining bytes using 128-bit operations.
+            size_t res = find_invalid_sse2(r,str + pos,len - pos);
+            return pos + res;
+        }
+
+        CHARCLASS_TARGET_AVX2
+        static void make_valid_avx2(const Ranges &r,unsigned char *dst,const char *src,size_t len)
+        {
+            const __m256i repl = _mm256_set1_epi8('_');
+            const __m256i case_diff = _mm256_set1_epi8('a' - 'A');
+
+            size_t pos = 0;
+            for (; pos + 32 <= len; pos += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + pos));
+                v = _mm256_sub_epi8(v,_mm256_and_si256(avx2_in_range(v,'a','z'),case_diff));
+
+                __m256i mask = avx2_valid(r,v);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + pos),
+                                    _mm256_blendv_epi8(repl,v,mask));
+            }
+
+            make_valid_sse2(r,dst + pos,src + pos,len - pos);
+        }
+
+        static bool cpu_has_avx2()
+        {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info,0);
+            if (info[0] < 7)
+                return false;
+
+            // The operating system must save the YMM registers.
+            __cpuid(info,1);
+            if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+                return false;
+
+            __cpuidex(info,7,0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }
+#endif
+
+#ifdef CHARCLASS_NEON
+        /*
+            NEON
+        */
+        static inline uint8x16_t neon_in_range(uint8x16_t v,unsigned char lo,unsigned char hi)
+        {
+            return vcleq_u8(vsubq_u8(v,vdupq_n_u8(lo)),vdupq_n_u8(hi - lo));
+        }
+
+        static inline uint8x16_t neon_valid(const Ranges &r,uint8x16_t v)
+        {
+            uint8x16_t mask = vdupq_n_u8(0);
+            for (unsigned char i = 0; i < r.count; i++)
+                mask = vorrq_u8(mask,neon_in_range(v,r.lo[i],r.hi[i]));
+
+            return r.invert ? vmvnq_u8(mask) : mask;
+        }
+
+        static size_t find_invalid_neon(const Ranges &r,const unsigned char *str,size_t len)
+        {
+            size_t pos = 0;
+            for (; pos + 16 <= len; pos += 16)
+            {
+                uint8x16_t invalid = vmvnq_u8(neon_valid(r,vld1q_u8(str + pos)));
+                uint8x8_t any = vorr_u8(vget_low_u8(invalid),vget_high_u8(invalid));
+                if (vget_lane_u64(vreinterpret_u64_u8(any),0) != 0)
+                    return scalar_find_invalid(r,str,pos + 16,pos);
+            }
+
+            return scalar_find_invalid(r,str,len,pos);
+        }
+
+        static void make_valid_neon(const Ranges &r,unsigned char *dst,const char *src,size_t len)
+        {
+            const uint8x16_t repl = vdupq_n_u8('_');
+            const uint8x16_t case_diff = vdupq_n_u8('a' - 'A');
+
+            size_t pos = 0;
+            for (; pos + 16 <= len; pos += 16)
+            {
+                uint8x16_t v = vld1q_u8(reinterpret_cast<const unsigned char *>(src + pos));
+                v = vsubq_u8(v,vandq_u8(neon_in_range(v,'a','z'),case_diff));
+
+                vst1q_u8(dst + pos,vbslq_u8(neon_valid(r,v),v,repl));
+            }
+
+            scalar_make_valid(r,dst,src,len,pos);
+        }
+#endif
+
+        /**
+         * @brief Implementation selected for the running processor.
+         */
+        struct Kernel
+        {
+            const char *name;
+            size_t (*find_invalid)(const Ranges &r,const unsigned char *str,size_t len);
+            void (*make_valid)(const Ranges &r,unsigned char *dst,const char *src,size_t len);
+        };
+
+        static Kernel select_kernel()
+        {
+#ifdef CHARCLASS_AVX2
+            if (cpu_has_avx2())
+            {
+                Kernel kernel = { "avx2",find_invalid_avx2,make_valid_avx2 };
+                return kernel;
+            }
+#endif
+#if defined(CHARCLASS_SSE2)
+            Kernel kernel = { "sse2",find_invalid_sse2,make_valid_sse2 };
+#elif defined(CHARCLASS_NEON)
+            Kernel kernel = { "neon",find_invalid_neon,make_valid_neon };
+#else
+            Kernel kernel = { "scalar",find_invalid_scalar,make_valid_scalar };
+#endif
+            return kernel;
+        }
+
+        static bool find_kernel(const char *name,Kernel &result)
+        {
+            static const Kernel kernels[] =
+            {
+#ifdef CHARCLASS_AVX2
+                { "avx2",find_invalid_avx2,make_valid_avx2 },
+#endif
+#ifdef CHARCLASS_SSE2
+                { "sse2",find_invalid_sse2,make_valid_sse2 },
+#endif
+#ifdef CHARCLASS_NEON
+                { "neon",find_invalid_neon,make_valid_neon },
+#endif
+                { "scalar",find_invalid_scalar,make_valid_scalar }
+            };
+
+            for (size_t i = 0; i < sizeof(kernels) / sizeof(Kernel); i++)
+            {
+                if (strcmp(kernels[i].name,name) != 0)
+                    continue;
+
+#ifdef CHARCLASS_AVX2
+                if (kernels[i].find_invalid == find_invalid_avx2 && !cpu_has_avx2())
+                    return false;
+#endif
+                result = kernels[i];
+                return true;
+            }
+
+            return false;
+        }
+
+        // Selected during static initialization, before any other thread can
+        // exist. Only changed by set_kernel().
+        static Kernel kernel = select_kernel();
+
+        /**
+         * Finds the first byte not belonging to the specified character class.
+         * @param [in] char_class The character class.
+         * @param [in] str The string to search.
+         * @param [in] len The string length in bytes.
+         * @return The position of the first invalid byte, or len if all
+         *         bytes are valid.
+         */
+        size_t find_invalid(CharClass char_class,const unsigned char *str,size_t len)
+        {
+            return kernel.find_invalid(classes[char_class],str,len);
+        }
+
+        /**
+         * Converts a string to upper case and replaces all characters not
+         * belonging to the specified character class with underscores.
+         * @param [in] char_class The character class, CHARCLASS_A,
+         *                        CHARCLASS_D or CHARCLASS_D_SEP.
+         * @param [out] dst The target buffer, at least len bytes.
+         * @param [in] src The string to convert.
+         * @param [in] len The string length in bytes.
+         */
+        void make_valid(CharClass char_class,unsigned char *dst,const char *src,size_t len)
+        {
+            kernel.make_valid(classes[char_class],dst,src,len);
+        }
+
+        /**
+         * Returns the name of the selected implementation.
+         */
+        const char *kernel_name()
+        {
+            return kernel.name;
+        }
+
+        /**
+         * Replaces the implementation selected at start-up, used for comparing
+         * the implementations in tests and benchmarks. The function must not
+         * be called while other threads may use the library.
+         * @param [in] name Implementation name as returned by kernel_name(),
+         *                  "scalar" is always available.
+         * @return true if the implementation was selected, false if it is not
+         *         supported by the build or the running processor.
+         */
+        bool set_kernel(const char *name)
+        {
+            return find_kernel(name,kernel);
+        }
+    };
+};
@@ -0,0 +1,484 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+#endif
+#include <string.h>
+#include <ckcore/exception.hh>
+#include "ckfilesystem/exception.hh"
+#include "ckfilesystem/clonestream.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * Constructs a CloneOutStream object.
+     * @param [in] file_path Path to the image file to create.
+     * @param [in] buffer_size Size of the write buffer in bytes.
+     */
+    CloneOutStream::CloneOutStream(const ckcore::tchar *file_path,
+                                   ckcore::tuint32 buffer_size) :
+        file_path_(file_path),
+#ifdef _WINDOWS
+        file_handle_(INVALID_HANDLE_VALUE),
+#else
+        file_handle_(-1),
+#endif
+        pos_(0),buffer_(NULL),buffer_size_(buffer_size > 0 ? buffer_size : 1),
+        buffer_used_(0),block_size_(1),clone_supported_(false),
+        copy_range_supported_(false),cloned_bytes_(0),copied_bytes_(0),
+        buffered_bytes_(0),drop_window_(0),sync_pos_(0),drop_pos_(0)
+    {
+        buffer_ = new unsigned char[buffer_size_];
+    }
+
+    CloneOutStream::~CloneOutStream()
+    {
+        close();
+
+        delete [] buffer_;
+    }
+
+    /**
+     * Creates the image file, truncating any existing file.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool CloneOutStream::open()
+    {
+        close();
+
+        pos_ = 0;
+        buffer_used_ = 0;
+        sync_pos_ = 0;
+        drop_pos_ = 0;
+
+#ifdef _WINDOWS
+        file_handle_ = CreateFile(file_path_.c_str(),GENERIC_WRITE,0,NULL,
+                                  CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
+        return file_handle_ != INVALID_HANDLE_VALUE;
+#else
+        file_handle_ = ::open(file_path_.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0666);
+        if (file_handle_ == -1)
+            return false;
+
+        struct stat file_stat;
+        if (fstat(file_handle_,&file_stat) == 0 && file_stat.st_blksize > 0)
+            block_size_ = static_cast<ckcore::tuint32>(file_stat.st_blksize);
+
+#if defined(__linux__) && defined(FICLONERANGE)
+        clone_supported_ = true;
+#endif
+#if defined(__linux__) && defined(__NR_copy_file_range)
+        copy_range_supported_ = true;
+#endif
+        return true;
+#endif
+    }
+
+    /**
+     * Flushes any buffered data and closes the image file.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool CloneOutStream::close()
+    {
+        bool res = flush();
+        drop_cache(true);
+
+#ifdef _WINDOWS
+        if (file_handle_ != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file_handle_);
+            file_handle_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (file_handle_ != -1)
+        {
+            if (::close(file_handle_) != 0)
+                res = false;
+            file_handle_ = -1;
+        }
+#endif
+        return res;
+    }
+
+    /**
+     * Evicts written data from the page cache. Write-back of the most recent
+     * window is started asynchronously, the window before it is waited for
+     * and evicted. This keeps the disk busy without the writer having to wait
+     * for its own data.
+     * @param [in] all Set to true to wait for and evict all written data.
+     */
+    void CloneOutStream::drop_cache(bool all)
+    {
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+        if (drop_window_ == 0 || file_handle_ == -1)
+            return;
+
+        if (!all && pos_ - sync_pos_ < drop_window_)
+            return;
+
+        if (sync_pos_ > drop_pos_)
+        {
+            sync_file_range(file_handle_,drop_pos_,sync_pos_ - drop_pos_,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(file_handle_,drop_pos_,sync_pos_ - drop_pos_,POSIX_FADV_DONTNEED);
+            drop_pos_ = sync_pos_;
+        }
+
+        if (pos_ > sync_pos_)
+        {
+            sync_file_range(file_handle_,sync_pos_,pos_ - sync_pos_,all ?
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER :
+                            SYNC_FILE_RANGE_WRITE);
+            if (all)
+            {
+                posix_fadvise(file_handle_,sync_pos_,pos_ - sync_pos_,POSIX_FADV_DONTNEED);
+                drop_pos_ = pos_;
+            }
+
+            sync_pos_ = pos_;
+        }
+#endif
+    }
+
+    bool CloneOutStream::write_at(const void *buffer,ckcore::tuint32 count,
+                                  ckcore::tuint64 offset)
+    {
+        const unsigned char *ptr = static_cast<const unsigned char *>(buffer);
+
+        while (count > 0)
+        {
+#ifdef _WINDOWS
+            OVERLAPPED overlapped;
+            memset(&overlapped,0,sizeof(overlapped));
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+            DWORD processed = 0;
+            if (!WriteFile(file_handle_,ptr,count,&processed,&overlapped) || processed == 0)
+                return false;
+#else
+            ssize_t processed = pwrite(file_handle_,ptr,count,static_cast<off_t>(offset));
+            if (processed == -1 && errno == EINTR)
+                continue;
+            if (processed <= 0)
+                return false;
+#endif
+            ptr += processed;
+            offset += processed;
+            count -= static_cast<ckcore::tuint32>(processed);
+        }
+
+        return true;
+    }
+
+    /**
+     * Writes all buffered data to the image file.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool CloneOutStream::flush()
+    {
+        if (buffer_used_ == 0)
+            return true;
+
+        if (!write_at(buffer_,buffer_used_,pos_))
+            return false;
+
+        pos_ += buffer_used_;
+        buffer_used_ = 0;
+
+        drop_cache(false);
+        return true;
+    }
+
+    ckcore::tint64 CloneOutStream::write(const void *buffer,ckcore::tuint32 count)
+    {
+        const unsigned char *ptr = static_cast<const unsigned char *>(buffer);
+        ckcore::tuint32 remaining = count;
+
+        while (remaining > 0)
+        {
+            if (buffer_used_ == buffer_size_ && !flush())
+                return -1;
+
+            ckcore::tuint32 chunk = buffer_size_ - buffer_used_;
+            if (chunk > remaining)
+                chunk = remaining;
+
+            memcpy(buffer_ + buffer_used_,ptr,chunk);
+            buffer_used_ += chunk;
+            ptr += chunk;
+            remaining -= chunk;
+        }
+
+        return count;
+    }
+
+#ifndef _WINDOWS
+    /**
+     * Clones a range of a source file.
+     * @param [in] src_handle Source file descriptor.
+     * @param [in] src_offset Offset in the source file to start cloning from.
+     * @param [in] dst_offset Offset in the image file to clone to.
+     * @param [in] count The number of bytes to clone, must be a multiple of
+     *                   the block size.
+     * @return The number of bytes cloned, zero if the range can't be cloned.
+     */
+    ckcore::tuint64 CloneOutStream::clone_range(int src_handle,ckcore::tuint64 src_offset,
+                                                ckcore::tuint64 dst_offset,ckcore::tuint64 count)
+    {
+#if defined(__linux__) && defined(FICLONERANGE)
+        if (!clone_supported_ || count == 0)
+            return 0;
+
+        struct file_clone_range range;
+        range.src_fd = src_handle;
+        range.src_offset = src_offset;
+        range.src_length = count;
+        range.dest_offset = dst_offset;
+
+        if (ioctl(file_handle_,FICLONERANGE,&range) != 0)
+        {
+            // Don't try again if the output file system can't share extents.
+            if (errno == EOPNOTSUPP || errno == ENOTTY || errno == ENOSYS)
+                clone_supported_ = false;
+
+            return 0;
+        }
+
+        cloned_bytes_ += count;
+        return count;
+#else
+        return 0;
+#endif
+    }
+
+    /**
+     * Copies a range of a source file using copy_file_range(2), the data is
+     * never transfered to user space.
+     * @param [in] src_handle Source file descriptor.
+     * @param [in] src_offset Offset in the source file to start copying from.
+     * @param [in] dst_offset Offset in the image file to copy to.
+     * @param [in] count The number of bytes to copy.
+     * @return The number of bytes copied.
+     */
+    ckcore::tuint64 CloneOutStream::copy_range(int src_handle,ckcore::tuint64 src_offset,
+                                               ckcore::tuint64 dst_offset,ckcore::tuint64 count)
+    {
+        ckcore::tuint64 copied = 0;
+
+#if defined(__linux__) && defined(__NR_copy_file_range)
+        loff_t src_pos = static_cast<loff_t>(src_offset);
+        loff_t dst_pos = static_cast<loff_t>(dst_offset);
+
+        while (copy_range_supported_ && copied < count)
+        {
+            long res = syscall(__NR_copy_file_range,src_handle,&src_pos,file_handle_,
+                               &dst_pos,static_cast<size_t>(count - copied),0);
+            if (res == -1 && errno == EINTR)
+                continue;
+
+            if (res == -1)
+            {
+                if (errno == ENOSYS || errno == EOPNOTSUPP)
+                    copy_range_supported_ = false;
+
+                break;
+            }
+
+            // Premature end of file.
+            if (res == 0)
+                break;
+
+            copied += res;
+        }
+
+        copied_bytes_ += copied;
+#endif
+        return copied;
+    }
+#endif
+
+    /**
+     * Copies a range of a source file through the write buffer.
+     * @param [in] src_handle Source file descriptor or handle.
+     * @param [in] src_offset Offset in the source file to start copying from.
+     * @param [in] dst_offset Offset in the image file to copy to.
+     * @param [in] count The number of bytes to copy.
+     * @return The number of bytes copied.
+     */
+#ifdef _WINDOWS
+    ckcore::tuint64 CloneOutStream::copy_buffered(void *src_handle,ckcore::tuint64 src_offset,
+                                                  ckcore::tuint64 dst_offset,ckcore::tuint64 count)
+#else
+    ckcore::tuint64 CloneOutStream::copy_buffered(int src_handle,ckcore::tuint64 src_offset,
+                                                  ckcore::tuint64 dst_offset,ckcore::tuint64 count)
+#endif
+    {
+        ckcore::tuint64 copied = 0;
+
+        while (copied < count)
+        {
+            ckcore::tuint32 chunk = buffer_size_;
+            if (chunk > count - copied)
+                chunk = static_cast<ckcore::tuint32>(count - copied);
+
+            ckcore::tuint64 offset = src_offset + copied;
+
+#ifdef _WINDOWS
+            OVERLAPPED overlapped;
+            memset(&overlapped,0,sizeof(overlapped));
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+            DWORD processed = 0;
+            if (!ReadFile(src_handle,buffer_,chunk,&processed,&overlapped))
+                processed = 0;
+#else
+            ssize_t processed = pread(src_handle,buffer_,chunk,static_cast<off_t>(offset));
+            if (processed == -1 && errno == EINTR)
+                continue;
+#endif
+            if (processed <= 0)
+                break;
+
+            if (!write_at(buffer_,static_cast<ckcore::tuint32>(processed),dst_offset + copied))
+                break;
+
+            copied += processed;
+        }
+
+        buffered_bytes_ += copied;
+        return copied;
+    }
+
+    /**
+     * Copies a range of a source file, in the kernel if possible.
+     * @return The number of bytes copied.
+     */
+#ifdef _WINDOWS
+    ckcore::tuint64 CloneOutStream::copy(void *src_handle,ckcore::tuint64 src_offset,
+                                         ckcore::tuint64 dst_offset,ckcore::tuint64 count)
+    {
+        return copy_buffered(src_handle,src_offset,dst_offset,count);
+    }
+#else
+    ckcore::tuint64 CloneOutStream::copy(int src_handle,ckcore::tuint64 src_offset,
+                                         ckcore::tuint64 dst_offset,ckcore::tuint64 count)
+    {
+        ckcore::tuint64 copied = copy_range(src_handle,src_offset,dst_offset,count);
+        if (copied < count)
+        {
+            copied += copy_buffered(src_handle,src_offset + copied,dst_offset + copied,
+                                    count - copied);
+        }
+
+        return copied;
+    }
+#endif
+
+    /**
+     * Writes a range of a file at the current position. Data that is block
+     * aligned both in the source file and in the image is cloned if possible,
+     * the rest is copied.
+     * @param [in] file_path Path to the file to write.
+     * @param [in] file_offset Offset in the file to start writing from.
+     * @param [in] file_size The number of bytes to write from the file.
+     * @throw FileOpenException If the file could not be opened.
+     * @throw Exception If the data could not be written.
+     */
+    void CloneOutStream::write_file(const ckcore::tchar *file_path,ckcore::tuint64 file_offset,
+                                    ckcore::tuint64 file_size)
+    {
+        if (!flush())
+        {
+            throw ckcore::Exception2(ckcore::string::formatstr(
+                ckT("Unable to write to \"%s\"."),file_path_.c_str()));
+        }
+
+        ckcore::tuint64 written = 0;
+
+#ifdef _WINDOWS
+        HANDLE src_handle = CreateFile(file_path,GENERIC_READ,FILE_SHARE_READ,NULL,
+                                       OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+        if (src_handle == INVALID_HANDLE_VALUE)
+            throw FileOpenException(file_path);
+
+        written = copy(src_handle,file_offset,pos_,file_size);
+
+        CloseHandle(src_handle);
+#else
+        int src_handle = ::open(file_path,O_RDONLY);
+        if (src_handle == -1)
+            throw FileOpenException(file_path);
+
+        // Extents can only be shared if the source and the image are aligned
+        // the same way, the unaligned head and tail are copied.
+        ckcore::tuint64 head = 0,body = 0;
+        if (clone_supported_ && pos_ % block_size_ == file_offset % block_size_)
+        {
+            head = (block_size_ - pos_ % block_size_) % block_size_;
+            if (head > file_size)
+                head = file_size;
+
+            body = file_size - head;
+            body -= body % block_size_;
+        }
+
+        written = copy(src_handle,file_offset,pos_,head);
+        if (written == head && body > 0)
+        {
+            written += clone_range(src_handle,file_offset + head,pos_ + head,body);
+        }
+        if (written < file_size)
+        {
+            written += copy(src_handle,file_offset + written,pos_ + written,
+                            file_size - written);
+        }
+
+        ::close(src_handle);
+#endif
+
+        if (written < file_size)
+        {
+            throw ckcore::Exception2(ckcore::string::formatstr(
+                ckT("Unable to copy the contents of \"%s\" to \"%s\"."),
+                file_path,file_path_.c_str()));
+        }
+
+        pos_ += file_size;
+
+        drop_cache(false);
+    }
+};
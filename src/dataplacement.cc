@@ -0,0 +1,149 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <ckcore/file.hh>
+#include <ckcore/filestream.hh>
+#include <ckcore/string.hh>
+#include "ckfilesystem/dataplacement.hh"
+
+namespace ckfilesystem
+{
+    /**
+     * Removes all files from the profile.
+     */
+    void DataPlacement::clear()
+    {
+        weights_.clear();
+    }
+
+    /**
+     * Loads a sort-weight or access trace file. The files are added to any
+     * files already in the profile.
+     * @param [in] file_path Path to the profile file.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool DataPlacement::load(const ckcore::tchar *file_path)
+    {
+        ckcore::FileInStream in_stream(file_path);
+        if (!in_stream.open())
+            return false;
+
+        std::string contents;
+        char buffer[4096];
+
+        while (!in_stream.end())
+        {
+            ckcore::tint64 processed = in_stream.read(buffer,sizeof(buffer));
+            if (processed == -1)
+                return false;
+            if (processed == 0)
+                break;
+
+            contents.append(buffer,static_cast<size_t>(processed));
+        }
+
+        // Trace entries are weighted after all lines have been read so that
+        // the first entry gets the highest weight.
+        std::vector<std::string> trace;
+
+        size_t line_start = 0;
+        while (line_start < contents.size())
+        {
+            size_t line_end = contents.find('\n',line_start);
+            if (line_end == std::string::npos)
+                line_end = contents.size();
+
+            std::string line = contents.substr(line_start,line_end - line_start);
+            line_start = line_end + 1;
+
+            // Trim white-space.
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#')
+                continue;
+
+            line = line.substr(first,line.find_last_not_of(" \t\r") - first + 1);
+
+            // Sort-weight lines end with an integer.
+            size_t last_space = line.find_last_of(" \t");
+            if (last_space != std::string::npos)
+            {
+                const char *weight_str = line.c_str() + last_space + 1;
+                char *weight_end = NULL;
+                long weight = strtol(weight_str,&weight_end,10);
+
+                if (*weight_str != '\0' && *weight_end == '\0')
+                {
+                    std::string path = line.substr(0,line.find_last_not_of(" \t",last_space) + 1);
+                    set_weight(ckcore::string::to_auto(path),
+                               static_cast<ckcore::tint32>(weight));
+                    continue;
+                }
+            }
+
+            trace.push_back(line);
+        }
+
+        // A file read several times keeps the weight of its first access, and
+        // any higher weight it already has.
+        for (size_t i = 0; i < trace.size(); i++)
+        {
+            ckcore::tstring path = ckcore::string::to_auto(trace[i]);
+            ckcore::tint32 weight = static_cast<ckcore::tint32>(trace.size() - i);
+
+            std::map<ckcore::tstring,ckcore::tint32>::const_iterator it = weights_.find(path);
+            if (it == weights_.end() || it->second < weight)
+                set_weight(path,weight);
+        }
+
+        return true;
+    }
+
+    /**
+     * Sets the weight of a file.
+     * @param [in] file_path Path in the disc image or to the source file.
+     * @param [in] weight The weight, files with higher weights are placed
+     *                    first.
+     */
+    void DataPlacement::set_weight(const ckcore::tstring &file_path,ckcore::tint32 weight)
+    {
+        weights_[file_path] = weight;
+    }
+
+    /**
+     * Returns the weight of a file, or zero if it's not in the profile.
+     * @param [in] internal_path Path of the file in the disc image.
+     * @param [in] external_path Path to the source file.
+     * @return The weight of the file.
+     */
+    ckcore::tint32 DataPlacement::get_weight(const ckcore::tstring &internal_path,
+                                             const ckcore::tstring &external_path) const
+    {
+        std::map<ckcore::tstring,ckcore::tint32>::const_iterator it = weights_.find(internal_path);
+        if (it != weights_.end())
+            return it->second;
+
+        it = weights_.find(external_path);
+        if (it != weights_.end())
+            return it->second;
+
+        return 0;
+    }
+};
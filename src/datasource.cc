@@ -0,0 +1,261 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "ckfilesystem/datasource.hh"
+
+namespace ckfilesystem
+{
+    /*
+        MemoryDataSource
+    */
+
+    /**
+     * Constructs a MemoryDataSource object.
+     * @param [in] data The data, it is copied.
+     * @param [in] size The size of the data in bytes.
+     */
+    MemoryDataSource::MemoryDataSource(const void *data,size_t size) :
+        data_(static_cast<const unsigned char *>(data),
+              static_cast<const unsigned char *>(data) + size),
+        pos_(0),open_(false)
+    {
+    }
+
+    bool MemoryDataSource::open()
+    {
+        pos_ = 0;
+        open_ = true;
+        return true;
+    }
+
+    bool MemoryDataSource::close()
+    {
+        open_ = false;
+        return true;
+    }
+
+    bool MemoryDataSource::test()
+    {
+        return open_;
+    }
+
+    bool MemoryDataSource::end()
+    {
+        return pos_ >= data_.size();
+    }
+
+    bool MemoryDataSource::seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence)
+    {
+        ckcore::tint64 pos = (whence == ckcore::InStream::ckSTREAM_BEGIN ? 0 : pos_) + distance;
+        if (pos < 0 || ckcore::tuint64(pos) > data_.size())
+            return false;
+
+        pos_ = static_cast<size_t>(pos);
+        return true;
+    }
+
+    ckcore::tint64 MemoryDataSource::read(void *buffer,ckcore::tuint32 count)
+    {
+        if (!open_)
+            return -1;
+
+        if (count > data_.size() - pos_)
+            count = static_cast<ckcore::tuint32>(data_.size() - pos_);
+
+        if (count > 0)
+            memcpy(buffer,&data_[pos_],count);
+
+        pos_ += count;
+        return count;
+    }
+
+    ckcore::tint64 MemoryDataSource::size()
+    {
+        return data_.size();
+    }
+
+    /*
+        CallbackDataSource
+    */
+
+    /**
+     * Constructs a CallbackDataSource object.
+     * @param [in] size The number of bytes the callback provides.
+     * @param [in] read_func The function providing the data.
+     */
+    CallbackDataSource::CallbackDataSource(ckcore::tuint64 size,ReadFunction read_func) :
+        size_(size),read_func_(read_func),pos_(0),open_(false)
+    {
+    }
+
+    bool CallbackDataSource::open()
+    {
+        pos_ = 0;
+        open_ = true;
+        return true;
+    }
+
+    bool CallbackDataSource::close()
+    {
+        open_ = false;
+        return true;
+    }
+
+    bool CallbackDataSource::test()
+    {
+        return open_;
+    }
+
+    bool CallbackDataSource::end()
+    {
+        return pos_ >= size_;
+    }
+
+    bool CallbackDataSource::seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence)
+    {
+        ckcore::tint64 pos = (whence == ckcore::InStream::ckSTREAM_BEGIN ? 0 : pos_) + distance;
+        if (pos < 0 || ckcore::tuint64(pos) > size_)
+            return false;
+
+        pos_ = pos;
+        return true;
+    }
+
+    ckcore::tint64 CallbackDataSource::read(void *buffer,ckcore::tuint32 count)
+    {
+        if (!open_)
+            return -1;
+
+        if (count > size_ - pos_)
+            count = static_cast<ckcore::tuint32>(size_ - pos_);
+
+        if (count == 0)
+            return 0;
+
+        // Providing nothing before the end is an error, the data would
+        // otherwise never be complete.
+        ckcore::tint64 res = read_func_(pos_,buffer,count);
+        if (res <= 0 || res > count)
+            return -1;
+
+        pos_ += res;
+        return res;
+    }
+
+    ckcore::tint64 CallbackDataSource::size()
+    {
+        return size_;
+    }
+
+    /*
+        FileRangeDataSource
+    */
+
+    /**
+     * Constructs a FileRangeDataSource object.
+     * @param [in] file_path The path of the file containing the data.
+     * @param [in] file_offset The offset of the data in the file.
+     * @param [in] size The size of the data in bytes.
+     */
+    FileRangeDataSource::FileRangeDataSource(const ckcore::tchar *file_path,
+                                             ckcore::tuint64 file_offset,
+                                             ckcore::tuint64 size) :
+        file_path_(file_path),file_offset_(file_offset),size_(size),pos_(0),
+        stream_(file_path)
+    {
+    }
+
+    /**
+     * Opens the file and moves to the beginning of the range.
+     * @return If successful true is returned, otherwise false. Opening
+     *         fails if the file is too small to contain the range.
+     */
+    bool FileRangeDataSource::open()
+    {
+        pos_ = 0;
+
+        if (!stream_.open())
+            return false;
+
+        if (stream_.size() < 0 || ckcore::tuint64(stream_.size()) < file_offset_ + size_ ||
+            !stream_.seek(file_offset_,ckcore::InStream::ckSTREAM_BEGIN))
+        {
+            stream_.close();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool FileRangeDataSource::close()
+    {
+        return stream_.close();
+    }
+
+    bool FileRangeDataSource::test()
+    {
+        return stream_.test();
+    }
+
+    bool FileRangeDataSource::end()
+    {
+        return pos_ >= size_;
+    }
+
+    bool FileRangeDataSource::seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence)
+    {
+        ckcore::tint64 pos = (whence == ckcore::InStream::ckSTREAM_BEGIN ? 0 : pos_) + distance;
+        if (pos < 0 || ckcore::tuint64(pos) > size_)
+            return false;
+
+        if (!stream_.seek(file_offset_ + pos,ckcore::InStream::ckSTREAM_BEGIN))
+            return false;
+
+        pos_ = pos;
+        return true;
+    }
+
+    ckcore::tint64 FileRangeDataSource::read(void *buffer,ckcore::tuint32 count)
+    {
+        if (count > size_ - pos_)
+            count = static_cast<ckcore::tuint32>(size_ - pos_);
+
+        if (count == 0)
+            return 0;
+
+        ckcore::tint64 res = stream_.read(buffer,count);
+        if (res > 0)
+            pos_ += res;
+
+        return res;
+    }
+
+    ckcore::tint64 FileRangeDataSource::size()
+    {
+        return size_;
+    }
+
+    bool FileRangeDataSource::get_file_range(ckcore::tstring &file_path,
+                                             ckcore::tuint64 &file_offset)
+    {
+        file_path = file_path_;
+        file_offset = file_offset_;
+        return true;
+    }
+};
@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <ckcore/convert.hh>
+#include "ckfilesystem/trace.hh"
 #include "ckfilesystem/dvdvideo.hh"
 #include "ckfilesystem/iforeader.hh"
 
@@ -446,6 +447,8 @@ namespace ckfilesystem
 
     bool DvdVideo::calc_file_padding(FileTree &file_tree)
     {
+        CKFS_TRACE_SCOPE("dvdvideo","calc_file_padding");
+
         // First locate VIDEO_TS.IFO.
         FileTreeNode *vts_node = file_tree.get_node_from_path(ckT("/VIDEO_TS/VIDEO_TS.IFO"));
         if (vts_node == NULL)
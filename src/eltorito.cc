@@ -23,6 +23,7 @@
 #include "ckfilesystem/iso.hh"
 #include "ckfilesystem/util.hh"
 #include "ckfilesystem/exception.hh"
+#include "ckfilesystem/trace.hh"
 #include "ckfilesystem/eltorito.hh"
 
 namespace ckfilesystem
@@ -93,6 +94,8 @@ namespace ckfilesystem
 
     void ElTorito::write_boot_catalog(SectorOutStream &out_stream)
     {
+        CKFS_TRACE_SCOPE("eltorito","write_boot_catalog");
+
         char szManufacturer[] = { 0x49,0x4e,0x46,0x52,0x41,0x52,0x45,0x43,0x4F,0x52,0x44,0x45,0x52 };
         teltorito_valientry ve;
         memset(&ve,0,sizeof(teltorito_valientry));
@@ -265,6 +268,8 @@ namespace ckfilesystem
 
     void ElTorito::write_boot_images(SectorOutStream &out_stream)
     {
+        CKFS_TRACE_SCOPE("eltorito","write_boot_images");
+
         std::vector<ElToritoImage *>::iterator it;
         for (it = boot_images_.begin(); it != boot_images_.end(); it++)
             write_boot_image(out_stream,(*it)->full_path_.c_str());
@@ -324,6 +329,8 @@ namespace ckfilesystem
     void ElTorito::calc_filesys_data(ckcore::tuint64 start_sec,
                                      ckcore::tuint64 &last_sec)
     {
+        CKFS_TRACE_SCOPE("eltorito","calc_filesys_data");
+
         std::vector<ElToritoImage *>::iterator it;
         for (it = boot_images_.begin(); it != boot_images_.end(); it++)
         {
@@ -0,0 +1,347 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <climits>
+#include <deque>
+#include <exception>
+#include <vector>
+#include "ckfilesystem/threadpool.hh"
+#include "ckfilesystem/executor.hh"
+
+namespace ckfilesystem
+{
+    /*
+        TaskGroup::State
+    */
+
+    /**
+     * @brief State of a task group. Shared with the runners submitted to
+     *        the executor since these may outlive the group.
+     */
+    class TaskGroup::State
+    {
+    public:
+        Mutex mutex_;
+        Condition done_cond_;
+
+        std::deque<Executor::Task *> tasks_;
+        ckcore::tuint32 max_running_;
+        ckcore::tuint32 max_runners_;
+        ckcore::tuint32 running_;
+        ckcore::tuint32 runners_;
+        ckcore::tuint32 refs_;
+
+        // The thread that created the group and the processor time used by
+        // tasks executed on other threads.
+#ifdef _WINDOWS
+        DWORD owner_;
+#else
+        pthread_t owner_;
+#endif
+        ckcore::tuint64 cpu_time_;
+
+        // The first exception thrown by a task, rethrown by wait().
+        std::exception_ptr error_;
+
+        State(ckcore::tuint32 max_running,ckcore::tuint32 max_runners) :
+            max_running_(max_running),max_runners_(max_runners),
+            running_(0),runners_(0),refs_(1),cpu_time_(0)
+        {
+#ifdef _WINDOWS
+            owner_ = GetCurrentThreadId();
+#else
+            owner_ = pthread_self();
+#endif
+        }
+
+        /**
+         * Returns true if called by the thread that created the group.
+         */
+        bool is_owner() const
+        {
+#ifdef _WINDOWS
+            return owner_ == GetCurrentThreadId();
+#else
+            return pthread_equal(owner_,pthread_self()) != 0;
+#endif
+        }
+
+        /**
+         * Takes the next task if the concurrency limit allows it. The mutex
+         * must be locked.
+         */
+        bool take(Executor::Task *&task)
+        {
+            if (tasks_.empty() || running_ >= max_running_)
+                return false;
+
+            task = tasks_.front();
+            tasks_.pop_front();
+            running_++;
+            return true;
+        }
+
+        /**
+         * Runs a task taken by take() and marks it as completed. The mutex
+         * must be locked, it is released while the task runs.
+         * @param [in] task The task to run.
+         * @param [in] measure Set to true to add the processor time used by
+         *                     the task to the group.
+         */
+        void execute(Executor::Task *task,bool measure)
+        {
+            mutex_.unlock();
+
+            ckcore::tuint64 cpu_start = measure ? ThreadPool::thread_cpu_time() : 0;
+            std::exception_ptr error;
+            try
+            {
+                task->run();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            ckcore::tuint64 cpu_time = measure ? ThreadPool::thread_cpu_time() - cpu_start : 0;
+
+            mutex_.lock();
+            cpu_time_ += cpu_time;
+            if (error && !error_)
+                error_ = error;
+
+            if (--running_ == 0 && tasks_.empty())
+                done_cond_.broadcast();
+        }
+
+        /**
+         * Drops one reference, returns true if it was the last one. The
+         * mutex must be locked.
+         */
+        bool release()
+        {
+            return --refs_ == 0;
+        }
+    };
+
+    /*
+        TaskGroup::Runner
+    */
+
+    /**
+     * @brief Executor task running queued tasks of a group until there are
+     *        none left or the concurrency limit is reached.
+     */
+    class TaskGroup::Runner : public Executor::Task
+    {
+    private:
+        State *state_;
+
+    public:
+        Runner(State *state) : state_(state)
+        {
+        }
+
+        void run()
+        {
+            State *state = state_;
+
+            // The owner measures its own processor time.
+            bool measure = !state->is_owner();
+
+            state->mutex_.lock();
+
+            Executor::Task *task;
+            while (state->take(task))
+                state->execute(task,measure);
+
+            state->runners_--;
+            bool last = state->release();
+            state->mutex_.unlock();
+
+            if (last)
+                delete state;
+
+            delete this;
+        }
+    };
+
+    /**
+     * @brief Task processing one chunk of a parallel_for() range.
+     */
+    class RangeChunk : public Executor::Task
+    {
+    private:
+        Executor::RangeTask *body_;
+        size_t begin_;
+        size_t end_;
+
+    public:
+        RangeChunk(Executor::RangeTask *body,size_t begin,size_t end) :
+            body_(body),begin_(begin),end_(end)
+        {
+        }
+
+        void run()
+        {
+            body_->run(begin_,end_);
+        }
+    };
+
+    /*
+        TaskGroup
+    */
+
+    /**
+     * Constructs a TaskGroup object.
+     * @param [in] executor The executor to run the tasks on.
+     * @param [in] max_concurrency The maximum number of tasks of the group
+     *                             running at the same time, zero means
+     *                             that the executor decides.
+     */
+    TaskGroup::TaskGroup(Executor &executor,ckcore::tuint32 max_concurrency) :
+        executor_(executor)
+    {
+        ckcore::tuint32 max_runners = executor.concurrency();
+        if (max_runners == 0)
+            max_runners = 1;
+        if (max_concurrency > 0 && max_concurrency < max_runners)
+            max_runners = max_concurrency;
+
+        state_ = new State(max_concurrency > 0 ? max_concurrency : UINT_MAX,max_runners);
+    }
+
+    /**
+     * Destructs the TaskGroup object after waiting for all tasks. Exceptions
+     * of tasks not rethrown by wait() are discarded.
+     */
+    TaskGroup::~TaskGroup()
+    {
+        try
+        {
+            wait();
+        }
+        catch (...)
+        {
+        }
+
+        state_->mutex_.lock();
+        bool last = state_->release();
+        state_->mutex_.unlock();
+
+        if (last)
+            delete state_;
+    }
+
+    /**
+     * Queues a task for execution. The group does not take ownership of the
+     * task, it must be kept alive until wait() has returned.
+     * @param [in] task The task to execute.
+     */
+    void TaskGroup::submit(Executor::Task *task)
+    {
+        state_->mutex_.lock();
+        state_->tasks_.push_back(task);
+
+        bool dispatch = state_->runners_ < state_->max_runners_;
+        if (dispatch)
+        {
+            state_->runners_++;
+            state_->refs_++;
+        }
+
+        state_->mutex_.unlock();
+
+        // May execute the runner directly.
+        if (dispatch)
+            executor_.submit(new Runner(state_));
+    }
+
+    /**
+     * Waits until all tasks submitted to the group have been executed. The
+     * calling thread executes queued tasks while waiting. If any task threw
+     * an exception the first one is rethrown once all tasks have completed,
+     * the group can then be used again.
+     * @throw Any exception thrown by a task of the group.
+     */
+    void TaskGroup::wait()
+    {
+        bool measure = !state_->is_owner();
+
+        MutexLock lock(state_->mutex_);
+
+        while (!state_->tasks_.empty() || state_->running_ > 0)
+        {
+            Executor::Task *task;
+            if (state_->take(task))
+            {
+                state_->execute(task,measure);
+            }
+            else
+            {
+                state_->done_cond_.wait(state_->mutex_);
+            }
+        }
+
+        if (state_->error_)
+        {
+            std::exception_ptr error = state_->error_;
+            state_->error_ = std::exception_ptr();
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * Returns the processor time used by tasks of the group executed by
+     * other threads than the one that created the group, in microseconds.
+     * The creating thread is expected to measure its own time.
+     */
+    ckcore::tuint64 TaskGroup::get_cpu_time() const
+    {
+        MutexLock lock(state_->mutex_);
+        return state_->cpu_time_;
+    }
+
+    /**
+     * Splits a range of indices into chunks and processes them in parallel.
+     * Returns when the whole range has been processed, this also waits for
+     * any other tasks in the group.
+     * @param [in] begin The first index.
+     * @param [in] end The index after the last index.
+     * @param [in] grain The number of indices in each chunk.
+     * @param [in] body The task processing the chunks.
+     * @throw Any exception thrown by the body or another task of the group.
+     */
+    void TaskGroup::parallel_for(size_t begin,size_t end,size_t grain,
+                                 Executor::RangeTask &body)
+    {
+        if (grain == 0)
+            grain = 1;
+
+        std::vector<RangeChunk> chunks;
+        if (end > begin)
+            chunks.reserve((end - begin) / grain + 1);
+
+        for (size_t i = begin; i < end; i += grain)
+            chunks.push_back(RangeChunk(&body,i,end - i > grain ? i + grain : end));
+
+        for (size_t i = 0; i < chunks.size(); i++)
+            submit(&chunks[i]);
+
+        wait();
+    }
+};
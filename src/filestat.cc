@@ -0,0 +1,193 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WINDOWS
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <io.h>
+#include <windows.h>
+#else
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+#include <ckcore/file.hh>
+#include "ckfilesystem/filestat.hh"
+
+namespace ckfilesystem
+{
+#ifndef _WINDOWS
+    /**
+     * Takes the snapshot using statx(2) if supported by the kernel and if it
+     * returns all requested fields, otherwise stat(2) is used. The file is
+     * never opened.
+     * @param [in] file_path The full path to the file or directory.
+     * @param [out] stat The snapshot.
+     * @param [in,out] stat_count Incremented for each stat call made.
+     * @return If successful true is returned, otherwise false.
+     */
+    static bool read_stat(const ckcore::tchar *file_path,FileStat &stat,
+                          ckcore::tuint64 &stat_count)
+    {
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+        // The creation time is the status change time like with stat(2), the
+        // birth time is not requested since many file systems lack it.
+        const unsigned int mask = STATX_SIZE | STATX_ATIME | STATX_MTIME |
+                                  STATX_CTIME | STATX_INO;
+
+        struct statx stx;
+        stat_count++;
+        if (statx(AT_FDCWD,file_path,AT_STATX_SYNC_AS_STAT,mask,&stx) == 0)
+        {
+            // The kernel may leave out fields the file system can't provide.
+            if ((stx.stx_mask & mask) == mask)
+            {
+                stat.size_ = stx.stx_size;
+                stat.access_time_ = stx.stx_atime.tv_sec;
+                stat.modify_time_ = stx.stx_mtime.tv_sec;
+                stat.create_time_ = stx.stx_ctime.tv_sec;
+                stat.inode_ = stx.stx_ino;
+                stat.dev_ = (static_cast<ckcore::tuint64>(stx.stx_dev_major) << 32) | stx.stx_dev_minor;
+                return true;
+            }
+        }
+        else if (errno != ENOSYS)
+        {
+            return false;
+        }
+#endif
+
+        struct stat st;
+        stat_count++;
+        if (::stat(file_path,&st) != 0)
+            return false;
+
+        stat.size_ = st.st_size;
+        stat.access_time_ = st.st_atime;
+        stat.modify_time_ = st.st_mtime;
+        stat.create_time_ = st.st_ctime;
+        stat.inode_ = st.st_ino;
+        stat.dev_ = st.st_dev;
+        return true;
+    }
+#endif
+
+    /**
+     * Takes a snapshot of the meta data of the specified file or directory.
+     * On Linux statx(2) is used if supported by the kernel, only the fields
+     * needed by the file system writers are requested.
+     * @param [in] file_path The full path to the file or directory.
+     * @param [in] check_readable If true the snapshot fails if the file
+     *                            can't be opened for reading. This is
+     *                            checked using the access permissions, the
+     *                            file is not opened.
+     * @param [in,out] stat_count If not NULL, incremented for each stat call
+     *                            made. More than one call is made if statx(2)
+     *                            can't provide all fields.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool FileStat::read(const ckcore::tchar *file_path,bool check_readable,
+                        ckcore::tuint64 *stat_count)
+    {
+        flags_ = 0;
+
+        ckcore::tuint64 count = 0;
+
+#ifdef _WINDOWS
+        struct _stat64 st;
+        count++;
+#ifdef _UNICODE
+        int res = _wstat64(file_path,&st);
+#else
+        int res = _stat64(file_path,&st);
+#endif
+
+        if (stat_count != NULL)
+            *stat_count += count;
+
+        if (res != 0)
+            return false;
+
+#ifdef _UNICODE
+        if (check_readable && _waccess(file_path,4) != 0)
+#else
+        if (check_readable && _access(file_path,4) != 0)
+#endif
+            return false;
+
+        size_ = st.st_size;
+        access_time_ = st.st_atime;
+        modify_time_ = st.st_mtime;
+        create_time_ = st.st_ctime;     // Creation time on Windows.
+        inode_ = st.st_ino;
+        dev_ = st.st_dev;
+#else
+        bool res = read_stat(file_path,*this,count);
+
+        if (stat_count != NULL)
+            *stat_count += count;
+
+        if (!res)
+            return false;
+
+        // Checked with the effective ids like when the file is opened.
+        if (check_readable && faccessat(AT_FDCWD,file_path,R_OK,AT_EACCESS) != 0)
+            return false;
+#endif
+
+        flags_ |= FLAG_VALID;
+        if (ckcore::File::hidden(file_path))
+            flags_ |= FLAG_HIDDEN;
+
+        return true;
+    }
+
+    /**
+     * Converts the snapshot time stamps into local time.
+     * @param [out] access_time Time of last access.
+     * @param [out] modify_time Time of last modification.
+     * @param [out] create_time Time of creation, or last status change on
+     *                          Unix systems.
+     * @return If the snapshot is valid true is returned, otherwise false.
+     */
+    bool FileStat::get_times(struct tm &access_time,struct tm &modify_time,
+                             struct tm &create_time) const
+    {
+        if (!valid())
+            return false;
+
+        time_t access = static_cast<time_t>(access_time_);
+        time_t modify = static_cast<time_t>(modify_time_);
+        time_t create = static_cast<time_t>(create_time_);
+
+#ifdef _WINDOWS
+        return localtime_s(&access_time,&access) == 0 &&
+               localtime_s(&modify_time,&modify) == 0 &&
+               localtime_s(&create_time,&create) == 0;
+#else
+        return localtime_r(&access,&access_time) != NULL &&
+               localtime_r(&modify,&modify_time) != NULL &&
+               localtime_r(&create,&create_time) != NULL;
+#endif
+    }
+};
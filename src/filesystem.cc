@@ -21,7 +21,8 @@
 namespace ckfilesystem
 {
     FileSystem::FileSystem(Type type,const FileSet &file_set) :
-        type_(type),udf_(type == TYPE_DVDVIDEO),file_set_(file_set)
+        type_(type),udf_(type == TYPE_DVDVIDEO),file_set_(file_set),
+        create_time_(0)
     {
     }
 
@@ -84,6 +85,23 @@ namespace ckfilesystem
         joliet_.set_relax_max_name_len(enable);
     }
 
+    void FileSystem::set_embed_udf_data(bool enable)
+    {
+        udf_.set_embed_data(enable);
+    }
+
+    /**
+     * Sets the time recorded as creation time of the file system, it's also
+     * used as time stamp of directories without a source on the hard drive.
+     * Fixing the time makes it possible to create reproducible images.
+     * @param [in] create_time The creation time, or zero to use the time when
+     *                         the file system is written.
+     */
+    void FileSystem::set_create_time(time_t create_time)
+    {
+        create_time_ = create_time;
+    }
+
     bool FileSystem::add_boot_image_no_emu(const ckcore::tchar *full_path,bool bootable,
                                            ckcore::tuint16 load_segment,ckcore::tuint16 sec_count)
     {
@@ -135,4 +153,36 @@ namespace ckfilesystem
     {
         return iso_.get_max_dir_level();
     }
+
+    /**
+     * Returns the largest file size in bytes for which the file data will be
+     * embedded in the UDF file entry instead of being written to the data
+     * area. Returns zero if no files will be embedded, this is always the
+     * case when an ISO9660 file system is created since it needs the file
+     * data to be located in the data area.
+     */
+    ckcore::tuint32 FileSystem::get_max_embedded_file_size()
+    {
+        if (!is_udf() || is_iso())
+            return 0;
+
+        return udf_.get_max_embedded_size();
+    }
+
+    /**
+     * Returns the creation time of the file system in local time.
+     * @param [out] create_time The creation time.
+     */
+    void FileSystem::get_create_time(struct tm &create_time) const
+    {
+        time_t cur_time = create_time_;
+        if (cur_time == 0)
+            time(&cur_time);
+
+#ifdef _WINDOWS
+        localtime_s(&create_time,&cur_time);
+#else
+        localtime_r(&cur_time,&create_time);
+#endif
+    }
 };
@@ -16,6 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <ckcore/string.hh>
 #include "ckfilesystem/stringtable.hh"
 #include "ckfilesystem/sectormanager.hh"
@@ -23,13 +24,18 @@
 #include "ckfilesystem/udfwriter.hh"
 #include "ckfilesystem/dvdvideo.hh"
 #include "ckfilesystem/exception.hh"
+#include "ckfilesystem/util.hh"
+#include "ckfilesystem/verificationtap.hh"
+#include "ckfilesystem/trace.hh"
 #include "ckfilesystem/filesystemwriter.hh"
 
 namespace ckfilesystem
 {
     FileSystemWriter::FileSystemWriter(ckcore::Log &log,FileSystem &file_sys,
                                        bool fail_on_error) :
-        log_(log),file_sys_(file_sys),file_tree_(log),fail_on_error_(fail_on_error)
+        log_(log),file_sys_(file_sys),file_tree_(log),fail_on_error_(fail_on_error),
+        verify_output_(false),data_align_boundary_(0),data_align_min_size_(0),
+        sec_offset_(0)
     {
     }
 
@@ -37,10 +43,24 @@ namespace ckfilesystem
     {
     }
 
+    static bool compare_placement_weight(const std::pair<ckcore::tint64,FileTreeNode *> &item1,
+                                         const std::pair<ckcore::tint64,FileTreeNode *> &item2)
+    {
+        return item1.first < item2.first;
+    }
+
+    static bool compare_data_pos(const FileTreeNode *node1,const FileTreeNode *node2)
+    {
+        return node1->data_pos_normal_ < node2->data_pos_normal_;
+    }
+
     void FileSystemWriter::calc_local_filesys_data(std::vector<std::pair<FileTreeNode *,int> > &dir_node_stack,
                                                    FileTreeNode *local_node,int level,
-                                                   ckcore::tuint64 &sec_offset,ckcore::Progress &progress)
+                                                   std::vector<FileTreeNode *> &file_nodes,
+                                                   ckcore::Progress &progress)
     {
+        const ckcore::tuint32 max_embedded_size = file_sys_.get_max_embedded_file_size();
+
         std::vector<FileTreeNode *>::const_iterator it_file;
         for (it_file = local_node->children_.begin(); it_file !=
             local_node->children_.end(); it_file++)
@@ -65,7 +85,7 @@ namespace ckfilesystem
                     {
                         log_.print_line(ckT("  Warning: Skipping \"%s\", the file is larger than 4 GiB."),
                             (*it_file)->file_name_.c_str());
-                        progress.notify(ckcore::Progress::ckWARNING,StringTable::instance().get_string(StringTable::WARNING_SKIP4GFILE),
+                        progress.notify(ckcore::Progress::ckWARNING,file_sys_.get_string_table().get_string(StringTable::WARNING_SKIP4GFILE),
                             (*it_file)->file_name_.c_str());
 
                         continue;
@@ -74,7 +94,7 @@ namespace ckfilesystem
                     {
                         log_.print_line(ckT("  Warning: The file \"%s\" is larger than 4 GiB. It will not be visible in the ISO9660/Joliet file system."),
                             (*it_file)->file_name_.c_str());
-                        progress.notify(ckcore::Progress::ckWARNING,StringTable::instance().get_string(StringTable::WARNING_SKIP4GFILEISO),
+                        progress.notify(ckcore::Progress::ckWARNING,file_sys_.get_string_table().get_string(StringTable::WARNING_SKIP4GFILEISO),
                             (*it_file)->file_name_.c_str());
                     }
                 }
@@ -97,33 +117,40 @@ namespace ckfilesystem
                     (*it_file)->data_pos_normal_ = import_node_ptr->extent_loc_;
                     (*it_file)->data_pos_joliet_ = import_node_ptr->extent_loc_;
                 }
-                else
+                else if (max_embedded_size > 0 && (*it_file)->file_size_ <= max_embedded_size &&
+                         (*it_file)->data_pad_len_ == 0)
                 {
+                    // Small files are embedded in the UDF file entry and
+                    // does not occupy any sectors in the data area.
+                    (*it_file)->file_flags_ |= FileTreeNode::FLAG_EMBEDDED;
+
                     (*it_file)->data_size_normal_ = (*it_file)->file_size_;
                     (*it_file)->data_size_joliet_ = (*it_file)->file_size_;
 
-                    (*it_file)->data_pos_normal_ = sec_offset;
-                    (*it_file)->data_pos_joliet_ = sec_offset;
-
-                    sec_offset += (*it_file)->data_size_normal_/ISO_SECTOR_SIZE;
-                    if ((*it_file)->data_size_normal_ % ISO_SECTOR_SIZE != 0)
-                        sec_offset++;
-
-                    // Pad if necessary.
-                    sec_offset += (*it_file)->data_pad_len_;
+                    (*it_file)->data_pos_normal_ = 0;
+                    (*it_file)->data_pos_joliet_ = 0;
+                }
+                else
+                {
+                    // The data is placed when all files are known.
+                    (*it_file)->file_flags_ &= ~FileTreeNode::FLAG_EMBEDDED;
+                    file_nodes.push_back(*it_file);
                 }
             }
         }
     }
 
     void FileSystemWriter::calc_filesys_data(FileTree &file_tree,ckcore::Progress &progress,
-                                             ckcore::tuint64 start_sec,ckcore::tuint64 &last_sec)
+                                             SectorManager &sec_manager,ckcore::tuint64 start_sec,
+                                             ckcore::tuint64 &last_sec,
+                                             std::vector<FileTreeNode *> &file_nodes)
     {
+        CKFS_TRACE_SCOPE("writer","calc_filesys_data");
+
         FileTreeNode *cur_node = file_tree.get_root();
-        ckcore::tuint64 sec_offset = start_sec;
 
         std::vector<std::pair<FileTreeNode *,int> > dir_node_stack;
-        calc_local_filesys_data(dir_node_stack,cur_node,2,sec_offset,progress);
+        calc_local_filesys_data(dir_node_stack,cur_node,2,file_nodes,progress);
 
         while (dir_node_stack.size() > 0)
         { 
@@ -131,26 +158,367 @@ namespace ckfilesystem
             int level = dir_node_stack[dir_node_stack.size() - 1].second;
             dir_node_stack.pop_back();
 
-            calc_local_filesys_data(dir_node_stack,cur_node,level,sec_offset,progress);
+            calc_local_filesys_data(dir_node_stack,cur_node,level,file_nodes,progress);
+        }
+
+        if (!data_placement_.empty())
+            place_file_data(file_nodes);
+
+        if (!prev_layout_.empty() && !file_sys_.is_dvdvideo() &&
+            place_incremental_file_data(file_nodes,sec_manager,start_sec,last_sec))
+        {
+            return;
+        }
+
+        // Allocate the file data in placement order.
+        ckcore::tuint64 sec_offset = start_sec;
+
+        std::vector<FileTreeNode *>::const_iterator it_file;
+        for (it_file = file_nodes.begin(); it_file != file_nodes.end(); it_file++)
+        {
+            // Align large files according to the allocation policy.
+            (*it_file)->data_align_len_ = sec_manager.calc_data_align_len(sec_offset,(*it_file)->file_size_);
+            sec_offset += (*it_file)->data_align_len_;
+
+            (*it_file)->data_size_normal_ = (*it_file)->file_size_;
+            (*it_file)->data_size_joliet_ = (*it_file)->file_size_;
+
+            (*it_file)->data_pos_normal_ = sec_offset;
+            (*it_file)->data_pos_joliet_ = sec_offset;
+
+            sec_offset += (*it_file)->data_size_normal_/ISO_SECTOR_SIZE;
+            if ((*it_file)->data_size_normal_ % ISO_SECTOR_SIZE != 0)
+                sec_offset++;
+
+            // Pad if necessary.
+            sec_offset += (*it_file)->data_pad_len_;
         }
 
         last_sec = sec_offset;
     }
 
-    void FileSystemWriter::write_file_node(SectorOutStream &out_stream,FileTreeNode *node,
-                                           ckcore::Progresser &progresser)
+    /**
+     * Orders the file data according to the data placement profile. Files
+     * with higher weights are placed first, the order of files with equal
+     * weights is kept. The DVD-Video files are always placed first in their
+     * original order since their padding has been calculated for it.
+     * @param [in,out] file_nodes The files with data to place, in default
+     *                            order.
+     */
+    void FileSystemWriter::place_file_data(std::vector<FileTreeNode *> &file_nodes)
     {
-        // Make sure that the file stream is ready for reading. Please note that this
-        // is the second place of try. The stream should already be open.
-        if (!node->file_stream_.test() && node->file_stream_.open())
-            throw FileOpenException(node->file_path_);
+        std::vector<std::pair<ckcore::tint64,FileTreeNode *> > weighted_nodes;
+        weighted_nodes.reserve(file_nodes.size());
+
+        ckcore::tuint32 match_count = 0;
+
+        std::vector<FileTreeNode *>::const_iterator it_file;
+        for (it_file = file_nodes.begin(); it_file != file_nodes.end(); it_file++)
+        {
+            ckcore::tstring internal_path;
+            get_internal_path(*it_file,internal_path,false,false);
+
+            ckcore::tint64 weight = data_placement_.get_weight(internal_path,(*it_file)->file_path_);
+            if (weight != 0)
+                match_count++;
+
+            if (file_sys_.is_dvdvideo() &&
+                !internal_path.compare(0,10,ckT("/VIDEO_TS/")))
+            {
+                weight = 0x100000000LL;
+            }
+
+            weighted_nodes.push_back(std::make_pair(-weight,*it_file));
+        }
+
+        std::stable_sort(weighted_nodes.begin(),weighted_nodes.end(),compare_placement_weight);
+
+        for (size_t i = 0; i < weighted_nodes.size(); i++)
+            file_nodes[i] = weighted_nodes[i].second;
+
+        log_.print_line(ckT("  data placement: %u of %u files found in profile."),
+                        match_count,(ckcore::tuint32)file_nodes.size());
+    }
+
+    /**
+     * Allocates the file data for an incremental build. Files that have not
+     * changed since the previous image keep their extents, the other files
+     * are placed in the first free space large enough to hold them, or
+     * after all kept extents.
+     * @param [in,out] file_nodes The files with data to place, they are
+     *                            returned in the order they're placed.
+     * @param [in] sec_manager The sector manager providing the alignment
+     *                         policy.
+     * @param [in] start_sec The first sector of the data area.
+     * @param [out] last_sec The first sector after the data area.
+     * @return If the files could be placed true is returned. If the free
+     *         space in front of a file is too large to be padded false is
+     *         returned, no file is then kept and file_nodes is unchanged.
+     */
+    bool FileSystemWriter::place_incremental_file_data(std::vector<FileTreeNode *> &file_nodes,
+                                                       SectorManager &sec_manager,
+                                                       ckcore::tuint64 start_sec,
+                                                       ckcore::tuint64 &last_sec)
+    {
+        std::vector<FileTreeNode *> reused_nodes,new_nodes;
+
+        std::vector<FileTreeNode *>::const_iterator it_file;
+        for (it_file = file_nodes.begin(); it_file != file_nodes.end(); it_file++)
+        {
+            FileTreeNode *node = *it_file;
+            node->file_flags_ &= ~FileTreeNode::FLAG_REUSED;
+            node->data_size_normal_ = node->file_size_;
+            node->data_size_joliet_ = node->file_size_;
+
+            ckcore::tstring internal_path;
+            get_internal_path(node,internal_path,false,false);
+
+            // Extents in front of the data area may have been overwritten by
+            // the meta data of the new image.
+            const LayoutMap::Entry *entry = prev_layout_.find(internal_path);
+            if (entry != NULL && node->file_size_ > 0 && entry->size_ == node->file_size_ &&
+                node->stat_.valid() && entry->modify_time_ == node->stat_.modify_time_ &&
+                entry->sector_ >= start_sec && entry->sector_ >= prev_layout_.get_sec_offset())
+            {
+                node->file_flags_ |= FileTreeNode::FLAG_REUSED;
+                node->data_pos_normal_ = entry->sector_;
+                node->data_pos_joliet_ = entry->sector_;
+                reused_nodes.push_back(node);
+            }
+            else
+            {
+                new_nodes.push_back(node);
+            }
+        }
+
+        // Collect the free space between the kept extents. Extents
+        // overlapping a previous extent are not kept.
+        std::stable_sort(reused_nodes.begin(),reused_nodes.end(),compare_data_pos);
+
+        std::vector<std::pair<ckcore::tuint64,ckcore::tuint64> > free_space;
+        ckcore::tuint64 end_sec = start_sec;
+        ckcore::tuint32 reused_count = 0;
+
+        for (it_file = reused_nodes.begin(); it_file != reused_nodes.end(); it_file++)
+        {
+            FileTreeNode *node = *it_file;
+            if (node->data_pos_normal_ < end_sec)
+            {
+                node->file_flags_ &= ~FileTreeNode::FLAG_REUSED;
+                new_nodes.push_back(node);
+                continue;
+            }
+
+            if (node->data_pos_normal_ > end_sec)
+                free_space.push_back(std::make_pair(end_sec,node->data_pos_normal_));
+
+            end_sec = node->data_pos_normal_ + util::bytes_to_sec64(node->file_size_);
+            reused_count++;
+        }
+
+        // Place the new and modified files, first fit.
+        for (it_file = new_nodes.begin(); it_file != new_nodes.end(); it_file++)
+        {
+            FileTreeNode *node = *it_file;
+            ckcore::tuint64 sec_count = util::bytes_to_sec64(node->file_size_);
+
+            bool placed = false;
+            for (size_t i = 0; i < free_space.size() && !placed; i++)
+            {
+                ckcore::tuint64 pos = free_space[i].first +
+                    sec_manager.calc_data_align_len(free_space[i].first,node->file_size_);
+                if (pos + sec_count <= free_space[i].second)
+                {
+                    node->data_pos_normal_ = pos;
+                    free_space[i].first = pos + sec_count;
+                    placed = true;
+                }
+            }
+
+            if (!placed)
+            {
+                node->data_pos_normal_ = end_sec + sec_manager.calc_data_align_len(end_sec,node->file_size_);
+                end_sec = node->data_pos_normal_ + sec_count;
+            }
+
+            node->data_pos_joliet_ = node->data_pos_normal_;
+        }
+
+        // The data is written in sector order, the space in front of each
+        // file is filled with zeroes.
+        std::vector<FileTreeNode *> placed_nodes(file_nodes);
+        std::stable_sort(placed_nodes.begin(),placed_nodes.end(),compare_data_pos);
+
+        ckcore::tuint64 cur_sec = start_sec;
+        for (it_file = placed_nodes.begin(); it_file != placed_nodes.end(); it_file++)
+        {
+            if ((*it_file)->data_pos_normal_ - cur_sec > 0xffffffff)
+            {
+                for (it_file = file_nodes.begin(); it_file != file_nodes.end(); it_file++)
+                    (*it_file)->file_flags_ &= ~FileTreeNode::FLAG_REUSED;
+
+                log_.print_line(ckT("  incremental build: the previous layout leaves too much free space, placing all files."));
+                return false;
+            }
+
+            cur_sec = (*it_file)->data_pos_normal_ + util::bytes_to_sec64((*it_file)->file_size_);
+        }
+
+        cur_sec = start_sec;
+        for (it_file = placed_nodes.begin(); it_file != placed_nodes.end(); it_file++)
+        {
+            (*it_file)->data_align_len_ = static_cast<ckcore::tuint32>((*it_file)->data_pos_normal_ - cur_sec);
+            cur_sec = (*it_file)->data_pos_normal_ + util::bytes_to_sec64((*it_file)->file_size_);
+        }
+
+        file_nodes.swap(placed_nodes);
+
+        log_.print_line(ckT("  incremental build: reusing %u of %u files."),
+                        reused_count,(ckcore::tuint32)file_nodes.size());
+
+        last_sec = end_sec;
+        return true;
+    }
+
+    /**
+     * Prints the alignment padding of all aligned files to the log.
+     * @param [in] file_tree The file tree to report.
+     */
+    void FileSystemWriter::print_data_alignment(FileTree &file_tree)
+    {
+        ckcore::tuint64 tot_align_len = 0;
+        ckcore::tuint32 align_count = 0;
+
+        std::vector<FileTreeNode *> dir_node_stack;
+        dir_node_stack.push_back(file_tree.get_root());
+
+        while (dir_node_stack.size() > 0)
+        {
+            FileTreeNode *cur_node = dir_node_stack.back();
+            dir_node_stack.pop_back();
+
+            std::vector<FileTreeNode *>::const_iterator it_file;
+            for (it_file = cur_node->children_.begin(); it_file !=
+                cur_node->children_.end(); it_file++)
+            {
+                if ((*it_file)->file_flags_ & FileTreeNode::FLAG_DIRECTORY)
+                {
+                    dir_node_stack.push_back(*it_file);
+                }
+                else if ((*it_file)->data_align_len_ > 0)
+                {
+                    log_.print_line(ckT("  %s: align %u sector(s)."),
+                        (*it_file)->file_path_.c_str(),(*it_file)->data_align_len_);
+
+                    tot_align_len += (*it_file)->data_align_len_;
+                    align_count++;
+                }
+            }
+        }
+
+        log_.print_line(ckT("  alignment padding: %u sector(s) in %u file(s)."),
+            (ckcore::tuint32)tot_align_len,align_count);
+    }
+
+    /**
+     * Writes a number of sectors filled with zeroes.
+     * @param [in] out_stream The stream to write to.
+     * @param [in] num_sec The number of sectors to write.
+     */
+    void FileSystemWriter::write_zero_sectors(SectorOutStream &out_stream,ckcore::tuint32 num_sec)
+    {
+        char tmp[ISO_SECTOR_SIZE];
+        memset(tmp,0,sizeof(tmp));
+
+        for (ckcore::tuint32 i = 0; i < num_sec; i++)
+            out_stream.write(tmp,ISO_SECTOR_SIZE);
+    }
+
+    /**
+     * Copies the data of a file kept from the previous image. The data is
+     * read from the same location in the previous image.
+     * @param [in] out_stream The stream to write to.
+     * @param [in] extent_stream Stream to pass the data to by reference,
+     *                           may be NULL.
+     * @param [in] prev_image The open previous image, must not be NULL unless
+     *                        extent_stream is given. Its size has already
+     *                        been checked to cover the file.
+     * @param [in] node The file to write.
+     * @param [in] progresser Object to report progress to.
+     * @throw Exception If the previous image could not be read.
+     */
+    void FileSystemWriter::write_reused_file_node(SectorOutStream &out_stream,ExtentOutStream *extent_stream,
+                                                  ckcore::FileInStream *prev_image,FileTreeNode *node,
+                                                  ckcore::Progresser &progresser)
+    {
+        CKFS_TRACE_SCOPE_ARG("data","write_reused_file",node->file_path_.c_str());
+
+        ckcore::tuint64 image_offset = (node->data_pos_normal_ - prev_layout_.get_sec_offset()) *
+            ISO_SECTOR_SIZE;
+
+        if (extent_stream != NULL)
+        {
+            extent_stream->write_file(prev_image_path_.c_str(),image_offset,node->file_size_);
+            out_stream.skip(node->file_size_);
+            progresser.update(node->file_size_);
+        }
+        else
+        {
+            if (!prev_image->seek(image_offset,ckcore::InStream::ckSTREAM_BEGIN))
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("Unable to read the data of \"") << node->file_path_
+                    << ckT("\" from the previous image \"") << prev_image_path_
+                    << ckT("\".");
+                throw ckcore::Exception2(msg.str());
+            }
+
+            StatsInStream stats_stream(*prev_image,stats_);
+            ckcore::CanexInStream in_stream(stats_stream,prev_image_path_);
+            ckcore::canexstream::copy(in_stream,out_stream,progresser,node->file_size_);
+        }
+
+        stats_.data_bytes_ += node->file_size_;
+
+        // Pad the sector.
+        if (out_stream.get_allocated() != 0)
+            out_stream.pad_sector();
+    }
+
+    void FileSystemWriter::write_file_node(SectorOutStream &out_stream,ExtentOutStream *extent_stream,
+                                           ckcore::FileInStream *prev_image,CacheAdvisor &cache_advisor,
+                                           FileTreeNode *node,ckcore::Progresser &progresser)
+    {
+        CKFS_TRACE_SCOPE_ARG("data","write_file",node->file_path_.c_str());
+
+        if (node->file_flags_ & FileTreeNode::FLAG_REUSED)
+        {
+            write_reused_file_node(out_stream,extent_stream,prev_image,node,progresser);
+            return;
+        }
+
+        // Time spent waiting for the source file, slow sources are reported
+        // in the statistics.
+        ckcore::tuint64 open_time = 0,read_time = 0;
+
+        // The file is opened just before copying the data to not keep
+        // descriptors of all files open at the same time.
+        if (!node->data_open())
+        {
+            ckcore::tuint64 start_time = WriteStats::get_wall_time();
+            if (!node->open_data())
+                throw FileOpenException(node->file_path_);
+
+            open_time = WriteStats::get_wall_time() - start_time;
+            stats_.open_count_++;
+        }
 
 #ifdef _DEBUG
         node->data_pos_actual_ = out_stream.get_sector();
 #endif
 
         // Validate the file size.
-        if (ckcore::tuint64(node->file_stream_.size()) != node->file_size_)
+        if (ckcore::tuint64(node->data_stream().size()) != node->file_size_)
         {
             if (fail_on_error_)
             {
@@ -174,81 +542,124 @@ namespace ckfilesystem
             }
         }
 
-        // Copy the file data into the disc file system.
-        ckcore::CanexInStream in_stream(node->file_stream_,node->file_path_);
-        ckcore::canexstream::copy(in_stream,out_stream,progresser,node->file_size_);
+        // Copy the file data into the disc file system. Data not stored in a
+        // file can't be passed by reference and is copied.
+        ckcore::tstring range_path;
+        ckcore::tuint64 range_offset = 0;
+
+        if (extent_stream != NULL && node->get_data_range(range_path,range_offset))
+        {
+            node->close_data();
+
+            ckcore::tuint64 start_time = WriteStats::get_wall_time();
+            extent_stream->write_file(range_path.c_str(),range_offset,node->file_size_);
+            read_time = WriteStats::get_wall_time() - start_time;
+
+            out_stream.skip(node->file_size_);
+            progresser.update(node->file_size_);
+        }
+        else if (cache_advisor.get_read_size() > 0)
+        {
+            // Copy one window at a time to keep the page cache hints ahead
+            // of the read position.
+            StatsInStream stats_stream(node->data_stream(),stats_);
+            ckcore::CanexInStream in_stream(stats_stream,node->file_path_);
+
+            ckcore::tuint64 pos = 0;
+            while (pos < node->file_size_ && !progresser.cancelled())
+            {
+                ckcore::tuint64 count = node->file_size_ - pos;
+                if (count > cache_advisor.get_read_size())
+                    count = cache_advisor.get_read_size();
+
+                ckcore::canexstream::copy(in_stream,out_stream,progresser,count);
+                pos += count;
+
+                cache_advisor.read(pos);
+            }
+
+            node->close_data();
+            read_time = stats_stream.get_read_time();
+        }
+        else
+        {
+            StatsInStream stats_stream(node->data_stream(),stats_);
+            ckcore::CanexInStream in_stream(stats_stream,node->file_path_);
+            ckcore::canexstream::copy(in_stream,out_stream,progresser,node->file_size_);
+            node->close_data();
+            read_time = stats_stream.get_read_time();
+        }
+
+        stats_.data_bytes_ += node->file_size_;
+        stats_.record_file(node->file_path_,node->file_size_,open_time,read_time);
 
         // Pad the sector.
         if (out_stream.get_allocated() != 0)
             out_stream.pad_sector();
     }
 
-    void FileSystemWriter::write_local_file_data(SectorOutStream &out_stream,
-                                                 std::vector<std::pair<FileTreeNode *,int> > &dir_node_stack,
-                                                 FileTreeNode *local_node,int level,
-                                                 ckcore::Progresser &progresser)
+    void FileSystemWriter::write_file_data(SectorOutStream &out_stream,ExtentOutStream *extent_stream,
+                                           const std::vector<FileTreeNode *> &file_nodes,
+                                           ckcore::Progresser &progresser)
     {
-        std::vector<FileTreeNode *>::const_iterator it_file;
-        for (it_file = local_node->children_.begin(); it_file !=
-            local_node->children_.end(); it_file++)
-        {
-            // Check if we should abort.
-            if (progresser.cancelled())
-                return;
+        CacheAdvisor cache_advisor(cache_policy_,file_nodes);
 
-            if ((*it_file)->file_flags_ & FileTreeNode::FLAG_DIRECTORY)
-            {
-                // Validate directory level.
-                if (level > file_sys_.get_max_dir_level())
-                    continue;
-                else
-                    dir_node_stack.push_back(std::make_pair(*it_file,level + 1));
-            }
-            else if (!((*it_file)->file_flags_ & FileTreeNode::FLAG_IMPORTED))  // We don't have any data to write for imported files.
+        // The previous image is opened once for all files kept from it, it
+        // must contain the data of all of them.
+        ckcore::FileInStream prev_image(prev_image_path_.c_str());
+        if (extent_stream == NULL)
+        {
+            ckcore::tuint64 prev_image_end = 0;
+            for (size_t i = 0; i < file_nodes.size(); i++)
             {
-                // Validate file size.
-                if (file_sys_.is_iso() && !file_sys_.is_udf())
+                FileTreeNode *node = file_nodes[i];
+                if (node->file_flags_ & FileTreeNode::FLAG_REUSED)
                 {
-                    if ((*it_file)->file_size_ > ISO_MAX_EXTENT_SIZE && !file_sys_.allows_fragmentation())
-                        continue;
+                    ckcore::tuint64 end = (node->data_pos_normal_ - prev_layout_.get_sec_offset()) *
+                        ISO_SECTOR_SIZE + node->file_size_;
+                    if (end > prev_image_end)
+                        prev_image_end = end;
                 }
+            }
 
-                write_file_node(out_stream,*it_file,progresser);
+            if (prev_image_end > 0)
+            {
+                if (!prev_image.open())
+                    throw FileOpenException(prev_image_path_);
 
-                // The write operation might have been cancelled.
-                if (progresser.cancelled())
-                    return;
+                stats_.open_count_++;
 
-                // Pad if necessary.
-                char tmp[1] = { 0 };
-                for (unsigned int i = 0; i < (*it_file)->data_pad_len_; i++)
+                if (prev_image.size() < 0 || ckcore::tuint64(prev_image.size()) < prev_image_end)
                 {
-                    for (unsigned int j = 0; j < ISO_SECTOR_SIZE; j++)
-                        out_stream.write(tmp,1);
+                    ckcore::tstringstream msg;
+                    msg << ckT("The previous image \"") << prev_image_path_
+                        << ckT("\" is smaller than its layout map.");
+                    throw ckcore::Exception2(msg.str());
                 }
             }
         }
-    }
 
-    void FileSystemWriter::write_file_data(SectorOutStream &out_stream,FileTree &file_tree,
-                                           ckcore::Progresser &progresser)
-    {
-        FileTreeNode *cur_node = file_tree.get_root();
+        for (size_t i = 0; i < file_nodes.size(); i++)
+        {
+            // Check if we should abort.
+            if (progresser.cancelled())
+                return;
 
-        std::vector<std::pair<FileTreeNode *,int> > dir_node_stack;
-        write_local_file_data(out_stream,dir_node_stack,cur_node,2,progresser);
-        if (progresser.cancelled())
-            return;
+            FileTreeNode *node = file_nodes[i];
 
-        while (dir_node_stack.size() > 0)
-        { 
-            cur_node = dir_node_stack[dir_node_stack.size() - 1].first;
-            int level = dir_node_stack[dir_node_stack.size() - 1].second;
-            dir_node_stack.pop_back();
+            // Align the file if necessary.
+            write_zero_sectors(out_stream,node->data_align_len_);
 
-            write_local_file_data(out_stream,dir_node_stack,cur_node,level,progresser);
+            cache_advisor.begin_file(i);
+            write_file_node(out_stream,extent_stream,&prev_image,cache_advisor,node,progresser);
+            cache_advisor.end_file();
+
+            // The write operation might have been cancelled.
             if (progresser.cancelled())
                 return;
+
+            // Pad if necessary.
+            write_zero_sectors(out_stream,node->data_pad_len_);
         }
     }
 
@@ -424,38 +835,77 @@ namespace ckfilesystem
     int FileSystemWriter::write(ckcore::OutStream &out_stream,ckcore::Progress &progress,
                                 ckcore::tuint32 sec_offset)
     {
+        CKFS_TRACE_SCOPE("writer","write");
+
         log_.print_line(ckT("FileSystemWriter::write"));
         log_.print_line(ckT("  sector offset: %u."),sec_offset);
+        sec_offset_ = sec_offset;
+
+        // The verifiers need the complete image, multi-session images are
+        // therefore not verified.
+        bool verify = verify_output_ && sec_offset == 0;
+        if (verify_output_ && !verify)
+            log_.print_line(ckT("  skipping verification of multi-session image."));
+
+        stats_.clear();
+        StatsOutStream stats_stream(out_stream,stats_);
+
+        VerificationTap tap(stats_stream,verify && file_sys_.is_iso(),verify && file_sys_.is_udf());
 
-        ckcore::BufferedOutStream out_buf_stream(out_stream);
-        SectorOutStream out_sec_stream(out_buf_stream);
+        // File data is passed by reference if the output stream supports it,
+        // for example to be cloned. Such streams do their own buffering, they
+        // must see all writes in order. The verifier needs the actual data so
+        // nothing is passed by reference while it's active.
+        CloneOutStream *image_stream = dynamic_cast<CloneOutStream *>(&out_stream);
+        ExtentOutStream *extent_stream = tap.active() ? NULL : dynamic_cast<ExtentOutStream *>(&out_stream);
+        if (extent_stream != NULL)
+            log_.print_line(ckT("  writing file data by reference."));
+
+        if (cache_policy_.drop_output_)
+        {
+            if (image_stream != NULL)
+                image_stream->set_drop_cache(cache_policy_.window_size_);
+            else
+                log_.print_line(ckT("  warning: image data can only be evicted from the page cache when writing to a CloneOutStream."));
+        }
+
+        ckcore::BufferedOutStream out_buf_stream(tap);
+        SectorOutStream out_sec_stream(extent_stream != NULL ?
+            static_cast<ckcore::OutStream &>(tap) : static_cast<ckcore::OutStream &>(out_buf_stream));
 
         // The first 16 sectors are reserved for system use (write 0s).
         char tmp[ISO_SECTOR_SIZE];
         memset(tmp,0,ISO_SECTOR_SIZE);
         for (unsigned int i = 0; i < 16; i++)
-            out_stream.write(tmp,ISO_SECTOR_SIZE);
+            tap.write(tmp,ISO_SECTOR_SIZE);
 
-        progress.set_status(ckT("%s"),StringTable::instance().get_string(StringTable::STATUS_BUILDTREE));
+        progress.set_status(ckT("%s"),file_sys_.get_string_table().get_string(StringTable::STATUS_BUILDTREE));
         progress.set_marquee(true);
 
         try
         {
             // Create a file tree.
+            stats_.begin_phase(WriteStats::PHASE_TREE,out_sec_stream.get_sector());
             if (!file_tree_.create_from_file_set(file_sys_.files()))
             {
                 log_.print_line(ckT("error: failed to build file tree."));
                 return RESULT_FAIL;
             }
 
+            stats_.file_count_ = file_tree_.get_file_count();
+            stats_.dir_count_ = file_tree_.get_dir_count();
+            stats_.stat_count_ = file_tree_.get_stat_count();
+            stats_.add_cpu_time(file_tree_.get_stat_cpu_time());
+
             // Calculate padding if DVD-Video file system.
             if (file_sys_.is_dvdvideo())
             {
+                stats_.begin_phase(WriteStats::PHASE_DVDVIDEO,out_sec_stream.get_sector());
                 DvdVideo dvd_video(log_);
                 if (!dvd_video.calc_file_padding(file_tree_))
                 {
                     progress.notify(ckcore::Progress::ckERROR,
-                                    StringTable::instance().get_string(StringTable::ERROR_DVDVIDEO));
+                                    file_sys_.get_string_table().get_string(StringTable::ERROR_DVDVIDEO));
 
                     // Restore progress.
                     progress.set_marquee(false);
@@ -473,10 +923,13 @@ namespace ckfilesystem
             bool is_joliet = file_sys_.is_joliet();
 
             SectorManager sec_manager(16 + sec_offset);
+            if (!file_sys_.is_dvdvideo())
+                sec_manager.set_data_alignment(data_align_boundary_,data_align_min_size_);
             IsoWriter iso_writer(log_,out_sec_stream,sec_manager,file_sys_,true,is_joliet);
             UdfWriter udf_writer(log_,out_sec_stream,sec_manager,file_sys_,true);
 
             // FIXME: Put failure messages to Progress.
+            stats_.begin_phase(WriteStats::PHASE_ALLOC,out_sec_stream.get_sector());
             if (is_iso)
                 iso_writer.alloc_header();
 
@@ -490,9 +943,11 @@ namespace ckfilesystem
             if (is_iso)
             {
                 // Make proper names.
+                stats_.begin_phase(WriteStats::PHASE_NAMES,out_sec_stream.get_sector());
                 iso_writer.calc_names(file_tree_);
 
                 // Populate and sort path tables.
+                stats_.begin_phase(WriteStats::PHASE_PATH_TABLES,out_sec_stream.get_sector());
                 iso_path_table_populate(pt_iso,file_tree_,file_sys_,progress);
                 iso_path_table_sort(pt_iso,false,file_sys_.is_dvdvideo());
 
@@ -502,6 +957,7 @@ namespace ckfilesystem
                     iso_path_table_sort(pt_jol,true,file_sys_.is_dvdvideo());
                 }
 
+                stats_.begin_phase(WriteStats::PHASE_ALLOC,out_sec_stream.get_sector());
                 iso_writer.alloc_path_tables(pt_iso,pt_jol,progress);
                 iso_writer.alloc_dir_entries(file_tree_);
             }
@@ -510,12 +966,21 @@ namespace ckfilesystem
             ckcore::tuint64 first_data_sec = sec_manager.get_next_free();
             ckcore::tuint64 last_data_sec = 0;
 
-            calc_filesys_data(file_tree_,progress,first_data_sec,last_data_sec);
+            std::vector<FileTreeNode *> file_nodes;
+            stats_.begin_phase(WriteStats::PHASE_ALLOC_DATA,out_sec_stream.get_sector());
+            calc_filesys_data(file_tree_,progress,sec_manager,first_data_sec,last_data_sec,file_nodes);
+            if (sec_manager.get_data_alignment() > 1)
+                print_data_alignment(file_tree_);
 
             sec_manager.alloc_data_sectors(last_data_sec - first_data_sec);
+            tap.set_data_area(sec_manager.get_data_start(),sec_manager.get_data_length());
+
+            // All names have been made, the tree does not grow any more.
+            stats_.tree_mem_usage_ = file_tree_.get_mem_usage();
 
             int res = RESULT_FAIL;
 
+            stats_.begin_phase(WriteStats::PHASE_HEADER,out_sec_stream.get_sector());
             if (is_iso)
                 iso_writer.write_header(file_sys_.files(),file_tree_);
 
@@ -523,13 +988,18 @@ namespace ckfilesystem
                 udf_writer.write_header();
 
             if (is_udf)
+            {
+                stats_.begin_phase(WriteStats::PHASE_UDF_PARTITION,out_sec_stream.get_sector());
                 udf_writer.write_partition(file_tree_);
+            }
 
             // FIXME: Add progress for this.
             if (is_iso)
             {
+                stats_.begin_phase(WriteStats::PHASE_WRITE_PATH_TABLES,out_sec_stream.get_sector());
                 iso_writer.write_path_tables(pt_iso,pt_jol,file_tree_,progress);
 
+                stats_.begin_phase(WriteStats::PHASE_DIR_ENTRIES,out_sec_stream.get_sector());
                 res = iso_writer.write_dir_entries(file_tree_,progress);
                 if (res != RESULT_OK)
                 {
@@ -541,19 +1011,42 @@ namespace ckfilesystem
                 }
             }
 
-            progress.set_status(ckT("%s"),StringTable::instance().get_string(StringTable::STATUS_WRITEDATA));
+            progress.set_status(ckT("%s"),file_sys_.get_string_table().get_string(StringTable::STATUS_WRITEDATA));
             progress.set_marquee(false);
 
             // To help keep track of the progress.
             ckcore::Progresser progresser(progress,sec_manager.get_data_length() * ISO_SECTOR_SIZE);
-            write_file_data(out_sec_stream,file_tree_,progresser);
+            stats_.begin_phase(WriteStats::PHASE_DATA,out_sec_stream.get_sector());
+            write_file_data(out_sec_stream,extent_stream,file_nodes,progresser);
             if (progresser.cancelled())
                 return RESULT_CANCEL;
 
+            if (image_stream != NULL && extent_stream != NULL)
+            {
+#ifdef _WINDOWS
+                log_.print_line(ckT("  cloned %I64u bytes, copied %I64u bytes in kernel and %I64u bytes through memory."),
+#else
+                log_.print_line(ckT("  cloned %llu bytes, copied %llu bytes in kernel and %llu bytes through memory."),
+#endif
+                    image_stream->get_cloned_bytes(),image_stream->get_copied_bytes(),
+                    image_stream->get_buffered_bytes());
+            }
+
             if (is_udf)
+            {
+                stats_.begin_phase(WriteStats::PHASE_UDF_TAIL,out_sec_stream.get_sector());
                 udf_writer.write_tail();
+            }
 
             out_buf_stream.flush();
+            if (image_stream != NULL)
+                image_stream->flush();
+
+            // Report any problems found by the verifiers.
+            tap.finish();
+            stats_.add_cpu_time(tap.get_cpu_time());
+            stats_.end_phase(out_sec_stream.get_sector());
+            stats_.print(log_);
 #ifdef _DEBUG
             file_tree_.print_tree();
 #endif
@@ -561,7 +1054,7 @@ namespace ckfilesystem
         catch (FileOpenException &e)
         {
             progress.notify(ckcore::Progress::ckERROR,
-                            StringTable::instance().get_string(StringTable::ERROR_OPENREAD),
+                            file_sys_.get_string_table().get_string(StringTable::ERROR_OPENREAD),
                             e.file_path().c_str());
 
             // Restore progress.
@@ -593,4 +1086,40 @@ namespace ckfilesystem
         create_file_path_map(file_tree_,file_path_map,file_sys_.is_joliet());
         return RESULT_OK;
     }
+
+    int FileSystemWriter::layout_map(LayoutMap &layout_map)
+    {
+        layout_map.clear();
+        layout_map.set_sec_offset(sec_offset_);
+
+        std::vector<FileTreeNode *> dir_node_stack;
+        dir_node_stack.push_back(file_tree_.get_root());
+
+        while (dir_node_stack.size() > 0)
+        {
+            FileTreeNode *cur_node = dir_node_stack.back();
+            dir_node_stack.pop_back();
+
+            std::vector<FileTreeNode *>::const_iterator it_file;
+            for (it_file = cur_node->children_.begin(); it_file !=
+                cur_node->children_.end(); it_file++)
+            {
+                if ((*it_file)->file_flags_ & FileTreeNode::FLAG_DIRECTORY)
+                {
+                    dir_node_stack.push_back(*it_file);
+                }
+                else if (!((*it_file)->file_flags_ & (FileTreeNode::FLAG_IMPORTED | FileTreeNode::FLAG_EMBEDDED)) &&
+                         (*it_file)->data_pos_normal_ != 0 && (*it_file)->stat_.valid())
+                {
+                    ckcore::tstring internal_path;
+                    get_internal_path(*it_file,internal_path,false,false);
+
+                    layout_map.add(internal_path,(*it_file)->data_pos_normal_,
+                                   (*it_file)->file_size_,(*it_file)->stat_.modify_time_);
+                }
+            }
+        }
+
+        return RESULT_OK;
+    }
 };
@@ -17,12 +17,19 @@
  */
 
 #include <cassert>
+#include "ckfilesystem/threadpool.hh"
+#include "ckfilesystem/trace.hh"
 #include "ckfilesystem/filetree.hh"
 
+// The number of nodes processed by each meta data snapshot task.
+#define FILETREE_STAT_CHUNK_SIZE        256
+
 namespace ckfilesystem
 {
     FileTree::FileTree(ckcore::Log &log) :
-        log_(log),root_node_(NULL),dir_count_(0),file_count_(0)
+        log_(log),root_node_(NULL),dir_count_(0),file_count_(0),
+        stat_thread_count_(0),check_readable_(false),executor_(NULL),max_concurrency_(0),
+        stat_count_(0),stat_cpu_time_(0)
     {
     }
 
@@ -116,27 +123,145 @@ namespace ckfilesystem
                 file.external_path_.c_str(),true,0,import_flag,import_data_ptr));
 
             file_count_++;
+
+            // The size of generated data is known up front, there is nothing
+            // on the hard drive to take a snapshot of.
+            if (file.data_source_ != NULL)
+            {
+                FileTreeNode *node = cur_node->children_.back();
+                node->data_source_ = file.data_source_;
+                file.data_source_->stat(node->stat_);
+
+                ckcore::tint64 size = file.data_source_->size();
+                node->file_size_ = size > 0 ? size : 0;
+                return true;
+            }
         }
 
+        if (!import_flag)
+            stat_nodes_.push_back(cur_node->children_.back());
+
         return true;
     }
 
+    /**
+     * @brief Task taking the meta data snapshots of a range of nodes.
+     */
+    class FileTree::StatTask : public Executor::Task
+    {
+    private:
+        FileTreeNode **begin_;
+        FileTreeNode **end_;
+        bool check_readable_;
+
+    public:
+        FileTreeNode *failed_node_;
+        ckcore::tuint64 stat_count_;
+
+        StatTask(FileTreeNode **begin,FileTreeNode **end,bool check_readable) :
+            begin_(begin),end_(end),check_readable_(check_readable),
+            failed_node_(NULL),stat_count_(0)
+        {
+        }
+
+        void run()
+        {
+            CKFS_TRACE_SCOPE("tree","stat_task");
+
+            for (FileTreeNode **it = begin_; it != end_; it++)
+            {
+                FileTreeNode *node = *it;
+
+                // Files that can't be read are normally reported when their
+                // data is opened.
+                bool is_file = !(node->file_flags_ & FileTreeNode::FLAG_DIRECTORY);
+                if (node->stat_.read(node->file_path_.c_str(),is_file && check_readable_,
+                                     &stat_count_))
+                {
+                    if (is_file)
+                        node->file_size_ = node->stat_.size_;
+                }
+                else if (is_file && failed_node_ == NULL)
+                {
+                    failed_node_ = node;
+                }
+            }
+        }
+    };
+
+    /**
+     * Takes the meta data snapshots of all nodes added since the last call,
+     * possibly using multiple threads. If no executor has been set a private
+     * thread pool is used. Directories without a snapshot use the image
+     * creation time.
+     * @throw FileOpenException If a file could not be accessed.
+     */
+    void FileTree::stat_nodes()
+    {
+        CKFS_TRACE_SCOPE("tree","stat_nodes");
+
+        std::vector<StatTask> tasks;
+        tasks.reserve(stat_nodes_.size() / FILETREE_STAT_CHUNK_SIZE + 1);
+
+        for (size_t i = 0; i < stat_nodes_.size(); i += FILETREE_STAT_CHUNK_SIZE)
+        {
+            size_t end = i + FILETREE_STAT_CHUNK_SIZE;
+            if (end > stat_nodes_.size())
+                end = stat_nodes_.size();
+
+            tasks.push_back(StatTask(&stat_nodes_[0] + i,&stat_nodes_[0] + end,check_readable_));
+        }
+
+        ckcore::tuint32 thread_count = executor_ != NULL ? 0 : stat_thread_count_;
+        if (thread_count > tasks.size())
+            thread_count = static_cast<ckcore::tuint32>(tasks.size());
+
+        // No point in starting a single worker thread.
+        ThreadPool pool(thread_count > 1 ? thread_count : 0);
+        TaskGroup group(executor_ != NULL ? *executor_ : pool,max_concurrency_);
+        for (size_t i = 0; i < tasks.size(); i++)
+            group.submit(&tasks[i]);
+
+        group.wait();
+        stat_nodes_.clear();
+
+        // Time of the calling thread is measured by the caller.
+        stat_cpu_time_ += group.get_cpu_time();
+
+        for (size_t i = 0; i < tasks.size(); i++)
+            stat_count_ += tasks[i].stat_count_;
+
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            if (tasks[i].failed_node_ != NULL)
+                throw FileOpenException(tasks[i].failed_node_->file_path_);
+        }
+    }
+
     bool FileTree::create_from_file_set(const FileSet &files)
     {
+        CKFS_TRACE_SCOPE("tree","create_from_file_set");
+
         if (root_node_ != NULL)
             delete root_node_;
 
         root_node_ = new FileTreeNode(NULL,ckT(""),ckT(""),true,0,
                                       FileTreeNode::FLAG_DIRECTORY);
+        stat_count_ = 0;
+        stat_cpu_time_ = 0;
 
         FileSet::const_iterator it;
         for (it = files.begin(); it != files.end(); it++)
         {
             ckfilesystem::FileDescriptor * fd = *it;
             if (!add_file_from_path(*fd))
+            {
+                stat_nodes_.clear();
                 return false;
+            }
         }
 
+        stat_nodes();
         return true;
     }
 
@@ -192,6 +317,38 @@ namespace ckfilesystem
         return file_count_;
     }
 
+    /**
+     * Estimates the heap memory used by the tree, including the names and
+     * identifiers of all nodes.
+     * @return The estimated memory usage in bytes.
+     */
+    ckcore::tuint64 FileTree::get_mem_usage()
+    {
+        ckcore::tuint64 mem_usage = 0;
+
+        std::vector<FileTreeNode *> node_stack;
+        if (root_node_ != NULL)
+            node_stack.push_back(root_node_);
+
+        while (node_stack.size() > 0)
+        {
+            FileTreeNode *cur_node = node_stack.back();
+            node_stack.pop_back();
+
+            mem_usage += sizeof(FileTreeNode) +
+                cur_node->children_.capacity() * sizeof(FileTreeNode *) +
+                (cur_node->file_name_.capacity() + cur_node->file_path_.capacity()) * sizeof(ckcore::tchar) +
+                cur_node->file_name_iso_.capacity() +
+                cur_node->file_name_joliet_.capacity() * sizeof(wchar_t) +
+                cur_node->file_ident_joliet_.capacity() +
+                cur_node->file_ident_udf_.capacity();
+
+            node_stack.insert(node_stack.end(),cur_node->children_.begin(),cur_node->children_.end());
+        }
+
+        return mem_usage;
+    }
+
 #ifdef _DEBUG
     void FileTree::print_local_tree(std::vector<std::pair<FileTreeNode *,int> > &dir_node_stack,
                                     FileTreeNode *local_node,int indent)
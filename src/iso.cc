@@ -26,6 +26,7 @@
 #endif
 #include <string.h>
 #include "ckfilesystem/util.hh"
+#include "ckfilesystem/charclass.hh"
 #include "ckfilesystem/iso.hh"
 
 namespace ckfilesystem
@@ -102,12 +103,24 @@ namespace ckfilesystem
 
     void iso_memcpy_a(unsigned char *dst, const char *src, size_t size, CharacterSet char_set)
     {
+        if (char_set == CHARSET_ISO)
+        {
+            charclass::make_valid(charclass::CHARCLASS_A_SAFE, dst, src, size);
+            return;
+        }
+
         for (size_t i = 0; i < size; i++)
             dst[i] = iso_make_char_a(src[i], char_set);
     }
 
     void iso_memcpy_d(unsigned char *dst, const char *src, size_t size, CharacterSet char_set)
     {
+        if (char_set == CHARSET_ISO)
+        {
+            charclass::make_valid(charclass::CHARCLASS_D, dst, src, size);
+            return;
+        }
+
         for (size_t i = 0; i < size; i++)
             dst[i] = iso_make_char_d(src[i], char_set);
     }
@@ -143,8 +156,7 @@ namespace ckfilesystem
         if (ext_delim == -1)
         {
             size_t max = file_name_len < 8 ? file_name_len : 8;
-            for (size_t i = 0; i < max; i++)
-                buffer[i] = iso_make_char_d(ansi_file_name[i], char_set);
+            iso_memcpy_d(buffer, ansi_file_name, max, char_set);
             
             len = (unsigned char)max;
             buffer[max] = '\0';
@@ -156,14 +168,12 @@ namespace ckfilesystem
                 ext_len = 3;
 
             size_t max = ext_delim < 8 ? ext_delim : 8;
-            for (size_t i = 0; i < max; i++)
-                buffer[i] = iso_make_char_d(ansi_file_name[i], char_set);
+            iso_memcpy_d(buffer, ansi_file_name, max, char_set);
 
             buffer[max] = '.';
 
             // Copy the extension.
-            for (size_t i = max + 1; i < max + ext_len + 1; i++)
-                buffer[i] = iso_make_char_d(ansi_file_name[++ext_delim], char_set);
+            iso_memcpy_d(buffer + max + 1, ansi_file_name + ext_delim + 1, ext_len, char_set);
 
             len = (unsigned char)max + (unsigned char)ext_len + 1;
             buffer[len] = '\0';
@@ -203,8 +213,7 @@ namespace ckfilesystem
         if (ext_delim == -1)
         {
             size_t max = file_name_len < max_len ? file_name_len : max_len;
-            for (size_t i = 0; i < max; i++)
-                buffer[i] = iso_make_char_d(ansi_file_name[i], char_set);
+            iso_memcpy_d(buffer, ansi_file_name, max, char_set);
             
             len = (unsigned char)max;
             buffer[max] = '\0';
@@ -216,14 +225,12 @@ namespace ckfilesystem
                 ext_len = max_len - 1;
 
             size_t max = ext_delim < (max_len - ext_len) ? ext_delim : (max_len - 1 - ext_len);
-            for (size_t i = 0; i < max; i++)
-                buffer[i] = iso_make_char_d(ansi_file_name[i], char_set);
+            iso_memcpy_d(buffer, ansi_file_name, max, char_set);
 
             buffer[max] = '.';
 
             // Copy the extension.
-            for (size_t i = max + 1; i < max + ext_len + 1; i++)
-                buffer[i] = iso_make_char_d(ansi_file_name[++ext_delim], char_set);
+            iso_memcpy_d(buffer + max + 1, ansi_file_name + ext_delim + 1, ext_len, char_set);
 
             len = (unsigned char)max + (unsigned char)ext_len + 1;
             buffer[len] = '\0';
@@ -249,8 +256,7 @@ namespace ckfilesystem
         char *ansi_dir_name = (char *)dir_name;
     #endif
 
-        for (size_t i = 0; i < (size_t)max; i++)
-            buffer[i] = iso_make_char_d(ansi_dir_name[i], char_set);
+        iso_memcpy_d(buffer, ansi_dir_name, max, char_set);
             
         buffer[max] = '\0';
 
@@ -286,8 +292,7 @@ namespace ckfilesystem
         char *ansi_dir_name = (char *)dir_name;
     #endif
 
-        for (size_t i = 0; i < (size_t)max; i++)
-            buffer[i] = iso_make_char_d(ansi_dir_name[i], char_set);
+        iso_memcpy_d(buffer, ansi_dir_name, max, char_set);
             
         buffer[max] = '\0';
 
@@ -437,6 +442,21 @@ namespace ckfilesystem
         time |= (iso_time.sec & 0x1f) >> 1;
     }
 
+    /**
+     * Checks if a supplementary volume descriptor describes a Joliet file
+     * system. Joliet descriptors announce UCS-2 level 1, 2 or 3 using the
+     * escape sequences %/@, %/C or %/E.
+     * @param [in] voldesc_suppl The supplementary volume descriptor.
+     * @return If the descriptor is a Joliet descriptor true is returned,
+     *         otherwise false.
+     */
+    bool iso_is_joliet(const tiso_voldesc_suppl &voldesc_suppl)
+    {
+        return voldesc_suppl.esc_sec[0] == 0x25 && voldesc_suppl.esc_sec[1] == 0x2f &&
+               (voldesc_suppl.esc_sec[2] == 0x40 || voldesc_suppl.esc_sec[2] == 0x43 ||
+                voldesc_suppl.esc_sec[2] == 0x45);
+    }
+
     Iso::Iso()
         : relax_max_dir_level_(false)
         , inc_file_ver_info_(true)
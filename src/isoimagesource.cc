@@ -0,0 +1,243 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <ckcore/filestream.hh>
+#include "ckfilesystem/iso.hh"
+#include "ckfilesystem/isoreader.hh"
+#include "ckfilesystem/util.hh"
+#include "ckfilesystem/isoimagesource.hh"
+
+namespace ckfilesystem
+{
+    using namespace util;
+
+    /**
+     * @brief Data source reading the data of a file in an ISO9660 image.
+     */
+    class IsoExtentDataSource : public FileRangeDataSource
+    {
+    private:
+        FileStat stat_;
+
+    public:
+        /**
+         * Constructs an IsoExtentDataSource object.
+         * @param [in] image_path The path of the image file.
+         * @param [in] node The first directory record of the file.
+         * @param [in] size The size of the file data in bytes, larger than
+         *                  the extent length if the file has multiple
+         *                  extents.
+         */
+        IsoExtentDataSource(const ckcore::tchar *image_path,const IsoTree::Node &node,
+                            ckcore::tuint64 size) :
+            FileRangeDataSource(image_path,
+                                static_cast<ckcore::tuint64>(node.extent_loc_) * ISO_SECTOR_SIZE,size)
+        {
+            // A zero month means that the time has not been recorded.
+            const tiso_dir_record_datetime &rec_time = node.rec_timestamp_;
+            if (rec_time.mon == 0)
+                return;
+
+            struct tm time;
+            memset(&time,0,sizeof(struct tm));
+            time.tm_year = rec_time.year;
+            time.tm_mon = rec_time.mon - 1;
+            time.tm_mday = rec_time.day;
+            time.tm_hour = rec_time.hour;
+            time.tm_min = rec_time.min;
+            time.tm_sec = rec_time.sec;
+
+            // The zone is the offset from GMT in 15 minute intervals.
+            ckcore::tint64 seconds = make_time(time) -
+                static_cast<signed char>(rec_time.zone) * 15 * 60;
+
+            stat_.size_ = size;
+            stat_.access_time_ = seconds;
+            stat_.modify_time_ = seconds;
+            stat_.create_time_ = seconds;
+            stat_.flags_ = FileStat::FLAG_VALID;
+
+            if (node.file_flags_ & DIRRECORD_FILEFLAG_HIDDEN)
+                stat_.flags_ |= FileStat::FLAG_HIDDEN;
+        }
+
+        bool stat(FileStat &stat)
+        {
+            if (!stat_.valid())
+                return false;
+
+            stat = stat_;
+            return true;
+        }
+    };
+
+    /**
+     * Constructs an IsoImageSource object.
+     * @param [in] log The log used for reporting errors.
+     * @param [in] image_path The path of the ISO9660 image file.
+     */
+    IsoImageSource::IsoImageSource(ckcore::Log &log,const ckcore::tchar *image_path) :
+        log_(log),image_path_(image_path)
+    {
+    }
+
+    IsoImageSource::~IsoImageSource()
+    {
+        std::vector<DataSource *>::iterator it;
+        for (it = data_sources_.begin(); it != data_sources_.end(); it++)
+            delete *it;
+
+        data_sources_.clear();
+    }
+
+    /**
+     * Adds the directories and files of the image to a file set. Files
+     * already in the set take precedence, a file of the image can therefore
+     * be replaced or removed by inserting a descriptor of the new file
+     * before calling this function, or by erasing the descriptor from the
+     * set afterwards. The added descriptors are owned by the file set.
+     * @param [in] file_set The file set to add the files to.
+     * @param [in] internal_path The directory in the new image which the
+     *                           root directory of the image is mapped to.
+     * @return If successful true is returned, otherwise false. Adding fails
+     *         if the data of any file lies outside of the image.
+     */
+    bool IsoImageSource::add_files(FileSet &file_set,const ckcore::tchar *internal_path)
+    {
+        IsoReader reader(log_);
+
+        ckcore::FileInStream in_stream(image_path_.c_str());
+        if (!in_stream.open())
+        {
+            log_.print_line(ckT("  Error: Unable to open image file \"%s\"."),image_path_.c_str());
+            return false;
+        }
+
+        if (!reader.read(in_stream,0))
+            return false;
+
+        ckcore::tint64 image_size = in_stream.size();
+        in_stream.close();
+
+        if (image_size < 0)
+        {
+            log_.print_line(ckT("  Error: Unable to obtain the size of image file \"%s\"."),
+                            image_path_.c_str());
+            return false;
+        }
+
+        const IsoTree &tree = reader.get_tree();
+        if (tree.empty())
+            return true;
+
+        // Walk the tree in depth first order, see IsoTree::make_file_set().
+        ckcore::tstring path = internal_path;
+        std::vector<std::pair<ckcore::tuint32,size_t> > dir_node_stack;
+        dir_node_stack.push_back(std::make_pair(tree.node(IsoTree::ROOT_INDEX).first_child_,path.size()));
+
+        while (dir_node_stack.size() > 0)
+        {
+            const ckcore::tuint32 i = dir_node_stack.back().first;
+            const size_t dir_path_len = dir_node_stack.back().second;
+            if (i == IsoTree::INVALID_INDEX)
+            {
+                dir_node_stack.pop_back();
+                continue;
+            }
+
+            const IsoTree::Node &node = tree.node(i);
+            dir_node_stack.back().first = node.next_sibling_;
+
+            path.resize(dir_path_len);
+            path.push_back('/');
+            path.append(tree.name(i),node.name_len_);
+
+            if (tree.is_dir(i))
+            {
+                FileDescriptor *file = new FileDescriptor(path.c_str(),ckT(""),
+                                                          FileDescriptor::FLAG_DIRECTORY);
+                if (!file_set.insert(file).second)
+                    delete file;
+
+                dir_node_stack.push_back(std::make_pair(node.first_child_,path.size()));
+                continue;
+            }
+
+            // ISO9660 names without an extension end with a separator, Joliet
+            // names are kept as they are.
+            if (!reader.is_joliet() && path[path.size() - 1] == '.')
+                path.resize(path.size() - 1);
+
+            // Files of 4 GiB and larger are recorded using one directory
+            // record per extent, all but the last one flagged as multi-extent.
+            // The data is only read as one range if the extents follow each
+            // other.
+            ckcore::tuint64 size = node.extent_len_;
+            ckcore::tuint32 last = i;
+            while (tree.node(last).file_flags_ & DIRRECORD_FILEFLAG_MULTIEXTENT)
+            {
+                const IsoTree::Node &prev = tree.node(last);
+                if (prev.next_sibling_ == IsoTree::INVALID_INDEX)
+                {
+                    log_.print_line(ckT("  Error: Missing final extent of \"%s\"."),path.c_str());
+                    return false;
+                }
+
+                const IsoTree::Node &next = tree.node(prev.next_sibling_);
+                if (prev.extent_len_ % ISO_SECTOR_SIZE != 0 ||
+                    next.extent_loc_ != prev.extent_loc_ + bytes_to_sec(prev.extent_len_))
+                {
+                    log_.print_line(ckT("  Error: The extents of \"%s\" are not contiguous."),
+                                    path.c_str());
+                    return false;
+                }
+
+                size += next.extent_len_;
+                last = prev.next_sibling_;
+            }
+
+            dir_node_stack.back().first = tree.node(last).next_sibling_;
+
+            // The data must be within the image, it is not read until the new
+            // image is written.
+            ckcore::tuint64 data_end = static_cast<ckcore::tuint64>(node.extent_loc_) * ISO_SECTOR_SIZE + size;
+            if (size > 0 && data_end > static_cast<ckcore::tuint64>(image_size))
+            {
+                log_.print_line(ckT("  Error: The data of \"%s\" extends beyond the end of the image."),
+                                path.c_str());
+                return false;
+            }
+
+            IsoExtentDataSource *data_source =
+                new IsoExtentDataSource(image_path_.c_str(),node,size);
+
+            FileDescriptor *file = new FileDescriptor(path.c_str(),data_source);
+            if (!file_set.insert(file).second)
+            {
+                delete file;
+                delete data_source;
+                continue;
+            }
+
+            data_sources_.push_back(data_source);
+        }
+
+        return true;
+    }
+};
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <algorithm>
 #include "ckfilesystem/stringtable.hh"
+#include "ckfilesystem/trace.hh"
 
 namespace ckfilesystem
 {
@@ -55,6 +56,8 @@ namespace ckfilesystem
                                  FileSystem &file_sys,
                                  ckcore::Progress &progress)
     {
+        CKFS_TRACE_SCOPE("iso","path_table_populate");
+
         std::vector<FileTreeNode *> node_stack;
         iso_path_table_populate_locally(node_stack, pt, tree.get_root());
 
@@ -78,14 +81,14 @@ namespace ckfilesystem
                     //log_.print_line(ckT("  Warning: The directory structure is deeper than %d levels. Deep files and folders will be ignored."),
                     //             file_sys_.iso_.get_max_dir_level());
                     progress.notify(ckcore::Progress::ckWARNING,
-                                    StringTable::instance().get_string(StringTable::WARNING_FSDIRLEVEL),
+                                    file_sys.get_string_table().get_string(StringTable::WARNING_FSDIRLEVEL),
                                     file_sys.get_max_dir_level());
                     found_deep = true;
                 }
 
                 //log_.print_line(ckT("  Skipping: %s."),cur_node->file_path_.c_str());
                 progress.notify(ckcore::Progress::ckWARNING,
-                                StringTable::instance().get_string(StringTable::WARNING_SKIPFILE),
+                                file_sys.get_string_table().get_string(StringTable::WARNING_SKIPFILE),
                                 node->file_path_.c_str());
                 continue;
             }
@@ -287,6 +290,8 @@ namespace ckfilesystem
 
     void iso_path_table_sort(IsoPathTable &pt, bool joliet, bool dvdvideo)
     {
+        CKFS_TRACE_SCOPE("iso","path_table_sort");
+
         // First, sort everything by level.
         std::sort(pt.begin(), pt.end(), level_predicate);
 
@@ -26,7 +26,7 @@ namespace ckfilesystem
     using namespace util;
 
     IsoReader::IsoReader(ckcore::Log &log) :
-        log_(log),root_node_(NULL)
+        log_(log),root_node_(NULL),joliet_(false)
     {
     }
 
@@ -39,15 +39,76 @@ namespace ckfilesystem
         }
     }
 
+    /**
+     * Creates a pointer based copy of the imported tree.
+     * @return The root of the new tree, or NULL if no tree has been read.
+     */
+    IsoTreeNode *IsoReader::make_node_tree() const
+    {
+        if (tree_.empty())
+            return NULL;
+
+        const IsoTree::Node &root = tree_.node(IsoTree::ROOT_INDEX);
+        tiso_dir_record_datetime rec_timestamp = root.rec_timestamp_;
+
+        IsoTreeNode *root_node = new IsoTreeNode(NULL,NULL,root.extent_loc_,root.extent_len_,
+            root.volseq_num_,root.file_flags_,root.file_unit_size_,
+            root.interleave_gap_size_,rec_timestamp);
+
+        std::vector<std::pair<ckcore::tuint32,IsoTreeNode *> > dir_node_stack;
+        dir_node_stack.push_back(std::make_pair(IsoTree::ROOT_INDEX,root_node));
+
+        while (dir_node_stack.size() > 0)
+        {
+            ckcore::tuint32 parent_index = dir_node_stack.back().first;
+            IsoTreeNode *parent_node = dir_node_stack.back().second;
+            dir_node_stack.pop_back();
+
+            for (ckcore::tuint32 i = tree_.node(parent_index).first_child_;
+                 i != IsoTree::INVALID_INDEX; i = tree_.node(i).next_sibling_)
+            {
+                const IsoTree::Node &node = tree_.node(i);
+                rec_timestamp = node.rec_timestamp_;
+
+                IsoTreeNode *new_node = new IsoTreeNode(parent_node,tree_.name(i),
+                    node.extent_loc_,node.extent_len_,node.volseq_num_,node.file_flags_,
+                    node.file_unit_size_,node.interleave_gap_size_,rec_timestamp);
+                parent_node->children_.push_back(new_node);
+
+                if (tree_.is_dir(i))
+                    dir_node_stack.push_back(std::make_pair(i,new_node));
+            }
+        }
+
+        return root_node;
+    }
+
+    /**
+     * Returns the root of a pointer based copy of the imported tree. The copy
+     * is created the first time this function is called after reading.
+     * @return The root node, or NULL if no tree has been read.
+     */
+    IsoTreeNode *IsoReader::get_root()
+    {
+        if (root_node_ == NULL)
+            root_node_ = make_node_tree();
+
+        return root_node_;
+    }
+
     /**
         Reads an entire directory entry.
      */
     bool IsoReader::read_dir_entry(ckcore::InStream &in_stream,
-                                   std::vector<IsoTreeNode *> &dir_entries,
-                                   IsoTreeNode *parent_node,bool joliet)
+                                   std::vector<ckcore::tuint32> &dir_entries,
+                                   ckcore::tuint32 parent_index,bool joliet)
     {
+        // Copy the parent extent, adding nodes may relocate the tree storage.
+        const ckcore::tuint32 parent_extent_loc = tree_.node(parent_index).extent_loc_;
+        const ckcore::tuint32 parent_extent_len = tree_.node(parent_index).extent_len_;
+
         // Search to the extent location.
-        in_stream.seek(parent_node->extent_loc_ * ISO_SECTOR_SIZE,ckcore::InStream::ckSTREAM_BEGIN);
+        in_stream.seek(parent_extent_loc * ISO_SECTOR_SIZE,ckcore::InStream::ckSTREAM_BEGIN);
 
         unsigned char file_name_buf[ISOWRITER_FILENAME_BUFFER_SIZE];
         ckcore::tchar file_name[(ISOWRITER_FILENAME_BUFFER_SIZE / sizeof(ckcore::tchar)) + 1];
@@ -78,10 +139,10 @@ namespace ckfilesystem
         tiso_dir_record dr;
 
         // Read all other records.
-        while (read < parent_node->extent_len_)
+        while (read < parent_extent_len)
         {
             // Check if we can read further.
-            if (read + sizeof(tiso_dir_record) > parent_node->extent_len_)
+            if (read + sizeof(tiso_dir_record) > parent_extent_len)
                 break;
 
             ckcore::tuint32 dir_rec_processed = 0;
@@ -163,15 +224,13 @@ namespace ckfilesystem
 
             //log_.print_line(ckT("  %s: %u"),file_name,read733(dr.extent_loc));
 
-            IsoTreeNode *new_node = new IsoTreeNode(parent_node,file_name,
+            ckcore::tuint32 new_index = tree_.add_node(parent_index,file_name,
                     read733(dr.extent_loc),read733(dr.data_len),
                     read723(dr.volseq_num),dr.file_flags,
                     dr.file_unit_size,dr.interleave_gap_size,dr.rec_timestamp);
 
             if (dr.file_flags & DIRRECORD_FILEFLAG_DIRECTORY)
-                dir_entries.push_back(new_node);
-
-            parent_node->children_.push_back(new_node);
+                dir_entries.push_back(new_index);
 
             // Skip any extra data.
             if (dr.dir_record_len - dir_rec_processed > 0)
@@ -186,24 +245,11 @@ namespace ckfilesystem
             in_stream.seek(dr.ext_attr_record_len,ckcore::InStream::ckSTREAM_CURRENT);
             read += dr.ext_attr_record_len;
 
-            // Ignore any zeroes.
-            unsigned char next_byte;
-            processed = in_stream.read(&next_byte,1);
-            if (processed == -1)
+            // Ignore any zeroes. Stop at the end of the extent, the data
+            // following it may be zeroes as well.
+            while (read < parent_extent_len)
             {
-                log_.print_line(ckT("Error: Unable to read through zeroes."));
-                return false;
-            }
-            if (processed != 1)
-            {
-                log_.print_line(ckT("Error: Unable to read through zeroes (size mismatch)."));
-                return false;
-            }
-
-            while (next_byte == 0)
-            {
-                read++;
-
+                unsigned char next_byte;
                 processed = in_stream.read(&next_byte,1);
                 if (processed == -1)
                 {
@@ -215,15 +261,30 @@ namespace ckfilesystem
                     log_.print_line(ckT("Error: Unable to read through zeroes (size mismatch)."));
                     return false;
                 }
+
+                if (next_byte != 0)
+                    break;
+
+                read++;
             }
 
-            in_stream.seek(parent_node->extent_loc_ * ISO_SECTOR_SIZE + read,ckcore::InStream::ckSTREAM_BEGIN);
+            in_stream.seek(parent_extent_loc * ISO_SECTOR_SIZE + read,ckcore::InStream::ckSTREAM_BEGIN);
         }
 
         return true;
     }
 
-    bool IsoReader::read(ckcore::InStream &in_stream,ckcore::tuint32 start_sec)
+    /**
+     * Reads the directory hierarchy of the last session in an ISO9660 file
+     * system, the Joliet hierarchy is used if present.
+     * @param [in] in_stream The stream to read from, must be seekable.
+     * @param [in] start_sec The first sector of the session.
+     * @param [in] recursive If false only the root directory is read, other
+     *                       directories can be read later using read_dir().
+     * @return If successful true is returned, otherwise false.
+     */
+    bool IsoReader::read(ckcore::InStream &in_stream,ckcore::tuint32 start_sec,
+                         bool recursive)
     {
         log_.print_line(ckT("IsoReader::Read"));
 
@@ -303,62 +364,57 @@ namespace ckfilesystem
             if (voldesc_suppl.type == VOLDESCTYPE_SUPPL_VOL_DESC)
             {
                 // Check if Joliet.
-                if (voldesc_suppl.esc_sec[0] == 0x25 &&
-                    voldesc_suppl.esc_sec[1] == 0x2f)
+                if (iso_is_joliet(voldesc_suppl))
                 {
-                    if (voldesc_suppl.esc_sec[2] == 0x45 ||
-                        voldesc_suppl.esc_sec[2] == 0x43 ||
-                        voldesc_suppl.esc_sec[2] == 0x40)
-                    {
-                        log_.print_line(ckT("  Found Joliet file system extension."));
-                        joliet = true;
-                        break;
-                    }
+                    log_.print_line(ckT("  Found Joliet file system extension."));
+                    joliet = true;
+                    break;
                 }
             }
         }
 
         // Obtain positions of interest.
-        ckcore::tuint32 root_extent_loc;
-        ckcore::tuint32 root_extent_len;
+        tiso_dir_record &root_dir_record = joliet ? voldesc_suppl.root_dir_record :
+            voldesc_prim.root_dir_record;
 
-        if (joliet)
-        {
-            root_extent_loc = read733(voldesc_suppl.root_dir_record.extent_loc);
-            root_extent_len = read733(voldesc_suppl.root_dir_record.data_len);
-        }
-        else
-        {
-            root_extent_loc = read733(voldesc_prim.root_dir_record.extent_loc);
-            root_extent_len = read733(voldesc_prim.root_dir_record.data_len);
-        }
+        joliet_ = joliet;
+
+        ckcore::tuint32 root_extent_loc = read733(root_dir_record.extent_loc);
+        ckcore::tuint32 root_extent_len = read733(root_dir_record.data_len);
 
         log_.print_line(ckT("  Location of root directory extent: %u."),root_extent_loc);
         log_.print_line(ckT("  Length of root directory extent: %u."),root_extent_len);
 
         if (root_node_ != NULL)
+        {
             delete root_node_;
+            root_node_ = NULL;
+        }
 
-        root_node_ = new IsoTreeNode(NULL,NULL,root_extent_loc,root_extent_len,
-            read723(voldesc_suppl.root_dir_record.volseq_num),voldesc_suppl.root_dir_record.file_flags,
-            voldesc_suppl.root_dir_record.file_unit_size,voldesc_suppl.root_dir_record.interleave_gap_size,
-            voldesc_suppl.root_dir_record.rec_timestamp);
+        tree_.add_root(root_extent_loc,root_extent_len,
+            read723(root_dir_record.volseq_num),root_dir_record.file_flags,
+            root_dir_record.file_unit_size,root_dir_record.interleave_gap_size,
+            root_dir_record.rec_timestamp);
 
-        std::vector<IsoTreeNode *> dir_entries;
-        if (!read_dir_entry(in_stream,dir_entries,root_node_,joliet))
+        std::vector<ckcore::tuint32> dir_entries;
+        if (!read_dir_entry(in_stream,dir_entries,IsoTree::ROOT_INDEX,joliet))
         {
             log_.print_line(ckT("  Error: Failed to read directory entry at sector: %u."),root_extent_loc);
             return false;
         }
 
+        if (!recursive)
+            return true;
+
         while (dir_entries.size() > 0)
         {
-            IsoTreeNode *parent_node = dir_entries.back();
+            ckcore::tuint32 parent_index = dir_entries.back();
             dir_entries.pop_back();
 
-            if (!read_dir_entry(in_stream,dir_entries,parent_node,joliet))
+            if (!read_dir_entry(in_stream,dir_entries,parent_index,joliet))
             {
-                log_.print_line(ckT("  Error: Failed to read directory entry at sector: %u."),parent_node->extent_loc_);
+                log_.print_line(ckT("  Error: Failed to read directory entry at sector: %u."),
+                    tree_.node(parent_index).extent_loc_);
                 return false;
             }
         }
@@ -366,51 +422,81 @@ namespace ckfilesystem
         return true;
     }
 
+    /**
+     * Reads the children of a directory that was skipped by a non-recursive
+     * call to read(). Subdirectories of the directory are not read. Calling
+     * the function for a directory that has already been read has no effect.
+     * @param [in] in_stream The stream the tree was read from.
+     * @param [in] index Index of the directory in the tree.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool IsoReader::read_dir(ckcore::InStream &in_stream,ckcore::tuint32 index)
+    {
+        if (index >= tree_.size() || !tree_.is_dir(index))
+            return false;
+
+        if (tree_.node(index).first_child_ != IsoTree::INVALID_INDEX)
+            return true;
+
+        // The pointer based copy no longer matches the tree.
+        if (root_node_ != NULL)
+        {
+            delete root_node_;
+            root_node_ = NULL;
+        }
+
+        std::vector<ckcore::tuint32> dir_entries;
+        if (!read_dir_entry(in_stream,dir_entries,index,joliet_))
+        {
+            log_.print_line(ckT("  Error: Failed to read directory entry at sector: %u."),
+                tree_.node(index).extent_loc_);
+            return false;
+        }
+
+        return true;
+    }
+
     #ifdef _DEBUG
-    void IsoReader::print_local_tree(std::vector<std::pair<IsoTreeNode *,int> > &dir_node_stack,
-                                     IsoTreeNode *local_node,int indent)
+    void IsoReader::print_local_tree(std::vector<std::pair<ckcore::tuint32,int> > &dir_node_stack,
+                                     ckcore::tuint32 local_index,int indent)
     {
-        std::vector<IsoTreeNode *>::const_iterator it_file;
-        for (it_file = local_node->children_.begin(); it_file !=
-            local_node->children_.end(); it_file++)
+        for (ckcore::tuint32 i = tree_.node(local_index).first_child_;
+             i != IsoTree::INVALID_INDEX; i = tree_.node(i).next_sibling_)
         {
-            if ((*it_file)->file_flags_ & DIRRECORD_FILEFLAG_DIRECTORY)
+            if (tree_.is_dir(i))
             {
-                dir_node_stack.push_back(std::make_pair(*it_file,indent));
+                dir_node_stack.push_back(std::make_pair(i,indent));
             }
             else
             {
-                for (int i = 0; i < indent; i++)
+                for (int j = 0; j < indent; j++)
                     log_.print(ckT(" "));
 
                 log_.print(ckT("<f>"));
-                log_.print((*it_file)->file_name_.c_str());
-                log_.print_line(ckT(" (%u:%u)"),(*it_file)->extent_loc_,(*it_file)->extent_len_);
+                log_.print(tree_.name(i));
+                log_.print_line(ckT(" (%u:%u)"),tree_.node(i).extent_loc_,tree_.node(i).extent_len_);
             }
         }
     }
 
     void IsoReader::print_tree()
     {
-        if (root_node_ == NULL)
+        if (tree_.empty())
             return;
 
-        IsoTreeNode *cur_node = root_node_;
+        ckcore::tuint32 cur_index = IsoTree::ROOT_INDEX;
         int indent = 0;
 
         log_.print_line(ckT("IsoReader::print_tree"));
-#ifdef _WINDOWS
-        log_.print_line(ckT("  <root> (%I64u:%I64u)"),cur_node->extent_loc_,cur_node->extent_len_);
-#else
-        log_.print_line(ckT("  <root> (%llu:%llu)"),cur_node->extent_loc_,cur_node->extent_len_);
-#endif
+        log_.print_line(ckT("  <root> (%u:%u)"),tree_.node(cur_index).extent_loc_,
+                        tree_.node(cur_index).extent_len_);
 
-        std::vector<std::pair<IsoTreeNode *,int> > dir_node_stack;
-        print_local_tree(dir_node_stack,cur_node,4);
+        std::vector<std::pair<ckcore::tuint32,int> > dir_node_stack;
+        print_local_tree(dir_node_stack,cur_index,4);
 
         while (dir_node_stack.size() > 0)
         { 
-            cur_node = dir_node_stack[dir_node_stack.size() - 1].first;
+            cur_index = dir_node_stack[dir_node_stack.size() - 1].first;
             indent = dir_node_stack[dir_node_stack.size() - 1].second;
 
             dir_node_stack.pop_back();
@@ -420,14 +506,11 @@ namespace ckfilesystem
                 log_.print(ckT(" "));
 
             log_.print(ckT("<d>"));
-            log_.print(cur_node->file_name_.c_str());
-#ifdef _WINDOWS
-            log_.print_line(ckT(" (%I64u:%I64u)"),cur_node->extent_loc_,cur_node->extent_len_);
-#else
-            log_.print_line(ckT(" (%llu:%llu)"),cur_node->extent_loc_,cur_node->extent_len_);
-#endif
+            log_.print(tree_.name(cur_index));
+            log_.print_line(ckT(" (%u:%u)"),tree_.node(cur_index).extent_loc_,
+                            tree_.node(cur_index).extent_len_);
 
-            print_local_tree(dir_node_stack,cur_node,indent + 2);
+            print_local_tree(dir_node_stack,cur_index,indent + 2);
         }
     }
 #endif
@@ -0,0 +1,305 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+#include <string.h>
+#include <ckcore/string.hh>
+#include "ckfilesystem/isowriter.hh"
+#include "ckfilesystem/isotree.hh"
+
+#define ISOTREE_NAME_SLOTS_MIN          256
+
+namespace ckfilesystem
+{
+    IsoTree::IsoTree() :
+        name_count_(0),tail_parent_(INVALID_INDEX),tail_child_(INVALID_INDEX)
+    {
+        clear();
+    }
+
+    /**
+     * Removes all nodes and names from the tree. Allocated storage is kept so
+     * that the tree can be reused when reading another session.
+     */
+    void IsoTree::clear()
+    {
+        nodes_.clear();
+        names_.clear();
+
+        // Offset zero is reserved for the empty name used by the root.
+        names_.push_back('\0');
+
+        name_slots_.assign(ISOTREE_NAME_SLOTS_MIN,0);
+        name_count_ = 0;
+
+        tail_parent_ = INVALID_INDEX;
+        tail_child_ = INVALID_INDEX;
+    }
+
+    /**
+     * Pre-allocates storage for the specified number of nodes and name
+     * characters.
+     * @param [in] node_count Expected number of nodes.
+     * @param [in] name_chars Expected number of name characters.
+     */
+    void IsoTree::reserve(size_t node_count,size_t name_chars)
+    {
+        nodes_.reserve(node_count);
+        names_.reserve(name_chars);
+    }
+
+    /**
+     * Calculates a FNV-1a hash of the specified name.
+     */
+    ckcore::tuint32 IsoTree::hash_name(const ckcore::tchar *name,size_t name_len)
+    {
+        ckcore::tuint32 hash = 2166136261U;
+        for (size_t i = 0; i < name_len; i++)
+        {
+            hash ^= static_cast<ckcore::tuint32>(name[i]);
+            hash *= 16777619U;
+        }
+
+        return hash;
+    }
+
+    void IsoTree::grow_name_slots()
+    {
+        std::vector<ckcore::tuint32> old_slots;
+        old_slots.swap(name_slots_);
+        name_slots_.assign(old_slots.size() << 1,0);
+
+        const size_t mask = name_slots_.size() - 1;
+
+        std::vector<ckcore::tuint32>::const_iterator it;
+        for (it = old_slots.begin(); it != old_slots.end(); it++)
+        {
+            if (*it == 0)
+                continue;
+
+            const ckcore::tchar *name = &names_[*it - 1];
+            size_t slot = hash_name(name,ckcore::string::astrlen(name)) & mask;
+            while (name_slots_[slot] != 0)
+                slot = (slot + 1) & mask;
+
+            name_slots_[slot] = *it;
+        }
+    }
+
+    /**
+     * Returns the name pool offset of the specified name, adding the name to
+     * the pool if it's not already present.
+     * @param [in] name The name to intern, does not need to be terminated.
+     * @param [in] name_len The number of characters in name.
+     * @return The offset of the null-terminated name in the name pool.
+     */
+    ckcore::tuint32 IsoTree::intern_name(const ckcore::tchar *name,size_t name_len)
+    {
+        if (name_len == 0)
+            return 0;
+
+        // Keep the load factor below 0.5.
+        if ((name_count_ + 1) << 1 > name_slots_.size())
+            grow_name_slots();
+
+        const size_t mask = name_slots_.size() - 1;
+        size_t slot = hash_name(name,name_len) & mask;
+
+        while (name_slots_[slot] != 0)
+        {
+            const ckcore::tuint32 off = name_slots_[slot] - 1;
+            if (off + name_len < names_.size() && names_[off + name_len] == '\0' &&
+                !memcmp(&names_[off],name,name_len * sizeof(ckcore::tchar)))
+            {
+                return off;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+
+        const ckcore::tuint32 off = static_cast<ckcore::tuint32>(names_.size());
+        names_.insert(names_.end(),name,name + name_len);
+        names_.push_back('\0');
+
+        name_slots_[slot] = off + 1;
+        name_count_++;
+
+        return off;
+    }
+
+    /**
+     * Creates the root node of the tree, any existing nodes are removed.
+     * @return The index of the root node.
+     */
+    ckcore::tuint32 IsoTree::add_root(ckcore::tuint32 extent_loc,ckcore::tuint32 extent_len,
+                                      ckcore::tuint16 volseq_num,unsigned char file_flags,
+                                      unsigned char file_unit_size,unsigned char interleave_gap_size,
+                                      const tiso_dir_record_datetime &rec_timestamp)
+    {
+        clear();
+
+        Node root;
+        root.parent_ = INVALID_INDEX;
+        root.first_child_ = INVALID_INDEX;
+        root.next_sibling_ = INVALID_INDEX;
+        root.name_off_ = 0;
+        root.name_len_ = 0;
+        root.extent_loc_ = extent_loc;
+        root.extent_len_ = extent_len;
+        root.volseq_num_ = volseq_num;
+        root.file_flags_ = file_flags | DIRRECORD_FILEFLAG_DIRECTORY;
+        root.file_unit_size_ = file_unit_size;
+        root.interleave_gap_size_ = interleave_gap_size;
+        memcpy(&root.rec_timestamp_,&rec_timestamp,sizeof(tiso_dir_record_datetime));
+
+        nodes_.push_back(root);
+        return ROOT_INDEX;
+    }
+
+    /**
+     * Adds a new node as the last child of the specified parent node.
+     * @param [in] parent Index of the parent node.
+     * @param [in] file_name Null-terminated name of the new node.
+     * @return The index of the new node.
+     */
+    ckcore::tuint32 IsoTree::add_node(ckcore::tuint32 parent,const ckcore::tchar *file_name,
+                                      ckcore::tuint32 extent_loc,ckcore::tuint32 extent_len,
+                                      ckcore::tuint16 volseq_num,unsigned char file_flags,
+                                      unsigned char file_unit_size,unsigned char interleave_gap_size,
+                                      const tiso_dir_record_datetime &rec_timestamp)
+    {
+        assert(parent < nodes_.size());
+
+        size_t name_len = file_name != NULL ? ckcore::string::astrlen(file_name) : 0;
+        if (name_len > 0xff)
+            name_len = 0xff;
+
+        Node node;
+        node.parent_ = parent;
+        node.first_child_ = INVALID_INDEX;
+        node.next_sibling_ = INVALID_INDEX;
+        node.name_off_ = intern_name(file_name,name_len);
+        node.name_len_ = static_cast<unsigned char>(name_len);
+        node.extent_loc_ = extent_loc;
+        node.extent_len_ = extent_len;
+        node.volseq_num_ = volseq_num;
+        node.file_flags_ = file_flags;
+        node.file_unit_size_ = file_unit_size;
+        node.interleave_gap_size_ = interleave_gap_size;
+        memcpy(&node.rec_timestamp_,&rec_timestamp,sizeof(tiso_dir_record_datetime));
+
+        const ckcore::tuint32 index = static_cast<ckcore::tuint32>(nodes_.size());
+        nodes_.push_back(node);
+
+        // Link the node as the last child of its parent.
+        if (nodes_[parent].first_child_ == INVALID_INDEX)
+        {
+            nodes_[parent].first_child_ = index;
+        }
+        else
+        {
+            ckcore::tuint32 last = tail_parent_ == parent ? tail_child_ :
+                nodes_[parent].first_child_;
+            while (nodes_[last].next_sibling_ != INVALID_INDEX)
+                last = nodes_[last].next_sibling_;
+
+            nodes_[last].next_sibling_ = index;
+        }
+
+        tail_parent_ = parent;
+        tail_child_ = index;
+
+        return index;
+    }
+
+    /**
+     * Converts all nodes into writer import data. The import data of a node
+     * is stored at the same index as the node itself, the root included.
+     * @param [out] import_data Vector to fill with import data.
+     */
+    void IsoTree::make_import_data(std::vector<IsoImportData> &import_data) const
+    {
+        import_data.resize(nodes_.size());
+
+        for (size_t i = 0; i < nodes_.size(); i++)
+        {
+            const Node &node = nodes_[i];
+            IsoImportData &data = import_data[i];
+
+            data.file_flags_ = node.file_flags_;
+            data.file_unit_size_ = node.file_unit_size_;
+            data.interleave_gap_size_ = node.interleave_gap_size_;
+            data.volseq_num_ = node.volseq_num_;
+            data.extent_loc_ = node.extent_loc_;
+            data.extent_len_ = node.extent_len_;
+            memcpy(&data.rec_timestamp_,&node.rec_timestamp_,sizeof(tiso_dir_record_datetime));
+        }
+    }
+
+    /**
+     * Adds file descriptors for all nodes (except the root) to a file set.
+     * The descriptors will reference the import data in import_data, the
+     * vector must therefore be kept alive and unmodified for as long as the
+     * file set is in use. One descriptor is allocated per node, they are
+     * owned by the file set and released using destroy_file_set().
+     * @param [out] file_set The file set to add the file descriptors to.
+     * @param [out] import_data Vector to fill with import data.
+     * @param [in] internal_path Path in the disc image where the tree should
+     *                           be placed, an empty path denotes the root.
+     */
+    void IsoTree::make_file_set(FileSet &file_set,std::vector<IsoImportData> &import_data,
+                                const ckcore::tchar *internal_path) const
+    {
+        make_import_data(import_data);
+        if (nodes_.empty())
+            return;
+
+        // The path is built in a single buffer which grows and shrinks as we
+        // walk the tree in depth first order. Each stack entry holds the next
+        // child to visit and the length of its parent path.
+        ckcore::tstring path = internal_path;
+        std::vector<std::pair<ckcore::tuint32,size_t> > dir_node_stack;
+        dir_node_stack.push_back(std::make_pair(nodes_[ROOT_INDEX].first_child_,path.size()));
+
+        while (dir_node_stack.size() > 0)
+        {
+            const ckcore::tuint32 i = dir_node_stack.back().first;
+            const size_t dir_path_len = dir_node_stack.back().second;
+            if (i == INVALID_INDEX)
+            {
+                dir_node_stack.pop_back();
+                continue;
+            }
+
+            dir_node_stack.back().first = nodes_[i].next_sibling_;
+
+            path.resize(dir_path_len);
+            path.push_back('/');
+            path.append(&names_[nodes_[i].name_off_],nodes_[i].name_len_);
+
+            unsigned char flags = FileDescriptor::FLAG_IMPORTED;
+            if (is_dir(i))
+                flags |= FileDescriptor::FLAG_DIRECTORY;
+
+            file_set.insert(new FileDescriptor(path.c_str(),ckT(""),flags,&import_data[i]));
+
+            if (is_dir(i))
+                dir_node_stack.push_back(std::make_pair(nodes_[i].first_child_,path.size()));
+        }
+    }
+};
@@ -16,23 +16,68 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include <ckcore/exception.hh>
 #include <ckcore/log.hh>
 #include <ckcore/string.hh>
 #include "ckfilesystem/sectorstream.hh"
 #include "ckfilesystem/util.hh"
+#include "ckfilesystem/charclass.hh"
 #include "ckfilesystem/iso.hh"
 #include "ckfilesystem/isoverifier.hh"
 
+// The largest possible path table, parent directory numbers limit a table
+// to 65535 records of at most 8 + 255 + 1 bytes each.
+#define ISOVERIFIER_MAX_PATH_TABLE_SIZE         (65535 * 264)
+
 namespace ckfilesystem
 {
     using namespace util;
 
+    /**
+     * @brief Log printing to the standard output, used by verifiers that
+     *        have not been given a log.
+     */
+    class StdOutLog : public ckcore::Log
+    {
+    public:
+        void print(const ckcore::tchar *format,...)
+        {
+            va_list args;
+            va_start(args,format);
+#ifdef _UNICODE
+            vwprintf(format,args);
+#else
+            vprintf(format,args);
+#endif
+            va_end(args);
+        }
+
+        void print_line(const ckcore::tchar *format,...)
+        {
+            va_list args;
+            va_start(args,format);
+#ifdef _UNICODE
+            vwprintf(format,args);
+            wprintf(L"\n");
+#else
+            vprintf(format,args);
+            printf("\n");
+#endif
+            va_end(args);
+        }
+    };
+
+    static StdOutLog std_out_log;
+
     /**
      * Constructs an IsoVolDescSet object.
+     * @param [in] log The log to print the descriptors to.
      */
-    IsoVolDescSet::IsoVolDescSet()
+    IsoVolDescSet::IsoVolDescSet(ckcore::Log &log) : log_(log)
     {
         memset(&voldesc_primary_,0,sizeof(voldesc_primary_));
     }
@@ -45,7 +90,7 @@ namespace ckfilesystem
     void IsoVolDescSet::read(SectorInStream &in_stream)
     {
         unsigned char buffer[2048];
-        ckcore::log::print_line(ckT("Looking for volume descriptor set..."));
+        log_.print_line(ckT("Looking for volume descriptor set..."));
 
         while (!in_stream.end())
         {
@@ -64,7 +109,7 @@ namespace ckfilesystem
                     voldesc_bootrec_.push_back(tmp);
                 }
 
-                ckcore::log::print_line(ckT("  Found: Boot catalog at sector %d."),cur_sec);
+                log_.print_line(ckT("  Found: Boot catalog at sector %d."),cur_sec);
                 break;
 
             case VOLDESCTYPE_PRIM_VOL_DESC:
@@ -73,14 +118,14 @@ namespace ckfilesystem
 
                 if (memcmp(&voldesc_primary_,&zero,sizeof(tiso_voldesc_primary)))
                 {
-                    ckcore::log::print_line(ckT("Warning: Found an extra primary ")
+                    log_.print_line(ckT("Warning: Found an extra primary ")
                                             ckT("volume descriptor at sector %d."),
                                             cur_sec);
                 }
 
                 memcpy(&voldesc_primary_,buffer,sizeof(voldesc_primary_));
 
-                ckcore::log::print_line(ckT("  Found: Primary volume descriptor at sector %d."),cur_sec);
+                log_.print_line(ckT("  Found: Primary volume descriptor at sector %d."),cur_sec);
                 break;
 
             case VOLDESCTYPE_SUPPL_VOL_DESC:
@@ -90,7 +135,7 @@ namespace ckfilesystem
                     voldesc_suppl_.push_back(tmp);
                 }
 
-                ckcore::log::print_line(ckT("  Found: Supplementary volume descriptor at sector %d."),cur_sec);
+                log_.print_line(ckT("  Found: Supplementary volume descriptor at sector %d."),cur_sec);
                 break;
 
             case VOLDESCTYPE_VOL_PARTITION_DESC:
@@ -99,7 +144,7 @@ namespace ckfilesystem
                     memcpy(&tmp,buffer,sizeof(tmp));
                     voldesc_part_.push_back(tmp);
 
-                    ckcore::log::print_line(ckT("  Found: Volume partition descriptor at sector %d."),cur_sec);
+                    log_.print_line(ckT("  Found: Volume partition descriptor at sector %d."),cur_sec);
                 }
                 break;
 
@@ -109,9 +154,9 @@ namespace ckfilesystem
                     memcpy(&tmp,buffer,sizeof(tmp));
                     voldesc_setterm_.push_back(tmp);
 
-                    ckcore::log::print_line(ckT("  Found: Volume set terminator descriptor at sector %d."),cur_sec);
-                    ckcore::log::print_line(ckT("End of volume set found."));
-                    ckcore::log::print_line(ckT(""));
+                    log_.print_line(ckT("  Found: Volume set terminator descriptor at sector %d."),cur_sec);
+                    log_.print_line(ckT("End of volume set found."));
+                    log_.print_line(ckT(""));
                     return;
                 }
 
@@ -123,7 +168,7 @@ namespace ckfilesystem
             }
         }
 
-        ckcore::log::print_line(ckT(""));
+        log_.print_line(ckT(""));
 
         throw VerificationException(ckT("Volume set did not contain a terminator."),
                                     ckT("ECMA 119: 6.7.1.5."));
@@ -156,7 +201,7 @@ namespace ckfilesystem
         ckcore::tuint32 sec = (sec_str[0] - '0') * 10 + (sec_str[1] - '0');
         ckcore::tuint32 hundreds = (hundreds_str[0] - '0') * 10 + (hundreds_str[1] - '0');
 
-        ckcore::log::print_line(ckT("%s %04d-%02d-%02d %02d:%02d:%02d(:%02d) in zone %d"),
+        log_.print_line(ckT("%s %04d-%02d-%02d %02d:%02d:%02d(:%02d) in zone %d"),
                                 label,year,mon,day,hour,min,sec,hundreds,voldesc_datetime.zone);
 
         if (year == 0 && mon == 0 && day == 0 && hour == 0 &&
@@ -218,16 +263,16 @@ namespace ckfilesystem
         char str_buffer[1024];
         size_t len = 0;
 
-        ckcore::log::print_line(ckT("Primary volume descriptor:"));
+        log_.print_line(ckT("Primary volume descriptor:"));
 
         // Volume descriptor type.
-        ckcore::log::print_line(ckT("  Volume descriptor type: %d"),
+        log_.print_line(ckT("  Volume descriptor type: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_primary.type));
 
         // Standard identifier.
         memcpy(str_buffer,voldesc_primary.ident,sizeof(voldesc_primary.ident));
         str_buffer[sizeof(voldesc_primary.ident)] = '\0';
-        ckcore::log::print_line(ckT("  Standard identifier: \"%s\""),
+        log_.print_line(ckT("  Standard identifier: \"%s\""),
                                 ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
 
         if (memcmp(voldesc_primary.ident,"CD001",sizeof(voldesc_primary.ident)))
@@ -237,70 +282,70 @@ namespace ckfilesystem
         }
 
         // Volume descriptor version.
-        ckcore::log::print_line(ckT("  Volume descriptor version: %d"),
+        log_.print_line(ckT("  Volume descriptor version: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_primary.version));
 
         if (voldesc_primary.version != 1)
         {
-            ckcore::log::print_line(ckT("=> Warning: Descriptor version is not 1."));
-            ckcore::log::print_line(ckT("=>          See ECMA 119: 8.4.3."));
+            log_.print_line(ckT("=> Warning: Descriptor version is not 1."));
+            log_.print_line(ckT("=>          See ECMA 119: 8.4.3."));
         }
 
         // System identifier.
         IsoVerifier::read_a_chars(voldesc_primary.sys_ident,
                                   sizeof(voldesc_primary.sys_ident),str_buffer);
-        ckcore::log::print_line(ckT("  System identifier: \"%s\""),
+        log_.print_line(ckT("  System identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_a_chars(voldesc_primary.sys_ident,len);
 
         // Volume identifier.
         IsoVerifier::read_d_chars(voldesc_primary.vol_ident,
                                   sizeof(voldesc_primary.vol_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Volume identifier: \"%s\""),
+        log_.print_line(ckT("  Volume identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_d_chars(voldesc_primary.vol_ident,len);
 
         // Volume space size.
-        ckcore::log::print_line(ckT("  Volume space size: %d blocks"),
+        log_.print_line(ckT("  Volume space size: %d blocks"),
                                 read733(voldesc_primary.vol_space_size));
 
-        ckcore::log::print_line(ckT("  Volume set size: %d"),
+        log_.print_line(ckT("  Volume set size: %d"),
                                 read723(voldesc_primary.volset_size));
 
-        ckcore::log::print_line(ckT("  Volume sequence number: %d"),
+        log_.print_line(ckT("  Volume sequence number: %d"),
                                 read723(voldesc_primary.volseq_num));
 
-        ckcore::log::print_line(ckT("  Logical block size: %d bytes"),
+        log_.print_line(ckT("  Logical block size: %d bytes"),
                                 read723(voldesc_primary.logical_block_size));
 
-        ckcore::log::print_line(ckT("  Path table size: %d bytes"),
+        log_.print_line(ckT("  Path table size: %d bytes"),
                                 read733(voldesc_primary.path_table_size));
 
-        ckcore::log::print_line(ckT("  Location of occurrence of type L path table: sector %d"),
+        log_.print_line(ckT("  Location of occurrence of type L path table: sector %d"),
                                 read731(voldesc_primary.path_table_type_l));
 
-        ckcore::log::print_line(ckT("  Location of optional occurrence of type L path table: sector %d"),
+        log_.print_line(ckT("  Location of optional occurrence of type L path table: sector %d"),
                                 read731(voldesc_primary.opt_path_table_type_l));
 
-        ckcore::log::print_line(ckT("  Location of occurrence of type M path table: sector %d"),
+        log_.print_line(ckT("  Location of occurrence of type M path table: sector %d"),
                                 read721(voldesc_primary.path_table_type_m));
 
-        ckcore::log::print_line(ckT("  Location of optional occurrence of type M path table: sector %d"),
+        log_.print_line(ckT("  Location of optional occurrence of type M path table: sector %d"),
                                 read731(voldesc_primary.opt_path_table_type_m));
 
         // Root directory record.
-        ckcore::log::print_line(ckT("  Directory record for root directory:"));
+        log_.print_line(ckT("  Directory record for root directory:"));
 
-        ckcore::log::print_line(ckT("    Length of directory record: %d bytes"),
+        log_.print_line(ckT("    Length of directory record: %d bytes"),
                                 static_cast<ckcore::tuint32>(voldesc_primary.root_dir_record.dir_record_len));
-        ckcore::log::print_line(ckT("    Extended attribute record length: %d bytes"),
+        log_.print_line(ckT("    Extended attribute record length: %d bytes"),
                                 static_cast<ckcore::tuint32>(voldesc_primary.root_dir_record.ext_attr_record_len));
-        ckcore::log::print_line(ckT("    Location of extent: sector %d"),
+        log_.print_line(ckT("    Location of extent: sector %d"),
             read733(voldesc_primary.root_dir_record.extent_loc));
-        ckcore::log::print_line(ckT("    Data length: %d bytes"),
+        log_.print_line(ckT("    Data length: %d bytes"),
             read733(voldesc_primary.root_dir_record.data_len));
 
-        ckcore::log::print_line(ckT("    Recording date and time: %04d-%02d-%02d %02d:%02d:%02d in zone %d"),
+        log_.print_line(ckT("    Recording date and time: %04d-%02d-%02d %02d:%02d:%02d in zone %d"),
             voldesc_primary.root_dir_record.rec_timestamp.year + 1900,
             voldesc_primary.root_dir_record.rec_timestamp.mon,
             voldesc_primary.root_dir_record.rec_timestamp.day,
@@ -361,7 +406,7 @@ namespace ckfilesystem
         if (flags.size() > 0)
             flags.resize(flags.size() - 1);
 
-        ckcore::log::print_line(ckT("    File flags: %d (%s)"),
+        log_.print_line(ckT("    File flags: %d (%s)"),
                                 static_cast<ckcore::tuint32>(voldesc_primary.root_dir_record.file_flags),
                                 flags.c_str());
 
@@ -386,16 +431,16 @@ namespace ckfilesystem
             }
         }
 
-        ckcore::log::print_line(ckT("    File unit size: %d"),
+        log_.print_line(ckT("    File unit size: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_primary.root_dir_record.file_unit_size));
 
-        ckcore::log::print_line(ckT("    Interleave gap size: %d"),
+        log_.print_line(ckT("    Interleave gap size: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_primary.root_dir_record.interleave_gap_size));
 
-        ckcore::log::print_line(ckT("    Volume sequence number: %d"),
+        log_.print_line(ckT("    Volume sequence number: %d"),
             read723(voldesc_primary.root_dir_record.volseq_num));
 
-        ckcore::log::print_line(ckT("    File identifier length: %d"),
+        log_.print_line(ckT("    File identifier length: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_primary.root_dir_record.file_ident_len));
 
         if (voldesc_primary.root_dir_record.file_ident_len != 1 ||
@@ -409,12 +454,12 @@ namespace ckfilesystem
             throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.2.2."));
         }
 
-        ckcore::log::print_line(ckT("    File identifier: 0"));
+        log_.print_line(ckT("    File identifier: 0"));
 
         /*memcpy(str_buffer,voldesc_primary.root_dir_record.file_ident,
                voldesc_primary.root_dir_record.file_ident_len);
         str_buffer[voldesc_primary.root_dir_record.file_ident_len] = '\0';
-        ckcore::log::print_line(ckT("    File identifier: \"%s\""),
+        log_.print_line(ckT("    File identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_d_chars(voldesc_primary.root_dir_record.file_ident,
                                     voldesc_primary.root_dir_record.file_ident_len,
@@ -423,49 +468,49 @@ namespace ckfilesystem
         // Volume set identifier.
         IsoVerifier::read_d_chars(voldesc_primary.volset_ident,
                                   sizeof(voldesc_primary.volset_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Volume set identifier: \"%s\""),
+        log_.print_line(ckT("  Volume set identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_d_chars(voldesc_primary.volset_ident,len);
 
         // Publisher identifier.
         IsoVerifier::read_a_chars(voldesc_primary.publ_ident,
                                   sizeof(voldesc_primary.publ_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Publisher identifier: \"%s\""),
+        log_.print_line(ckT("  Publisher identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_a_chars(voldesc_primary.publ_ident,len);
 
         // Data preparer identifier.
         IsoVerifier::read_a_chars(voldesc_primary.prep_ident,
                                   sizeof(voldesc_primary.prep_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Data preparer identifier: \"%s\""),
+        log_.print_line(ckT("  Data preparer identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_a_chars(voldesc_primary.prep_ident,len);
 
         // Application identifier.
         IsoVerifier::read_a_chars(voldesc_primary.app_ident,
                                   sizeof(voldesc_primary.app_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Application identifier: \"%s\""),
+        log_.print_line(ckT("  Application identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_a_chars(voldesc_primary.app_ident,len);
 
         // Copyright file identifier.
         IsoVerifier::read_d_chars(voldesc_primary.copy_file_ident,
                                   sizeof(voldesc_primary.copy_file_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Copyright file identifier: \"%s\""),
+        log_.print_line(ckT("  Copyright file identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_d_chars(voldesc_primary.copy_file_ident,len,true);
 
         // Abstract file identifier.
         IsoVerifier::read_d_chars(voldesc_primary.abst_file_ident,
                                   sizeof(voldesc_primary.abst_file_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Abstract file identifier: \"%s\""),
+        log_.print_line(ckT("  Abstract file identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_d_chars(voldesc_primary.abst_file_ident,len,true);
 
         // Bibliographic file identifier.
         IsoVerifier::read_d_chars(voldesc_primary.bibl_file_ident,
                                   sizeof(voldesc_primary.bibl_file_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Bibliographic file identifier: \"%s\""),
+        log_.print_line(ckT("  Bibliographic file identifier: \"%s\""),
             ckcore::string::ansi_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_d_chars(voldesc_primary.bibl_file_ident,len,true);
 
@@ -476,25 +521,25 @@ namespace ckfilesystem
         verify(voldesc_primary.effect_time,ckT("  Volume effective date and time:"));
 
         // File structure version.
-        ckcore::log::print_line(ckT("  File structure version: %d"),
+        log_.print_line(ckT("  File structure version: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_primary.file_struct_ver));
 
         unsigned char app_data_zero[512];
         memset(app_data_zero,0,sizeof(app_data_zero));
         if (!memcmp(voldesc_primary.app_data,app_data_zero,sizeof(voldesc_primary.app_data)))
-            ckcore::log::print_line(ckT("  Application use: <no>"));
+            log_.print_line(ckT("  Application use: <no>"));
         else
-            ckcore::log::print_line(ckT("  Application use: <yes>"));
+            log_.print_line(ckT("  Application use: <yes>"));
 
         unsigned char unused5_zero[653];
         memset(unused5_zero,0,sizeof(unused5_zero));
         if (memcmp(voldesc_primary.unused5,unused5_zero,sizeof(voldesc_primary.unused5)))
         {
-            ckcore::log::print_line(ckT("=> Warning: Reserved data in primary volume descriptor is used."));
-            ckcore::log::print_line(ckT("=>          See ECMA 119: 8.4.33."));
+            log_.print_line(ckT("=> Warning: Reserved data in primary volume descriptor is used."));
+            log_.print_line(ckT("=>          See ECMA 119: 8.4.33."));
         }
 
-        ckcore::log::print_line(ckT(""));
+        log_.print_line(ckT(""));
     }
 
     /**
@@ -508,17 +553,17 @@ namespace ckfilesystem
         wchar_t str_buffer[1024];
         size_t len = 0;
 
-        ckcore::log::print_line(ckT("Supplementary volume descriptor %d:"),index);
+        log_.print_line(ckT("Supplementary volume descriptor %d:"),index);
 
         // Volume descriptor type.
-        ckcore::log::print_line(ckT("  Volume descriptor type: %d"),
+        log_.print_line(ckT("  Volume descriptor type: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.type));
 
         // Standard identifier.
         char ident[1024];
         memcpy(ident,voldesc_suppl.ident,sizeof(voldesc_suppl.ident));
         str_buffer[sizeof(voldesc_suppl.ident)] = '\0';
-        ckcore::log::print_line(ckT("  Standard identifier: \"%s\""),
+        log_.print_line(ckT("  Standard identifier: \"%s\""),
                                 ckcore::string::ansi_to_auto<1024>(ident).c_str());
 
         if (memcmp(voldesc_suppl.ident,"CD001",sizeof(voldesc_suppl.ident)))
@@ -528,38 +573,38 @@ namespace ckfilesystem
         }
 
         // Volume descriptor version.
-        ckcore::log::print_line(ckT("  Volume descriptor version: %d"),
+        log_.print_line(ckT("  Volume descriptor version: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.version));
 
         if (voldesc_suppl.version != 1)
         {
-            ckcore::log::print_line(ckT("=> Warning: Descriptor version is not 1."));
-            ckcore::log::print_line(ckT("=>          See ECMA 119: 8.4.3."));
+            log_.print_line(ckT("=> Warning: Descriptor version is not 1."));
+            log_.print_line(ckT("=>          See ECMA 119: 8.4.3."));
         }
 
         // Volume flags.
-        ckcore::log::print_line(ckT("  Volume flags: %d"),
+        log_.print_line(ckT("  Volume flags: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.vol_flags));
 
         // System identifier.
         IsoVerifier::read_j_chars(voldesc_suppl.sys_ident,
                                   sizeof(voldesc_suppl.sys_ident),str_buffer);
-        ckcore::log::print_line(ckT("  System identifier: \"%s\""),
+        log_.print_line(ckT("  System identifier: \"%s\""),
                                 ckcore::string::utf16_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_j_chars(voldesc_suppl.sys_ident,len);
 
         // Volume identifier.
         IsoVerifier::read_j_chars(voldesc_suppl.vol_ident,
                                   sizeof(voldesc_suppl.vol_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Volume identifier: \"%s\""),
+        log_.print_line(ckT("  Volume identifier: \"%s\""),
                                 ckcore::string::utf16_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_j_chars(voldesc_suppl.vol_ident,len);
 
         // Volume space size.
-        ckcore::log::print_line(ckT("  Volume space size: %d blocks"),
+        log_.print_line(ckT("  Volume space size: %d blocks"),
                                 read733(voldesc_suppl.vol_space_size));
         // Escape sequences.
-        ckcore::log::print_line(ckT("  Escape sequences: %02x%02x%02x%02x%02x%02x%02x%02x%02x%02x")
+        log_.print_line(ckT("  Escape sequences: %02x%02x%02x%02x%02x%02x%02x%02x%02x%02x")
                                 ckT("%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x")
                                 ckT("%02x%02x%02x%02x%02x%02x%02x"),
             voldesc_suppl.esc_sec[ 0],voldesc_suppl.esc_sec[ 1],voldesc_suppl.esc_sec[ 2],
@@ -574,52 +619,50 @@ namespace ckfilesystem
             voldesc_suppl.esc_sec[27],voldesc_suppl.esc_sec[28],voldesc_suppl.esc_sec[29],
             voldesc_suppl.esc_sec[30],voldesc_suppl.esc_sec[31]);
 
-        if (!(voldesc_suppl.esc_sec[0] == 0x25 && voldesc_suppl.esc_sec[1] == 0x2f &&
-             (voldesc_suppl.esc_sec[2] == 0x40 || voldesc_suppl.esc_sec[2] == 0x43 ||
-              voldesc_suppl.esc_sec[2] == 0x45)))
+        if (!iso_is_joliet(voldesc_suppl))
         {
             throw VerificationException(ckT("Unknown escape sequence in supplementary volume ")
                                         ckT("descriptor, string entries have possibly been wrongly interpreted."),
                                         ckT("Joliet Specification: SVD Escape Sequences Field"));
         }
 
-        ckcore::log::print_line(ckT("  Volume set size: %d"),
+        log_.print_line(ckT("  Volume set size: %d"),
                                 read723(voldesc_suppl.volset_size));
 
-        ckcore::log::print_line(ckT("  Volume sequence number: %d"),
+        log_.print_line(ckT("  Volume sequence number: %d"),
                                 read723(voldesc_suppl.volseq_num));
 
-        ckcore::log::print_line(ckT("  Logical block size: %d bytes"),
+        log_.print_line(ckT("  Logical block size: %d bytes"),
                                 read723(voldesc_suppl.logical_block_size));
 
-        ckcore::log::print_line(ckT("  Path table size: %d bytes"),
+        log_.print_line(ckT("  Path table size: %d bytes"),
                                 read733(voldesc_suppl.path_table_size));
 
-        ckcore::log::print_line(ckT("  Location of occurrence of type L path table: sector %d"),
+        log_.print_line(ckT("  Location of occurrence of type L path table: sector %d"),
                                 read731(voldesc_suppl.path_table_type_l));
 
-        ckcore::log::print_line(ckT("  Location of optional occurrence of type L path table: sector %d"),
+        log_.print_line(ckT("  Location of optional occurrence of type L path table: sector %d"),
                                 read731(voldesc_suppl.opt_path_table_type_l));
 
-        ckcore::log::print_line(ckT("  Location of occurrence of type M path table: sector %d"),
+        log_.print_line(ckT("  Location of occurrence of type M path table: sector %d"),
                                 read721(voldesc_suppl.path_table_type_m));
 
-        ckcore::log::print_line(ckT("  Location of optional occurrence of type M path table: sector %d"),
+        log_.print_line(ckT("  Location of optional occurrence of type M path table: sector %d"),
                                 read731(voldesc_suppl.opt_path_table_type_m));
 
         // Root directory record.
-        ckcore::log::print_line(ckT("  Directory record for root directory:"));
+        log_.print_line(ckT("  Directory record for root directory:"));
 
-        ckcore::log::print_line(ckT("    Length of directory record: %d bytes"),
+        log_.print_line(ckT("    Length of directory record: %d bytes"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.root_dir_record.dir_record_len));
-        ckcore::log::print_line(ckT("    Extended attribute record length: %d bytes"),
+        log_.print_line(ckT("    Extended attribute record length: %d bytes"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.root_dir_record.ext_attr_record_len));
-        ckcore::log::print_line(ckT("    Location of extent: sector %d"),
+        log_.print_line(ckT("    Location of extent: sector %d"),
             read733(voldesc_suppl.root_dir_record.extent_loc));
-        ckcore::log::print_line(ckT("    Data length: %d bytes"),
+        log_.print_line(ckT("    Data length: %d bytes"),
             read733(voldesc_suppl.root_dir_record.data_len));
 
-        ckcore::log::print_line(ckT("    Recording date and time: %04d-%02d-%02d %02d:%02d:%02d in zone %d"),
+        log_.print_line(ckT("    Recording date and time: %04d-%02d-%02d %02d:%02d:%02d in zone %d"),
             voldesc_suppl.root_dir_record.rec_timestamp.year + 1900,
             voldesc_suppl.root_dir_record.rec_timestamp.mon,
             voldesc_suppl.root_dir_record.rec_timestamp.day,
@@ -680,7 +723,7 @@ namespace ckfilesystem
         if (flags.size() > 0)
             flags.resize(flags.size() - 1);
 
-        ckcore::log::print_line(ckT("    File flags: %d (%s)"),
+        log_.print_line(ckT("    File flags: %d (%s)"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.root_dir_record.file_flags),
                                 flags.c_str());
 
@@ -705,16 +748,16 @@ namespace ckfilesystem
             }
         }
 
-        ckcore::log::print_line(ckT("    File unit size: %d"),
+        log_.print_line(ckT("    File unit size: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.root_dir_record.file_unit_size));
 
-        ckcore::log::print_line(ckT("    Interleave gap size: %d"),
+        log_.print_line(ckT("    Interleave gap size: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.root_dir_record.interleave_gap_size));
 
-        ckcore::log::print_line(ckT("    Volume sequence number: %d"),
+        log_.print_line(ckT("    Volume sequence number: %d"),
             read723(voldesc_suppl.root_dir_record.volseq_num));
 
-        ckcore::log::print_line(ckT("    File identifier length: %d"),
+        log_.print_line(ckT("    File identifier length: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.root_dir_record.file_ident_len));
 
         if (voldesc_suppl.root_dir_record.file_ident_len != 1 ||
@@ -728,54 +771,54 @@ namespace ckfilesystem
             throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.2.2."));
         }
 
-        ckcore::log::print_line(ckT("    File identifier: 0"));
+        log_.print_line(ckT("    File identifier: 0"));
 
         // Volume set identifier.
         IsoVerifier::read_j_chars(voldesc_suppl.volset_ident,
                                   sizeof(voldesc_suppl.volset_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Volume set identifier: \"%s\""),
+        log_.print_line(ckT("  Volume set identifier: \"%s\""),
             ckcore::string::utf16_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_j_chars(voldesc_suppl.volset_ident,len);
 
         // Publisher identifier.
         IsoVerifier::read_j_chars(voldesc_suppl.publ_ident,
                                   sizeof(voldesc_suppl.publ_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Publisher identifier: \"%s\""),
+        log_.print_line(ckT("  Publisher identifier: \"%s\""),
             ckcore::string::utf16_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_j_chars(voldesc_suppl.publ_ident,len);
 
         // Data preparer identifier.
         IsoVerifier::read_j_chars(voldesc_suppl.prep_ident,
                                   sizeof(voldesc_suppl.prep_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Data preparer identifier: \"%s\""),
+        log_.print_line(ckT("  Data preparer identifier: \"%s\""),
             ckcore::string::utf16_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_j_chars(voldesc_suppl.prep_ident,len);
 
         // Application identifier.
         IsoVerifier::read_j_chars(voldesc_suppl.app_ident,
                                   sizeof(voldesc_suppl.app_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Application identifier: \"%s\""),
+        log_.print_line(ckT("  Application identifier: \"%s\""),
             ckcore::string::utf16_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_j_chars(voldesc_suppl.app_ident,len);
 
         // Copyright file identifier.
         IsoVerifier::read_j_chars(voldesc_suppl.copy_file_ident,
                                   sizeof(voldesc_suppl.copy_file_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Copyright file identifier: \"%s\""),
+        log_.print_line(ckT("  Copyright file identifier: \"%s\""),
             ckcore::string::utf16_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_j_chars(voldesc_suppl.copy_file_ident,len);
 
         // Abstract file identifier.
         IsoVerifier::read_j_chars(voldesc_suppl.abst_file_ident,
                                   sizeof(voldesc_suppl.abst_file_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Abstract file identifier: \"%s\""),
+        log_.print_line(ckT("  Abstract file identifier: \"%s\""),
             ckcore::string::utf16_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_j_chars(voldesc_suppl.abst_file_ident,len);
 
         // Bibliographic file identifier.
         IsoVerifier::read_j_chars(voldesc_suppl.bibl_file_ident,
                                   sizeof(voldesc_suppl.bibl_file_ident),str_buffer);
-        ckcore::log::print_line(ckT("  Bibliographic file identifier: \"%s\""),
+        log_.print_line(ckT("  Bibliographic file identifier: \"%s\""),
             ckcore::string::utf16_to_auto<1024>(str_buffer).c_str());
         IsoVerifier::verify_j_chars(voldesc_suppl.bibl_file_ident,len);
 
@@ -786,25 +829,25 @@ namespace ckfilesystem
         verify(voldesc_suppl.effect_time,ckT("  Volume effective date and time:"));
 
         // File structure version.
-        ckcore::log::print_line(ckT("  File structure version: %d"),
+        log_.print_line(ckT("  File structure version: %d"),
                                 static_cast<ckcore::tuint32>(voldesc_suppl.file_struct_ver));
 
         unsigned char app_data_zero[512];
         memset(app_data_zero,0,sizeof(app_data_zero));
         if (!memcmp(voldesc_suppl.app_data,app_data_zero,sizeof(voldesc_suppl.app_data)))
-            ckcore::log::print_line(ckT("  Application use: <no>"));
+            log_.print_line(ckT("  Application use: <no>"));
         else
-            ckcore::log::print_line(ckT("  Application use: <yes>"));
+            log_.print_line(ckT("  Application use: <yes>"));
 
         unsigned char unused3_zero[653];
         memset(unused3_zero,0,sizeof(unused3_zero));
         if (memcmp(voldesc_suppl.unused3,unused3_zero,sizeof(voldesc_suppl.unused3)))
         {
-            ckcore::log::print_line(ckT("=> Warning: Reserved data in primary volume descriptor is used."));
-            ckcore::log::print_line(ckT("=>          See ECMA 119: 8.4.33."));
+            log_.print_line(ckT("=> Warning: Reserved data in primary volume descriptor is used."));
+            log_.print_line(ckT("=>          See ECMA 119: 8.4.33."));
         }
 
-        ckcore::log::print_line(ckT(""));
+        log_.print_line(ckT(""));
     }
 
     /**
@@ -840,184 +883,1526 @@ namespace ckfilesystem
     }
 
     /**
-     * Constructs an IsoVerifier object.
+     * Constructs an IsoHierarchyVerifier object.
+     * @param [in] log The log to print progress and warnings to.
      */
-    IsoVerifier::IsoVerifier()// : voldesc_primary_(NULL)
+    IsoHierarchyVerifier::IsoHierarchyVerifier(ckcore::Log &log) : log_(log),vol_space_size_(0)
+    {
+        memset(buffer_,0,sizeof(buffer_));
+    }
+
+    const ckcore::tchar *IsoHierarchyVerifier::label(const Hierarchy &hierarchy) const
     {
+        return hierarchy.joliet_ ? ckT("Joliet") : ckT("ISO9660");
     }
 
     /**
-     * Destructs the IsoVerifier object.
+     * Verifies a directory record date and time.
+     * @param [in] datetime The date and time to verify.
+     * @throw VerificationException If the date or time is invalid.
      */
-    IsoVerifier::~IsoVerifier()
+    void IsoHierarchyVerifier::verify(const tiso_dir_record_datetime &datetime)
     {
+        // All zeroes means that the date and time is not specified.
+        if (datetime.year == 0 && datetime.mon == 0 && datetime.day == 0 &&
+            datetime.hour == 0 && datetime.min == 0 && datetime.sec == 0)
+        {
+            return;
+        }
+
+        if (datetime.mon < 1 || datetime.mon > 12)
+        {
+            throw VerificationException(ckT("The month must be a value between 1 and 12."),
+                                        ckT("ECMA 119: 9.1.5."));
+        }
+
+        if (datetime.day < 1 || datetime.day > 31)
+        {
+            throw VerificationException(ckT("The day must be a value between 1 and 31."),
+                                        ckT("ECMA 119: 9.1.5."));
+        }
+
+        if (datetime.hour > 23)
+        {
+            throw VerificationException(ckT("The hour must be a value between 0 and 23."),
+                                        ckT("ECMA 119: 9.1.5."));
+        }
+
+        if (datetime.min > 59)
+        {
+            throw VerificationException(ckT("The minute must be a value between 0 and 59."),
+                                        ckT("ECMA 119: 9.1.5."));
+        }
+
+        if (datetime.sec > 59)
+        {
+            throw VerificationException(ckT("The second must be a value between 0 and 59."),
+                                        ckT("ECMA 119: 9.1.5."));
+        }
     }
 
-    void IsoVerifier::read_vol_desc(SectorInStream &in_stream)
+    /**
+     * Verifies the file flags of a directory record.
+     * @param [in] file_flags The file flags to verify.
+     * @throw VerificationException If the flags are invalid.
+     */
+    void IsoHierarchyVerifier::verify_file_flags(unsigned char file_flags)
     {
-        unsigned char buffer[2048];
-        in_stream.read(buffer,sizeof(buffer));
+        if (!(file_flags & DIRRECORD_FILEFLAG_DIRECTORY))
+            return;
 
-        //tiso_voldesc_primary
-        unsigned char type = buffer[0];
+        if (file_flags & DIRRECORD_FILEFLAG_ASSOCIATEDFILE)
+        {
+            throw VerificationException(ckT("Directories cannot have the <associated file> flag set."),
+                                        ckT("ECMA 119: 9.1.6."));
+        }
 
-        switch (type)
+        if (file_flags & DIRRECORD_FILEFLAG_RECORD)
         {
-        case VOLDESCTYPE_BOOT_CATALOG:
-            //read_boot_cat(in_stream);
-            break;
+            throw VerificationException(ckT("Directories cannot have the <record> flag set."),
+                                        ckT("ECMA 119: 9.1.6."));
+        }
 
-        case VOLDESCTYPE_PRIM_VOL_DESC:
-            //if (voldesc_primary_ != NULL)
+        if (file_flags & DIRRECORD_FILEFLAG_MULTIEXTENT)
+        {
+            throw VerificationException(ckT("Directories cannot have the <multi-extent> flag set."),
+                                        ckT("ECMA 119: 9.1.6."));
+        }
+    }
+
+    /**
+     * @brief Base class for tasks executed by the parallel verifier. Errors
+     *        are captured and reported on the calling thread.
+     */
+    class IsoHierarchyVerifier::VerifyTask : public Executor::Task
+    {
+    public:
+        ckcore::tuint32 sector_;
+
+        bool failed_;
+        bool verification_;
+        ckcore::tstring message_;
+        ckcore::tstring reference_;
+
+        VerifyTask(ckcore::tuint32 sector) : sector_(sector),
+            failed_(false),verification_(false)
+        {
+        }
+
+        virtual void execute() = 0;
+
+        void run()
+        {
+            try
+            {
+                execute();
+            }
+            catch (const VerificationException &e)
+            {
+                failed_ = true;
+                verification_ = true;
+                message_ = ckcore::get_except_msg(e);
+                reference_ = e.reference();
+            }
+            catch (const std::exception &e)
+            {
+                failed_ = true;
+                message_ = ckcore::get_except_msg(e);
+            }
+            catch (...)
             {
                 ckcore::tstringstream msg;
-                msg << ckT("Encountered a second primary volume descriptor at sector ")
-                    << (in_stream.get_sector() - 1) << ckT(".");
-                throw ckcore::Exception2(msg.str());
+                msg << ckT("Unable to verify the structure at sector ") << sector_ << ckT(".");
+
+                failed_ = true;
+                message_ = msg.str();
             }
-            break;
+        }
+    };
 
-        case VOLDESCTYPE_SUPPL_VOL_DESC:
-            break;
+    /**
+     * @brief Reads and parses one path table.
+     */
+    class IsoHierarchyVerifier::PathTableTask : public VerifyTask
+    {
+    public:
+        SectorReader *reader_;
+        size_t hierarchy_;
+        ckcore::tuint32 size_;
+        bool type_l_;
+
+        std::vector<PathTableRecord> records_;
+        std::vector<unsigned char> idents_;
+
+        PathTableTask(SectorReader *reader,size_t hierarchy,ckcore::tuint32 sector,
+                      ckcore::tuint32 size,bool type_l) :
+            VerifyTask(sector),reader_(reader),hierarchy_(hierarchy),
+            size_(size),type_l_(type_l)
+        {
+        }
 
-        case VOLDESCTYPE_VOL_PARTITION_DESC:
-            break;
+        void execute()
+        {
+            std::vector<unsigned char> table(size_);
+            reader_->read(sector_,&table[0],size_);
 
-        case VOLDESCTYPE_VOL_DESC_SET_TERM:
-            break;
+            parse_path_table(table,sector_,type_l_,records_,idents_);
+        }
+    };
 
-        default:
+    /**
+     * @brief Reads and scans one directory extent.
+     */
+    class IsoHierarchyVerifier::DirTask : public VerifyTask
+    {
+    public:
+        SectorReader *reader_;
+        size_t hierarchy_;
+        bool joliet_;
+        ckcore::tuint32 vol_space_size_;
+
+        DirScan scan_;
+
+        DirTask(SectorReader *reader,size_t hierarchy,ckcore::tuint32 sector,
+                bool joliet,ckcore::tuint32 vol_space_size) :
+            VerifyTask(sector),reader_(reader),hierarchy_(hierarchy),
+            joliet_(joliet),vol_space_size_(vol_space_size),scan_(sector)
+        {
+        }
+
+        void execute()
+        {
+            unsigned char buffer[ISO_SECTOR_SIZE];
+            reader_->read(sector_,buffer,ISO_SECTOR_SIZE);
+            scan_dir_sector(scan_,buffer,0,joliet_);
+
+            // The '.' record in the first sector gives the extent size. It is
+            // read from the image, so the extent is checked against the volume
+            // space before the remaining sectors are read one at a time.
+            if (scan_.sec_count_ > 1)
+            {
+                verify_extent(sector_,scan_.data_len_,vol_space_size_,ckT("directory"));
+
+                for (ckcore::tuint32 i = 1; i < scan_.sec_count_; i++)
+                {
+                    reader_->read(sector_ + i,buffer,ISO_SECTOR_SIZE);
+                    scan_dir_sector(scan_,buffer,i,joliet_);
+                }
+            }
+
+            scan_dir_end(scan_);
+        }
+    };
+
+    /**
+     * Registers a directory hierarchy and queues its path tables and root
+     * directory for verification.
+     */
+    void IsoHierarchyVerifier::add_hierarchy(const tiso_dir_record &root_dir_record,
+                                             const unsigned char *path_table_size,
+                                             const unsigned char *path_table_type_l,
+                                             const unsigned char *opt_path_table_type_l,
+                                             const unsigned char *path_table_type_m,
+                                             const unsigned char *opt_path_table_type_m,
+                                             bool joliet)
+    {
+        hierarchies_.push_back(Hierarchy(joliet));
+
+        size_t index = hierarchies_.size() - 1;
+        Hierarchy &hierarchy = hierarchies_.back();
+
+        hierarchy.root_loc_ = read733(root_dir_record.extent_loc);
+        hierarchy.path_table_size_ = read733(path_table_size);
+
+        // The root directory is its own parent.
+        DirInfo &root = hierarchy.dirs_[hierarchy.root_loc_];
+        root.parent_loc_ = hierarchy.root_loc_;
+        root.data_len_ = read733(root_dir_record.data_len);
+        queue_dir(index,hierarchy.root_loc_);
+
+        if (hierarchy.path_table_size_ == 0)
+        {
+            throw VerificationException(ckT("The path table size must not be zero."),
+                                        ckT("ECMA 119: 8.4.14."));
+        }
+
+        // The size is read from the image, it must be checked before a
+        // buffer for the table is allocated.
+        if (hierarchy.path_table_size_ > ISOVERIFIER_MAX_PATH_TABLE_SIZE)
+        {
             ckcore::tstringstream msg;
-            msg << ckT("Invalid volume descriptor of type ") << type
-                << ckT(" at sector ") << (in_stream.get_sector() - 1) << ckT(".");
-            throw ckcore::Exception2(msg.str());
+            msg << ckT("The path table size of ") << hierarchy.path_table_size_
+                << ckT(" bytes exceeds the size of a table of 65535 directories.");
+
+            throw VerificationException(msg.str(),ckT("ECMA 119: 9.4."));
+        }
+
+        // Sector zero is part of the system area, only the optional path
+        // tables may be omitted by recording zero.
+        ckcore::tuint32 path_table_loc = read731(path_table_type_l);
+        if (path_table_loc == 0)
+        {
+            throw VerificationException(ckT("The location of the type L path table must not be zero."),
+                                        ckT("ECMA 119: 8.4.15."));
+        }
+        queue_.push(WorkItem(path_table_loc,ITEM_PATH_TABLE_L,index));
+
+        path_table_loc = read731(opt_path_table_type_l);
+        if (path_table_loc != 0)
+            queue_.push(WorkItem(path_table_loc,ITEM_PATH_TABLE_L,index));
+
+        path_table_loc = read732(path_table_type_m);
+        if (path_table_loc == 0)
+        {
+            throw VerificationException(ckT("The location of the type M path table must not be zero."),
+                                        ckT("ECMA 119: 8.4.17."));
         }
+        queue_.push(WorkItem(path_table_loc,ITEM_PATH_TABLE_M,index));
+
+        path_table_loc = read732(opt_path_table_type_m);
+        if (path_table_loc != 0)
+            queue_.push(WorkItem(path_table_loc,ITEM_PATH_TABLE_M,index));
     }
 
     /**
-     * Resets the internal state of the verifier, making it ready for a new
-     * verification analysis.
+     * Verifies that an extent is located within the volume space.
+     * @param [in] extent_loc The first sector of the extent.
+     * @param [in] extent_len The extent length in bytes.
+     * @param [in] vol_space_size The volume space size in sectors.
+     * @param [in] label What the extent contains, used in error messages.
+     * @throw VerificationException If the extent exceeds the volume space.
      */
-    void IsoVerifier::reset()
+    void IsoHierarchyVerifier::verify_extent(ckcore::tuint32 extent_loc,ckcore::tuint64 extent_len,
+                                             ckcore::tuint32 vol_space_size,const ckcore::tchar *label)
     {
+        ckcore::tuint64 sec_count = bytes_to_sec64(extent_len);
+        if (extent_loc + sec_count > vol_space_size)
+        {
+            ckcore::tstringstream msg;
+            msg << ckT("The ") << label << ckT(" extent at sector ") << extent_loc
+                << ckT(" (") << sec_count << ckT(" sectors) exceeds the volume space size of ")
+                << vol_space_size << ckT(" sectors.");
+            throw VerificationException(msg.str(),ckT("ECMA 119: 8.4.8."));
+        }
     }
 
     /**
-     * Verifies the file system provided by the specified input stream.
-     * @throw Exception on any error.
+     * Registers an extent for overlap checking.
+     * @param [in] extent_loc The first sector of the extent.
+     * @param [in] extent_len The extent length in bytes.
+     * @param [in] label What the extent contains, used in error messages.
+     * @throw VerificationException If the extent exceeds the volume space.
      */
-    void IsoVerifier::verify(SectorInStream &in_stream)
+    void IsoHierarchyVerifier::add_extent(ckcore::tuint32 extent_loc,ckcore::tuint64 extent_len,
+                                          const ckcore::tchar *label)
     {
-        reset();
-
-        //ckcore::log::print_line(ckT("Analyzing: "),in_stream.);
+        if (extent_len == 0)
+            return;
 
-        // Skip the first 16 sectors.
-        in_stream.seek(16 * 2048,ckcore::InStream::ckSTREAM_BEGIN);
+        verify_extent(extent_loc,extent_len,vol_space_size_,label);
 
-        //read_vol_desc(in_stream);
+        extents_.push_back(std::make_pair(extent_loc,static_cast<ckcore::tuint32>(bytes_to_sec64(extent_len))));
+    }
 
-        IsoVolDescSet voldesc_set;
-        voldesc_set.read(in_stream);
+    /**
+     * Queues a directory for verification unless already queued.
+     */
+    void IsoHierarchyVerifier::queue_dir(size_t hierarchy,ckcore::tuint32 extent_loc)
+    {
+        DirInfo &dir = hierarchies_[hierarchy].dirs_[extent_loc];
+        if (dir.queued_)
+            return;
 
-        voldesc_set.verify();
+        dir.queued_ = true;
+        queue_.push(WorkItem(extent_loc,ITEM_DIRECTORY,hierarchy));
     }
 
     /**
-     * Verifies that the specified string contains only valid a-characters.
-     * @param [in] str The string to verify.
-     * @param [in] len The string length counter in characters.
-     * @throw VerificationException If the string is invalid.
+     * Reads the next sector into the internal buffer.
+     * @throw Exception If the sector could not be read.
      */
-    void IsoVerifier::verify_a_chars(const unsigned char *str,size_t len)
+    void IsoHierarchyVerifier::read_sector(SectorInStream &in_stream)
     {
-        for (size_t i = 0; i < len; i++)
+        ckcore::tuint64 cur_sec = in_stream.get_sector();
+        if (in_stream.end() || in_stream.read(buffer_,ISO_SECTOR_SIZE) != ISO_SECTOR_SIZE)
         {
-            unsigned char c = str[i];
-            if (c >= ' ' && c <= '"')
-                continue;
-            if (c >= '%' && c <= '?')
-                continue;
-            if (c >= 'A' && c <= 'Z')
-                continue;
-            if (c == '_')
-                continue;
-
-            char str_buffer[1024];
-            memcpy(str_buffer,str,len);
-            str_buffer[len] = '\0';
-
             ckcore::tstringstream msg;
-            msg << ckT("Invalid character '") << (char)c << ckT("' in the a-string \"")
-                << ckcore::string::ansi_to_auto<1024>(str_buffer)
-                << ckT("\".");
-            throw VerificationException(msg.str(),ckT("ECMA 119: Appendix A."));
+            msg << ckT("Unexpected end of file system at sector ") << cur_sec << ckT(".");
+            throw ckcore::Exception2(msg.str());
         }
     }
 
     /**
-     * Verifies that the specified string contains only valid d-characters.
-     * @param [in] str The string to verify.
-     * @param [in] len The string length counter in characters.
-     * @param [in] allow_sep Set to true to accept SEPARATOR 1 and SEPARATOR 2
-     *                       characters.
-     * @throw VerificationException If the string is invalid.
+     * Advances the stream to the specified sector. Data is read and discarded
+     * rather than seeked past, making it possible to use non-seekable streams.
+     * @param [in] in_stream The stream to advance.
+     * @param [in] sector The target sector.
+     * @return If successful true is returned, if the sector has already been
+     *         passed false is returned.
      */
-    void IsoVerifier::verify_d_chars(const unsigned char *str,size_t len,bool allow_sep)
+    bool IsoHierarchyVerifier::skip_to(SectorInStream &in_stream,ckcore::tuint32 sector)
+    {
+        if (sector < in_stream.get_sector())
+            return false;
+
+        while (in_stream.get_sector() < sector)
+            read_sector(in_stream);
+
+        return true;
+    }
+
+    /**
+     * Parses and verifies the records of a path table.
+     * @param [in] table The complete path table.
+     * @param [in] sector The first sector of the path table.
+     * @param [in] type_l true for a type L table, false for a type M table.
+     * @param [out] records The parsed records.
+     * @param [out] idents The directory identifiers of all records.
+     * @throw VerificationException If the path table is invalid.
+     */
+    void IsoHierarchyVerifier::parse_path_table(const std::vector<unsigned char> &table,
+                                                ckcore::tuint32 sector,bool type_l,
+                                                std::vector<PathTableRecord> &records,
+                                                std::vector<unsigned char> &idents)
     {
-        for (size_t i = 0; i < len; i++)
+        const ckcore::tuint32 size = static_cast<ckcore::tuint32>(table.size());
+
+        ckcore::tuint32 pos = 0;
+        while (pos < size)
         {
-            unsigned char c = str[i];
-            if (c >= '0' && c <= '9')
-                continue;
-            if (c >= 'A' && c <= 'Z')
-                continue;
-            if (c == '_')
-                continue;
-            if (allow_sep)
+            if (pos + sizeof(tiso_pathtable_record) - 1 > size ||
+                pos + sizeof(tiso_pathtable_record) - 1 + table[pos] > size)
             {
-                // SEPARATOR 1 or SEPARATOR 2, in according to ECMA 119: 7.4.3.
-                if (c == 0x2e || c == 0x3b)
-                    continue;
+                ckcore::tstringstream msg;
+                msg << ckT("Truncated record ") << (records.size() + 1)
+                    << ckT(" in path table at sector ") << sector << ckT(".");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 9.4."));
             }
 
-            char str_buffer[1024];
-            memcpy(str_buffer,str,len);
-            str_buffer[len] = '\0';
+            const tiso_pathtable_record *ptr =
+                reinterpret_cast<const tiso_pathtable_record *>(&table[pos]);
+            if (ptr->dir_ident_len == 0)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("Record ") << (records.size() + 1) << ckT(" in path table at sector ")
+                    << sector << ckT(" has an empty directory identifier.");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 9.4.1."));
+            }
+
+            PathTableRecord rec;
+            rec.extent_loc_ = type_l ? read731(ptr->extent_loc) : read732(ptr->extent_loc);
+            rec.parent_num_ = type_l ? read721(ptr->parent_dir_num) : read722(ptr->parent_dir_num);
+            rec.ident_off_ = static_cast<ckcore::tuint32>(idents.size());
+            rec.ident_len_ = ptr->dir_ident_len;
+            idents.insert(idents.end(),ptr->dir_ident,ptr->dir_ident + ptr->dir_ident_len);
+            records.push_back(rec);
+
+            // Records of odd length are padded with one byte.
+            pos += sizeof(tiso_pathtable_record) - 1 + ptr->dir_ident_len + (ptr->dir_ident_len & 1);
+        }
 
+        if (pos != size)
+        {
             ckcore::tstringstream msg;
-            msg << ckT("Invalid character '") << (char)c << ckT("' in the d-string \"")
-                << ckcore::string::ansi_to_auto<1024>(str_buffer)
-                << ckT("\".");
-            throw VerificationException(msg.str(),ckT("ECMA 119: Appendix A."));
+            msg << ckT("The path table at sector ") << sector
+                << ckT(" does not end on a record boundary.");
+            throw VerificationException(msg.str(),ckT("ECMA 119: 6.9."));
         }
     }
 
     /**
-     * Verifies that the specified string contains only valid Joliet
-     * characters.
-     * @param [in] str The string to verify.
-     * @param [in] len The string length counter in characters.
-     * @throw VerificationException If the string is invalid.
+     * Reads and verifies a path table.
+     * @param [in] in_stream The stream to read from, positioned at the table.
+     * @param [in] hierarchy Index of the hierarchy owning the table.
+     * @param [in] sector The first sector of the path table.
+     * @param [in] type_l true for a type L table, false for a type M table.
+     * @throw VerificationException If the path table is invalid.
      */
-    void IsoVerifier::verify_j_chars(const unsigned char *str,size_t len)
+    void IsoHierarchyVerifier::read_path_table(SectorInStream &in_stream,size_t hierarchy,
+                                               ckcore::tuint32 sector,bool type_l)
     {
-        for (size_t i = 0; i < len; i++)
+        Hierarchy &h = hierarchies_[hierarchy];
+        const ckcore::tuint32 size = h.path_table_size_;
+
+        log_.print_line(ckT("  Found: %s type %s path table at sector %d."),
+                                label(h),type_l ? ckT("L") : ckT("M"),sector);
+
+        add_extent(sector,size,ckT("path table"));
+
+        // Read the complete table, its size is proportional to the number of
+        // directories and not to the size of the file system.
+        std::vector<unsigned char> table(size);
+        for (ckcore::tuint32 pos = 0; pos < size; pos += ISO_SECTOR_SIZE)
         {
-            unsigned char c = str[i];
-            if (c == '*' || c == '/' || c == ':' ||
-                c == ';' || c == '?' || c == '\\')
+            read_sector(in_stream);
+            memcpy(&table[pos],buffer_,std::min<ckcore::tuint32>(size - pos,ISO_SECTOR_SIZE));
+        }
+
+        std::vector<PathTableRecord> records;
+        std::vector<unsigned char> idents;
+        parse_path_table(table,sector,type_l,records,idents);
+
+        add_path_table(hierarchy,sector,type_l,records,idents);
+    }
+
+    /**
+     * Verifies the parsed records of a path table against the hierarchy. The
+     * first table read becomes the reference table and all its directories
+     * are queued for verification, additional tables must be identical.
+     * @param [in] hierarchy Index of the hierarchy owning the table.
+     * @param [in] sector The first sector of the path table.
+     * @param [in] type_l true for a type L table, false for a type M table.
+     * @param [in] records The parsed records, may be swapped out.
+     * @param [in] idents The parsed identifiers, may be swapped out.
+     * @throw VerificationException If the path table is invalid.
+     */
+    void IsoHierarchyVerifier::add_path_table(size_t hierarchy,ckcore::tuint32 sector,bool type_l,
+                                              std::vector<PathTableRecord> &records,
+                                              std::vector<unsigned char> &idents)
+    {
+        Hierarchy &h = hierarchies_[hierarchy];
+
+        // Additional tables must be identical to the first one.
+        if (h.path_table_read_)
+        {
+            for (size_t i = 0; i < records.size() || i < h.path_table_.size(); i++)
             {
-                char str_buffer[1024];
-                memcpy(str_buffer,str,len);
-                str_buffer[len] = '\0';
+                bool match = i < records.size() && i < h.path_table_.size();
+                if (match)
+                {
+                    const PathTableRecord &rec1 = h.path_table_[i];
+                    const PathTableRecord &rec2 = records[i];
+                    match = rec1.extent_loc_ == rec2.extent_loc_ &&
+                            rec1.parent_num_ == rec2.parent_num_ &&
+                            rec1.ident_len_ == rec2.ident_len_ &&
+                            !memcmp(&h.path_table_idents_[rec1.ident_off_],
+                                    &idents[rec2.ident_off_],rec1.ident_len_);
+                }
+
+                if (!match)
+                {
+                    ckcore::tstringstream msg;
+                    msg << ckT("The type ") << (type_l ? ckT("L") : ckT("M"))
+                        << ckT(" path table at sector ") << sector
+                        << ckT(" differs from the previously read path table at record ")
+                        << (i + 1) << ckT(".");
+                    throw VerificationException(msg.str(),ckT("ECMA 119: 6.9."));
+                }
+            }
 
+            return;
+        }
+
+        // Verify the root record.
+        if (records[0].ident_len_ != 1 || idents[records[0].ident_off_] != 0 ||
+            records[0].parent_num_ != 1)
+        {
+            throw VerificationException(ckT("The first path table record does not describe the root directory."),
+                                        ckT("ECMA 119: 6.9.1."));
+        }
+
+        if (records[0].extent_loc_ != h.root_loc_)
+        {
+            ckcore::tstringstream msg;
+            msg << ckT("The root path table record refers to sector ") << records[0].extent_loc_
+                << ckT(", but the root directory record refers to sector ") << h.root_loc_ << ckT(".");
+            throw VerificationException(msg.str(),ckT("ECMA 119: 6.9.1."));
+        }
+
+        // Verify the parent numbering. Parents must be recorded before their
+        // children and the records must be ordered by parent number.
+        for (size_t i = 1; i < records.size(); i++)
+        {
+            const PathTableRecord &rec = records[i];
+            if (rec.parent_num_ < 1 || rec.parent_num_ > i)
+            {
                 ckcore::tstringstream msg;
-                msg << ckT("Invalid character '") << (char)c << ckT("' in the Joliet string \"")
-                    << ckcore::string::ansi_to_auto<1024>(str_buffer)
-                    << ckT("\".");
-                throw VerificationException(msg.str(),ckT("Joliet Specification: Allowed Character Set"));
+                msg << ckT("Path table record ") << (i + 1) << ckT(" refers to parent directory number ")
+                    << rec.parent_num_ << ckT(" which has not been recorded before it.");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 6.9.1."));
             }
+
+            const PathTableRecord &prev = records[i - 1];
+            if (rec.parent_num_ < prev.parent_num_)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("Path table record ") << (i + 1)
+                    << ckT(" is not ordered by parent directory number.");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 6.9.1."));
+            }
+
+            // Siblings should be ordered by identifier, DVD-Video images are
+            // deliberately ordered differently so only warn.
+            if (i > 1 && rec.parent_num_ == prev.parent_num_)
+            {
+                int res = memcmp(&idents[prev.ident_off_],&idents[rec.ident_off_],
+                                 std::min(prev.ident_len_,rec.ident_len_));
+                if (res > 0 || (res == 0 && prev.ident_len_ >= rec.ident_len_))
+                {
+                    log_.print_line(ckT("=> Warning: Path table record %d is not ordered by directory identifier."),
+                                            static_cast<ckcore::tuint32>(i + 1));
+                    log_.print_line(ckT("=>          See ECMA 119: 6.9.1."));
+                }
+            }
+        }
+
+        h.path_table_.swap(records);
+        h.path_table_idents_.swap(idents);
+        h.path_table_read_ = true;
+
+        // All directories are now known, queue them for verification.
+        for (size_t i = 0; i < h.path_table_.size(); i++)
+        {
+            DirInfo &dir = h.dirs_[h.path_table_[i].extent_loc_];
+            if (dir.path_num_ != 0)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("Path table records ") << dir.path_num_ << ckT(" and ") << (i + 1)
+                    << ckT(" refer to the same directory extent.");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 6.9."));
+            }
+
+            dir.path_num_ = static_cast<ckcore::tuint32>(i + 1);
+            queue_dir(hierarchy,h.path_table_[i].extent_loc_);
+        }
+    }
+
+    /**
+     * Verifies a file identifier. Joliet violations are errors, ISO9660
+     * identifiers outside the d-character set are counted as warnings since
+     * relaxed character sets are commonly used on purpose.
+     * @throw VerificationException If the identifier is invalid.
+     */
+    void IsoHierarchyVerifier::verify_ident(DirScan &scan,const tiso_dir_record &dr,
+                                            const unsigned char *file_ident,bool joliet)
+    {
+        const bool dir = (dr.file_flags & DIRRECORD_FILEFLAG_DIRECTORY) != 0;
+
+        if (file_ident[0] <= 1 && dr.file_ident_len == 1)
+        {
+            throw VerificationException(ckT("Only the first two directory records may use the reserved identifiers 0 and 1."),
+                                        ckT("ECMA 119: 6.8.2.2."));
+        }
+
+        if (joliet)
+        {
+            if (dr.file_ident_len & 1)
+            {
+                throw VerificationException(ckT("Joliet file identifiers must be of even length."),
+                                            ckT("Joliet Specification: Directory Record"));
+            }
+
+            // The character class finds the bytes of the reserved characters.
+            // Other UCS-2 characters may contain the same bytes, so each match
+            // is checked as a whole character.
+            size_t len = dr.file_ident_len;
+            size_t invalid = len;
+
+            size_t pos = 0;
+            while ((pos += charclass::find_invalid(charclass::CHARCLASS_J,file_ident + pos,len - pos)) < len)
+            {
+                size_t i = pos & ~static_cast<size_t>(1);
+                wchar_t c = (file_ident[i] << 8) | file_ident[i + 1];
+
+                // The file version is separated by a semicolon.
+                if (c == ';' && !dir)
+                {
+                    len = i;
+                    break;
+                }
+
+                if (c == '*' || c == '/' || c == ':' || c == ';' || c == '?' || c == '\\')
+                {
+                    invalid = i;
+                    break;
+                }
+
+                pos = i + 2;
+            }
+
+            // Control characters can't be told from other characters by a
+            // single byte.
+            for (size_t i = 0; i < len && i < invalid; i += 2)
+            {
+                if (file_ident[i] == 0 && file_ident[i + 1] < 0x20)
+                {
+                    invalid = i;
+                    break;
+                }
+            }
+
+            if (invalid < len)
+            {
+                wchar_t c = (file_ident[invalid] << 8) | file_ident[invalid + 1];
+
+                ckcore::tstringstream msg;
+                msg << ckT("Invalid character ") << static_cast<ckcore::tuint32>(c)
+                    << ckT(" in Joliet file identifier.");
+                throw VerificationException(msg.str(),ckT("Joliet Specification: Allowed Character Set"));
+            }
+        }
+        else
+        {
+            try
+            {
+                IsoVerifier::verify_d_chars(file_ident,dr.file_ident_len,!dir);
+            }
+            catch (const VerificationException &e)
+            {
+                if (scan.ident_warnings_++ == 0)
+                {
+                    scan.ident_warning_ = ckcore::get_except_msg(e);
+                    scan.ident_warning_ref_ = e.reference();
+                }
+            }
+        }
+    }
+
+    /**
+     * Verifies all directory records in one sector of a directory extent.
+     * @param [in,out] scan The state of the directory being scanned.
+     * @param [in] buffer The sector data.
+     * @param [in] sector_index Index of the sector within the extent.
+     * @param [in] joliet true if the directory belongs to a Joliet hierarchy.
+     * @throw VerificationException If the directory is invalid.
+     */
+    void IsoHierarchyVerifier::scan_dir_sector(DirScan &scan,const unsigned char *buffer,
+                                               ckcore::tuint32 sector_index,bool joliet)
+    {
+        const ckcore::tuint32 extent_loc = scan.extent_loc_;
+
+        ckcore::tuint32 pos = 0;
+        while (pos < ISO_SECTOR_SIZE)
+        {
+            const unsigned char rec_len = buffer[pos];
+
+            // The remaining part of the sector should be zero padding.
+            if (rec_len == 0)
+            {
+                for (ckcore::tuint32 j = pos; j < ISO_SECTOR_SIZE; j++)
+                {
+                    if (buffer[j] != 0)
+                    {
+                        ckcore::tstringstream msg;
+                        msg << ckT("Non-zero padding in directory at sector ")
+                            << (extent_loc + sector_index) << ckT(", offset ") << j << ckT(".");
+                        throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.1.1."));
+                    }
+                }
+
+                break;
+            }
+
+            tiso_dir_record dr;
+            memset(&dr,0,sizeof(dr));
+            memcpy(&dr,buffer + pos,std::min<size_t>(rec_len,sizeof(dr)));
+
+            if (rec_len < sizeof(tiso_dir_record) || pos + rec_len > ISO_SECTOR_SIZE ||
+                sizeof(tiso_dir_record) - 1 + dr.file_ident_len > rec_len)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("Invalid directory record length ") << static_cast<ckcore::tuint32>(rec_len)
+                    << ckT(" in directory at sector ") << (extent_loc + sector_index)
+                    << ckT(", offset ") << pos << ckT(".");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.1.1."));
+            }
+
+            const unsigned char *file_ident = buffer + pos + sizeof(tiso_dir_record) - 1;
+
+            verify(dr.rec_timestamp);
+
+            if (scan.rec_count_ < 2)
+            {
+                // The '.' and '..' records.
+                if (dr.file_ident_len != 1 || file_ident[0] != scan.rec_count_ ||
+                    !(dr.file_flags & DIRRECORD_FILEFLAG_DIRECTORY))
+                {
+                    ckcore::tstringstream msg;
+                    msg << ckT("The directory at sector ") << extent_loc
+                        << ckT(" does not start with '.' and '..' records.");
+                    throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.2.2."));
+                }
+
+                const ckcore::tuint32 rec_loc = read733(dr.extent_loc);
+                if (scan.rec_count_ == 0)
+                {
+                    const ckcore::tuint32 data_len = read733(dr.data_len);
+                    if (rec_loc != extent_loc || data_len == 0)
+                    {
+                        ckcore::tstringstream msg;
+                        msg << ckT("The '.' record of the directory at sector ") << extent_loc
+                            << ckT(" does not describe the directory itself.");
+                        throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.2.2."));
+                    }
+
+                    scan.data_len_ = data_len;
+                    scan.sec_count_ = bytes_to_sec(data_len);
+                }
+                else
+                {
+                    scan.parent_loc_ = rec_loc;
+                }
+            }
+            else
+            {
+                verify_file_flags(dr.file_flags);
+                verify_ident(scan,dr,file_ident,joliet);
+
+                DirEntry entry;
+                entry.extent_loc_ = read733(dr.extent_loc);
+                entry.data_len_ = read733(dr.data_len);
+                entry.dir_ = (dr.file_flags & DIRRECORD_FILEFLAG_DIRECTORY) != 0;
+                scan.entries_.push_back(entry);
+            }
+
+            scan.rec_count_++;
+            pos += rec_len;
+        }
+    }
+
+    /**
+     * Verifies that a completely scanned directory contains the mandatory
+     * records.
+     * @throw VerificationException If the directory is invalid.
+     */
+    void IsoHierarchyVerifier::scan_dir_end(const DirScan &scan)
+    {
+        if (scan.rec_count_ < 2)
+        {
+            ckcore::tstringstream msg;
+            msg << ckT("The directory at sector ") << scan.extent_loc_
+                << ckT(" does not contain '.' and '..' records.");
+            throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.2.2."));
+        }
+    }
+
+    /**
+     * Reads and verifies all records of a directory.
+     * @param [in] in_stream The stream to read from, positioned at the extent.
+     * @param [in] hierarchy Index of the hierarchy owning the directory.
+     * @param [in] extent_loc The first sector of the directory extent.
+     * @throw VerificationException If the directory is invalid.
+     */
+    void IsoHierarchyVerifier::read_dir(SectorInStream &in_stream,size_t hierarchy,
+                                        ckcore::tuint32 extent_loc)
+    {
+        DirScan scan(extent_loc);
+
+        // The sector count is updated when the '.' record has been read, it
+        // must not take the scan beyond the volume space.
+        for (ckcore::tuint32 i = 0; i < scan.sec_count_; i++)
+        {
+            read_sector(in_stream);
+            scan_dir_sector(scan,buffer_,i,hierarchies_[hierarchy].joliet_);
+
+            if (i == 0)
+                verify_extent(extent_loc,scan.data_len_,vol_space_size_,ckT("directory"));
+        }
+
+        scan_dir_end(scan);
+        merge_dir(hierarchy,scan);
+    }
+
+    /**
+     * Merges a scanned directory into its hierarchy, verifying it against
+     * what is already known about the directory and its children.
+     * @param [in] hierarchy Index of the hierarchy owning the directory.
+     * @param [in] scan The scanned directory.
+     * @throw VerificationException If the directory is inconsistent.
+     */
+    void IsoHierarchyVerifier::merge_dir(size_t hierarchy,const DirScan &scan)
+    {
+        Hierarchy &h = hierarchies_[hierarchy];
+        h.dir_count_++;
+
+        const ckcore::tuint32 extent_loc = scan.extent_loc_;
+
+        // References to map elements remain valid when inserting new elements.
+        DirInfo &dir = h.dirs_[extent_loc];
+        dir.read_ = true;
+
+        if (dir.data_len_ != 0 && dir.data_len_ != scan.data_len_)
+        {
+            ckcore::tstringstream msg;
+            msg << ckT("The directory at sector ") << extent_loc << ckT(" is ")
+                << dir.data_len_ << ckT(" bytes according to its parent but ")
+                << scan.data_len_ << ckT(" bytes according to its own '.' record.");
+            throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.2.2."));
+        }
+
+        dir.data_len_ = scan.data_len_;
+        add_extent(extent_loc,scan.data_len_,ckT("directory"));
+
+        if (dir.parent_loc_ != 0 && dir.parent_loc_ != scan.parent_loc_)
+        {
+            ckcore::tstringstream msg;
+            msg << ckT("The '..' record of the directory at sector ") << extent_loc
+                << ckT(" refers to sector ") << scan.parent_loc_
+                << ckT(" but the directory belongs to the directory at sector ")
+                << dir.parent_loc_ << ckT(".");
+            throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.2.2."));
+        }
+
+        dir.parent_loc_ = scan.parent_loc_;
+
+        std::vector<DirEntry>::const_iterator it;
+        for (it = scan.entries_.begin(); it != scan.entries_.end(); it++)
+        {
+            if (it->dir_)
+            {
+                DirInfo &child = h.dirs_[it->extent_loc_];
+                if (child.parent_loc_ != 0 && child.parent_loc_ != extent_loc)
+                {
+                    ckcore::tstringstream msg;
+                    msg << ckT("The directory at sector ") << it->extent_loc_
+                        << ckT(" is referenced from the directories at sector ")
+                        << child.parent_loc_ << ckT(" and ") << extent_loc << ckT(".");
+                    throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.2."));
+                }
+
+                if (child.data_len_ != 0 && child.data_len_ != it->data_len_)
+                {
+                    ckcore::tstringstream msg;
+                    msg << ckT("The directory at sector ") << it->extent_loc_ << ckT(" is ")
+                        << it->data_len_ << ckT(" bytes according to its parent but ")
+                        << child.data_len_ << ckT(" bytes according to its own '.' record.");
+                    throw VerificationException(msg.str(),ckT("ECMA 119: 6.8.2.2."));
+                }
+
+                child.parent_loc_ = extent_loc;
+                child.data_len_ = it->data_len_;
+                queue_dir(hierarchy,it->extent_loc_);
+            }
+            else
+            {
+                h.file_count_++;
+                add_extent(it->extent_loc_,it->data_len_,ckT("file"));
+
+                if (it->data_len_ > 0)
+                    h.files_.push_back(std::make_pair(it->extent_loc_,it->data_len_));
+            }
+        }
+
+        if (scan.ident_warnings_ > 0)
+        {
+            if (h.ident_warnings_ == 0)
+            {
+                log_.print_line(ckT("=> Warning: %s"),scan.ident_warning_.c_str());
+                log_.print_line(ckT("=>          See %s"),scan.ident_warning_ref_.c_str());
+            }
+
+            h.ident_warnings_ += scan.ident_warnings_;
+        }
+    }
+
+    /**
+     * Cross-checks the path table of a hierarchy with its directory records.
+     * @throw VerificationException If the structures are inconsistent.
+     */
+    void IsoHierarchyVerifier::verify_hierarchy(const Hierarchy &hierarchy) const
+    {
+        if (!hierarchy.path_table_read_)
+        {
+            log_.print_line(ckT("=> Warning: The %s path table could not be verified in a single pass."),
+                                    label(hierarchy));
+            return;
+        }
+
+        for (size_t i = 0; i < hierarchy.path_table_.size(); i++)
+        {
+            const PathTableRecord &rec = hierarchy.path_table_[i];
+
+            std::map<ckcore::tuint32,DirInfo>::const_iterator it = hierarchy.dirs_.find(rec.extent_loc_);
+            if (it == hierarchy.dirs_.end() || !it->second.read_)
+                continue;
+
+            const ckcore::tuint32 parent_loc = hierarchy.path_table_[rec.parent_num_ - 1].extent_loc_;
+            if (it->second.parent_loc_ != parent_loc)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("Path table record ") << (i + 1) << ckT(" places the directory at sector ")
+                    << rec.extent_loc_ << ckT(" in the directory at sector ") << parent_loc
+                    << ckT(" but its directory records place it in the directory at sector ")
+                    << it->second.parent_loc_ << ckT(".");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 6.9.1."));
+            }
+        }
+
+        std::map<ckcore::tuint32,DirInfo>::const_iterator it;
+        for (it = hierarchy.dirs_.begin(); it != hierarchy.dirs_.end(); it++)
+        {
+            if (it->second.read_ && it->second.path_num_ == 0)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("The directory at sector ") << it->first
+                    << ckT(" is not present in the ") << label(hierarchy) << ckT(" path table.");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 6.9."));
+            }
+        }
+    }
+
+    /**
+     * Verifies that the supplementary hierarchies agree with the primary
+     * hierarchy. Files sharing an extent must be of the same size, files
+     * missing from the primary hierarchy (for example because of the
+     * ISO9660 depth limit) are only reported as warnings.
+     * @throw VerificationException If the hierarchies disagree.
+     */
+    void IsoHierarchyVerifier::verify_agreement()
+    {
+        if (hierarchies_.size() < 2)
+            return;
+
+        Hierarchy &primary = hierarchies_[0];
+        std::sort(primary.files_.begin(),primary.files_.end());
+
+        for (size_t i = 1; i < hierarchies_.size(); i++)
+        {
+            Hierarchy &h = hierarchies_[i];
+            std::sort(h.files_.begin(),h.files_.end());
+
+            ckcore::tuint32 missing = 0;
+
+            std::vector<std::pair<ckcore::tuint32,ckcore::tuint32> >::const_iterator it;
+            for (it = h.files_.begin(); it != h.files_.end(); it++)
+            {
+                if (std::binary_search(primary.files_.begin(),primary.files_.end(),*it))
+                    continue;
+
+                std::vector<std::pair<ckcore::tuint32,ckcore::tuint32> >::const_iterator it_primary =
+                    std::lower_bound(primary.files_.begin(),primary.files_.end(),
+                                     std::make_pair(it->first,static_cast<ckcore::tuint32>(0)));
+                if (it_primary == primary.files_.end() || it_primary->first != it->first)
+                {
+                    missing++;
+                    continue;
+                }
+
+                ckcore::tstringstream msg;
+                msg << ckT("The ") << label(h) << ckT(" file at sector ") << it->first
+                    << ckT(" is ") << it->second << ckT(" bytes but the ") << label(primary)
+                    << ckT(" file at the same sector is ") << it_primary->second << ckT(" bytes.");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 9.1.4."));
+            }
+
+            if (h.dir_count_ != primary.dir_count_)
+            {
+                log_.print_line(ckT("=> Warning: The %s hierarchy contains %d directories but the %s hierarchy contains %d."),
+                                        label(h),h.dir_count_,label(primary),primary.dir_count_);
+            }
+
+            if (missing > 0)
+            {
+                log_.print_line(ckT("=> Warning: %d %s files do not have a matching %s file."),
+                                        missing,label(h),label(primary));
+            }
+        }
+    }
+
+    /**
+     * Verifies that no two extents overlap. Identical extents are accepted
+     * since the ISO9660 and Joliet hierarchies share file data.
+     * @throw VerificationException If two extents overlap.
+     */
+    void IsoHierarchyVerifier::verify_extents()
+    {
+        std::sort(extents_.begin(),extents_.end());
+        extents_.erase(std::unique(extents_.begin(),extents_.end()),extents_.end());
+
+        for (size_t i = 1; i < extents_.size(); i++)
+        {
+            const std::pair<ckcore::tuint32,ckcore::tuint32> &prev = extents_[i - 1];
+            const std::pair<ckcore::tuint32,ckcore::tuint32> &cur = extents_[i];
+
+            if (static_cast<ckcore::tuint64>(prev.first) + prev.second > cur.first)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("The extent at sector ") << prev.first << ckT(" (") << prev.second
+                    << ckT(" sectors) overlaps the extent at sector ") << cur.first
+                    << ckT(" (") << cur.second << ckT(" sectors).");
+                throw VerificationException(msg.str(),ckT("ECMA 119: 6.5."));
+            }
+        }
+    }
+
+    /**
+     * Registers all hierarchies described by a volume descriptor set.
+     * @param [in] voldesc_set The volume descriptor set.
+     * @param [in] voldesc_end The first sector after the volume descriptor
+     *                         set.
+     */
+    void IsoHierarchyVerifier::begin(const IsoVolDescSet &voldesc_set,ckcore::tuint32 voldesc_end)
+    {
+        log_.print_line(ckT("Verifying directory hierarchies..."));
+
+        const tiso_voldesc_primary &primary = voldesc_set.primary();
+        vol_space_size_ = read733(primary.vol_space_size);
+
+        // The system area and volume descriptor set.
+        add_extent(0,static_cast<ckcore::tuint64>(voldesc_end) * ISO_SECTOR_SIZE,
+                   ckT("volume descriptor set"));
+
+        add_hierarchy(primary.root_dir_record,primary.path_table_size,
+                      primary.path_table_type_l,primary.opt_path_table_type_l,
+                      primary.path_table_type_m,primary.opt_path_table_type_m,false);
+
+        // Only descriptors announcing UCS-2 contain Joliet identifiers, any
+        // other supplementary hierarchy is verified using the ISO9660 rules.
+        std::vector<tiso_voldesc_suppl>::const_iterator it;
+        for (it = voldesc_set.supplementary().begin(); it != voldesc_set.supplementary().end(); it++)
+        {
+            add_hierarchy(it->root_dir_record,it->path_table_size,
+                          it->path_table_type_l,it->opt_path_table_type_l,
+                          it->path_table_type_m,it->opt_path_table_type_m,
+                          iso_is_joliet(*it));
+        }
+    }
+
+    /**
+     * Performs the verifications requiring all structures to have been read
+     * and prints a summary.
+     */
+    void IsoHierarchyVerifier::end()
+    {
+        std::vector<Hierarchy>::const_iterator it_hierarchy;
+        for (it_hierarchy = hierarchies_.begin(); it_hierarchy != hierarchies_.end(); it_hierarchy++)
+        {
+            verify_hierarchy(*it_hierarchy);
+
+            log_.print_line(ckT("  %s: %d directories, %d files."),label(*it_hierarchy),
+                                    it_hierarchy->dir_count_,it_hierarchy->file_count_);
+
+            if (it_hierarchy->ident_warnings_ > 1)
+            {
+                log_.print_line(ckT("=> Warning: %d %s identifiers contain characters outside the d-character set."),
+                                        it_hierarchy->ident_warnings_,label(*it_hierarchy));
+            }
+        }
+
+        verify_agreement();
+        verify_extents();
+
+        log_.print_line(ckT("  Verified %d extents."),static_cast<ckcore::tuint32>(extents_.size()));
+        log_.print_line(ckT(""));
+    }
+
+    /**
+     * Removes all queued work items, in sector order.
+     * @param [out] items Vector to fill with the work items.
+     */
+    void IsoHierarchyVerifier::take_items(std::vector<WorkItem> &items)
+    {
+        items.clear();
+        while (!queue_.empty())
+        {
+            items.push_back(queue_.top());
+            queue_.pop();
+        }
+    }
+
+    /**
+     * Reports the errors of a completed batch of tasks. All errors but the
+     * first are printed, the first error (in sector order) is thrown.
+     * @param [in] tasks The tasks, ordered by sector.
+     * @throw Exception If any of the tasks failed.
+     */
+    void IsoHierarchyVerifier::throw_errors(const std::vector<VerifyTask *> &tasks) const
+    {
+        const VerifyTask *first = NULL;
+
+        std::vector<VerifyTask *>::const_iterator it;
+        for (it = tasks.begin(); it != tasks.end(); it++)
+        {
+            if (!(*it)->failed_)
+                continue;
+
+            if (first == NULL)
+            {
+                first = *it;
+                continue;
+            }
+
+            log_.print_line(ckT("=> Error: %s"),(*it)->message_.c_str());
+            if ((*it)->verification_)
+                log_.print_line(ckT("=>        See %s"),(*it)->reference_.c_str());
+        }
+
+        if (first == NULL)
+            return;
+
+        if (first->verification_)
+            throw VerificationException(first->message_,first->reference_.c_str());
+
+        throw ckcore::Exception2(first->message_);
+    }
+
+    /**
+     * Verifies the path tables, directory hierarchies and extents of the file
+     * system. The stream must be positioned directly after the volume
+     * descriptor set.
+     * @param [in] in_stream The stream to read from.
+     * @param [in] voldesc_set The volume descriptor set read from the stream.
+     * @throw Exception If an error occurred.
+     */
+    void IsoHierarchyVerifier::verify(SectorInStream &in_stream,const IsoVolDescSet &voldesc_set)
+    {
+        begin(voldesc_set,static_cast<ckcore::tuint32>(in_stream.get_sector()));
+
+        // Process everything in sector order.
+        while (!queue_.empty())
+        {
+            const WorkItem item = queue_.top();
+            queue_.pop();
+
+            if (!skip_to(in_stream,item.sector_))
+            {
+                log_.print_line(ckT("=> Warning: Unable to verify %s %s at sector %d, it is located before sector %d."),
+                                        label(hierarchies_[item.hierarchy_]),
+                                        item.type_ == ITEM_DIRECTORY ? ckT("directory") : ckT("path table"),
+                                        item.sector_,static_cast<ckcore::tuint32>(in_stream.get_sector()));
+                continue;
+            }
+
+            switch (item.type_)
+            {
+                case ITEM_PATH_TABLE_L:
+                    read_path_table(in_stream,item.hierarchy_,item.sector_,true);
+                    break;
+
+                case ITEM_PATH_TABLE_M:
+                    read_path_table(in_stream,item.hierarchy_,item.sector_,false);
+                    break;
+
+                case ITEM_DIRECTORY:
+                    read_dir(in_stream,item.hierarchy_,item.sector_);
+                    break;
+            }
+        }
+
+        end();
+    }
+
+    /**
+     * Verifies the path tables, directory hierarchies and extents of the file
+     * system using positional reads from multiple threads. All path tables
+     * are read first, then all known directories are read in rounds until no
+     * new directories are discovered.
+     * @param [in] reader The reader to read sectors from.
+     * @param [in] group The task group to read and scan structures on.
+     * @param [in] voldesc_set The volume descriptor set of the file system.
+     * @param [in] voldesc_end The first sector after the volume descriptor
+     *                         set.
+     * @throw Exception If an error occurred.
+     */
+    void IsoHierarchyVerifier::verify(SectorReader &reader,TaskGroup &group,
+                                      const IsoVolDescSet &voldesc_set,
+                                      ckcore::tuint32 voldesc_end)
+    {
+        begin(voldesc_set,voldesc_end);
+
+        std::vector<WorkItem> items;
+        take_items(items);
+
+        // Read all path tables.
+        std::vector<PathTableTask> path_table_tasks;
+        path_table_tasks.reserve(items.size());
+
+        std::vector<WorkItem>::const_iterator it;
+        for (it = items.begin(); it != items.end(); it++)
+        {
+            if (it->type_ == ITEM_DIRECTORY)
+            {
+                queue_.push(*it);
+                continue;
+            }
+
+            const Hierarchy &h = hierarchies_[it->hierarchy_];
+            const bool type_l = it->type_ == ITEM_PATH_TABLE_L;
+
+            log_.print_line(ckT("  Found: %s type %s path table at sector %d."),
+                                    label(h),type_l ? ckT("L") : ckT("M"),it->sector_);
+
+            add_extent(it->sector_,h.path_table_size_,ckT("path table"));
+            path_table_tasks.push_back(PathTableTask(&reader,it->hierarchy_,it->sector_,
+                                                     h.path_table_size_,type_l));
+        }
+
+        std::vector<VerifyTask *> tasks;
+        for (size_t i = 0; i < path_table_tasks.size(); i++)
+        {
+            tasks.push_back(&path_table_tasks[i]);
+            group.submit(&path_table_tasks[i]);
+        }
+
+        group.wait();
+        throw_errors(tasks);
+
+        for (size_t i = 0; i < path_table_tasks.size(); i++)
+        {
+            PathTableTask &task = path_table_tasks[i];
+            add_path_table(task.hierarchy_,task.sector_,task.type_l_,task.records_,task.idents_);
+        }
+
+        // Read the directories. Normally all directories are found in the
+        // path tables and a single round is enough.
+        while (!queue_.empty())
+        {
+            take_items(items);
+
+            std::vector<DirTask> dir_tasks;
+            dir_tasks.reserve(items.size());
+
+            for (it = items.begin(); it != items.end(); it++)
+            {
+                dir_tasks.push_back(DirTask(&reader,it->hierarchy_,it->sector_,
+                                            hierarchies_[it->hierarchy_].joliet_,
+                                            vol_space_size_));
+            }
+
+            tasks.clear();
+            for (size_t i = 0; i < dir_tasks.size(); i++)
+            {
+                tasks.push_back(&dir_tasks[i]);
+                group.submit(&dir_tasks[i]);
+            }
+
+            group.wait();
+            throw_errors(tasks);
+
+            for (size_t i = 0; i < dir_tasks.size(); i++)
+                merge_dir(dir_tasks[i].hierarchy_,dir_tasks[i].scan_);
+        }
+
+        end();
+    }
+
+    /**
+     * Constructs an IsoVerifier object printing its report to the standard
+     * output.
+     */
+    IsoVerifier::IsoVerifier() : log_(std_out_log)
+    {
+    }
+
+    /**
+     * Constructs an IsoVerifier object printing its report to the specified
+     * log instead of the standard output.
+     * @param [in] log The log to print the report to.
+     */
+    IsoVerifier::IsoVerifier(ckcore::Log &log) : log_(log)
+    {
+    }
+
+    /**
+     * Destructs the IsoVerifier object.
+     */
+    IsoVerifier::~IsoVerifier()
+    {
+    }
+
+    void IsoVerifier::read_vol_desc(SectorInStream &in_stream)
+    {
+        unsigned char buffer[2048];
+        in_stream.read(buffer,sizeof(buffer));
+
+        //tiso_voldesc_primary
+        unsigned char type = buffer[0];
+
+        switch (type)
+        {
+        case VOLDESCTYPE_BOOT_CATALOG:
+            //read_boot_cat(in_stream);
+            break;
+
+        case VOLDESCTYPE_PRIM_VOL_DESC:
+            //if (voldesc_primary_ != NULL)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("Encountered a second primary volume descriptor at sector ")
+                    << (in_stream.get_sector() - 1) << ckT(".");
+                throw ckcore::Exception2(msg.str());
+            }
+            break;
+
+        case VOLDESCTYPE_SUPPL_VOL_DESC:
+            break;
+
+        case VOLDESCTYPE_VOL_PARTITION_DESC:
+            break;
+
+        case VOLDESCTYPE_VOL_DESC_SET_TERM:
+            break;
+
+        default:
+            ckcore::tstringstream msg;
+            msg << ckT("Invalid volume descriptor of type ") << type
+                << ckT(" at sector ") << (in_stream.get_sector() - 1) << ckT(".");
+            throw ckcore::Exception2(msg.str());
+        }
+    }
+
+    /**
+     * Resets the internal state of the verifier, making it ready for a new
+     * verification analysis.
+     */
+    void IsoVerifier::reset()
+    {
+    }
+
+    /**
+     * Verifies the file system provided by the specified input stream.
+     * @throw Exception on any error.
+     */
+    void IsoVerifier::verify(SectorInStream &in_stream)
+    {
+        reset();
+
+        //log_.print_line(ckT("Analyzing: "),in_stream.);
+
+        // Skip the first 16 sectors. The data is read rather than seeked past
+        // to support non-seekable streams.
+        unsigned char buffer[ISO_SECTOR_SIZE];
+        for (unsigned int i = 0; i < 16; i++)
+            in_stream.read(buffer,sizeof(buffer));
+
+        //read_vol_desc(in_stream);
+
+        IsoVolDescSet voldesc_set(log_);
+        voldesc_set.read(in_stream);
+
+        voldesc_set.verify();
+
+        IsoHierarchyVerifier hierarchy_verifier(log_);
+        hierarchy_verifier.verify(in_stream,voldesc_set);
+    }
+
+    /**
+     * Verifies the file system using multiple threads. The volume descriptor
+     * set is read from the input stream, everything else is read from the
+     * random access reader.
+     * @param [in] in_stream The stream to read the volume descriptors from.
+     * @param [in] reader The reader to read all other structures from.
+     * @param [in] thread_count The number of threads to use.
+     * @throw Exception on any error.
+     */
+    void IsoVerifier::verify(SectorInStream &in_stream,SectorReader &reader,
+                             ckcore::tuint32 thread_count)
+    {
+        log_.print_line(ckT("Using %d threads."),thread_count);
+
+        ThreadPool pool(thread_count);
+        verify(in_stream,reader,pool);
+    }
+
+    /**
+     * Verifies the file system by running the parallel parts of the
+     * verification on an executor owned by the caller.
+     * @param [in] in_stream The stream to read the volume descriptors from.
+     * @param [in] reader The reader to read all other structures from.
+     * @param [in] executor The executor to run the verification tasks on.
+     * @param [in] max_concurrency The maximum number of verification tasks
+     *                             running at the same time, zero for no
+     *                             limit.
+     * @throw Exception on any error.
+     */
+    void IsoVerifier::verify(SectorInStream &in_stream,SectorReader &reader,
+                             Executor &executor,ckcore::tuint32 max_concurrency)
+    {
+        reset();
+
+        unsigned char buffer[ISO_SECTOR_SIZE];
+        for (unsigned int i = 0; i < 16; i++)
+            in_stream.read(buffer,sizeof(buffer));
+
+        IsoVolDescSet voldesc_set(log_);
+        voldesc_set.read(in_stream);
+
+        voldesc_set.verify();
+
+        TaskGroup group(executor,max_concurrency);
+
+        IsoHierarchyVerifier hierarchy_verifier(log_);
+        hierarchy_verifier.verify(reader,group,voldesc_set,
+                                  static_cast<ckcore::tuint32>(in_stream.get_sector()));
+    }
+
+    /**
+     * Verifies that the specified string contains only valid a-characters.
+     * @param [in] str The string to verify.
+     * @param [in] len The string length counter in characters.
+     * @throw VerificationException If the string is invalid.
+     */
+    void IsoVerifier::verify_a_chars(const unsigned char *str,size_t len)
+    {
+        size_t i = charclass::find_invalid(charclass::CHARCLASS_A,str,len);
+        if (i < len)
+        {
+            unsigned char c = str[i];
+
+            char str_buffer[1024];
+            memcpy(str_buffer,str,len);
+            str_buffer[len] = '\0';
+
+            ckcore::tstringstream msg;
+            msg << ckT("Invalid character '") << (char)c << ckT("' in the a-string \"")
+                << ckcore::string::ansi_to_auto<1024>(str_buffer)
+                << ckT("\".");
+            throw VerificationException(msg.str(),ckT("ECMA 119: Appendix A."));
+        }
+    }
+
+    /**
+     * Verifies that the specified string contains only valid d-characters.
+     * @param [in] str The string to verify.
+     * @param [in] len The string length counter in characters.
+     * @param [in] allow_sep Set to true to accept SEPARATOR 1 and SEPARATOR 2
+     *                       characters.
+     * @throw VerificationException If the string is invalid.
+     */
+    void IsoVerifier::verify_d_chars(const unsigned char *str,size_t len,bool allow_sep)
+    {
+        // SEPARATOR 1 and SEPARATOR 2 are allowed in according to ECMA 119: 7.4.3.
+        size_t i = charclass::find_invalid(allow_sep ? charclass::CHARCLASS_D_SEP :
+                                                       charclass::CHARCLASS_D,str,len);
+        if (i < len)
+        {
+            unsigned char c = str[i];
+
+            char str_buffer[1024];
+            memcpy(str_buffer,str,len);
+            str_buffer[len] = '\0';
+
+            ckcore::tstringstream msg;
+            msg << ckT("Invalid character '") << (char)c << ckT("' in the d-string \"")
+                << ckcore::string::ansi_to_auto<1024>(str_buffer)
+                << ckT("\".");
+            throw VerificationException(msg.str(),ckT("ECMA 119: Appendix A."));
+        }
+    }
+
+    /**
+     * Verifies that the specified string contains only valid Joliet
+     * characters.
+     * @param [in] str The string to verify.
+     * @param [in] len The string length counter in characters.
+     * @throw VerificationException If the string is invalid.
+     */
+    void IsoVerifier::verify_j_chars(const unsigned char *str,size_t len)
+    {
+        size_t i = charclass::find_invalid(charclass::CHARCLASS_J,str,len);
+        if (i < len)
+        {
+            unsigned char c = str[i];
+
+            char str_buffer[1024];
+            memcpy(str_buffer,str,len);
+            str_buffer[len] = '\0';
+
+            ckcore::tstringstream msg;
+            msg << ckT("Invalid character '") << (char)c << ckT("' in the Joliet string \"")
+                << ckcore::string::ansi_to_auto<1024>(str_buffer)
+                << ckT("\".");
+            throw VerificationException(msg.str(),ckT("Joliet Specification: Allowed Character Set"));
         }
     }
 
@@ -20,12 +20,11 @@
 #include <string.h>
 #include <stdio.h>
 #include <wctype.h>
-#include <ckcore/file.hh>
-#include <ckcore/directory.hh>
 #include <ckcore/convert.hh>
 #include "ckfilesystem/util.hh"
 #include "ckfilesystem/stringtable.hh"
 #include "ckfilesystem/isoreader.hh"
+#include "ckfilesystem/trace.hh"
 #include "ckfilesystem/isowriter.hh"
 
 namespace ckfilesystem
@@ -40,11 +39,7 @@ namespace ckfilesystem
         use_joliet_(use_joliet),use_file_times_(use_file_times),
         pathtable_size_normal_(0),pathtable_size_joliet_(0)
     {
-        // Get system time.
-        time_t cur_time;
-        time(&cur_time);
-
-        create_time_ = *localtime(&cur_time);
+        file_sys_.get_create_time(create_time_);
     }
 
     IsoWriter::~IsoWriter()
@@ -312,6 +307,43 @@ namespace ckfilesystem
         memcpy(file_name_ptr,file_name,file_name_size);
     }
 
+    /**
+     * Returns the ISO9660 or Joliet file identifier of a node as it should be
+     * recorded on disc. The identifier is calculated and made unique on the
+     * first call, subsequent calls return the cached identifier.
+     * @param [in] node The node to get the identifier of.
+     * @param [in] joliet Set to true to get the Joliet identifier.
+     * @param [out] ident_len The length of the identifier in bytes.
+     * @return Pointer to the identifier, valid as long as the node is.
+     */
+    const unsigned char *IsoWriter::get_file_ident(FileTreeNode *node,bool joliet,
+                                                   unsigned char &ident_len)
+    {
+        std::string &ident = joliet ? node->file_ident_joliet_ : node->file_name_iso_;
+        if (ident.empty())
+        {
+            bool is_folder = node->file_flags_ & FileTreeNode::FLAG_DIRECTORY;
+
+            unsigned char file_name[ISOWRITER_FILENAME_BUFFER_SIZE];    // Large enough for both level 1, 2 and even Joliet.
+            unsigned char name_size;
+            if (joliet)
+            {
+                name_size = file_sys_.joliet_.write_file_name(file_name,node->file_name_.c_str(),is_folder) << 1;
+                make_unique_joliet(node,file_name,name_size);
+            }
+            else
+            {
+                name_size = file_sys_.iso_.write_file_name(file_name,node->file_name_.c_str(),is_folder);
+                make_unique_iso(node,file_name,name_size);
+            }
+
+            ident.assign(reinterpret_cast<const char *>(file_name),name_size);
+        }
+
+        ident_len = static_cast<unsigned char>(ident.size());
+        return reinterpret_cast<const unsigned char *>(ident.data());
+    }
+
     bool IsoWriter::compare_strings(const char *str1,const ckcore::tchar *str2,
                                     unsigned char len)
     {
@@ -371,12 +403,8 @@ namespace ckfilesystem
         IsoPathTable::const_iterator it;
         for (it = pt.begin(); it != pt.end(); it++)
         {
-            FileTreeNode *cur_node = it->first;
-
-            // FIXME: This can be made to use the length of the already computed names.
-            unsigned char name_len = joliet_table ?
-                file_sys_.joliet_.calc_file_name_len(cur_node->file_name_.c_str(),true) << 1 : 
-                file_sys_.iso_.calc_file_name_len(cur_node->file_name_.c_str(),true);
+            unsigned char name_len;
+            get_file_ident(it->first,joliet_table,name_len);
             unsigned char pathtable_rec_len = sizeof(tiso_pathtable_record) + name_len - 1;
 
             // If the record length is not even padd it with a 0 byte.
@@ -428,63 +456,8 @@ namespace ckfilesystem
                 factor++;
             }
 
-            bool is_folder = (*it_file)->file_flags_ & FileTreeNode::FLAG_DIRECTORY;
-
             unsigned char name_size;
-            
-            // Optimization: If the the compatible file name is equal (not case-sensitive) to the
-            // original file name we assume that it is uniqe.
-            unsigned char file_name[ISOWRITER_FILENAME_BUFFER_SIZE + 4]; // Large enough for level 1, 2 and even Joliet.
-            if (joliet)
-            {
-                name_size = file_sys_.joliet_.write_file_name(file_name,(*it_file)->file_name_.c_str(),is_folder) << 1;
-
-                unsigned char file_name_end;
-                if (!is_folder && file_sys_.joliet_.includes_file_ver_info())
-                    file_name_end = (name_size >> 1) - 2;
-                else
-                    file_name_end = (name_size >> 1);
-
-                // UPDATE: Removed due to causing duplicate Joliet file names.
-                /*if (compare_strings(file_name,(*it_file)->file_name_.c_str(),file_name_end))
-                {
-#ifdef _UNICODE
-                    (*it_file)->file_name_joliet_ = (*it_file)->file_name_;
-
-                    if (!is_folder && file_sys_.joliet_.includes_file_ver_info())
-                        (*it_file)->file_name_joliet_.append(L";1");
-#else
-                    wchar_t szWideFileName[(ISOWRITER_FILENAME_BUFFER_SIZE >> 1) + 1];
-                    unsigned char file_name_pos = 0;
-                    for (unsigned char i = 0; i < (name_len >> 1); i++)
-                    {
-                        szWideFileName[i]  = file_name[file_name_pos++] << 8;
-                        szWideFileName[i] |= file_name[file_name_pos++];
-                    }
-
-                    szWideFileName[name_len >> 1] = '\0';
-
-                    (*it_file)->file_name_joliet_ = szWideFileName;
-#endif
-                }*/
-            }
-            else
-            {
-                name_size = file_sys_.iso_.write_file_name(file_name,(*it_file)->file_name_.c_str(),is_folder);
-
-                unsigned char file_name_end;
-                if (!is_folder && file_sys_.iso_.includes_file_ver_info())
-                    file_name_end = name_size - 2;
-                else
-                    file_name_end = name_size;
-
-                // UPDATE: Removed due to causing duplicate ISO9660 file names.
-                /*if (compare_strings((const char *)file_name,(*it_file)->file_name_.c_str(),file_name_end))
-                {
-                    file_name[name_len] = '\0';
-                    (*it_file)->file_name_iso_ = (const char *)file_name;
-                }*/
-            }
+            get_file_ident(*it_file,joliet,name_size);
 
             unsigned char cur_rec_size = sizeof(tiso_dir_record) + name_size - 1;
 
@@ -572,30 +545,22 @@ namespace ckfilesystem
             node->children_.end(); it++)
         {
             FileTreeNode *cur_node = *it;
-            bool is_folder = cur_node->file_flags_ & FileTreeNode::FLAG_DIRECTORY;
-
-            if (is_folder)
+            if (cur_node->file_flags_ & FileTreeNode::FLAG_DIRECTORY)
                 node_stack.push_back(*it);
 
             unsigned char name_size;
-            unsigned char file_name[ISOWRITER_FILENAME_BUFFER_SIZE];    // Large enough for both level 1, 2 and even Joliet.
-
             if (file_sys_.is_iso())
-            {
-                name_size = file_sys_.iso_.write_file_name(file_name,cur_node->file_name_.c_str(),is_folder);
-                make_unique_iso(cur_node,file_name,name_size);
-            }
+                get_file_ident(cur_node,false,name_size);
 
             if (file_sys_.is_joliet())
-            {
-                name_size = file_sys_.joliet_.write_file_name(file_name,cur_node->file_name_.c_str(),is_folder) << 1;
-                make_unique_joliet(cur_node,file_name,name_size);
-            }
+                get_file_ident(cur_node,true,name_size);
         }
     }
 
     void IsoWriter::calc_names(FileTree &file_tree)
     {
+        CKFS_TRACE_SCOPE("iso","calc_names");
+
         FileTreeNode *cur_node = file_tree.get_root();
 
         std::vector<FileTreeNode *> node_stack;
@@ -658,18 +623,7 @@ namespace ckfilesystem
             memset(&path_record,0,sizeof(path_record));
 
             unsigned char name_size;
-            unsigned char file_name[ISOWRITER_FILENAME_BUFFER_SIZE];    // Large enough for both level 1, 2 and even Joliet.
-
-            if (joliet_table)
-            {
-                name_size = file_sys_.joliet_.write_file_name(file_name,cur_node->file_name_.c_str(),true) << 1;
-                make_unique_joliet(cur_node,file_name,name_size);
-            }
-            else
-            {
-                name_size = file_sys_.iso_.write_file_name(file_name,cur_node->file_name_.c_str(),true);
-                make_unique_iso(cur_node,file_name,name_size);
-            }
+            const unsigned char *file_name = get_file_ident(cur_node,joliet_table,name_size);
 
             // If the record length is not even padd it with a 0 byte.
             bool pad_byte = false;
@@ -703,7 +657,7 @@ namespace ckfilesystem
 
             // Write the record.
             out_stream_.write(&path_record,sizeof(path_record) - 1);
-            out_stream_.write(file_name,name_size);
+            out_stream_.write(const_cast<unsigned char *>(file_name),name_size);
 
             // Pad if necessary.
             if (pad_byte)
@@ -781,6 +735,8 @@ namespace ckfilesystem
 
     void IsoWriter::alloc_header()
     {
+        CKFS_TRACE_SCOPE("iso","alloc_header");
+
         // Allocate volume descriptor.
         ckcore::tuint32 voldesc_size = sizeof(tiso_voldesc_primary) + sizeof(tiso_voldesc_setterm);
         if (file_sys_.eltorito_.get_boot_image_count() > 0)
@@ -804,6 +760,8 @@ namespace ckfilesystem
                                       const IsoPathTable &pt_jol,
                                       ckcore::Progress &progress)
     {
+        CKFS_TRACE_SCOPE("iso","alloc_path_tables");
+
         // Calculate path table sizes.
         pathtable_size_normal_ = 0;
         if (!calc_path_table_size(pt_iso,false,pathtable_size_normal_,progress))
@@ -829,6 +787,8 @@ namespace ckfilesystem
 
     void IsoWriter::alloc_dir_entries(FileTree &file_tree)
     {
+        CKFS_TRACE_SCOPE("iso","alloc_dir_entries");
+
         ckcore::tuint64 dir_entries_len = 0;
         calc_dir_entries_len(file_tree,sec_manager_.get_next_free(),dir_entries_len);
 
@@ -843,6 +803,8 @@ namespace ckfilesystem
 
     void IsoWriter::write_header(const FileSet &files,FileTree &file_tree)
     {
+        CKFS_TRACE_SCOPE("iso","write_header");
+
         // Make sure that everything has been allocated.
         if (pathtable_size_normal_ == 0)
             throw ckcore::Exception2(ckT("Memory for ISO9660 path table has not been allocated."));
@@ -951,7 +913,9 @@ namespace ckfilesystem
                                       const IsoPathTable &pt_jol,
                                       FileTree &file_tree,ckcore::Progress &progress)
     {
-        progress.set_status(ckT("%s"),  StringTable::instance().get_string(StringTable::STATUS_WRITEISOTABLE));
+        CKFS_TRACE_SCOPE("iso","write_path_tables");
+
+        progress.set_status(ckT("%s"),  file_sys_.get_string_table().get_string(StringTable::STATUS_WRITEISOTABLE));
 
         // Write the path tables.
         write_path_table(pt_iso,file_tree,false,false);
@@ -959,7 +923,7 @@ namespace ckfilesystem
 
         if (use_joliet_)
         {
-            progress.set_status(ckT("%s"), StringTable::instance().get_string(StringTable::STATUS_WRITEJOLIETTABLE));
+            progress.set_status(ckT("%s"), file_sys_.get_string_table().get_string(StringTable::STATUS_WRITEJOLIETTABLE));
 
             write_path_table(pt_jol,file_tree,true,false);
             write_path_table(pt_jol,file_tree,true,true);
@@ -1031,21 +995,8 @@ namespace ckfilesystem
 
                 memset(&dr,0,sizeof(dr));
 
-                // Make a valid file name.
                 unsigned char name_size;
-                unsigned char file_name[ISOWRITER_FILENAME_BUFFER_SIZE + 4]; // Large enough for level 1, 2 and even Joliet.
-
-                bool is_folder = (*it_file)->file_flags_ & FileTreeNode::FLAG_DIRECTORY;
-                if (joliet)
-                {
-                    name_size = file_sys_.joliet_.write_file_name(file_name,(*it_file)->file_name_.c_str(),is_folder) << 1;
-                    make_unique_joliet((*it_file),file_name,name_size);
-                }
-                else
-                {
-                    name_size = file_sys_.iso_.write_file_name(file_name,(*it_file)->file_name_.c_str(),is_folder);
-                    make_unique_iso((*it_file),file_name,name_size);
-                }
+                const unsigned char *file_name = get_file_ident(*it_file,joliet,name_size);
 
                 // If the record length is not even pad it with a 0 byte.
                 bool pad_byte = false;
@@ -1085,19 +1036,7 @@ namespace ckfilesystem
                     if (use_file_times_)
                     {
                         struct tm access_time,modify_time,create_time;
-                        bool res = true;
-
-                        if ((*it_file)->file_flags_ & FileTreeNode::FLAG_DIRECTORY)
-                        {
-                            res = ckcore::Directory::time((*it_file)->file_path_.c_str(),
-                                                          access_time,modify_time,create_time);
-                            
-                        }
-                        else
-                        {
-                            res = ckcore::File::time((*it_file)->file_path_.c_str(),
-                                                     access_time,modify_time,create_time);
-                        }
+                        bool res = (*it_file)->stat_.get_times(access_time,modify_time,create_time);
 
                         ckcore::tuint16 file_date = 0,file_time = 0;
                         ckcore::convert::tm_to_dostime(modify_time,file_date,file_time);
@@ -1118,7 +1057,7 @@ namespace ckfilesystem
                     if ((*it_file)->file_flags_ & FileTreeNode::FLAG_DIRECTORY)
                         dr.file_flags |= DIRRECORD_FILEFLAG_DIRECTORY;
 
-                    if (ckcore::File::hidden((*it_file)->file_path_.c_str()))
+                    if ((*it_file)->stat_.hidden())
                         dr.file_flags |= DIRRECORD_FILEFLAG_HIDDEN;
 
                     dr.file_unit_size = 0;
@@ -1153,7 +1092,7 @@ namespace ckfilesystem
 
                 // Write the record.
                 out_stream_.write(&dr,sizeof(dr) - 1);
-                out_stream_.write(file_name,name_size);
+                out_stream_.write(const_cast<unsigned char *>(file_name),name_size);
 
                 // Pad if necessary.
                 if (pad_byte)
@@ -1207,7 +1146,9 @@ namespace ckfilesystem
 
     int IsoWriter::write_dir_entries(FileTree &file_tree,ckcore::Progress &progress)
     {
-        progress.set_status(ckT("%s"), StringTable::instance().get_string(StringTable::STATUS_WRITEDIRENTRIES));
+        CKFS_TRACE_SCOPE("iso","write_dir_entries");
+
+        progress.set_status(ckT("%s"), file_sys_.get_string_table().get_string(StringTable::STATUS_WRITEDIRENTRIES));
 
         FileTreeNode *cur_node = file_tree.get_root();
 
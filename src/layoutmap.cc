@@ -0,0 +1,292 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <string>
+#include <ckcore/filestream.hh>
+#include "ckfilesystem/layoutmap.hh"
+
+namespace ckfilesystem
+{
+#ifdef _UNICODE
+    /**
+     * Encodes a path as UTF-8.
+     * @param [in] path The path to encode, UTF-16 if wchar_t is 16 bits wide.
+     * @param [out] utf8 The encoded path is appended to this string.
+     */
+    static void path_to_utf8(const ckcore::tstring &path,std::string &utf8)
+    {
+        for (size_t i = 0; i < path.size(); i++)
+        {
+            unsigned long c = static_cast<unsigned long>(path[i]);
+
+            // Surrogate pair.
+            if (c >= 0xd800 && c < 0xdc00 && i + 1 < path.size() &&
+                static_cast<unsigned long>(path[i + 1]) >= 0xdc00 &&
+                static_cast<unsigned long>(path[i + 1]) < 0xe000)
+            {
+                c = 0x10000 + ((c - 0xd800) << 10) + (static_cast<unsigned long>(path[++i]) - 0xdc00);
+            }
+
+            if (c < 0x80)
+            {
+                utf8 += static_cast<char>(c);
+            }
+            else if (c < 0x800)
+            {
+                utf8 += static_cast<char>(0xc0 | (c >> 6));
+                utf8 += static_cast<char>(0x80 | (c & 0x3f));
+            }
+            else if (c < 0x10000)
+            {
+                utf8 += static_cast<char>(0xe0 | (c >> 12));
+                utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+                utf8 += static_cast<char>(0x80 | (c & 0x3f));
+            }
+            else
+            {
+                utf8 += static_cast<char>(0xf0 | (c >> 18));
+                utf8 += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+                utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+                utf8 += static_cast<char>(0x80 | (c & 0x3f));
+            }
+        }
+    }
+
+    /**
+     * Decodes an UTF-8 encoded path.
+     * @param [in] utf8 The encoded path.
+     * @param [out] path The decoded path.
+     * @return If the path is valid UTF-8 true is returned, otherwise false.
+     */
+    static bool utf8_to_path(const char *utf8,ckcore::tstring &path)
+    {
+        path.clear();
+
+        const unsigned char *ptr = reinterpret_cast<const unsigned char *>(utf8);
+        while (*ptr != 0)
+        {
+            unsigned long c = *ptr++;
+            int extra = 0;
+            if (c >= 0xf8)
+            {
+                return false;
+            }
+            else if (c >= 0xf0)
+            {
+                c &= 0x07;
+                extra = 3;
+            }
+            else if (c >= 0xe0)
+            {
+                c &= 0x0f;
+                extra = 2;
+            }
+            else if (c >= 0xc0)
+            {
+                c &= 0x1f;
+                extra = 1;
+            }
+            else if (c >= 0x80)
+            {
+                return false;
+            }
+
+            for (int i = 0; i < extra; i++)
+            {
+                if ((*ptr & 0xc0) != 0x80)
+                    return false;
+
+                c = (c << 6) | (*ptr++ & 0x3f);
+            }
+
+            if (c >= 0x10000 && sizeof(wchar_t) == 2)
+            {
+                c -= 0x10000;
+                path += static_cast<wchar_t>(0xd800 + (c >> 10));
+                path += static_cast<wchar_t>(0xdc00 + (c & 0x3ff));
+            }
+            else
+            {
+                path += static_cast<wchar_t>(c);
+            }
+        }
+
+        return true;
+    }
+#endif
+
+    LayoutMap::LayoutMap() :
+        sec_offset_(0)
+    {
+    }
+
+    /**
+     * Removes all files from the map.
+     */
+    void LayoutMap::clear()
+    {
+        entries_.clear();
+        sec_offset_ = 0;
+    }
+
+    /**
+     * Loads a layout map previously saved using save(). Any files already in
+     * the map are removed.
+     * @param [in] file_path Path to the layout map file.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool LayoutMap::load(const ckcore::tchar *file_path)
+    {
+        clear();
+
+        ckcore::FileInStream in_stream(file_path);
+        if (!in_stream.open())
+            return false;
+
+        std::string contents;
+        char buffer[4096];
+
+        while (!in_stream.end())
+        {
+            ckcore::tint64 processed = in_stream.read(buffer,sizeof(buffer));
+            if (processed == -1)
+                return false;
+            if (processed == 0)
+                break;
+
+            contents.append(buffer,static_cast<size_t>(processed));
+        }
+
+        size_t line_start = 0;
+        while (line_start < contents.size())
+        {
+            size_t line_end = contents.find('\n',line_start);
+            if (line_end == std::string::npos)
+                line_end = contents.size();
+
+            std::string line = contents.substr(line_start,line_end - line_start);
+            line_start = line_end + 1;
+
+            if (!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            unsigned long sec_offset = 0;
+            if (sscanf(line.c_str(),"sec_offset %lu",&sec_offset) == 1)
+            {
+                sec_offset_ = static_cast<ckcore::tuint32>(sec_offset);
+                continue;
+            }
+
+            unsigned long long sector = 0,size = 0;
+            long long modify_time = 0;
+            int path_pos = 0;
+            if (sscanf(line.c_str(),"%llu %llu %lld %n",&sector,&size,&modify_time,&path_pos) < 3 ||
+                path_pos == 0 || path_pos >= static_cast<int>(line.size()))
+            {
+                clear();
+                return false;
+            }
+
+#ifdef _UNICODE
+            ckcore::tstring internal_path;
+            if (!utf8_to_path(line.c_str() + path_pos,internal_path))
+            {
+                clear();
+                return false;
+            }
+#else
+            ckcore::tstring internal_path = line.c_str() + path_pos;
+#endif
+            add(internal_path,sector,size,modify_time);
+        }
+
+        return true;
+    }
+
+    /**
+     * Saves the layout map to a file.
+     * @param [in] file_path Path to the layout map file.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool LayoutMap::save(const ckcore::tchar *file_path) const
+    {
+        ckcore::FileOutStream out_stream(file_path);
+        if (!out_stream.open())
+            return false;
+
+        char buffer[64];
+        std::string contents = "# ckfilesystem layout map\n";
+
+        sprintf(buffer,"sec_offset %lu\n",static_cast<unsigned long>(sec_offset_));
+        contents.append(buffer);
+
+        std::map<ckcore::tstring,Entry>::const_iterator it;
+        for (it = entries_.begin(); it != entries_.end(); it++)
+        {
+            sprintf(buffer,"%llu %llu %lld ",static_cast<unsigned long long>(it->second.sector_),
+                    static_cast<unsigned long long>(it->second.size_),
+                    static_cast<long long>(it->second.modify_time_));
+            contents.append(buffer);
+#ifdef _UNICODE
+            path_to_utf8(it->first,contents);
+#else
+            contents.append(it->first);
+#endif
+            contents.append("\n");
+        }
+
+        return out_stream.write(contents.c_str(),static_cast<ckcore::tuint32>(contents.size())) ==
+               static_cast<ckcore::tint64>(contents.size());
+    }
+
+    /**
+     * Adds a file to the map, replacing any previous entry for the same path.
+     * @param [in] internal_path Path of the file in the disc image.
+     * @param [in] sector First sector of the file data.
+     * @param [in] size File size in bytes.
+     * @param [in] modify_time Modification time of the source file.
+     */
+    void LayoutMap::add(const ckcore::tstring &internal_path,ckcore::tuint64 sector,
+                        ckcore::tuint64 size,ckcore::tint64 modify_time)
+    {
+        Entry &entry = entries_[internal_path];
+        entry.sector_ = sector;
+        entry.size_ = size;
+        entry.modify_time_ = modify_time;
+    }
+
+    /**
+     * Looks up a file in the map.
+     * @param [in] internal_path Path of the file in the disc image.
+     * @return Pointer to the entry of the file, NULL if the file is not in
+     *         the map.
+     */
+    const LayoutMap::Entry *LayoutMap::find(const ckcore::tstring &internal_path) const
+    {
+        std::map<ckcore::tstring,Entry>::const_iterator it = entries_.find(internal_path);
+        if (it == entries_.end())
+            return NULL;
+
+        return &it->second;
+    }
+};
@@ -23,7 +23,8 @@
 namespace ckfilesystem
 {
     SectorManager::SectorManager(ckcore::tuint64 start_sector) :
-        next_free_sec_(start_sector),data_start_(0),data_len_(0)
+        next_free_sec_(start_sector),data_start_(0),data_len_(0),
+        align_sec_(1),align_min_bytes_(0)
     {
     }
 
@@ -77,6 +78,50 @@ namespace ckfilesystem
         next_free_sec_ += data_len_;
     }
 
+    /**
+        Sets the alignment policy for file data extents in the data area. Large
+        extents can be aligned to for example the 32 KiB ECC blocks of optical
+        media, or the block size of the host file system so that the image can
+        be memory mapped or assembled using reflinks. The boundary is relative
+        to the absolute sector address, including any multi-session offset.
+        @param boundary the alignment boundary in bytes, it's rounded down to
+        whole sectors. A boundary of one sector or less disables alignment.
+        @param min_bytes extents smaller than this number of bytes are not
+        aligned and will be packed tightly.
+     */
+    void SectorManager::set_data_alignment(ckcore::tuint32 boundary,ckcore::tuint64 min_bytes)
+    {
+        align_sec_ = boundary / ISO_SECTOR_SIZE;
+        if (align_sec_ == 0)
+            align_sec_ = 1;
+
+        align_min_bytes_ = min_bytes;
+    }
+
+    /**
+        Calculates the number of padding sectors that should be placed before
+        a data extent according to the alignment policy.
+        @param sec the first free sector where the extent would be placed.
+        @param num_bytes the size of the extent in bytes.
+        @return the number of sectors to pad with before the extent.
+     */
+    ckcore::tuint32 SectorManager::calc_data_align_len(ckcore::tuint64 sec,ckcore::tuint64 num_bytes)
+    {
+        if (align_sec_ <= 1 || num_bytes == 0 || num_bytes < align_min_bytes_)
+            return 0;
+
+        ckcore::tuint32 rem = (ckcore::tuint32)(sec % align_sec_);
+        return rem == 0 ? 0 : align_sec_ - rem;
+    }
+
+    /**
+        Returns the data extent alignment boundary in sectors.
+     */
+    ckcore::tuint32 SectorManager::get_data_alignment()
+    {
+        return align_sec_;
+    }
+
     /**
         Returns the starting sector of the allocated sector range allocated by
         the client that matches the identifier.
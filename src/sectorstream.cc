@@ -16,6 +16,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#include <ckcore/exception.hh>
 #include "ckfilesystem/sectorstream.hh"
 
 namespace ckfilesystem
@@ -115,6 +124,18 @@ namespace ckfilesystem
         }
     }
 
+    /*
+        Advances the stream position without writing anything. Used when the
+        data has been written to the underlying stream by other means.
+    */
+    void SectorOutStream::skip(ckcore::tuint64 count)
+    {
+        written_ += count;
+
+        sector_ += written_ / sector_size_;
+        written_ %= sector_size_;
+    }
+
     /*
         Returns the current sector number.
     */
@@ -150,4 +171,95 @@ namespace ckfilesystem
         for (ckcore::tuint32 i = 0; i < remaining; i++)
             write(tmp,1);
     }
+
+    /*
+        FileSectorReader
+    */
+    FileSectorReader::FileSectorReader(const ckcore::tchar *file_path,
+                                       ckcore::tuint32 sector_size) :
+        file_path_(file_path),sector_size_(sector_size),
+#ifdef _WINDOWS
+        file_handle_(INVALID_HANDLE_VALUE)
+#else
+        file_handle_(-1)
+#endif
+    {
+    }
+
+    FileSectorReader::~FileSectorReader()
+    {
+        close();
+    }
+
+    /**
+     * Opens the file for reading.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool FileSectorReader::open()
+    {
+        close();
+
+#ifdef _WINDOWS
+        file_handle_ = CreateFile(file_path_.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,
+                                  OPEN_EXISTING,FILE_FLAG_RANDOM_ACCESS,NULL);
+        return file_handle_ != INVALID_HANDLE_VALUE;
+#else
+        file_handle_ = ::open(file_path_.c_str(),O_RDONLY);
+        return file_handle_ != -1;
+#endif
+    }
+
+    void FileSectorReader::close()
+    {
+#ifdef _WINDOWS
+        if (file_handle_ != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file_handle_);
+            file_handle_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (file_handle_ != -1)
+        {
+            ::close(file_handle_);
+            file_handle_ = -1;
+        }
+#endif
+    }
+
+    void FileSectorReader::read(ckcore::tuint64 sector,void *buffer,ckcore::tuint32 count)
+    {
+        ckcore::tuint64 offset = sector * sector_size_;
+        unsigned char *ptr = static_cast<unsigned char *>(buffer);
+
+        while (count > 0)
+        {
+#ifdef _WINDOWS
+            // An explicit offset makes the read independent of the file
+            // pointer shared by all threads.
+            OVERLAPPED overlapped;
+            memset(&overlapped,0,sizeof(overlapped));
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+            DWORD processed = 0;
+            if (!ReadFile(file_handle_,ptr,count,&processed,&overlapped))
+                processed = 0;
+#else
+            ssize_t processed = pread(file_handle_,ptr,count,static_cast<off_t>(offset));
+            if (processed == -1 && errno == EINTR)
+                continue;
+#endif
+            if (processed <= 0)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("Unable to read sector ") << (offset / sector_size_)
+                    << ckT(" from \"") << file_path_ << ckT("\".");
+                throw ckcore::Exception2(msg.str());
+            }
+
+            ptr += processed;
+            offset += processed;
+            count -= static_cast<ckcore::tuint32>(processed);
+        }
+    }
 };
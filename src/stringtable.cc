@@ -37,17 +37,7 @@ namespace ckfilesystem
         strings_[ERROR_DVDVIDEO] = ckT("Cannot create DVD-Video file system, is the VIDEO_TS folder present?");
     }
 
-    StringTable::~StringTable()
-    {
-    }
-
-    StringTable &StringTable::instance()
-    {
-        static StringTable instance;
-        return instance;
-    }
-
-    const ckcore::tchar *StringTable::get_string(StringId id)
+    const ckcore::tchar *StringTable::get_string(StringId id) const
     {
         return strings_[id];
     }
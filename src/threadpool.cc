@@ -0,0 +1,444 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WINDOWS
+#include <time.h>
+#include <unistd.h>
+#endif
+#include <ckcore/exception.hh>
+#include "ckfilesystem/threadpool.hh"
+
+namespace ckfilesystem
+{
+    /*
+        Mutex
+    */
+    Mutex::Mutex()
+    {
+#ifdef _WINDOWS
+        InitializeCriticalSection(&mutex_);
+#else
+        pthread_mutex_init(&mutex_,NULL);
+#endif
+    }
+
+    Mutex::~Mutex()
+    {
+#ifdef _WINDOWS
+        DeleteCriticalSection(&mutex_);
+#else
+        pthread_mutex_destroy(&mutex_);
+#endif
+    }
+
+    void Mutex::lock()
+    {
+#ifdef _WINDOWS
+        EnterCriticalSection(&mutex_);
+#else
+        pthread_mutex_lock(&mutex_);
+#endif
+    }
+
+    void Mutex::unlock()
+    {
+#ifdef _WINDOWS
+        LeaveCriticalSection(&mutex_);
+#else
+        pthread_mutex_unlock(&mutex_);
+#endif
+    }
+
+    /*
+        Condition
+    */
+    Condition::Condition()
+    {
+#ifdef _WINDOWS
+        InitializeConditionVariable(&cond_);
+#else
+        pthread_cond_init(&cond_,NULL);
+#endif
+    }
+
+    Condition::~Condition()
+    {
+#ifndef _WINDOWS
+        pthread_cond_destroy(&cond_);
+#endif
+    }
+
+    /**
+     * Atomically unlocks the mutex and waits for the condition to be
+     * signalled. The mutex is locked again before returning.
+     * @param [in] mutex The mutex protecting the condition, must be locked.
+     */
+    void Condition::wait(Mutex &mutex)
+    {
+#ifdef _WINDOWS
+        SleepConditionVariableCS(&cond_,&mutex.mutex_,INFINITE);
+#else
+        pthread_cond_wait(&cond_,&mutex.mutex_);
+#endif
+    }
+
+    void Condition::signal()
+    {
+#ifdef _WINDOWS
+        WakeConditionVariable(&cond_);
+#else
+        pthread_cond_signal(&cond_);
+#endif
+    }
+
+    void Condition::broadcast()
+    {
+#ifdef _WINDOWS
+        WakeAllConditionVariable(&cond_);
+#else
+        pthread_cond_broadcast(&cond_);
+#endif
+    }
+
+    /*
+        ThreadPool::Worker
+    */
+
+    /**
+     * @brief Worker thread with its own task queue.
+     */
+    class ThreadPool::Worker
+    {
+    public:
+        ThreadPool &pool_;
+        size_t index_;
+        bool started_;
+
+        // Protects the task queue, other workers steal from it.
+        Mutex mutex_;
+        std::deque<Task *> tasks_;
+
+#ifdef _WINDOWS
+        HANDLE thread_;
+#else
+        pthread_t thread_;
+#endif
+
+        Worker(ThreadPool &pool,size_t index) :
+            pool_(pool),index_(index),started_(false)
+        {
+        }
+    };
+
+    // The worker running on the current thread, if any.
+#ifdef _WINDOWS
+    static __declspec(thread) void *current_worker = NULL;
+#else
+    static __thread void *current_worker = NULL;
+#endif
+
+    /*
+        ThreadPool
+    */
+
+    /**
+     * Constructs a ThreadPool object.
+     * @param [in] thread_count The number of worker threads to start. If zero
+     *                          tasks will be executed by the submitting
+     *                          thread.
+     * @throw Exception If a worker thread could not be created.
+     */
+    ThreadPool::ThreadPool(ckcore::tuint32 thread_count) :
+        pending_(0),busy_(0),stop_(false)
+    {
+        // All workers must exist before the first thread starts stealing.
+        for (ckcore::tuint32 i = 0; i < thread_count; i++)
+            workers_.push_back(new Worker(*this,i));
+
+        for (ckcore::tuint32 i = 0; i < thread_count; i++)
+        {
+            Worker *worker = workers_[i];
+#ifdef _WINDOWS
+            worker->thread_ = CreateThread(NULL,0,thread_main,worker,0,NULL);
+            if (worker->thread_ == NULL)
+#else
+            if (pthread_create(&worker->thread_,NULL,thread_main,worker) != 0)
+#endif
+            {
+                stop();
+                throw ckcore::Exception2(ckT("Unable to create worker thread."));
+            }
+
+            worker->started_ = true;
+        }
+    }
+
+    /**
+     * Destructs the ThreadPool object. Already queued tasks are executed
+     * before the worker threads exit.
+     */
+    ThreadPool::~ThreadPool()
+    {
+        wait();
+        stop();
+    }
+
+    /**
+     * Stops and joins all worker threads.
+     */
+    void ThreadPool::stop()
+    {
+        mutex_.lock();
+        stop_ = true;
+        work_cond_.broadcast();
+        mutex_.unlock();
+
+        for (size_t i = 0; i < workers_.size(); i++)
+        {
+            if (workers_[i]->started_)
+            {
+#ifdef _WINDOWS
+                WaitForSingleObject(workers_[i]->thread_,INFINITE);
+                CloseHandle(workers_[i]->thread_);
+#else
+                pthread_join(workers_[i]->thread_,NULL);
+#endif
+            }
+        }
+
+        // Running workers may steal from any other worker.
+        for (size_t i = 0; i < workers_.size(); i++)
+            delete workers_[i];
+
+        workers_.clear();
+    }
+
+#ifdef _WINDOWS
+    DWORD WINAPI ThreadPool::thread_main(LPVOID param)
+    {
+        Worker *worker = static_cast<Worker *>(param);
+        worker->pool_.work(worker);
+        return 0;
+    }
+#else
+    void *ThreadPool::thread_main(void *param)
+    {
+        Worker *worker = static_cast<Worker *>(param);
+        worker->pool_.work(worker);
+        return NULL;
+    }
+#endif
+
+    /**
+     * Takes the newest task from the queue of the specified worker.
+     * @param [in] worker The worker to take a task from.
+     * @param [out] task The task.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool ThreadPool::take(Worker *worker,Task *&task)
+    {
+        MutexLock lock(worker->mutex_);
+        if (worker->tasks_.empty())
+            return false;
+
+        task = worker->tasks_.back();
+        worker->tasks_.pop_back();
+        return true;
+    }
+
+    /**
+     * Takes the oldest task from the queue of any other worker.
+     * @param [in] worker The worker looking for a task.
+     * @param [out] task The task.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool ThreadPool::steal(Worker *worker,Task *&task)
+    {
+        for (size_t i = 1; i < workers_.size(); i++)
+        {
+            Worker *victim = workers_[(worker->index_ + i) % workers_.size()];
+
+            MutexLock lock(victim->mutex_);
+            if (!victim->tasks_.empty())
+            {
+                task = victim->tasks_.front();
+                victim->tasks_.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Worker thread loop, executes tasks until the pool is stopped. Tasks
+     * are taken from the own queue first, then from the shared queue and
+     * last from the queues of the other workers.
+     * @param [in] worker The worker running on the calling thread.
+     */
+    void ThreadPool::work(Worker *worker)
+    {
+        current_worker = worker;
+
+        MutexLock lock(mutex_);
+
+        while (true)
+        {
+            Task *task = NULL;
+
+            mutex_.unlock();
+            bool found = take(worker,task);
+            mutex_.lock();
+
+            if (!found && !tasks_.empty())
+            {
+                task = tasks_.front();
+                tasks_.pop_front();
+                found = true;
+            }
+
+            if (!found)
+            {
+                mutex_.unlock();
+                found = steal(worker,task);
+                mutex_.lock();
+            }
+
+            if (!found)
+            {
+                // A task may have been queued but not yet counted, or the
+                // other way around. Look again until the counter settles.
+                if (pending_ > 0)
+                    continue;
+
+                if (stop_)
+                    break;
+
+                work_cond_.wait(mutex_);
+                continue;
+            }
+
+            pending_--;
+            busy_++;
+
+            mutex_.unlock();
+
+            try
+            {
+                task->run();
+            }
+            catch (...)
+            {
+            }
+
+            mutex_.lock();
+
+            if (--busy_ == 0 && pending_ == 0)
+                idle_cond_.broadcast();
+        }
+
+        current_worker = NULL;
+    }
+
+    /**
+     * Queues a task for execution. The pool does not take ownership of the
+     * task, it must be kept alive until wait() has returned.
+     * @param [in] task The task to execute.
+     */
+    void ThreadPool::submit(Task *task)
+    {
+        if (workers_.empty())
+        {
+            try
+            {
+                task->run();
+            }
+            catch (...)
+            {
+            }
+
+            return;
+        }
+
+        Worker *worker = static_cast<Worker *>(current_worker);
+        if (worker != NULL && &worker->pool_ == this)
+        {
+            MutexLock lock(worker->mutex_);
+            worker->tasks_.push_back(task);
+        }
+
+        MutexLock lock(mutex_);
+        if (worker == NULL || &worker->pool_ != this)
+            tasks_.push_back(task);
+
+        pending_++;
+        work_cond_.signal();
+    }
+
+    /**
+     * Waits until all submitted tasks have been executed. Must not be
+     * called from a task running on the pool, use a TaskGroup to wait for
+     * a subset of the tasks.
+     */
+    void ThreadPool::wait()
+    {
+        MutexLock lock(mutex_);
+        while (pending_ > 0 || busy_ > 0)
+            idle_cond_.wait(mutex_);
+    }
+
+    /**
+     * Returns the number of processors available to the process, or one if
+     * it cannot be determined.
+     */
+    ckcore::tuint32 ThreadPool::hardware_concurrency()
+    {
+#ifdef _WINDOWS
+        SYSTEM_INFO sys_info;
+        GetSystemInfo(&sys_info);
+        return sys_info.dwNumberOfProcessors > 0 ? sys_info.dwNumberOfProcessors : 1;
+#else
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? static_cast<ckcore::tuint32>(count) : 1;
+#endif
+    }
+
+    /**
+     * Returns the processor time used by the calling thread in microseconds.
+     */
+    ckcore::tuint64 ThreadPool::thread_cpu_time()
+    {
+#ifdef _WINDOWS
+        FILETIME create_time,exit_time,kernel_time,user_time;
+        if (!GetThreadTimes(GetCurrentThread(),&create_time,&exit_time,&kernel_time,&user_time))
+            return 0;
+
+        ckcore::tuint64 kernel = ((ckcore::tuint64)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+        ckcore::tuint64 user = ((ckcore::tuint64)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime;
+
+        // The times are in units of 100 nanoseconds.
+        return (kernel + user) / 10;
+#else
+        struct timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts) != 0)
+            return 0;
+
+        return (ckcore::tuint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+    }
+};
@@ -0,0 +1,278 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ckfilesystem/trace.hh"
+#include <stdio.h>
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+#include <ckcore/filestream.hh>
+#include <ckcore/string.hh>
+#include "ckfilesystem/writestats.hh"
+
+namespace ckfilesystem
+{
+    /*
+        TraceLog
+    */
+    Mutex TraceLog::active_mutex_;
+    TraceLog *TraceLog::active_ = NULL;
+
+    TraceLog::TraceLog()
+    {
+    }
+
+    TraceLog::~TraceLog()
+    {
+        MutexLock lock(active_mutex_);
+        if (active_ == this)
+            active_ = NULL;
+    }
+
+    /**
+     * Makes a trace log receive all events recorded from now on.
+     * @param [in] trace_log The trace log, NULL to stop recording. The trace
+     *                       log must not be destroyed while events can still
+     *                       be recorded into it.
+     */
+    void TraceLog::set_active(TraceLog *trace_log)
+    {
+        MutexLock lock(active_mutex_);
+        active_ = trace_log;
+    }
+
+    /**
+     * Returns true if the library records its own events, that is if it has
+     * been built with CKFILESYSTEM_TRACE defined. Events can always be
+     * recorded by the application.
+     */
+    bool TraceLog::enabled()
+    {
+#ifdef CKFILESYSTEM_TRACE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Returns an identifier of the calling thread.
+     */
+    ckcore::tuint64 TraceLog::get_thread_id()
+    {
+#ifdef _WINDOWS
+        return GetCurrentThreadId();
+#elif defined(__linux__)
+        return static_cast<ckcore::tuint64>(syscall(SYS_gettid));
+#else
+        return reinterpret_cast<ckcore::tuint64>(pthread_self());
+#endif
+    }
+
+    void TraceLog::add(const Event &event)
+    {
+        MutexLock lock(mutex_);
+        events_.push_back(event);
+    }
+
+    /**
+     * Removes all recorded events.
+     */
+    void TraceLog::clear()
+    {
+        MutexLock lock(mutex_);
+        events_.clear();
+    }
+
+    /**
+     * Records a span into the active trace log.
+     * @param [in] category Category of the span, must be a string literal.
+     * @param [in] name Name of the span, must be a string literal.
+     * @param [in] start_time Start time, see WriteStats::get_wall_time.
+     * @param [in] end_time End time.
+     * @param [in] arg Optional file name to attach to the span.
+     */
+    void TraceLog::span(const char *category,const char *name,
+                        ckcore::tuint64 start_time,ckcore::tuint64 end_time,
+                        const ckcore::tchar *arg)
+    {
+        MutexLock lock(active_mutex_);
+        if (active_ == NULL)
+            return;
+
+        Event event;
+        event.phase_ = 'X';
+        event.category_ = category;
+        event.name_ = name;
+        if (arg != NULL)
+        {
+#ifdef _UNICODE
+            char ansi_arg[1024];
+            ckcore::string::utf16_to_ansi(arg,ansi_arg,sizeof(ansi_arg));
+            event.arg_ = ansi_arg;
+#else
+            event.arg_ = arg;
+#endif
+        }
+        event.time_ = start_time;
+        event.duration_ = end_time > start_time ? end_time - start_time : 0;
+        event.value_ = 0;
+        event.thread_id_ = get_thread_id();
+
+        active_->add(event);
+    }
+
+    /**
+     * Records a counter value, such as a queue depth, into the active trace
+     * log.
+     * @param [in] category Category of the counter, must be a string
+     *                      literal.
+     * @param [in] name Name of the counter, must be a string literal.
+     * @param [in] value The current value.
+     */
+    void TraceLog::counter(const char *category,const char *name,ckcore::tint64 value)
+    {
+        MutexLock lock(active_mutex_);
+        if (active_ == NULL)
+            return;
+
+        Event event;
+        event.phase_ = 'C';
+        event.category_ = category;
+        event.name_ = name;
+        event.time_ = WriteStats::get_wall_time();
+        event.duration_ = 0;
+        event.value_ = value;
+        event.thread_id_ = get_thread_id();
+
+        active_->add(event);
+    }
+
+    static void append_json_string(std::string &json,const std::string &str)
+    {
+        json += '"';
+        for (size_t i = 0; i < str.size(); i++)
+        {
+            unsigned char c = static_cast<unsigned char>(str[i]);
+            if (c == '"' || c == '\\')
+            {
+                json += '\\';
+                json += c;
+            }
+            else if (c < 0x20)
+            {
+                char escaped[8];
+                sprintf(escaped,"\\u%04x",c);
+                json += escaped;
+            }
+            else
+            {
+                json += c;
+            }
+        }
+        json += '"';
+    }
+
+    /**
+     * Saves all recorded events as a JSON trace file.
+     * @param [in] file_path Path to the trace file.
+     * @return If successful true is returned, otherwise false.
+     */
+    bool TraceLog::save(const ckcore::tchar *file_path)
+    {
+        MutexLock lock(mutex_);
+
+        ckcore::FileOutStream out_stream(file_path);
+        if (!out_stream.open())
+            return false;
+
+        std::string json = "{\"traceEvents\":[\n";
+        char buffer[128];
+
+        for (size_t i = 0; i < events_.size(); i++)
+        {
+            const Event &event = events_[i];
+
+            json += "{\"name\":";
+            append_json_string(json,event.name_);
+            json += ",\"cat\":";
+            append_json_string(json,event.category_);
+
+            sprintf(buffer,",\"ph\":\"%c\",\"pid\":1,\"tid\":%llu,\"ts\":%llu",event.phase_,
+                    static_cast<unsigned long long>(event.thread_id_),
+                    static_cast<unsigned long long>(event.time_));
+            json += buffer;
+
+            if (event.phase_ == 'X')
+            {
+                sprintf(buffer,",\"dur\":%llu",static_cast<unsigned long long>(event.duration_));
+                json += buffer;
+
+                if (!event.arg_.empty())
+                {
+                    json += ",\"args\":{\"file\":";
+                    append_json_string(json,event.arg_);
+                    json += "}";
+                }
+            }
+            else
+            {
+                sprintf(buffer,",\"args\":{\"value\":%lld}",static_cast<long long>(event.value_));
+                json += buffer;
+            }
+
+            json += i + 1 < events_.size() ? "},\n" : "}\n";
+
+            // Write in chunks to not keep the whole file in memory.
+            if (json.size() >= 0x10000 || i + 1 == events_.size())
+            {
+                if (out_stream.write(json.c_str(),static_cast<ckcore::tuint32>(json.size())) !=
+                    static_cast<ckcore::tint64>(json.size()))
+                {
+                    return false;
+                }
+
+                json.clear();
+            }
+        }
+
+        json += "]}\n";
+
+        return out_stream.write(json.c_str(),static_cast<ckcore::tuint32>(json.size())) ==
+               static_cast<ckcore::tint64>(json.size());
+    }
+
+    /*
+        TraceScope
+    */
+    TraceScope::TraceScope(const char *category,const char *name,const ckcore::tchar *arg) :
+        category_(category),name_(name),arg_(arg),start_time_(WriteStats::get_wall_time())
+    {
+    }
+
+    TraceScope::~TraceScope()
+    {
+        TraceLog::span(category_,name_,start_time_,WriteStats::get_wall_time(),arg_);
+    }
+};
@@ -93,15 +93,16 @@ namespace ckfilesystem
     const char *ident_part_content_cdw = "+CDW02";  // As if it were a volume recorded according to ECMA-168.
     const char *ident_part_content_nsr = "+NSR02";  // According to Part 4 of this ECMA Standard.
 
-    Udf::Udf(bool dvd_video) : crc_stream_(ckcore::CrcStream::ckCRC_CCITT),dvd_video_(dvd_video)
+    Udf::Udf(bool dvd_video) : crc_stream_(ckcore::CrcStream::ckCRC_CCITT),dvd_video_(dvd_video),
+        scratch_mem_(NULL),scratch_(NULL),scratch_size_(0),scratch_pending_(0)
     {
-        // Intialize the byte buffer.
-        byte_buffer_ = NULL;
-        byte_buffer_size_ = 0;
 
         // Default parition type is read only.
         part_access_type_ = AT_READONLY;
 
+        // Data is not embedded in file entries by default.
+        embed_data_ = false;
+
         init_vol_desc_primary();
         init_vol_desc_partition();
         init_vol_desc_logical();
@@ -109,26 +110,128 @@ namespace ckfilesystem
 
     Udf::~Udf()
     {
-        // Free the byte buffer.
-        if (byte_buffer_ != NULL)
+        delete [] scratch_mem_;
+    }
+
+    /**
+     * Makes sure that the scratch arena is at least of the specified size.
+     * The arena is sized in whole sectors and aligned to the sector size.
+     * Pending file identifier descriptors are preserved when the arena
+     * grows.
+     * @param [in] min_size The minimum required size in bytes.
+     * @return Pointer to the beginning of the arena.
+     */
+    unsigned char *Udf::alloc_scratch(ckcore::tuint32 min_size)
+    {
+        if (scratch_size_ < min_size)
         {
-            delete [] byte_buffer_;
-            byte_buffer_ = NULL;
+            ckcore::tuint32 new_size = scratch_size_ > 0 ? scratch_size_ : UDF_SECTOR_SIZE;
+            while (new_size < min_size)
+                new_size <<= 1;
+
+            unsigned char *new_mem = new unsigned char[new_size + UDF_SECTOR_SIZE - 1];
+            unsigned char *new_scratch = new_mem + (UDF_SECTOR_SIZE -
+                reinterpret_cast<size_t>(new_mem) % UDF_SECTOR_SIZE) % UDF_SECTOR_SIZE;
+
+            if (scratch_pending_ > 0)
+                memcpy(new_scratch,scratch_,scratch_pending_);
 
-            byte_buffer_size_ = 0;
+            delete [] scratch_mem_;
+            scratch_mem_ = new_mem;
+            scratch_ = new_scratch;
+            scratch_size_ = new_size;
         }
+
+        return scratch_;
+    }
+
+    /**
+     * Prepares the scratch arena for assembling a descriptor that should be
+     * written padded to whole sectors. Any pending file identifier
+     * descriptors are flushed first.
+     * @param [in] out_stream The stream the descriptor will be written to.
+     * @param [in] desc_len The length of the descriptor in bytes.
+     * @return Pointer to a zeroed buffer large enough to hold the
+     *         descriptor and its padding.
+     */
+    unsigned char *Udf::begin_sectors(ckcore::CanexOutStream &out_stream,
+                                      ckcore::tuint32 desc_len)
+    {
+        flush_file_idents(out_stream);
+
+        ckcore::tuint32 sec_len = bytes_to_sec(desc_len) * UDF_SECTOR_SIZE;
+        unsigned char *buffer = alloc_scratch(sec_len);
+        memset(buffer,0,sec_len);
+
+        return buffer;
     }
 
-    void Udf::alloc_byte_buffer(ckcore::tuint32 min_size)
+    /**
+     * Writes a descriptor assembled using begin_sectors() to the output
+     * stream, padded to whole sectors.
+     * @param [in] out_stream The stream to write to.
+     * @param [in] desc_len The length of the descriptor in bytes.
+     */
+    void Udf::end_sectors(ckcore::CanexOutStream &out_stream,ckcore::tuint32 desc_len)
+    {
+        out_stream.write(scratch_,bytes_to_sec(desc_len) * UDF_SECTOR_SIZE);
+    }
+
+    /**
+     * Writes a descriptor to the output stream, padded to a whole sector.
+     * @param [in] out_stream The stream to write to.
+     * @param [in] desc Pointer to the descriptor.
+     * @param [in] desc_len The length of the descriptor in bytes.
+     */
+    void Udf::write_sector(ckcore::CanexOutStream &out_stream,const void *desc,
+                           ckcore::tuint32 desc_len)
+    {
+        memcpy(begin_sectors(out_stream,desc_len),desc,desc_len);
+        end_sectors(out_stream,desc_len);
+    }
+
+    /**
+     * Reserves space for a file identifier descriptor at the end of the
+     * pending descriptors in the scratch arena.
+     * @param [in] out_stream The stream to write complete sectors to.
+     * @param [in] desc_len The length of the descriptor in bytes.
+     * @return Pointer to a zeroed buffer of desc_len bytes.
+     */
+    unsigned char *Udf::append_file_ident(ckcore::CanexOutStream &out_stream,
+                                          ckcore::tuint32 desc_len)
     {
-        if (byte_buffer_size_ < min_size)
+        // Write all complete sectors once enough data has been collected.
+        if (scratch_pending_ >= UDF_SCRATCH_FLUSH_SIZE)
         {
-            if (byte_buffer_ != NULL)
-                delete [] byte_buffer_;
+            ckcore::tuint32 sec_bytes = scratch_pending_ - scratch_pending_ % UDF_SECTOR_SIZE;
+            out_stream.write(scratch_,sec_bytes);
 
-            byte_buffer_size_ = min_size;
-            byte_buffer_ = new unsigned char[byte_buffer_size_];
+            scratch_pending_ -= sec_bytes;
+            memmove(scratch_,scratch_ + sec_bytes,scratch_pending_);
         }
+
+        unsigned char *buffer = alloc_scratch(scratch_pending_ + desc_len) + scratch_pending_;
+        memset(buffer,0,desc_len);
+
+        scratch_pending_ += desc_len;
+        return buffer;
+    }
+
+    /**
+     * Writes all pending file identifier descriptors to the output stream
+     * and pads the last sector with zeroes.
+     * @param [in] out_stream The stream to write to.
+     */
+    void Udf::flush_file_idents(ckcore::CanexOutStream &out_stream)
+    {
+        if (scratch_pending_ == 0)
+            return;
+
+        ckcore::tuint32 sec_len = bytes_to_sec(scratch_pending_) * UDF_SECTOR_SIZE;
+        memset(scratch_ + scratch_pending_,0,sec_len - scratch_pending_);
+
+        out_stream.write(scratch_,sec_len);
+        scratch_pending_ = 0;
     }
 
     /*
@@ -280,15 +383,41 @@ namespace ckfilesystem
         Generates a unique volume set indentifer to identify a particular
         volume. pVolSysIdent is assumed to hold 128 bytes.
     */
-    void Udf::make_vol_set_ident(unsigned char *volset_ident,size_t volset_ident_size)
+    /**
+     * Generates the volume set identifier. The first 16 characters must be
+     * unique (OSTA UDF 2.2.2.5), they are made of the creation time followed
+     * by a hash of the logical volume identifier. The identifier depends on
+     * nothing else so concurrent and repeated builds of the same file system
+     * are identical.
+     * @param [out] volset_ident The identifier buffer.
+     * @param [in] volset_ident_size The size of the identifier buffer.
+     * @param [in] create_time The creation time of the file system.
+     */
+    void Udf::make_vol_set_ident(unsigned char *volset_ident,size_t volset_ident_size,
+                                 const struct tm &create_time)
     {
         if (volset_ident_size < 18)
             return;
 
+        // Seconds since 1970 of the broken down time, mktime() would read
+        // global time zone state.
+        ckcore::tuint32 time_val = static_cast<ckcore::tuint32>(make_time(create_time));
+
+        // FNV-1a.
+        ckcore::tuint32 hash_val = 2166136261U;
+        for (size_t i = 0; i < sizeof(voldesc_logical_.logical_vol_ident); i++)
+        {
+            hash_val ^= voldesc_logical_.logical_vol_ident[i];
+            hash_val *= 16777619U;
+        }
+
         ckcore::tchar charset[] = { '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' };
         wchar_t gen_ident[16];
-        for (unsigned int i = 0; i < sizeof(gen_ident)/sizeof(wchar_t); i++)
-            gen_ident[i] = charset[rand() % 16];
+        for (unsigned int i = 0; i < 8; i++)
+        {
+            gen_ident[i] = charset[(time_val >> (28 - i * 4)) & 0x0f];
+            gen_ident[i + 8] = charset[(hash_val >> (28 - i * 4)) & 0x0f];
+        }
 
         // Make a compatible D-string.
         memset(volset_ident,0,volset_ident_size);
@@ -329,6 +458,13 @@ namespace ckfilesystem
         os_ident = UDF_OSIDENT_UNDEFINED;
     }
 
+    /**
+     * Encodes a file name as an OSTA CS0 compressed file identifier.
+     * @param [out] out_buffer Buffer to receive the identifier, must be at
+     *                         least 255 bytes large.
+     * @param [in] file_name The file name to encode.
+     * @return The length of the identifier in bytes.
+     */
     unsigned char Udf::make_file_ident(unsigned char *out_buffer,const ckcore::tchar *file_name)
     {
         size_t name_len = ckcore::string::astrlen(file_name);
@@ -341,7 +477,7 @@ namespace ckfilesystem
         unsigned char byte_len = (unsigned char)compress_unicode_str(copy_len,str_comp,
             file_name,out_buffer);
     #else
-        wchar_t szWideFileName[125];
+        wchar_t szWideFileName[(254 >> 1) + 1];
         ckcore::string::ansi_to_utf16(file_name,szWideFileName,sizeof(szWideFileName) / sizeof(wchar_t));
 
         unsigned char byte_len = (unsigned char)compress_unicode_str(copy_len,str_comp,
@@ -360,8 +496,6 @@ namespace ckfilesystem
 
         make_char_spec(voldesc_primary_.desc_charset);
         make_char_spec(voldesc_primary_.explanatory_charset);
-
-        make_vol_set_ident(voldesc_primary_.volset_ident,sizeof(voldesc_primary_.volset_ident));
     }
 
     void Udf::init_vol_desc_partition()
@@ -455,6 +589,17 @@ namespace ckfilesystem
         part_access_type_ = access_type;
     }
 
+    /**
+     * Enables or disables embedding of small file data and directory
+     * contents in the allocation descriptor field of their file entries
+     * (ECMA 167 4/14.6.8). Embedding is never used for DVD-Video.
+     * @param [in] embed Set to true to enable embedding.
+     */
+    void Udf::set_embed_data(bool embed)
+    {
+        embed_data_ = embed;
+    }
+
     /*
         Write the initial volume descriptors. They're of the same format as the
         ISO9660 volume descriptors.
@@ -496,17 +641,14 @@ namespace ckfilesystem
         voldesc_primary_.charset_list = 1;
         voldesc_primary_.max_charset_list = 1;
 
+        make_vol_set_ident(voldesc_primary_.volset_ident,sizeof(voldesc_primary_.volset_ident),
+                           create_time);
         make_date_time(create_time,voldesc_primary_.rec_timestamp);
 
         // Calculate checksums.
         make_tag_checksums(voldesc_primary_.desc_tag,(unsigned char *)(&voldesc_primary_) + sizeof(tudf_tag));
 
-        out_stream.write(&voldesc_primary_,sizeof(tudf_voldesc_prim));
-
-        // Pad the sector from 512 to 2048 bytes.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (UDF_SECTOR_SIZE - sizeof(tudf_voldesc_prim)); i++)
-            out_stream.write(tmp,1);
+        write_sector(out_stream,&voldesc_primary_,sizeof(tudf_voldesc_prim));
     }
 
     void Udf::write_vol_desc_impl_use(ckcore::CanexOutStream &out_stream,
@@ -533,12 +675,7 @@ namespace ckfilesystem
         // Calculate tag checksums.
         make_tag_checksums(impl_use_voldesc.desc_tag,(unsigned char *)(&impl_use_voldesc) + sizeof(tudf_tag));
 
-        out_stream.write(&impl_use_voldesc,sizeof(tudf_voldesc_impl_use));
-
-        // Pad the sector from 512 to 2048 bytes.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (UDF_SECTOR_SIZE - sizeof(tudf_voldesc_impl_use)); i++)
-            out_stream.write(tmp,1);
+        write_sector(out_stream,&impl_use_voldesc,sizeof(tudf_voldesc_impl_use));
     }
 
     /**
@@ -560,12 +697,7 @@ namespace ckfilesystem
         // Calculate tag checksums.
         make_tag_checksums(voldesc_partition_.desc_tag,(unsigned char *)(&voldesc_partition_) + sizeof(tudf_tag));
 
-        out_stream.write(&voldesc_partition_,sizeof(tudf_voldesc_part));
-
-        // Pad the sector from 512 to 2048 bytes.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (UDF_SECTOR_SIZE - sizeof(tudf_voldesc_part)); i++)
-            out_stream.write(tmp,1);
+        write_sector(out_stream,&voldesc_partition_,sizeof(tudf_voldesc_part));
     }
 
     void Udf::write_vol_desc_logical(ckcore::CanexOutStream &out_stream,ckcore::tuint32 voldesc_seqnum,
@@ -591,23 +723,19 @@ namespace ckfilesystem
         part_map.volseq_num = 1;
         part_map.part_num = 0;
 
+        // Assemble the logical volume descriptor followed by the partition map.
+        ckcore::tuint32 desc_len = sizeof(tudf_voldesc_logical) + sizeof(tudf_logical_partmap_type1);
+        unsigned char *buffer = begin_sectors(out_stream,desc_len);
+        memcpy(buffer,&voldesc_logical_,sizeof(tudf_voldesc_logical));
+        memcpy(buffer + sizeof(tudf_voldesc_logical),&part_map,sizeof(tudf_logical_partmap_type1));
+
         // Calculate tag checksums.
-        unsigned char complete_buffer[sizeof(tudf_voldesc_logical) + sizeof(tudf_logical_partmap_type1)];
-        memcpy(complete_buffer,&voldesc_logical_,sizeof(tudf_voldesc_logical));
-        memcpy(complete_buffer + sizeof(tudf_voldesc_logical),&part_map,sizeof(tudf_logical_partmap_type1));
-        make_tag_checksums(voldesc_logical_.desc_tag,complete_buffer + sizeof(tudf_tag));
-
-        // Write logical volume descriptor.
-        out_stream.write(&voldesc_logical_,sizeof(tudf_voldesc_logical));
-
-        // Write partition map.
-        out_stream.write(&part_map,sizeof(tudf_logical_partmap_type1));
-
-        // Pad the sector.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (UDF_SECTOR_SIZE - sizeof(tudf_voldesc_logical) -
-            sizeof(tudf_logical_partmap_type1)); i++)
-            out_stream.write(tmp,1);
+        make_tag_checksums(voldesc_logical_.desc_tag,buffer + sizeof(tudf_tag));
+
+        // Re-copy the tag since the CRC and checksum has been updated.
+        memcpy(buffer,&voldesc_logical_.desc_tag,sizeof(tudf_tag));
+
+        end_sectors(out_stream,desc_len);
     }
 
     void Udf::write_vol_desc_unalloc(ckcore::CanexOutStream &out_stream,ckcore::tuint32 voldesc_seqnum,
@@ -627,13 +755,8 @@ namespace ckfilesystem
         // Calculate checksums.
         make_tag_checksums(unalloc_space_desc.desc_tag,(unsigned char *)(&unalloc_space_desc) + sizeof(tudf_tag));
 
-        // Write to the output stream.
-        out_stream.write(&unalloc_space_desc,sizeof(tudf_unalloc_space_desc));
-
-        // Pad the sector from 512 to 2048 bytes.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (UDF_SECTOR_SIZE - sizeof(tudf_unalloc_space_desc)); i++)
-            out_stream.write(tmp,1);
+        // Write to the output stream, padded to a whole sector.
+        write_sector(out_stream,&unalloc_space_desc,sizeof(tudf_unalloc_space_desc));
     }
 
     void Udf::write_vol_desc_term(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location)
@@ -647,13 +770,8 @@ namespace ckfilesystem
         term_desc.desc_tag.desc_crc_len = sizeof(tudf_voldesc_term) - sizeof(tudf_tag);
         make_tag_checksums(term_desc.desc_tag,(unsigned char *)(&term_desc) + sizeof(tudf_tag));
 
-        // Write to the output stream.
-        out_stream.write(&term_desc,sizeof(tudf_voldesc_term));
-
-        // Pad the sector from 512 to 2048 bytes.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (UDF_SECTOR_SIZE - sizeof(tudf_voldesc_term)); i++)
-            out_stream.write(tmp,1);
+        // Write to the output stream, padded to a whole sector.
+        write_sector(out_stream,&term_desc,sizeof(tudf_voldesc_term));
     }
 
     /**
@@ -699,13 +817,8 @@ namespace ckfilesystem
         // Calculate tag checksums.
         make_tag_checksums(vli.desc_tag,(unsigned char *)(&vli) + sizeof(tudf_tag));
 
-        // Write to the output stream.
-        out_stream.write(&vli,sizeof(tudf_voldesc_logical_integrity));
-
-        // Pad the sector to 2048 bytes.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (UDF_SECTOR_SIZE - sizeof(tudf_voldesc_logical_integrity)); i++)
-            out_stream.write(tmp,1);
+        // Write to the output stream, padded to a whole sector.
+        write_sector(out_stream,&vli,sizeof(tudf_voldesc_logical_integrity));
     }
 
     void Udf::write_anchor_vol_desc_ptr(ckcore::CanexOutStream &out_stream,
@@ -728,12 +841,7 @@ namespace ckfilesystem
         // Calculate tag checksums.
         make_tag_checksums(vap.desc_tag,(unsigned char *)(&vap) + sizeof(tudf_tag));
 
-        out_stream.write(&vap,sizeof(tudf_voldesc_anchor_ptr));
-
-        // Pad the sector to 2048 bytes.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (UDF_SECTOR_SIZE - sizeof(tudf_voldesc_anchor_ptr)); i++)
-            out_stream.write(tmp,1);
+        write_sector(out_stream,&vap,sizeof(tudf_voldesc_anchor_ptr));
     }
 
     /**
@@ -776,16 +884,12 @@ namespace ckfilesystem
         // Calculate tag checksums.
         make_tag_checksums(fd.desc_tag,(unsigned char *)(&fd) + sizeof(tudf_tag));
 
-        out_stream.write(&fd,sizeof(tudf_fileset_desc));
-
-        // Pad the sector to 2048 bytes.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (UDF_SECTOR_SIZE - sizeof(tudf_voldesc_anchor_ptr)); i++)
-            out_stream.write(tmp,1);
+        write_sector(out_stream,&fd,sizeof(tudf_fileset_desc));
     }
 
     /*
-        Note: This function does not pad to closest sector.
+        Note: This function does not pad to closest sector, the descriptor is
+        collected in the scratch arena until flush_file_idents is called.
     */
     void Udf::write_file_ident_parent(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
                                       ckcore::tuint32 file_entry_sec_loc)
@@ -807,21 +911,14 @@ namespace ckfilesystem
         fd.icb.extent_loc.logical_block_num = file_entry_sec_loc;
         fd.icb.extent_loc.partition_ref_num = 0;    // Always first partition.
 
-        // Calculate tag checksums.
-        unsigned char complete_buffer[sizeof(tudf_fileident_desc) + 2];
-        memcpy(complete_buffer,&fd,sizeof(tudf_fileident_desc));
-
-        // Padded bytes.
-        complete_buffer[sizeof(tudf_fileident_desc)    ] = 0;
-        complete_buffer[sizeof(tudf_fileident_desc) + 1] = 0;
+        // Calculate tag checksums, the two padding bytes are zero.
+        unsigned char *buffer = append_file_ident(out_stream,sizeof(tudf_fileident_desc) + 2);
+        memcpy(buffer,&fd,sizeof(tudf_fileident_desc));
 
-        make_tag_checksums(fd.desc_tag,complete_buffer + sizeof(tudf_tag));
+        make_tag_checksums(fd.desc_tag,buffer + sizeof(tudf_tag));
 
         // Re-copy the tag since the CRC and checksum has been updated.
-        memcpy(complete_buffer,&fd.desc_tag,sizeof(tudf_tag));
-
-        // Write to the output stream.
-        out_stream.write(complete_buffer,sizeof(complete_buffer));
+        memcpy(buffer,&fd.desc_tag,sizeof(tudf_tag));
     }
 
     /*
@@ -831,6 +928,24 @@ namespace ckfilesystem
                                ckcore::tuint32 sec_location,
                                ckcore::tuint32 file_entry_sec_loc,bool is_dir,
                                const ckcore::tchar *file_name)
+    {
+        unsigned char file_ident[255];
+        unsigned char file_ident_len = make_file_ident(file_ident,file_name);
+
+        write_file_ident(out_stream,sec_location,file_entry_sec_loc,is_dir,
+                         file_ident,file_ident_len);
+    }
+
+    /*
+        Note: This function does not pad to closest sector, the descriptor is
+        collected in the scratch arena until flush_file_idents is called. The
+        file identifier must already be encoded using make_file_ident.
+    */
+    void Udf::write_file_ident(ckcore::CanexOutStream &out_stream,
+                               ckcore::tuint32 sec_location,
+                               ckcore::tuint32 file_entry_sec_loc,bool is_dir,
+                               const unsigned char *file_ident,
+                               unsigned char file_ident_len)
     {
         tudf_fileident_desc fd;
         memset(&fd,0,sizeof(tudf_fileident_desc));
@@ -843,9 +958,7 @@ namespace ckfilesystem
         fd.file_ver_num = 1;
         fd.file_characteristics = is_dir ? UDF_FILECHARFLAG_DIRECTORY : 0;
         
-        // Create file identifier.
-        unsigned char file_ident[255];
-        fd.file_ident_len = make_file_ident(file_ident,file_name);
+        fd.file_ident_len = file_ident_len;
 
         fd.icb.extent_len = UDF_SECTOR_SIZE;        // The file entry will always fit within one sector.
         fd.icb.extent_loc.logical_block_num = file_entry_sec_loc;
@@ -860,18 +973,14 @@ namespace ckfilesystem
         ckcore::tuint16 desc_len = sizeof(tudf_fileident_desc) + fd.file_ident_len + usPadSize;
         fd.desc_tag.desc_crc_len = desc_len - sizeof(tudf_tag);
 
-        alloc_byte_buffer(desc_len);
-        memset(byte_buffer_,0,desc_len);
-        memcpy(byte_buffer_,&fd,sizeof(tudf_fileident_desc));
-        memcpy(byte_buffer_ + sizeof(tudf_fileident_desc),file_ident,fd.file_ident_len);
+        unsigned char *buffer = append_file_ident(out_stream,desc_len);
+        memcpy(buffer,&fd,sizeof(tudf_fileident_desc));
+        memcpy(buffer + sizeof(tudf_fileident_desc),file_ident,fd.file_ident_len);
 
-        make_tag_checksums(fd.desc_tag,byte_buffer_ + sizeof(tudf_tag));
+        make_tag_checksums(fd.desc_tag,buffer + sizeof(tudf_tag));
 
         // Re-copy the tag since the CRC and checksum has been updated.
-        memcpy(byte_buffer_,&fd.desc_tag,sizeof(tudf_tag));
-
-        // Write to the output stream.
-        out_stream.write(byte_buffer_,desc_len);
+        memcpy(buffer,&fd.desc_tag,sizeof(tudf_tag));
     }
 
     /**
@@ -885,6 +994,59 @@ namespace ckfilesystem
                                ckcore::tuint64 unique_ident,ckcore::tuint32 info_loc,
                                ckcore::tuint64 info_len,struct tm &access_time,
                                struct tm &modify_time,struct tm &create_time)
+    {
+        write_file_entry(out_stream,sec_location,is_dir,file_link_count,unique_ident,
+                         info_loc,info_len,NULL,access_time,modify_time,create_time);
+    }
+
+    /**
+        Writes a file entry with the file data embedded in the entry itself.
+        @param data the file data, must not be larger than the size returned
+        by get_max_embedded_size.
+        @param data_len the length of the file data in bytes.
+    */
+    void Udf::write_file_entry_embedded(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
+                                        ckcore::tuint64 unique_ident,const unsigned char *data,
+                                        ckcore::tuint32 data_len,struct tm &access_time,
+                                        struct tm &modify_time,struct tm &create_time)
+    {
+        write_file_entry(out_stream,sec_location,false,1,unique_ident,0,data_len,
+                         data,access_time,modify_time,create_time);
+    }
+
+    /**
+        Writes a directory file entry with all pending file identifier
+        descriptors embedded in the entry itself. The identifiers must have
+        been written using sec_location as their location and must not be
+        larger than the size returned by get_max_embedded_size.
+    */
+    void Udf::write_dir_entry_embedded(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
+                                       ckcore::tuint16 file_link_count,ckcore::tuint64 unique_ident,
+                                       struct tm &access_time,struct tm &modify_time,
+                                       struct tm &create_time)
+    {
+        unsigned char data[UDF_SECTOR_SIZE];
+        ckcore::tuint32 data_len = scratch_pending_;
+        if (data_len > sizeof(data))
+            throw ckcore::Exception2(ckT("The UDF directory is too large to be embedded in its file entry."));
+
+        memcpy(data,scratch_,data_len);
+        scratch_pending_ = 0;
+
+        write_file_entry(out_stream,sec_location,true,file_link_count,unique_ident,0,data_len,
+                         data,access_time,modify_time,create_time);
+    }
+
+    /**
+        @param embedded_data if not NULL, info_len bytes of data to embed in
+        the allocation descriptor field instead of referencing an extent.
+    */
+    void Udf::write_file_entry(ckcore::CanexOutStream &out_stream,ckcore::tuint32 sec_location,
+                               bool is_dir,ckcore::tuint16 file_link_count,
+                               ckcore::tuint64 unique_ident,ckcore::tuint32 info_loc,
+                               ckcore::tuint64 info_len,const unsigned char *embedded_data,
+                               struct tm &access_time,struct tm &modify_time,
+                               struct tm &create_time)
     {
         tudf_file_entry fe;
         memset(&fe,0,sizeof(tudf_file_entry));
@@ -909,8 +1071,11 @@ namespace ckfilesystem
         fe.icb_tag.parent_icb_loc.partition_ref_num = 0;    // Is optional.
 
         fe.icb_tag.flags = UDF_ICB_FILEFLAG_ARCHIVE/* | UDF_ICB_FILEFLAG_LONG_ALLOC_DESC*/;
-        fe.icb_tag.flags |= dvd_video_ ? UDF_ICB_FILEFLAG_SHORT_ALLOC_DESC :
-            UDF_ICB_FILEFLAG_LONG_ALLOC_DESC;
+        if (embedded_data != NULL)
+            fe.icb_tag.flags |= UDF_ICB_FILEFLAG_ONE_ALLOC_DESC;    // The data is recorded in the allocation descriptor field.
+        else
+            fe.icb_tag.flags |= dvd_video_ ? UDF_ICB_FILEFLAG_SHORT_ALLOC_DESC :
+                UDF_ICB_FILEFLAG_LONG_ALLOC_DESC;
 
         if (dvd_video_)
         {
@@ -931,7 +1096,7 @@ namespace ckfilesystem
         fe.file_link_count = file_link_count;
 
         fe.info_len = info_len;         // flow.txt = 40, root = 264
-        fe.logical_blocks_rec = bytes_to_sec64(info_len);
+        fe.logical_blocks_rec = embedded_data != NULL ? 0 : bytes_to_sec64(info_len);
 
         // File time stamps.
         make_date_time(access_time,fe.access_time);
@@ -961,10 +1126,19 @@ namespace ckfilesystem
             tot_alloc_desc_size = sizeof(tudf_short_alloc_desc);
         }
 
-        // FIXME: Move everything to byte_buffer_.
-        unsigned char *complete_buffer = new unsigned char[sizeof(tudf_file_entry) +
-            fe.extended_attr_len + tot_alloc_desc_size];
-        ckcore::AutoArray<unsigned char> auto_arr(complete_buffer);
+        if (embedded_data != NULL)
+            tot_alloc_desc_size = (ckcore::tuint32)info_len;
+
+        // The complete entry is assembled in the scratch arena.
+        unsigned char *complete_buffer = begin_sectors(out_stream,sizeof(tudf_file_entry) +
+            fe.extended_attr_len + tot_alloc_desc_size);
+
+        if (embedded_data != NULL)
+        {
+            fe.allocdesc_len = (ckcore::tuint32)info_len;
+            memcpy(complete_buffer + sizeof(tudf_file_entry) + fe.extended_attr_len,
+                   embedded_data,fe.allocdesc_len);
+        }
 
         // Extended attributes that seems to be necessary for DVD-Video support.
         if (dvd_video_)
@@ -1028,10 +1202,13 @@ namespace ckfilesystem
             sad.extent_len = (ckcore::tuint32)info_len;
             sad.extent_loc = info_loc;
 
-            fe.allocdesc_len = sizeof(tudf_short_alloc_desc);
-            memcpy(complete_buffer + buffer_pos,&sad,sizeof(tudf_short_alloc_desc));
+            if (embedded_data == NULL)
+            {
+                fe.allocdesc_len = sizeof(tudf_short_alloc_desc);
+                memcpy(complete_buffer + buffer_pos,&sad,sizeof(tudf_short_alloc_desc));
+            }
         }
-        else
+        else if (embedded_data == NULL)
         {
             ckcore::tuint32 buffer_pos = sizeof(tudf_file_entry) + fe.extended_attr_len;
             while (info_len > 0x3ffff800)
@@ -1077,13 +1254,8 @@ namespace ckfilesystem
         // Re-copy the tag since the CRC and checksum has been updated.
         memcpy(complete_buffer,&fe.desc_tag,sizeof(tudf_tag));
 
-        // Write to the output stream.
-        out_stream.write(complete_buffer,desc_len);
-
-        // Pad the sector to 2048 bytes.
-        char tmp[1] = { 0 };
-        for (ckcore::tuint32 i = 0; i < (ckcore::tuint32)(UDF_SECTOR_SIZE - desc_len); i++)
-            out_stream.write(tmp,1);
+        // Write to the output stream, padded to a whole sector.
+        end_sectors(out_stream,desc_len);
     }
 
     ckcore::tuint32 Udf::calc_file_ident_parent_size()
@@ -1093,11 +1265,18 @@ namespace ckfilesystem
 
     ckcore::tuint32 Udf::calc_file_ident_size(const ckcore::tchar *file_name)
     {
-        ckcore::tuint32 file_name_len = (ckcore::tuint32)ckcore::string::astrlen(file_name);
-        if (file_name_len > 254)
-            file_name_len = 254;
+        unsigned char file_ident[255];
+        return calc_file_ident_size(make_file_ident(file_ident,file_name));
+    }
 
-        ckcore::tuint32 file_ident_len = dvd_video_ ? file_name_len + 1 : (file_name_len << 1) + 1;
+    /**
+     * Calculates the size of a file identifier descriptor.
+     * @param [in] file_ident_len The length of the encoded file identifier as
+     *                            returned by make_file_ident.
+     * @return The size of the descriptor in bytes, including padding.
+     */
+    ckcore::tuint32 Udf::calc_file_ident_size(unsigned char file_ident_len)
+    {
         ckcore::tuint32 file_impl_use_len = 0;
 
         ckcore::tuint32 pad_size = 4 * (ckcore::tuint16)((file_ident_len + file_impl_use_len + 38 + 3)/4) -
@@ -1111,6 +1290,18 @@ namespace ckfilesystem
         return UDF_SECTOR_SIZE;
     }
 
+    /**
+     * Returns the maximum number of bytes of data that can be embedded in a
+     * file entry, zero if embedding is disabled.
+     */
+    ckcore::tuint32 Udf::get_max_embedded_size()
+    {
+        if (!embed_data_ || dvd_video_)
+            return 0;
+
+        return UDF_SECTOR_SIZE - sizeof(tudf_file_entry);
+    }
+
     /**
         Returns the number of bytes needed for the initial volume recognition
         sequence.
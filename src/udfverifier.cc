@@ -0,0 +1,155 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <ckcore/exception.hh>
+#include "ckfilesystem/isoverifier.hh"
+#include "ckfilesystem/udfverifier.hh"
+
+// The anchor volume descriptor pointer is always recorded at this sector.
+#define UDFVERIFIER_ANCHOR_SECTOR       256
+
+namespace ckfilesystem
+{
+    /**
+     * Constructs an UdfVerifier object.
+     */
+    UdfVerifier::UdfVerifier() : crc_stream_(ckcore::CrcStream::ckCRC_CCITT),
+        part_start_(0),part_found_(false),anchor_found_(false),desc_count_(0)
+    {
+    }
+
+    /**
+     * Checks if a tag looks like a descriptor tag, that is it has a known
+     * identifier and a valid tag checksum.
+     */
+    bool UdfVerifier::is_tag(const tudf_tag &tag)
+    {
+        if (!((tag.tag_ident >= UDF_TAGIDENT_PRIMVOLDESC &&
+               tag.tag_ident <= UDF_TAGIDENT_LOGICALVOLINTEGRITYDESC) ||
+              (tag.tag_ident >= UDF_TAGIDENT_FILESETDESC &&
+               tag.tag_ident <= UDF_TAGIDENT_EXTENDEDATTRDESC)))
+        {
+            return false;
+        }
+
+        if (tag.desc_ver != 2 && tag.desc_ver != 3)
+            return false;
+
+        // Sum of bytes 0-3 and 5-15 modulo 256.
+        const unsigned char *ptr = reinterpret_cast<const unsigned char *>(&tag);
+
+        unsigned char checksum = 0;
+        for (size_t i = 0; i < sizeof(tudf_tag); i++)
+        {
+            if (i != 4)
+                checksum += ptr[i];
+        }
+
+        return checksum == tag.tag_chksum;
+    }
+
+    /**
+     * Verifies the descriptor at the beginning of a sector, if any.
+     * @param [in] sector The sector number.
+     * @param [in] buffer The sector data, UDF_SECTOR_SIZE bytes.
+     * @throw VerificationException If the descriptor is invalid.
+     */
+    void UdfVerifier::verify_sector(ckcore::tuint32 sector,const unsigned char *buffer)
+    {
+        tudf_tag tag;
+        memcpy(&tag,buffer,sizeof(tudf_tag));
+
+        if (!is_tag(tag))
+            return;
+
+        desc_count_++;
+
+        // Descriptors extending into the next sector are only partially
+        // verified.
+        if (sizeof(tudf_tag) + tag.desc_crc_len <= UDF_SECTOR_SIZE)
+        {
+            crc_stream_.reset();
+            crc_stream_.write(buffer + sizeof(tudf_tag),tag.desc_crc_len);
+
+            if (static_cast<ckcore::tuint16>(crc_stream_.checksum()) != tag.desc_crc)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("Invalid CRC in descriptor of type ") << tag.tag_ident
+                    << ckT(" at sector ") << sector << ckT(".");
+                throw VerificationException(msg.str(),ckT("ECMA 167: 3/7.2.6."));
+            }
+        }
+
+        if (tag.tag_ident < UDF_TAGIDENT_FILESETDESC)
+        {
+            if (tag.tag_loc != sector)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("The descriptor of type ") << tag.tag_ident << ckT(" at sector ")
+                    << sector << ckT(" claims to be located at sector ") << tag.tag_loc << ckT(".");
+                throw VerificationException(msg.str(),ckT("ECMA 167: 3/7.2.8."));
+            }
+
+            if (tag.tag_ident == UDF_TAGIDENT_PARTDESC)
+            {
+                tudf_voldesc_part part_desc;
+                memcpy(&part_desc,buffer,sizeof(tudf_voldesc_part));
+
+                part_start_ = part_desc.part_start_loc;
+                part_found_ = true;
+            }
+            else if (tag.tag_ident == UDF_TAGIDENT_ANCHORVOLDESCPTR &&
+                     sector == UDFVERIFIER_ANCHOR_SECTOR)
+            {
+                anchor_found_ = true;
+            }
+        }
+        else if (part_found_)
+        {
+            if (sector < part_start_ || tag.tag_loc != sector - part_start_)
+            {
+                ckcore::tstringstream msg;
+                msg << ckT("The descriptor of type ") << tag.tag_ident << ckT(" at sector ")
+                    << sector << ckT(" claims to be located at partition sector ")
+                    << tag.tag_loc << ckT(" but the partition starts at sector ")
+                    << part_start_ << ckT(".");
+                throw VerificationException(msg.str(),ckT("ECMA 167: 4/7.2.8."));
+            }
+        }
+    }
+
+    /**
+     * Performs the verifications requiring all sectors to have been seen.
+     * @throw VerificationException If required descriptors are missing.
+     */
+    void UdfVerifier::verify_end()
+    {
+        if (!anchor_found_)
+        {
+            throw VerificationException(ckT("No anchor volume descriptor pointer found at sector 256."),
+                                        ckT("ECMA 167: 3/8.4.2.1."));
+        }
+
+        if (!part_found_)
+        {
+            throw VerificationException(ckT("No partition descriptor found."),
+                                        ckT("ECMA 167: 3/10.5."));
+        }
+    }
+};
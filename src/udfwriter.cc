@@ -18,10 +18,11 @@
 
 #include <time.h>
 #include <string.h>
-#include <ckcore/file.hh>
-#include <ckcore/directory.hh>
+#include <ckcore/exception.hh>
 #include "ckfilesystem/iso.hh"
 #include "ckfilesystem/util.hh"
+#include "ckfilesystem/exception.hh"
+#include "ckfilesystem/trace.hh"
 #include "ckfilesystem/udfwriter.hh"
 
 namespace ckfilesystem
@@ -34,11 +35,7 @@ namespace ckfilesystem
         memset(&voldesc_seqextent_main_,0,sizeof(tudf_extent_ad));
         memset(&voldesc_seqextent_rsrv_,0,sizeof(tudf_extent_ad));
 
-        // Get local system time.
-        time_t cur_time;
-        time(&cur_time);
-
-        create_time_ = *localtime(&cur_time);
+        file_sys_.get_create_time(create_time_);
     }
 
     UdfWriter::~UdfWriter()
@@ -48,9 +45,12 @@ namespace ckfilesystem
     void UdfWriter::calc_local_node_lengths(std::vector<FileTreeNode *> &dir_node_stack,
                                             FileTreeNode *local_node)
     {
+        ckcore::tuint64 ident_size = calc_ident_size(local_node);
+
         local_node->udf_size_ = 0;
         local_node->udf_size_ += util::bytes_to_sec(file_sys_.udf_.calc_file_entry_size());
-        local_node->udf_size_ += util::bytes_to_sec(calc_ident_size(local_node));
+        if (!is_embedded_dir(ident_size))
+            local_node->udf_size_ += util::bytes_to_sec(ident_size);
         local_node->udf_size_tot_ = local_node->udf_size_;
 
         std::vector<FileTreeNode *>::const_iterator it;
@@ -83,6 +83,38 @@ namespace ckfilesystem
         }
     }
 
+    /**
+     * Returns the UDF file identifier of a node as it should be recorded on
+     * disc. The identifier is encoded on the first call, subsequent calls
+     * return the cached identifier.
+     * @param [in] node The node to get the identifier of.
+     * @return The encoded identifier.
+     */
+    const std::string &UdfWriter::get_file_ident(FileTreeNode *node)
+    {
+        if (node->file_ident_udf_.empty())
+        {
+            unsigned char file_ident[255];
+            unsigned char file_ident_len = file_sys_.udf_.make_file_ident(file_ident,node->file_name_.c_str());
+
+            node->file_ident_udf_.assign(reinterpret_cast<const char *>(file_ident),file_ident_len);
+        }
+
+        return node->file_ident_udf_;
+    }
+
+    /**
+     * Tests if the identifiers of a directory should be embedded in the
+     * directory file entry.
+     * @param [in] ident_size The total size of all identifiers in bytes.
+     * @return If the identifiers should be embedded true is returned,
+     *         otherwise false is returned.
+     */
+    bool UdfWriter::is_embedded_dir(ckcore::tuint64 ident_size)
+    {
+        return ident_size <= file_sys_.udf_.get_max_embedded_size();
+    }
+
     ckcore::tuint64 UdfWriter::calc_ident_size(FileTreeNode *local_node)
     {
         ckcore::tuint64 tot_ident_size = 0;
@@ -90,7 +122,8 @@ namespace ckfilesystem
         for (it = local_node->children_.begin(); it !=
             local_node->children_.end(); it++)
         {
-            tot_ident_size += file_sys_.udf_.calc_file_ident_size((*it)->file_name_.c_str());
+            unsigned char file_ident_len = static_cast<unsigned char>(get_file_ident(*it).size());
+            tot_ident_size += file_sys_.udf_.calc_file_ident_size(file_ident_len);
         }
 
         // Don't forget to add the '..' item to the total.
@@ -149,33 +182,32 @@ namespace ckfilesystem
                                               FileTreeNode *local_node,ckcore::tuint32 &cur_part_sec,
                                               ckcore::tuint64 &unique_ident)
     {
-        ckcore::tuint32 entry_sec = cur_part_sec++;
-        ckcore::tuint32 ident_sec = cur_part_sec;   // On folders the identifiers will follow immediately.
+        // Calculate the size of all identifiers, small directories have
+        // their identifiers embedded in the file entry.
+        ckcore::tuint64 tot_ident_size = calc_ident_size(local_node);
+        bool embedded = is_embedded_dir(tot_ident_size);
 
-        // Calculate the size of all identifiers.
-        ckcore::tuint64 tot_ident_size = 0;
-        std::vector<FileTreeNode *>::const_iterator it;
-        for (it = local_node->children_.begin(); it !=
-            local_node->children_.end(); it++)
-        {
-            tot_ident_size += file_sys_.udf_.calc_file_ident_size((*it)->file_name_.c_str());
-        }
-
-        // Don't forget to add the '..' item to the total.
-        tot_ident_size += file_sys_.udf_.calc_file_ident_parent_size();
+        ckcore::tuint32 entry_sec = cur_part_sec++;
+        ckcore::tuint32 ident_sec = embedded ? entry_sec : cur_part_sec;   // On folders the identifiers will follow immediately.
 
-        ckcore::tuint32 next_entry_sec = ident_sec + util::bytes_to_sec(tot_ident_size);
+        ckcore::tuint32 next_entry_sec = embedded ? cur_part_sec :
+            ident_sec + util::bytes_to_sec(tot_ident_size);
 
         // Get file modified dates.
         struct tm access_time,modify_time,create_time;
-        if (!ckcore::Directory::time(local_node->file_path_.c_str(),access_time,modify_time,create_time))
+        if (!local_node->stat_.get_times(access_time,modify_time,create_time))
             access_time = modify_time = create_time = create_time_;
 
-        // The current folder entry.
-        file_sys_.udf_.write_file_entry(out_stream_,entry_sec,true,
-                                        (ckcore::tuint16)local_node->udf_link_tot_ + 1,
-                                        unique_ident,ident_sec,tot_ident_size,
-                                        access_time,modify_time,create_time);
+        // The current folder entry, embedded entries are written when all
+        // identifiers have been collected.
+        ckcore::tuint16 file_link_count = (ckcore::tuint16)local_node->udf_link_tot_ + 1;
+        ckcore::tuint64 entry_unique_ident = unique_ident;
+        if (!embedded)
+        {
+            file_sys_.udf_.write_file_entry(out_stream_,entry_sec,true,file_link_count,
+                                            entry_unique_ident,ident_sec,tot_ident_size,
+                                            access_time,modify_time,create_time);
+        }
 
         // Unique identifiers 0-15 are reserved for Macintosh implementations.
         if (unique_ident == 0)
@@ -185,41 +217,34 @@ namespace ckfilesystem
 
         // The '..' item.
         ckcore::tuint32 parent_entry_sec = local_node->parent() == NULL ? entry_sec : local_node->parent()->udf_part_loc_;
-        file_sys_.udf_.write_file_ident_parent(out_stream_,cur_part_sec,parent_entry_sec);
+        file_sys_.udf_.write_file_ident_parent(out_stream_,ident_sec,parent_entry_sec);
 
         // Keep track on how many bytes we have in our sector.
         ckcore::tuint32 sec_bytes = file_sys_.udf_.calc_file_ident_parent_size();
 
         std::vector<FileTreeNode *> tmp_stack;
+        std::vector<FileTreeNode *>::const_iterator it;
         for (it = local_node->children_.begin(); it !=
             local_node->children_.end(); it++)
         {
             // Push the item to the temporary stack.
             tmp_stack.push_back(*it);
 
-            if ((*it)->file_flags_ & FileTreeNode::FLAG_DIRECTORY)
-            {
-                file_sys_.udf_.write_file_ident(out_stream_,cur_part_sec,
-                                                next_entry_sec,true,
-                                                (*it)->file_name_.c_str());
+            const std::string &file_ident = get_file_ident(*it);
+            unsigned char file_ident_len = static_cast<unsigned char>(file_ident.size());
 
-                (*it)->udf_part_loc_ = next_entry_sec;  // Remember where this entry was stored.
-                next_entry_sec += (ckcore::tuint32)(*it)->udf_size_tot_;
-            }
-            else
-            {
-                file_sys_.udf_.write_file_ident(out_stream_,cur_part_sec,
-                                                next_entry_sec,false,
-                                                (*it)->file_name_.c_str());
+            file_sys_.udf_.write_file_ident(out_stream_,ident_sec,next_entry_sec,
+                                            ((*it)->file_flags_ & FileTreeNode::FLAG_DIRECTORY) != 0,
+                                            reinterpret_cast<const unsigned char *>(file_ident.data()),
+                                            file_ident_len);
 
-                (*it)->udf_part_loc_ = next_entry_sec;  // Remember where this entry was stored.
-                next_entry_sec += (ckcore::tuint32)(*it)->udf_size_tot_;
-            }
+            (*it)->udf_part_loc_ = next_entry_sec;  // Remember where this entry was stored.
+            next_entry_sec += (ckcore::tuint32)(*it)->udf_size_tot_;
 
-            sec_bytes += file_sys_.udf_.calc_file_ident_size((*it)->file_name_.c_str());
+            sec_bytes += file_sys_.udf_.calc_file_ident_size(file_ident_len);
             if (sec_bytes >= UDF_SECTOR_SIZE)
             {
-                cur_part_sec++;
+                ident_sec++;
                 sec_bytes -= UDF_SECTOR_SIZE;
             }
         }
@@ -229,11 +254,53 @@ namespace ckfilesystem
         for (it_stack = tmp_stack.rbegin(); it_stack != tmp_stack.rend(); it_stack++)
             dir_node_queue.push_front(*it_stack);
 
-        // Pad to the next sector.
-        out_stream_.pad_sector();
+        if (embedded)
+        {
+            file_sys_.udf_.write_dir_entry_embedded(out_stream_,entry_sec,file_link_count,
+                                                    entry_unique_ident,access_time,
+                                                    modify_time,create_time);
+        }
+        else
+        {
+            // Write the identifiers and pad to the next sector.
+            file_sys_.udf_.flush_file_idents(out_stream_);
 
-        if (sec_bytes > 0)
-            cur_part_sec++;
+            cur_part_sec = ident_sec;
+            if (sec_bytes > 0)
+                cur_part_sec++;
+        }
+    }
+
+    /**
+     * Reads the complete contents of a file that should be embedded in its
+     * file entry.
+     * @param [in] node The file node.
+     * @param [out] data Receives the file contents.
+     * @throw Exception If the file could not be read or if its size has
+     *                  changed since the file tree was created.
+     */
+    void UdfWriter::read_embedded_data(FileTreeNode *node,std::vector<unsigned char> &data)
+    {
+        data.resize((size_t)node->file_size_);
+        if (data.empty())
+            return;
+
+        if (!node->data_open() && !node->open_data())
+            throw FileOpenException(node->file_path_);
+
+        ckcore::tint64 read = node->data_stream().read(&data[0],(ckcore::tuint32)data.size());
+        bool end = node->data_stream().end();
+        node->close_data();
+
+        if (read != (ckcore::tint64)data.size() || !end)
+        {
+            ckcore::tstringstream msg;
+            msg << ckT("The file \"") << node->file_path_
+                << ckT("\" may have been modified during file system ")
+                   ckT("creation, please close all applications accessing ")
+                   ckT("the file and try again.");
+            throw ckcore::Exception2(msg.str());
+        }
     }
 
     void UdfWriter::write_partition_entries(FileTree &file_tree)
@@ -272,12 +339,25 @@ namespace ckfilesystem
             {
                 // Get file modified dates.
                 struct tm access_time,modify_time,create_time;
-                if (use_file_times_ && !ckcore::File::time(cur_node->file_path_.c_str(),access_time,modify_time,create_time))
+                if (use_file_times_ && !cur_node->stat_.get_times(access_time,modify_time,create_time))
                     access_time = modify_time = create_time = create_time_;
 
-                file_sys_.udf_.write_file_entry(out_stream_,cur_part_sec++,false,1,
-                                                unique_ident,(ckcore::tuint32)cur_node->data_pos_normal_ - 257,
-                                                cur_node->file_size_,access_time,modify_time,create_time);
+                if (cur_node->file_flags_ & FileTreeNode::FLAG_EMBEDDED)
+                {
+                    std::vector<unsigned char> data;
+                    read_embedded_data(cur_node,data);
+
+                    file_sys_.udf_.write_file_entry_embedded(out_stream_,cur_part_sec++,unique_ident,
+                                                             data.empty() ? NULL : &data[0],
+                                                             (ckcore::tuint32)data.size(),
+                                                             access_time,modify_time,create_time);
+                }
+                else
+                {
+                    file_sys_.udf_.write_file_entry(out_stream_,cur_part_sec++,false,1,
+                                                    unique_ident,(ckcore::tuint32)cur_node->data_pos_normal_ - 257,
+                                                    cur_node->file_size_,access_time,modify_time,create_time);
+                }
 
                 // Unique identifiers 0-15 are reserved for Macintosh implementations.
                 if (unique_ident == 0)
@@ -290,12 +370,16 @@ namespace ckfilesystem
 
     void UdfWriter::alloc_header()
     {
+        CKFS_TRACE_SCOPE("udf","alloc_header");
+
         sec_manager_.alloc_bytes(this,SR_INITIALDESCRIPTORS,
                                  file_sys_.udf_.get_vol_desc_initial_size());
     }
 
     void UdfWriter::alloc_partition(FileTree &file_tree)
     {
+        CKFS_TRACE_SCOPE("udf","alloc_partition");
+
         // Allocate everything up to sector 258.
         sec_manager_.alloc_sectors(this,SR_MAINDESCRIPTORS,258 - sec_manager_.get_next_free());
 
@@ -306,11 +390,15 @@ namespace ckfilesystem
 
     void UdfWriter::write_header()
     {
+        CKFS_TRACE_SCOPE("udf","write_header");
+
         file_sys_.udf_.write_vol_desc_initial(out_stream_);
     }
 
     void UdfWriter::write_partition(FileTree &file_tree)
     {
+        CKFS_TRACE_SCOPE("udf","write_partition");
+
         if (part_len_ == 0)
         {
             throw ckcore::Exception2(ckT("Cannot write UDF partition because ")
@@ -450,6 +538,8 @@ namespace ckfilesystem
 
     void UdfWriter::write_tail()
     {
+        CKFS_TRACE_SCOPE("udf","write_tail");
+
         ckcore::tuint64 last_data_sec = sec_manager_.get_data_start() +
             sec_manager_.get_data_length();
         if (last_data_sec > 0xffffffff)
@@ -248,6 +248,23 @@ namespace ckfilesystem
         {
             return read731(buffer);
         }
+
+        /**
+         * Converts a broken down time in UTC into the number of seconds since
+         * 1970. Unlike mktime() the time is not adjusted to the local time
+         * zone and no global state is used.
+         * @param [in] time The broken down time.
+         * @return The number of seconds since 1970.
+         */
+        ckcore::tint64 make_time(const struct tm &time)
+        {
+            int year = time.tm_year + 1900 - (time.tm_mon < 2 ? 1 : 0);
+            int month = (time.tm_mon + 10) % 12;
+            ckcore::tint64 days = 365 * static_cast<ckcore::tint64>(year) + year / 4 - year / 100 + year / 400 +
+                                  (153 * month + 2) / 5 + time.tm_mday - 1 - 719468;
+
+            return days * 86400 + time.tm_hour * 3600 + time.tm_min * 60 + time.tm_sec;
+        }
     }
 };
 
@@ -0,0 +1,391 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <ckcore/exception.hh>
+#include "ckfilesystem/sectorstream.hh"
+#include "ckfilesystem/isoverifier.hh"
+#include "ckfilesystem/trace.hh"
+#include "ckfilesystem/verificationtap.hh"
+
+// Size of the buffer between the writer and the verifiers.
+#define VERIFICATIONTAP_BUFFER_SIZE         (4 * 1024 * 1024)
+
+namespace ckfilesystem
+{
+    /**
+     * @brief Log discarding everything, the verification report is not
+     *        printed since any problems are returned to the writer.
+     */
+    class NullLog : public ckcore::Log
+    {
+    public:
+        void print(const ckcore::tchar * /*format*/,...) {}
+        void print_line(const ckcore::tchar * /*format*/,...) {}
+    };
+
+    /*
+        VerificationTap::TapInStream
+    */
+    bool VerificationTap::TapInStream::end()
+    {
+        return tap_.pull_end();
+    }
+
+    /**
+     * Only forward seeking is supported since the data is consumed as it is
+     * read.
+     */
+    bool VerificationTap::TapInStream::seek(ckcore::tint64 distance,
+                                            ckcore::InStream::StreamWhence whence)
+    {
+        if (whence != ckcore::InStream::ckSTREAM_CURRENT || distance < 0)
+            return false;
+
+        unsigned char buffer[ISO_SECTOR_SIZE];
+        while (distance > 0)
+        {
+            ckcore::tuint32 count = distance > static_cast<ckcore::tint64>(sizeof(buffer)) ?
+                sizeof(buffer) : static_cast<ckcore::tuint32>(distance);
+            if (tap_.pull(buffer,count) != count)
+                return false;
+
+            distance -= count;
+        }
+
+        return true;
+    }
+
+    ckcore::tint64 VerificationTap::TapInStream::read(void *buffer,ckcore::tuint32 count)
+    {
+        return tap_.pull(static_cast<unsigned char *>(buffer),count);
+    }
+
+    /**
+     * The size is not known until the writer has finished.
+     */
+    ckcore::tint64 VerificationTap::TapInStream::size()
+    {
+        return -1;
+    }
+
+    /*
+        VerificationTap::Consumer
+    */
+    void VerificationTap::Consumer::run()
+    {
+        tap_.consume();
+    }
+
+    /*
+        VerificationTap::Error
+    */
+    void VerificationTap::Error::set(const std::exception &e)
+    {
+        if (set_)
+            return;
+
+        set_ = true;
+        message_ = ckcore::get_except_msg(e);
+
+        const VerificationException *ve = dynamic_cast<const VerificationException *>(&e);
+        if (ve != NULL)
+        {
+            verification_ = true;
+            reference_ = ve->reference();
+        }
+    }
+
+    void VerificationTap::Error::raise() const
+    {
+        if (!set_)
+            return;
+
+        if (verification_)
+            throw VerificationException(message_,reference_.c_str());
+
+        throw ckcore::Exception2(message_);
+    }
+
+    /*
+        VerificationTap
+    */
+
+    /**
+     * Constructs a VerificationTap object. If no verifier is enabled the tap
+     * simply passes all data on to the underlying stream.
+     * @param [in] out_stream The stream to write the data to.
+     * @param [in] verify_iso Set to true to verify the ISO9660 and Joliet
+     *                        file systems.
+     * @param [in] verify_udf Set to true to verify the UDF descriptors.
+     * @throw Exception If the verification thread could not be created.
+     */
+    VerificationTap::VerificationTap(ckcore::OutStream &out_stream,
+                                     bool verify_iso,bool verify_udf) :
+        out_stream_(out_stream),verify_iso_(verify_iso),verify_udf_(verify_udf),
+        ring_pos_(0),ring_used_(0),closed_(false),data_start_(0),data_end_(0),
+        sector_fill_(0),sector_(0),cpu_time_(0),consumer_(*this),pool_(active() ? 1 : 0)
+    {
+        if (active())
+        {
+            ring_.resize(VERIFICATIONTAP_BUFFER_SIZE);
+            sector_buf_.resize(UDF_SECTOR_SIZE);
+
+            pool_.submit(&consumer_);
+        }
+    }
+
+    /**
+     * Destructs the VerificationTap object. If finish() has not been called
+     * the verification is aborted and any errors are discarded.
+     */
+    VerificationTap::~VerificationTap()
+    {
+        close();
+        pool_.wait();
+    }
+
+    /**
+     * Marks the end of the written data.
+     */
+    void VerificationTap::close()
+    {
+        MutexLock lock(mutex_);
+        closed_ = true;
+        data_cond_.broadcast();
+    }
+
+    /**
+     * Reads data written to the tap, blocks until the requested amount of
+     * data is available or the tap has been closed.
+     * @param [out] buffer The buffer to read into.
+     * @param [in] count The number of bytes to read.
+     * @return The number of bytes read, less than count only at the end of
+     *         the data.
+     */
+    ckcore::tuint32 VerificationTap::pull(unsigned char *buffer,ckcore::tuint32 count)
+    {
+        ckcore::tuint32 read = 0;
+        ckcore::tuint64 data_start = 0,data_end = 0;
+
+        {
+            MutexLock lock(mutex_);
+
+            while (read < count)
+            {
+                while (ring_used_ == 0 && !closed_)
+                    data_cond_.wait(mutex_);
+
+                if (ring_used_ == 0)
+                    break;
+
+                size_t chunk = count - read;
+                if (chunk > ring_used_)
+                    chunk = ring_used_;
+                if (chunk > ring_.size() - ring_pos_)
+                    chunk = ring_.size() - ring_pos_;
+
+                memcpy(buffer + read,&ring_[ring_pos_],chunk);
+                read += static_cast<ckcore::tuint32>(chunk);
+
+                ring_pos_ = (ring_pos_ + chunk) % ring_.size();
+                ring_used_ -= chunk;
+
+                space_cond_.signal();
+            }
+
+            data_start = data_start_;
+            data_end = data_end_;
+        }
+
+        feed(buffer,read,data_start,data_end);
+        return read;
+    }
+
+    /**
+     * Checks if all data written to the tap has been read, blocks until more
+     * data is available or the tap has been closed.
+     */
+    bool VerificationTap::pull_end()
+    {
+        MutexLock lock(mutex_);
+        while (ring_used_ == 0 && !closed_)
+            data_cond_.wait(mutex_);
+
+        return ring_used_ == 0;
+    }
+
+    /**
+     * Assembles consumed data into sectors and passes all sectors outside of
+     * the file data area to the UDF verifier.
+     */
+    void VerificationTap::feed(const unsigned char *buffer,size_t count,
+                               ckcore::tuint64 data_start,ckcore::tuint64 data_end)
+    {
+        if (!verify_udf_)
+            return;
+
+        while (count > 0)
+        {
+            size_t chunk = UDF_SECTOR_SIZE - sector_fill_;
+            if (chunk > count)
+                chunk = count;
+
+            memcpy(&sector_buf_[sector_fill_],buffer,chunk);
+            sector_fill_ += chunk;
+            buffer += chunk;
+            count -= chunk;
+
+            if (sector_fill_ < UDF_SECTOR_SIZE)
+                break;
+
+            if (!udf_error_.set_ && (sector_ < data_start || sector_ >= data_end))
+            {
+                try
+                {
+                    udf_verifier_.verify_sector(sector_,&sector_buf_[0]);
+                }
+                catch (const std::exception &e)
+                {
+                    udf_error_.set(e);
+                }
+            }
+
+            sector_fill_ = 0;
+            sector_++;
+        }
+    }
+
+    /**
+     * Runs the verifiers on the consumer thread until the tap is closed.
+     */
+    void VerificationTap::consume()
+    {
+        CKFS_TRACE_SCOPE("verify","consume");
+
+        ckcore::tuint64 cpu_start = ThreadPool::thread_cpu_time();
+
+        if (verify_iso_)
+        {
+            try
+            {
+                TapInStream in_stream(*this);
+                SectorInStream in_sec_stream(in_stream);
+
+                NullLog log;
+                IsoVerifier verifier(log);
+                verifier.verify(in_sec_stream);
+            }
+            catch (const std::exception &e)
+            {
+                iso_error_.set(e);
+            }
+        }
+
+        // The ISO9660 verifier does not need to read past the last directory,
+        // the remaining data must still be consumed to not block the writer.
+        unsigned char buffer[ISO_SECTOR_SIZE];
+        while (pull(buffer,sizeof(buffer)) == sizeof(buffer))
+            ;
+
+        if (verify_udf_ && !udf_error_.set_)
+        {
+            try
+            {
+                udf_verifier_.verify_end();
+            }
+            catch (const std::exception &e)
+            {
+                udf_error_.set(e);
+            }
+        }
+
+        cpu_time_ = ThreadPool::thread_cpu_time() - cpu_start;
+    }
+
+    /**
+     * Writes data to the underlying stream and queues it for verification.
+     * Blocks if the verifiers are too far behind.
+     * @param [in] buffer The data to write.
+     * @param [in] count The number of bytes to write.
+     * @return The result of the underlying stream.
+     */
+    ckcore::tint64 VerificationTap::write(const void *buffer,ckcore::tuint32 count)
+    {
+        ckcore::tint64 res = out_stream_.write(buffer,count);
+        if (!active())
+            return res;
+
+        const unsigned char *ptr = static_cast<const unsigned char *>(buffer);
+
+        MutexLock lock(mutex_);
+        while (count > 0 && !closed_)
+        {
+            while (ring_used_ == ring_.size())
+                space_cond_.wait(mutex_);
+
+            size_t write_pos = (ring_pos_ + ring_used_) % ring_.size();
+            size_t chunk = ring_.size() - ring_used_;
+            if (chunk > count)
+                chunk = count;
+            if (chunk > ring_.size() - write_pos)
+                chunk = ring_.size() - write_pos;
+
+            memcpy(&ring_[write_pos],ptr,chunk);
+            ring_used_ += chunk;
+            ptr += chunk;
+            count -= static_cast<ckcore::tuint32>(chunk);
+
+            CKFS_TRACE_COUNTER("verify","queued_bytes",static_cast<ckcore::tint64>(ring_used_));
+
+            data_cond_.signal();
+        }
+
+        return res;
+    }
+
+    /**
+     * Sets the location of the file data area. File data may contain
+     * anything, including UDF descriptors of other images, so the UDF
+     * verifier skips these sectors.
+     * @param [in] start The first sector of the file data area.
+     * @param [in] length The number of sectors in the file data area.
+     */
+    void VerificationTap::set_data_area(ckcore::tuint64 start,ckcore::tuint64 length)
+    {
+        MutexLock lock(mutex_);
+        data_start_ = start;
+        data_end_ = start + length;
+    }
+
+    /**
+     * Waits for the verifiers to process all written data.
+     * @throw VerificationException If the written file system is invalid.
+     */
+    void VerificationTap::finish()
+    {
+        if (!active())
+            return;
+
+        close();
+        pool_.wait();
+
+        iso_error_.raise();
+        udf_error_.raise();
+    }
+};
@@ -1,10 +1,13 @@
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
 #include <ckcore/path.hh>
 #include <ckcore/file.hh>
 #include <ckcore/string.hh>
 #include <ckcore/filestream.hh>
 #include <ckcore/exception.hh>
 #include "ckfilesystem/sectorstream.hh"
+#include "ckfilesystem/threadpool.hh"
 #include "ckfilesystem/isoverifier.hh"
 
 #define CKFSVFY_VERSION         "0.1"
@@ -23,14 +26,40 @@ int main(int argc,const char *argv[])
         << " Copyright (C) Christian Kindahl 2009" << std::endl << std::endl;
 
     // Parse the command line.
-    if (argc != 2)
+    const char *file_arg = NULL;
+    ckcore::tuint32 thread_count = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strncmp(argv[i],"-j",2))
+        {
+            // Accept both "-jN" and "-j N", zero means one thread per processor.
+            const char *count_arg = argv[i][2] != '\0' ? argv[i] + 2 :
+                (i + 1 < argc ? argv[++i] : "0");
+
+            int count = atoi(count_arg);
+            thread_count = count > 0 ? count : ckfilesystem::ThreadPool::hardware_concurrency();
+        }
+        else if (file_arg == NULL)
+        {
+            file_arg = argv[i];
+        }
+        else
+        {
+            file_arg = NULL;
+            break;
+        }
+    }
+
+    if (file_arg == NULL)
     {
         err << "Error: Invalid usage, please specify a disc image file to analyze."
             << std::endl;
+        err << "Usage: verifier [-j <threads>] <image>" << std::endl;
         return 1;
     }
 
-    ckcore::Path file_path(ckcore::string::ansi_to_auto<1024>(argv[1]).c_str());
+    ckcore::Path file_path(ckcore::string::ansi_to_auto<1024>(file_arg).c_str());
     if (!ckcore::File::exist(file_path))
     {
         err << "Error: The specified file doesn't exist." << std::endl;
@@ -56,7 +85,21 @@ int main(int argc,const char *argv[])
         ckfilesystem::IsoVerifier verifier;
 
         ckfilesystem::SectorInStream in_stream(file_stream);
-        verifier.verify(in_stream);
+        if (thread_count > 1)
+        {
+            ckfilesystem::FileSectorReader reader(ckcore::string::ansi_to_auto<1024>(file_arg).c_str());
+            if (!reader.open())
+            {
+                err << "Error: Unable to open file for reading." << std::endl;
+                return 1;
+            }
+
+            verifier.verify(in_stream,reader,thread_count);
+        }
+        else
+        {
+            verifier.verify(in_stream);
+        }
     }
     catch (ckfilesystem::VerificationException &e)
     {
@@ -0,0 +1,250 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <ckcore/exception.hh>
+#include "ckfilesystem/const.hh"
+#include "ckfilesystem/iso.hh"
+#include "ckfilesystem/exception.hh"
+#include "ckfilesystem/virtualimage.hh"
+
+namespace ckfilesystem
+{
+    /*
+        VirtualImage::Recorder
+    */
+    ckcore::tint64 VirtualImage::Recorder::write(const void *buffer,ckcore::tuint32 count)
+    {
+        image_.record(buffer,count);
+        return count;
+    }
+
+    void VirtualImage::Recorder::write_file(const ckcore::tchar *file_path,ckcore::tuint64 file_offset,
+                                            ckcore::tuint64 file_size)
+    {
+        image_.record_file(file_path,file_offset,file_size);
+    }
+
+    /*
+        VirtualImage
+    */
+    VirtualImage::VirtualImage() :
+        size_(0)
+    {
+    }
+
+    void VirtualImage::clear()
+    {
+        segments_.clear();
+        meta_.clear();
+        files_.clear();
+        size_ = 0;
+    }
+
+    /**
+     * Adds a range to the end of the image, merging it with the previous
+     * segment if possible.
+     */
+    void VirtualImage::append(SegmentType type,ckcore::tuint64 len,ckcore::tuint64 ref)
+    {
+        if (!segments_.empty() && type != SEGMENT_FILE)
+        {
+            Segment &last = segments_.back();
+            if (last.type_ == type &&
+                (type == SEGMENT_ZERO || last.ref_ + last.len_ == ref))
+            {
+                last.len_ += len;
+                size_ += len;
+                return;
+            }
+        }
+
+        Segment segment;
+        segment.pos_ = size_;
+        segment.len_ = len;
+        segment.ref_ = ref;
+        segment.type_ = type;
+        segments_.push_back(segment);
+
+        size_ += len;
+    }
+
+    /**
+     * Records data written by the file system writer. Each sector is checked
+     * for being zero filled so that padding does not have to be stored.
+     */
+    void VirtualImage::record(const void *buffer,ckcore::tuint32 count)
+    {
+        const unsigned char *ptr = static_cast<const unsigned char *>(buffer);
+
+        while (count > 0)
+        {
+            ckcore::tuint32 piece = ISO_SECTOR_SIZE - static_cast<ckcore::tuint32>(size_ % ISO_SECTOR_SIZE);
+            if (piece > count)
+                piece = count;
+
+            bool zero = true;
+            for (ckcore::tuint32 i = 0; i < piece; i++)
+            {
+                if (ptr[i] != 0)
+                {
+                    zero = false;
+                    break;
+                }
+            }
+
+            if (zero)
+            {
+                append(SEGMENT_ZERO,piece,0);
+            }
+            else
+            {
+                append(SEGMENT_META,piece,meta_.size());
+                meta_.insert(meta_.end(),ptr,ptr + piece);
+            }
+
+            ptr += piece;
+            count -= piece;
+        }
+    }
+
+    void VirtualImage::record_file(const ckcore::tchar *file_path,ckcore::tuint64 file_offset,
+                                   ckcore::tuint64 file_size)
+    {
+        if (file_size == 0)
+            return;
+
+        append(SEGMENT_FILE,file_size,files_.size());
+
+        FileRef file_ref;
+        file_ref.file_path_ = file_path;
+        file_ref.file_offset_ = file_offset;
+        files_.push_back(file_ref);
+    }
+
+    /**
+     * Builds the image layout. No file data is read.
+     * @param [in] writer The writer to use for creating the file system. The
+     *                    verification of the writer is disabled while
+     *                    building since no file data is written.
+     * @param [out] progress Object to report progress to.
+     * @param [in] sec_offset Space assumed to be allocated before this image.
+     * @return RESULT_OK on success, otherwise the result of the writer.
+     */
+    int VirtualImage::build(FileSystemWriter &writer,ckcore::Progress &progress,
+                            ckcore::tuint32 sec_offset)
+    {
+        clear();
+
+        bool verify_output = writer.get_verify_output();
+        writer.set_verify_output(false);
+
+        int res = RESULT_FAIL;
+        try
+        {
+            Recorder recorder(*this);
+            res = writer.write(recorder,progress,sec_offset);
+        }
+        catch (...)
+        {
+            writer.set_verify_output(verify_output);
+            clear();
+            throw;
+        }
+
+        writer.set_verify_output(verify_output);
+        if (res != RESULT_OK)
+            clear();
+
+        return res;
+    }
+
+    /**
+     * Reads data from the image.
+     * @param [in] offset Byte offset in the image to start reading from.
+     * @param [out] buffer The buffer to read into.
+     * @param [in] count The number of bytes to read.
+     * @return The number of bytes read, this is less than count only if the
+     *         end of the image is reached.
+     * @throw FileOpenException If a source file could not be opened.
+     * @throw Exception If a source file could not be read.
+     */
+    ckcore::tuint32 VirtualImage::read(ckcore::tuint64 offset,void *buffer,ckcore::tuint32 count) const
+    {
+        if (offset >= size_)
+            return 0;
+
+        if (count > size_ - offset)
+            count = static_cast<ckcore::tuint32>(size_ - offset);
+
+        // Find the last segment starting at or before the offset.
+        size_t first = 0,last = segments_.size();
+        while (last - first > 1)
+        {
+            size_t mid = first + (last - first) / 2;
+            if (segments_[mid].pos_ <= offset)
+                first = mid;
+            else
+                last = mid;
+        }
+
+        unsigned char *ptr = static_cast<unsigned char *>(buffer);
+        ckcore::tuint32 remaining = count;
+
+        for (size_t i = first; remaining > 0 && i < segments_.size(); i++)
+        {
+            const Segment &segment = segments_[i];
+
+            ckcore::tuint64 seg_offset = offset - segment.pos_;
+            ckcore::tuint32 piece = remaining;
+            if (piece > segment.len_ - seg_offset)
+                piece = static_cast<ckcore::tuint32>(segment.len_ - seg_offset);
+
+            switch (segment.type_)
+            {
+                case SEGMENT_META:
+                    memcpy(ptr,&meta_[static_cast<size_t>(segment.ref_ + seg_offset)],piece);
+                    break;
+
+                case SEGMENT_ZERO:
+                    memset(ptr,0,piece);
+                    break;
+
+                case SEGMENT_FILE:
+                    {
+                        const FileRef &file_ref = files_[static_cast<size_t>(segment.ref_)];
+
+                        // A sector size of one allows reading from any byte offset.
+                        FileSectorReader reader(file_ref.file_path_.c_str(),1);
+                        if (!reader.open())
+                            throw FileOpenException(file_ref.file_path_);
+
+                        reader.read(file_ref.file_offset_ + seg_offset,ptr,piece);
+                    }
+                    break;
+            }
+
+            ptr += piece;
+            offset += piece;
+            remaining -= piece;
+        }
+
+        return count;
+    }
+};
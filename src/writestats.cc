@@ -0,0 +1,448 @@
+/*
+ * The ckFileSystem library provides file system functionality.
+ * Copyright (C) 2006-2011 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "ckfilesystem/threadpool.hh"
+#include "ckfilesystem/writestats.hh"
+
+namespace ckfilesystem
+{
+    /*
+        LatencyHistogram
+    */
+    LatencyHistogram::LatencyHistogram() :
+        buckets_(BUCKET_COUNT,0)
+    {
+        clear();
+    }
+
+    /**
+     * Removes all recorded values.
+     */
+    void LatencyHistogram::clear()
+    {
+        std::fill(buckets_.begin(),buckets_.end(),0);
+        count_ = 0;
+        min_ = 0;
+        max_ = 0;
+        sum_ = 0;
+    }
+
+    /**
+     * Returns the index of the bucket a value belongs to.
+     */
+    size_t LatencyHistogram::get_bucket(ckcore::tuint64 value)
+    {
+        if (value < SUB_BUCKET_COUNT)
+            return static_cast<size_t>(value);
+
+        // Find the most significant bit.
+        int msb = 0;
+        for (ckcore::tuint64 tmp = value; tmp > 1; tmp >>= 1)
+            msb++;
+
+        size_t sub_bucket = static_cast<size_t>(value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+        return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + sub_bucket;
+    }
+
+    /**
+     * Returns the largest value belonging to a bucket.
+     */
+    ckcore::tuint64 LatencyHistogram::get_bucket_max(size_t bucket)
+    {
+        if (bucket < SUB_BUCKET_COUNT)
+            return bucket;
+
+        int shift = static_cast<int>(bucket / SUB_BUCKET_COUNT) - 1;
+        ckcore::tuint64 sub_bucket = SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT;
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+
+    /**
+     * Records a value.
+     * @param [in] value The value to record.
+     */
+    void LatencyHistogram::record(ckcore::tuint64 value)
+    {
+        buckets_[get_bucket(value)]++;
+
+        if (count_ == 0 || value < min_)
+            min_ = value;
+        if (value > max_)
+            max_ = value;
+
+        count_++;
+        sum_ += value;
+    }
+
+    /**
+     * Returns the value below which a certain percentage of the recorded
+     * values fall.
+     * @param [in] percentile The percentage, between 0 and 100.
+     * @return The largest value equivalent to the percentile within the
+     *         precision of the histogram, zero if no values have been
+     *         recorded.
+     */
+    ckcore::tuint64 LatencyHistogram::get_percentile(double percentile) const
+    {
+        if (count_ == 0)
+            return 0;
+
+        ckcore::tuint64 target = static_cast<ckcore::tuint64>(percentile / 100.0 * count_ + 0.5);
+        if (target < 1)
+            target = 1;
+
+        ckcore::tuint64 seen = 0;
+        for (size_t i = 0; i < buckets_.size(); i++)
+        {
+            seen += buckets_[i];
+            if (seen >= target)
+                return get_bucket_max(i) < max_ ? get_bucket_max(i) : max_;
+        }
+
+        return max_;
+    }
+
+    /*
+        WriteStats
+    */
+    WriteStats::WriteStats() :
+        slow_file_count_(10)
+    {
+        clear();
+    }
+
+    /**
+     * Resets all statistics.
+     */
+    void WriteStats::clear()
+    {
+        for (int i = 0; i < PHASE_COUNT; i++)
+            phases_[i] = PhaseStats();
+
+        cur_phase_ = PHASE_TREE;
+        in_phase_ = false;
+        phase_wall_start_ = 0;
+        phase_cpu_start_ = 0;
+        phase_sec_start_ = 0;
+
+        file_count_ = 0;
+        dir_count_ = 0;
+        stat_count_ = 0;
+        open_count_ = 0;
+        read_count_ = 0;
+        write_count_ = 0;
+        data_bytes_ = 0;
+        tree_mem_usage_ = 0;
+
+        open_latency_.clear();
+        read_latency_.clear();
+        read_rate_.clear();
+        slow_files_.clear();
+    }
+
+    /**
+     * Sets the number of slowest source files to keep, the default is ten.
+     * @param [in] count The number of files.
+     */
+    void WriteStats::set_slow_file_count(size_t count)
+    {
+        slow_file_count_ = count;
+        if (slow_files_.size() > count)
+            slow_files_.resize(count);
+    }
+
+    /**
+     * Records the time spent reading a source file.
+     * @param [in] file_path Path to the source file.
+     * @param [in] file_size The number of bytes read.
+     * @param [in] open_time Time to open the file in microseconds.
+     * @param [in] read_time Time blocked in read calls in microseconds.
+     */
+    void WriteStats::record_file(const ckcore::tstring &file_path,ckcore::tuint64 file_size,
+                                 ckcore::tuint64 open_time,ckcore::tuint64 read_time)
+    {
+        open_latency_.record(open_time);
+        if (file_size > 0 && read_time > 0)
+            read_rate_.record(file_size * 1000000 / 1024 / read_time);
+
+        if (slow_file_count_ == 0)
+            return;
+
+        // Keep the slowest files ordered by their total time.
+        ckcore::tuint64 total_time = open_time + read_time;
+        if (slow_files_.size() == slow_file_count_ &&
+            slow_files_.back().get_total_time() >= total_time)
+        {
+            return;
+        }
+
+        FileTiming timing;
+        timing.file_path_ = file_path;
+        timing.file_size_ = file_size;
+        timing.open_time_ = open_time;
+        timing.read_time_ = read_time;
+
+        std::vector<FileTiming>::iterator it = slow_files_.begin();
+        while (it != slow_files_.end() && it->get_total_time() >= total_time)
+            it++;
+
+        slow_files_.insert(it,timing);
+        if (slow_files_.size() > slow_file_count_)
+            slow_files_.pop_back();
+    }
+
+    /**
+     * Returns the value of a monotonic clock in microseconds.
+     */
+    ckcore::tuint64 WriteStats::get_wall_time()
+    {
+#ifdef _WINDOWS
+        LARGE_INTEGER counter,frequency;
+        if (!QueryPerformanceCounter(&counter) || !QueryPerformanceFrequency(&frequency) ||
+            frequency.QuadPart == 0)
+        {
+            return 0;
+        }
+
+        return (ckcore::tuint64)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+            (ckcore::tuint64)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC,&ts) != 0)
+            return 0;
+
+        return (ckcore::tuint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+    }
+
+    /**
+     * Adds processor time used by another thread working for the writer to
+     * the current phase.
+     * @param [in] cpu_time The processor time in microseconds.
+     */
+    void WriteStats::add_cpu_time(ckcore::tuint64 cpu_time)
+    {
+        phases_[cur_phase_].cpu_time_ += cpu_time;
+    }
+
+    /**
+     * Starts measuring a phase, any phase in progress is ended first. A
+     * phase may be entered more than once, the statistics are accumulated.
+     * @param [in] phase The phase to begin.
+     * @param [in] sector The current sector of the output stream.
+     */
+    void WriteStats::begin_phase(Phase phase,ckcore::tuint64 sector)
+    {
+        if (in_phase_)
+            end_phase(sector);
+
+        cur_phase_ = phase;
+        in_phase_ = true;
+        phase_sec_start_ = sector;
+        phase_cpu_start_ = ThreadPool::thread_cpu_time();
+        phase_wall_start_ = get_wall_time();
+    }
+
+    /**
+     * Ends the phase in progress.
+     * @param [in] sector The current sector of the output stream.
+     */
+    void WriteStats::end_phase(ckcore::tuint64 sector)
+    {
+        if (!in_phase_)
+            return;
+
+        PhaseStats &stats = phases_[cur_phase_];
+        stats.wall_time_ += get_wall_time() - phase_wall_start_;
+        stats.cpu_time_ += ThreadPool::thread_cpu_time() - phase_cpu_start_;
+        if (sector > phase_sec_start_)
+            stats.sectors_ += sector - phase_sec_start_;
+
+        in_phase_ = false;
+    }
+
+    /**
+     * Returns the sum of the statistics of all phases.
+     */
+    WriteStats::PhaseStats WriteStats::get_total() const
+    {
+        PhaseStats total;
+        for (int i = 0; i < PHASE_COUNT; i++)
+        {
+            total.wall_time_ += phases_[i].wall_time_;
+            total.cpu_time_ += phases_[i].cpu_time_;
+            total.sectors_ += phases_[i].sectors_;
+        }
+
+        return total;
+    }
+
+    /**
+     * Returns a short descriptive name of a phase.
+     * @param [in] phase The phase.
+     */
+    const ckcore::tchar *WriteStats::get_phase_name(Phase phase)
+    {
+        switch (phase)
+        {
+            case PHASE_TREE:
+                return ckT("file tree");
+            case PHASE_DVDVIDEO:
+                return ckT("DVD-Video padding");
+            case PHASE_NAMES:
+                return ckT("file names");
+            case PHASE_PATH_TABLES:
+                return ckT("path table sorting");
+            case PHASE_ALLOC:
+                return ckT("meta data allocation");
+            case PHASE_ALLOC_DATA:
+                return ckT("file data allocation");
+            case PHASE_HEADER:
+                return ckT("volume descriptors");
+            case PHASE_UDF_PARTITION:
+                return ckT("UDF partition");
+            case PHASE_WRITE_PATH_TABLES:
+                return ckT("path tables");
+            case PHASE_DIR_ENTRIES:
+                return ckT("directory entries");
+            case PHASE_DATA:
+                return ckT("file data");
+            case PHASE_UDF_TAIL:
+                return ckT("UDF tail");
+            default:
+                return ckT("unknown");
+        }
+    }
+
+    /**
+     * Prints the statistics to the log.
+     * @param [in] log The log to print to.
+     */
+    void WriteStats::print(ckcore::Log &log) const
+    {
+        log.print_line(ckT("  write statistics:"));
+
+        for (int i = 0; i < PHASE_COUNT; i++)
+        {
+            log.print_line(ckT("    %s: %u ms wall, %u ms cpu, %u sector(s)."),
+                           get_phase_name((Phase)i),
+                           (ckcore::tuint32)(phases_[i].wall_time_ / 1000),
+                           (ckcore::tuint32)(phases_[i].cpu_time_ / 1000),
+                           (ckcore::tuint32)phases_[i].sectors_);
+        }
+
+        PhaseStats total = get_total();
+        log.print_line(ckT("    total: %u ms wall, %u ms cpu, %u sector(s)."),
+                       (ckcore::tuint32)(total.wall_time_ / 1000),
+                       (ckcore::tuint32)(total.cpu_time_ / 1000),
+                       (ckcore::tuint32)total.sectors_);
+
+        log.print_line(ckT("    %u file(s) and %u director(ies), %u KiB file tree memory."),
+                       file_count_,dir_count_,(ckcore::tuint32)(tree_mem_usage_ >> 10));
+#ifdef _WINDOWS
+        log.print_line(ckT("    %I64u stat, %I64u open, %I64u read and %I64u write call(s)."),
+#else
+        log.print_line(ckT("    %llu stat, %llu open, %llu read and %llu write call(s)."),
+#endif
+                       stat_count_,open_count_,read_count_,write_count_);
+
+        print_histogram(log,ckT("open latency (us)"),open_latency_);
+        print_histogram(log,ckT("read latency (us)"),read_latency_);
+        print_histogram(log,ckT("read rate (KiB/s)"),read_rate_);
+
+        for (size_t i = 0; i < slow_files_.size(); i++)
+        {
+#ifdef _WINDOWS
+            log.print_line(ckT("    slow source: %s: %I64u us open, %I64u us read, %I64u bytes."),
+#else
+            log.print_line(ckT("    slow source: %s: %llu us open, %llu us read, %llu bytes."),
+#endif
+                           slow_files_[i].file_path_.c_str(),slow_files_[i].open_time_,
+                           slow_files_[i].read_time_,slow_files_[i].file_size_);
+        }
+    }
+
+    /**
+     * Prints a summary of a histogram to the log.
+     * @param [in] log The log to print to.
+     * @param [in] name Name of the histogram.
+     * @param [in] histogram The histogram to print.
+     */
+    void WriteStats::print_histogram(ckcore::Log &log,const ckcore::tchar *name,
+                                     const LatencyHistogram &histogram)
+    {
+        if (histogram.get_count() == 0)
+            return;
+
+#ifdef _WINDOWS
+        log.print_line(ckT("    %s: min %I64u, p50 %I64u, p90 %I64u, p99 %I64u, max %I64u of %I64u."),
+#else
+        log.print_line(ckT("    %s: min %llu, p50 %llu, p90 %llu, p99 %llu, max %llu of %llu."),
+#endif
+                       name,histogram.get_min(),histogram.get_percentile(50),
+                       histogram.get_percentile(90),histogram.get_percentile(99),
+                       histogram.get_max(),histogram.get_count());
+    }
+
+    /*
+        StatsInStream
+    */
+    bool StatsInStream::end()
+    {
+        return stream_.end();
+    }
+
+    bool StatsInStream::seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence)
+    {
+        return stream_.seek(distance,whence);
+    }
+
+    ckcore::tint64 StatsInStream::read(void *buffer,ckcore::tuint32 count)
+    {
+        ckcore::tuint64 start_time = WriteStats::get_wall_time();
+        ckcore::tint64 res = stream_.read(buffer,count);
+        ckcore::tuint64 read_time = WriteStats::get_wall_time() - start_time;
+
+        stats_.read_count_++;
+        stats_.read_latency_.record(read_time);
+        read_time_ += read_time;
+
+        return res;
+    }
+
+    ckcore::tint64 StatsInStream::size()
+    {
+        return stream_.size();
+    }
+
+    /*
+        StatsOutStream
+    */
+    ckcore::tint64 StatsOutStream::write(const void *buffer,ckcore::tuint32 count)
+    {
+        stats_.write_count_++;
+        return stream_.write(buffer,count);
+    }
+};
@@ -19,12 +19,43 @@
 #include <cxxtest/TestSuite.h>
 #include <algorithm>
 #include <map>
+#include <set>
+#include <stdexcept>
 #include <string.h>
+#ifndef _WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "ckcore/crcstream.hh"
+#include "ckcore/file.hh"
 #include "ckcore/filestream.hh"
 #include "ckcore/linereader.hh"
+#include "ckcore/progress.hh"
+#include "ckfilesystem/cacheadvisor.hh"
+#include "ckfilesystem/clonestream.hh"
+#include "ckfilesystem/const.hh"
+#include "ckfilesystem/dataplacement.hh"
+#include "ckfilesystem/filestat.hh"
 #include "ckfilesystem/filesystem.hh"
+#include "ckfilesystem/filesystemwriter.hh"
 #include "ckfilesystem/filetree.hh"
+#include "ckfilesystem/isoimagesource.hh"
+#include "ckfilesystem/isoreader.hh"
+#include "ckfilesystem/isoverifier.hh"
 #include "ckfilesystem/isowriter.hh"
+#include "ckfilesystem/layoutmap.hh"
+#include "ckfilesystem/sectormanager.hh"
+#include "ckfilesystem/sectorstream.hh"
+#include "ckfilesystem/threadpool.hh"
+#include "ckfilesystem/trace.hh"
+#include "ckfilesystem/udf.hh"
+#include "ckfilesystem/util.hh"
+#include "ckfilesystem/virtualimage.hh"
+#include "ckfilesystem/writestats.hh"
 
 #ifdef TEST_SRC_DIR
 #undef TEST_SRC_DIR
@@ -46,6 +77,28 @@ public:
     ckcore::tint64 write(const void *buffer, ckcore::tuint32 count) { return count; }
 };
 
+class DummyProgress : public ckcore::Progress
+{
+public:
+    void set_progress(unsigned char progress) {}
+    void set_status(const ckcore::tchar *format, ...) {}
+    void notify(MessageType type, const ckcore::tchar *format, ...) {}
+    bool cancelled() { return false; }
+};
+
+class MemoryStream : public ckcore::OutStream
+{
+public:
+    std::vector<unsigned char> data_;
+
+    ckcore::tint64 write(const void *buffer, ckcore::tuint32 count)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(buffer);
+        data_.insert(data_.end(), bytes, bytes + count);
+        return count;
+    }
+};
+
 void read_src(const ckcore::tchar *src_path, FileSet &file_set)
 {
     ckcore::FileInStream fis(src_path);
@@ -129,6 +182,576 @@ void run_tree_test_iso(const ckcore::tchar *src_path, const ckcore::tchar *exp_p
     }
 }
 
+/*
+ * Configures the file system and writer used by write_image. The default
+ * configuration writes the image to memory without any log.
+ */
+class ImageConfig
+{
+private:
+    DummyLogger dummy_logger_;
+
+public:
+    virtual ~ImageConfig() {}
+
+    virtual ckcore::Log &get_log() { return dummy_logger_; }
+    virtual void configure_file_system(FileSystem &file_sys) {}
+    virtual void configure_writer(FileSystemWriter &writer) {}
+
+    virtual int write(FileSystemWriter &writer, ckcore::Progress &progress,
+                      std::vector<unsigned char> &image)
+    {
+        MemoryStream out_stream;
+        int result = writer.write(out_stream, progress);
+
+        image.swap(out_stream.data_);
+        return result;
+    }
+
+    /*
+     * Called with the writer once the image has been written.
+     */
+    virtual void written(FileSystemWriter &writer) {}
+};
+
+/*
+ * Writes an image, returns the result of the writer.
+ */
+static int write_image(FileSet &file_set, FileSystem::Type type, bool embed_udf_data,
+                       std::vector<unsigned char> &image, ImageConfig *config = NULL)
+{
+    ImageConfig default_config;
+    if (config == NULL)
+        config = &default_config;
+
+    DummyProgress dummy_progress;
+
+    FileSystem file_sys(type, file_set);
+    file_sys.set_volume_label(ckT("SOURCES"));
+    file_sys.set_create_time(1234567890);
+    file_sys.set_embed_udf_data(embed_udf_data);
+    config->configure_file_system(file_sys);
+
+    FileSystemWriter writer(config->get_log(), file_sys, true);
+    config->configure_writer(writer);
+
+    int result = config->write(writer, dummy_progress, image);
+    config->written(writer);
+    return result;
+}
+
+/*
+ * Writes an image verifying it while it's written.
+ */
+class VerifyConfig : public ImageConfig
+{
+public:
+    void configure_writer(FileSystemWriter &writer)
+    {
+        writer.set_verify_output(true);
+    }
+};
+
+/*
+ * Builds a complete image in memory. Every task has its own file set, file
+ * system and writer, nothing is shared with other tasks.
+ */
+class BuildTask : public ThreadPool::Task, public ImageConfig
+{
+private:
+    FileSet file_set_;
+    FileSystem::Type type_;
+    bool verify_;
+
+public:
+    Executor *executor_;
+    int result_;
+    std::vector<unsigned char> image_;
+
+    BuildTask(FileSystem::Type type, bool verify) :
+        file_set_(false), type_(type), verify_(verify), executor_(NULL), result_(RESULT_FAIL)
+    {
+        for (int i = 0; i < 20; i++)
+        {
+            std::stringstream dir_path;
+            dir_path << "/Directory " << i;
+
+            file_set_.insert(new FileDescriptor(ckcore::string::to_auto(dir_path.str()).c_str(),
+                                                ckT(TEST_SRC_DIR)ckT("/data/dummy"),
+                                                FileDescriptor::FLAG_DIRECTORY));
+
+            // Long names with collisions in 8.3 form.
+            for (int j = 0; j < 50; j++)
+            {
+                std::stringstream file_path;
+                file_path << dir_path.str() << "/Some long file name " << j << ".txt";
+
+                file_set_.insert(new FileDescriptor(ckcore::string::to_auto(file_path.str()).c_str(),
+                                                    ckT(TEST_SRC_DIR)ckT("/data/dummy")));
+            }
+        }
+    }
+
+    ~BuildTask()
+    {
+        destroy_file_set(file_set_);
+    }
+
+    void configure_file_system(FileSystem &file_sys)
+    {
+        file_sys.set_volume_label(ckT("STRESS"));
+    }
+
+    void configure_writer(FileSystemWriter &writer)
+    {
+        writer.set_verify_output(verify_);
+        writer.set_executor(executor_, 2);
+    }
+
+    void run()
+    {
+        result_ = write_image(file_set_, type_, false, image_, this);
+    }
+};
+
+/*
+ * Records the highest number of tasks running at the same time.
+ */
+class ConcurrencyTask : public Executor::Task
+{
+private:
+    Mutex &mutex_;
+    int &running_;
+    int &max_running_;
+
+public:
+    ConcurrencyTask(Mutex &mutex, int &running, int &max_running) :
+        mutex_(mutex), running_(running), max_running_(max_running)
+    {
+    }
+
+    void run()
+    {
+        {
+            MutexLock lock(mutex_);
+            if (++running_ > max_running_)
+                max_running_ = running_;
+        }
+
+#ifdef _WINDOWS
+        Sleep(1);
+#else
+        usleep(1000);
+#endif
+
+        MutexLock lock(mutex_);
+        running_--;
+    }
+};
+
+class FillRange : public Executor::RangeTask
+{
+public:
+    std::vector<size_t> &values_;
+
+    FillRange(std::vector<size_t> &values) : values_(values) {}
+
+    void run(size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            values_[i] = i;
+    }
+};
+
+/*
+ * Runs a parallel loop in a nested task group on the executor it runs on.
+ */
+class NestedTask : public Executor::Task
+{
+private:
+    Executor &executor_;
+
+public:
+    std::vector<size_t> values_;
+
+    NestedTask(Executor &executor) : executor_(executor), values_(1000, 0) {}
+
+    void run()
+    {
+        FillRange body(values_);
+
+        TaskGroup group(executor_);
+        group.parallel_for(0, values_.size(), 10, body);
+    }
+};
+
+/*
+ * Returns the offset of the data in the image, or -1 if not found.
+ */
+static long find_data(const std::vector<unsigned char> &image, const std::vector<unsigned char> &data)
+{
+    std::vector<unsigned char>::const_iterator it =
+        std::search(image.begin(), image.end(), data.begin(), data.end());
+
+    return it == image.end() ? -1 : static_cast<long>(it - image.begin());
+}
+
+/*
+ * Positional sector reader over an image in memory.
+ */
+class MemorySectorReader : public SectorReader
+{
+private:
+    const std::vector<unsigned char> &image_;
+
+public:
+    MemorySectorReader(const std::vector<unsigned char> &image) : image_(image) {}
+
+    void read(ckcore::tuint64 sector, void *buffer, ckcore::tuint32 count)
+    {
+        ckcore::tuint64 offset = sector * ISO_SECTOR_SIZE;
+        if (offset + count > image_.size())
+            throw ckcore::Exception2(ckT("Read beyond the end of the image."));
+
+        memcpy(buffer, &image_[static_cast<size_t>(offset)], count);
+    }
+};
+
+/*
+ * Verifies an image in memory, sequentially if thread_count is zero.
+ * Returns true if the image passed verification.
+ */
+static bool verify_image(const std::vector<unsigned char> &image, ckcore::tuint32 thread_count)
+{
+    try
+    {
+        MemoryDataSource in_stream(&image[0], image.size());
+        in_stream.open();
+
+        IsoVerifier verifier;
+        SectorInStream sector_stream(in_stream);
+
+        if (thread_count > 0)
+        {
+            MemorySectorReader reader(image);
+            verifier.verify(sector_stream, reader, thread_count);
+        }
+        else
+        {
+            verifier.verify(sector_stream);
+        }
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Counts the lines printed to the log.
+ */
+class CountingLogger : public ckcore::Log
+{
+public:
+    int lines_;
+
+    CountingLogger() : lines_(0) {}
+
+    void print(const ckcore::tchar *format, ...) {}
+    void print_line(const ckcore::tchar *format, ...) { lines_++; }
+};
+
+/*
+ * Counts the UDF file identifier descriptors recorded back to back starting
+ * at the specified offset, checking their tags. Returns -1 if a tag is
+ * invalid.
+ */
+static long count_file_idents(const std::vector<unsigned char> &image, size_t offset)
+{
+    ckcore::CrcStream crc_stream(ckcore::CrcStream::ckCRC_CCITT);
+
+    long count = 0;
+    while (offset + sizeof(tudf_fileident_desc) <= image.size())
+    {
+        tudf_fileident_desc fid;
+        memcpy(&fid, &image[offset], sizeof(tudf_fileident_desc));
+        if (fid.desc_tag.tag_ident != UDF_TAGIDENT_FILEIDENTDESC)
+            break;
+
+        unsigned char checksum = 0;
+        for (size_t i = 0; i < sizeof(tudf_tag); i++)
+        {
+            if (i != 4)
+                checksum += image[offset + i];
+        }
+
+        crc_stream.reset();
+        crc_stream.write(&image[offset + sizeof(tudf_tag)], fid.desc_tag.desc_crc_len);
+        if (checksum != fid.desc_tag.tag_chksum ||
+            static_cast<ckcore::tuint16>(crc_stream.checksum()) != fid.desc_tag.desc_crc)
+        {
+            return -1;
+        }
+
+        size_t len = 38 + fid.impl_use_len + fid.file_ident_len;
+        offset += (len + 3) & ~3;
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * Returns true if the data is embedded in an UDF file entry.
+ */
+static bool is_embedded(const std::vector<unsigned char> &image, const std::vector<unsigned char> &data)
+{
+    long pos = find_data(image, data);
+    if (pos == -1)
+        return false;
+
+    tudf_file_entry file_entry;
+    size_t sector_pos = pos - pos % UDF_SECTOR_SIZE;
+    memcpy(&file_entry, &image[sector_pos], sizeof(tudf_file_entry));
+
+    return file_entry.desc_tag.tag_ident == UDF_TAGIDENT_FILEENTRYDESC &&
+           (file_entry.icb_tag.flags & 0x07) == UDF_ICB_FILEFLAG_ONE_ALLOC_DESC &&
+           file_entry.allocdesc_len == data.size() &&
+           static_cast<size_t>(pos) == sector_pos + sizeof(tudf_file_entry) + file_entry.extended_attr_len;
+}
+
+#ifndef _WINDOWS
+/*
+ * Temporary directory for files created by a test, the files and the
+ * directory are removed when it goes out of scope.
+ */
+class TempDir
+{
+private:
+    std::string dir_path_;
+    std::vector<std::string> file_paths_;
+
+public:
+    TempDir()
+    {
+        char dir_path[] = "/tmp/ckfilesystem-XXXXXX";
+        if (mkdtemp(dir_path) != NULL)
+            dir_path_ = dir_path;
+    }
+
+    ~TempDir()
+    {
+        // Files in subdirectories are removed before their directory.
+        for (size_t i = file_paths_.size(); i > 0; i--)
+            remove(file_paths_[i - 1].c_str());
+
+        if (!dir_path_.empty())
+            rmdir(dir_path_.c_str());
+    }
+
+    bool valid() const
+    {
+        return !dir_path_.empty();
+    }
+
+    /*
+     * Returns the path of a file or subdirectory in the directory, which is
+     * removed with it.
+     */
+    std::string file(const char *file_name)
+    {
+        file_paths_.push_back(dir_path_ + "/" + file_name);
+        return file_paths_.back();
+    }
+};
+
+/*
+ * Writes data to a new file, returns true if successful.
+ */
+static bool write_file(const std::string &file_path, const std::vector<unsigned char> &data)
+{
+    {
+        ckcore::FileOutStream out_stream(file_path.c_str());
+        if (!out_stream.open())
+            return false;
+
+        if (!data.empty() &&
+            out_stream.write(&data[0], static_cast<ckcore::tuint32>(data.size())) !=
+            static_cast<ckcore::tint64>(data.size()))
+        {
+            return false;
+        }
+    }
+
+    // Reads update access times recorded in images as long as the access
+    // time is not later than the modification and change times. Move it a
+    // second ahead so that images written from the file are comparable.
+    struct stat file_stat;
+    if (stat(file_path.c_str(), &file_stat) != 0)
+        return false;
+
+    struct timespec times[2];
+    times[0] = file_stat.st_mtim;
+    times[0].tv_sec += 1;
+    times[1].tv_sec = 0;
+    times[1].tv_nsec = UTIME_OMIT;
+    return utimensat(AT_FDCWD, file_path.c_str(), times, 0) == 0;
+}
+
+/*
+ * Reads the contents of a file.
+ */
+static std::vector<unsigned char> read_file(const std::string &file_path)
+{
+    std::vector<unsigned char> data;
+
+    ckcore::FileInStream in_stream(file_path.c_str());
+    if (!in_stream.open())
+        return data;
+
+    unsigned char buffer[4096];
+    ckcore::tint64 processed;
+    while ((processed = in_stream.read(buffer, sizeof(buffer))) > 0)
+        data.insert(data.end(), buffer, buffer + processed);
+
+    return data;
+}
+
+/*
+ * Writes the file back to disk and evicts its data from the page cache.
+ */
+static bool drop_file_cache(const std::string &file_path)
+{
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    bool result = fsync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return result;
+}
+
+/*
+ * Returns the number of pages of the file in the page cache, or -1 on
+ * error.
+ */
+static long count_cached_pages(const std::string &file_path, size_t size)
+{
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return -1;
+
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    std::vector<unsigned char> pages((size + page_size - 1) / page_size);
+
+    long resident = 0;
+    if (mincore(addr, size, &pages[0]) == 0)
+    {
+        for (size_t i = 0; i < pages.size(); i++)
+            resident += pages[i] & 1;
+    }
+    else
+    {
+        resident = -1;
+    }
+
+    munmap(addr, size);
+    return resident;
+}
+
+/*
+ * Writes the image to a file through a clone stream and reads it back.
+ */
+class CloneConfig : public ImageConfig
+{
+public:
+    std::string image_path_;
+    ckcore::tuint64 stream_size_;
+    ckcore::tuint64 file_bytes_;    ///< Bytes cloned, copied or buffered from files.
+
+    CloneConfig(const std::string &image_path) :
+        image_path_(image_path), stream_size_(0), file_bytes_(0) {}
+
+    int write(FileSystemWriter &writer, ckcore::Progress &progress,
+              std::vector<unsigned char> &image)
+    {
+        CloneOutStream out_stream(ckcore::string::to_auto(image_path_).c_str());
+        if (!out_stream.open())
+            return RESULT_FAIL;
+
+        int result = writer.write(out_stream, progress);
+        if (!out_stream.close())
+            result = RESULT_FAIL;
+
+        stream_size_ = out_stream.get_pos();
+        file_bytes_ = out_stream.get_cloned_bytes() + out_stream.get_copied_bytes() +
+                      out_stream.get_buffered_bytes();
+
+        image = read_file(image_path_);
+        return result;
+    }
+};
+#endif
+
+/*
+ * Keeps the processor busy for a while.
+ */
+class SpinTask : public Executor::Task
+{
+public:
+    void run()
+    {
+        ckcore::tuint64 start = ThreadPool::thread_cpu_time();
+        while (ThreadPool::thread_cpu_time() - start < 20000)
+            ;
+    }
+};
+
+/*
+ * Throws an exception carrying its index, or runs normally if negative.
+ */
+class ThrowingTask : public Executor::Task
+{
+private:
+    int index_;
+    Mutex &mutex_;
+    int &run_count_;
+
+public:
+    ThrowingTask(int index, Mutex &mutex, int &run_count) :
+        index_(index), mutex_(mutex), run_count_(run_count)
+    {
+    }
+
+    void run()
+    {
+        {
+            MutexLock lock(mutex_);
+            run_count_++;
+        }
+
+        if (index_ >= 0)
+            throw std::runtime_error(index_ == 0 ? "first" : "other");
+    }
+};
+
+class ThrowingRange : public Executor::RangeTask
+{
+public:
+    void run(size_t begin, size_t end)
+    {
+        if (begin <= 50 && 50 < end)
+            throw std::out_of_range("range");
+    }
+};
+
 class FileSystemTestSuite : public CxxTest::TestSuite
 {
 public:
@@ -169,4 +792,1860 @@ public:
         run_tree_test_iso(ckT(TEST_SRC_DIR)ckT("/data/iso/test-06.src"), ckT(TEST_SRC_DIR)ckT("/data/iso/test-06.exp"),
                           false, CHARSET_ASCII);
     }
+
+    /*
+     * Independent writers must be able to run at the same time and produce
+     * exactly the same images as when running one at a time.
+     */
+    void test_concurrent_builds()
+    {
+        const FileSystem::Type types[] =
+        {
+            FileSystem::TYPE_ISO,
+            FileSystem::TYPE_ISO_JOLIET,
+            FileSystem::TYPE_ISO_UDF_JOLIET,
+            FileSystem::TYPE_UDF
+        };
+        const size_t type_count = sizeof(types) / sizeof(FileSystem::Type);
+        const ckcore::tuint32 thread_count = 8;
+        const size_t build_count = thread_count * type_count * 2;
+
+        std::vector<std::vector<unsigned char> > reference(type_count);
+        for (size_t i = 0; i < type_count; i++)
+        {
+            BuildTask task(types[i], false);
+            task.run();
+
+            TS_ASSERT_EQUALS(task.result_, RESULT_OK);
+            reference[i].swap(task.image_);
+        }
+
+        // Every other round of builds also verifies the output, which adds a
+        // verification thread per build.
+        ThreadPool pool(thread_count);
+
+        // Half of the builds schedule their own parallel stages on the pool
+        // they are running on.
+        std::vector<BuildTask *> tasks;
+        for (size_t i = 0; i < build_count; i++)
+        {
+            tasks.push_back(new BuildTask(types[i % type_count], (i / type_count) % 2 == 1));
+            if ((i / (type_count * 2)) % 2 == 1)
+                tasks.back()->executor_ = &pool;
+        }
+
+        for (size_t i = 0; i < build_count; i++)
+            pool.submit(tasks[i]);
+
+        pool.wait();
+
+        for (size_t i = 0; i < build_count; i++)
+        {
+            TS_ASSERT_EQUALS(tasks[i]->result_, RESULT_OK);
+            TS_ASSERT(tasks[i]->image_ == reference[i % type_count]);
+
+            delete tasks[i];
+        }
+    }
+
+    void test_task_group()
+    {
+        ThreadPool pool(8);
+
+        // Every index must be visited exactly once.
+        std::vector<size_t> values(100000, 0);
+        FillRange body(values);
+        {
+            TaskGroup group(pool);
+            group.parallel_for(0, values.size(), 1000, body);
+        }
+
+        for (size_t i = 0; i < values.size(); i++)
+            TS_ASSERT_EQUALS(values[i], i);
+
+        // The group limit must be respected.
+        Mutex mutex;
+        int running = 0, max_running = 0;
+        std::vector<ConcurrencyTask> tasks(64, ConcurrencyTask(mutex, running, max_running));
+        {
+            TaskGroup group(pool, 3);
+            for (size_t i = 0; i < tasks.size(); i++)
+                group.submit(&tasks[i]);
+
+            group.wait();
+        }
+
+        TS_ASSERT(max_running > 0 && max_running <= 3);
+
+        // Groups waited for from tasks running on the same pool must not
+        // deadlock, even when all workers are busy waiting.
+        ThreadPool small_pool(2);
+        std::vector<NestedTask *> nested;
+        {
+            TaskGroup group(small_pool);
+            for (size_t i = 0; i < 16; i++)
+            {
+                nested.push_back(new NestedTask(small_pool));
+                group.submit(nested.back());
+            }
+        }
+
+        for (size_t i = 0; i < nested.size(); i++)
+        {
+            for (size_t j = 0; j < nested[i]->values_.size(); j++)
+                TS_ASSERT_EQUALS(nested[i]->values_[j], j);
+
+            delete nested[i];
+        }
+
+        // A pool without threads runs everything on the calling thread.
+        ThreadPool inline_pool(0);
+        std::vector<size_t> inline_values(100, 0);
+        FillRange inline_body(inline_values);
+        TaskGroup inline_group(inline_pool, 4);
+        inline_group.parallel_for(0, inline_values.size(), 7, inline_body);
+
+        for (size_t i = 0; i < inline_values.size(); i++)
+            TS_ASSERT_EQUALS(inline_values[i], i);
+    }
+
+    void test_data_sources()
+    {
+        // Memory buffer.
+        const char manifest[] = "name=data source test\nversion=1\n";
+        std::vector<unsigned char> manifest_data(manifest, manifest + sizeof(manifest) - 1);
+        MemoryDataSource memory_source(manifest, sizeof(manifest) - 1);
+
+        // Generated data spanning several sectors, produced in small pieces.
+        std::vector<unsigned char> generated_data(100000);
+        for (size_t i = 0; i < generated_data.size(); i++)
+            generated_data[i] = static_cast<unsigned char>((i * 7 + 3) % 251);
+
+        CallbackDataSource callback_source(generated_data.size(),
+            [&generated_data](ckcore::tuint64 offset, void *buffer, ckcore::tuint32 count)
+            {
+                if (count > 1000)
+                    count = 1000;
+
+                memcpy(buffer, &generated_data[offset], count);
+                return static_cast<ckcore::tint64>(count);
+            });
+
+        // Range of another file.
+        ckcore::FileInStream src_stream(ckT(TEST_SRC_DIR)ckT("/data/iso/test-01.src"));
+        TS_ASSERT(src_stream.open());
+        std::vector<unsigned char> range_data(static_cast<size_t>(src_stream.size()));
+        TS_ASSERT_EQUALS(src_stream.read(&range_data[0], range_data.size()), ckcore::tint64(range_data.size()));
+        src_stream.close();
+
+        range_data.erase(range_data.begin(), range_data.begin() + 10);
+        range_data.resize(range_data.size() - 5);
+        FileRangeDataSource range_source(ckT(TEST_SRC_DIR)ckT("/data/iso/test-01.src"), 10, range_data.size());
+
+        const FileSystem::Type types[] =
+        {
+            FileSystem::TYPE_ISO,
+            FileSystem::TYPE_ISO_UDF_JOLIET,
+            FileSystem::TYPE_UDF
+        };
+
+        for (size_t i = 0; i < sizeof(types) / sizeof(FileSystem::Type); i++)
+        {
+            for (int embed = 0; embed < 2; embed++)
+            {
+                FileComparator comparator(false);
+                FileSet file_set(comparator);
+                file_set.insert(new FileDescriptor(ckT("/manifest.txt"), &memory_source));
+                file_set.insert(new FileDescriptor(ckT("/generated.bin"), &callback_source));
+                file_set.insert(new FileDescriptor(ckT("/range.txt"), &range_source));
+
+                std::vector<unsigned char> image;
+                TS_ASSERT_EQUALS(write_image(file_set, types[i], embed == 1, image), RESULT_OK);
+                destroy_file_set(file_set);
+
+                // Small files may be embedded in their UDF file entries,
+                // everything else starts on a sector boundary.
+                long pos = find_data(image, manifest_data);
+                TS_ASSERT(pos > 0 && (embed == 1 || pos % 2048 == 0));
+                pos = find_data(image, range_data);
+                TS_ASSERT(pos > 0 && (embed == 1 || pos % 2048 == 0));
+                pos = find_data(image, generated_data);
+                TS_ASSERT(pos > 0 && pos % 2048 == 0);
+            }
+        }
+
+        // Errors reported by a data source must fail the write.
+        CallbackDataSource failing_source(5000,
+            [](ckcore::tuint64 offset, void *buffer, ckcore::tuint32 count)
+            {
+                if (offset >= 2048)
+                    return ckcore::tint64(-1);
+
+                if (count > 1000)
+                    count = 1000;
+
+                memset(buffer, 0, count);
+                return static_cast<ckcore::tint64>(count);
+            });
+        FileRangeDataSource short_source(ckT(TEST_SRC_DIR)ckT("/data/iso/test-01.src"), 0, 1 << 30);
+
+        DataSource *bad_sources[] = { &failing_source, &short_source };
+        for (size_t i = 0; i < sizeof(bad_sources) / sizeof(DataSource *); i++)
+        {
+            FileComparator comparator(false);
+            FileSet file_set(comparator);
+            file_set.insert(new FileDescriptor(ckT("/bad.bin"), bad_sources[i]));
+
+            std::vector<unsigned char> image;
+            TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO, false, image), RESULT_FAIL);
+            destroy_file_set(file_set);
+        }
+    }
+
+    void test_iso_image_source()
+    {
+#ifndef _WINDOWS
+        TempDir temp_dir;
+        TS_ASSERT(temp_dir.valid());
+
+        const char readme[] = "remastered without extraction\n";
+        const char old_notes[] = "notes of the original image\n";
+        const char new_notes[] = "notes of the remastered image\n";
+        std::vector<unsigned char> readme_data(readme, readme + sizeof(readme) - 1);
+        std::vector<unsigned char> old_notes_data(old_notes, old_notes + sizeof(old_notes) - 1);
+        std::vector<unsigned char> new_notes_data(new_notes, new_notes + sizeof(new_notes) - 1);
+
+        std::vector<unsigned char> generated_data(100000);
+        for (size_t i = 0; i < generated_data.size(); i++)
+            generated_data[i] = static_cast<unsigned char>((i * 13 + 5) % 253);
+
+        MemoryDataSource readme_source(readme, sizeof(readme) - 1);
+        MemoryDataSource old_notes_source(old_notes, sizeof(old_notes) - 1);
+        MemoryDataSource new_notes_source(new_notes, sizeof(new_notes) - 1);
+        MemoryDataSource generated_source(&generated_data[0], generated_data.size());
+
+        // The original image.
+        std::vector<unsigned char> image;
+        {
+            FileComparator comparator(false);
+            FileSet file_set(comparator);
+            file_set.insert(new FileDescriptor(ckT("/docs"), ckT(""), FileDescriptor::FLAG_DIRECTORY));
+            file_set.insert(new FileDescriptor(ckT("/docs/readme.txt"), &readme_source));
+            file_set.insert(new FileDescriptor(ckT("/notes.txt"), &old_notes_source));
+            file_set.insert(new FileDescriptor(ckT("/generated.bin"), &generated_source));
+
+            TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, image), RESULT_OK);
+            destroy_file_set(file_set);
+        }
+
+        std::string image_file = temp_dir.file("image.iso");
+        TS_ASSERT(write_file(image_file, image));
+        ckcore::tstring image_path = ckcore::string::to_auto(image_file);
+
+        const FileSystem::Type types[] =
+        {
+            FileSystem::TYPE_ISO,
+            FileSystem::TYPE_ISO_UDF_JOLIET,
+            FileSystem::TYPE_UDF
+        };
+
+        for (size_t i = 0; i < sizeof(types) / sizeof(FileSystem::Type); i++)
+        {
+            DummyLogger dummy_logger;
+            IsoImageSource image_source(dummy_logger, image_path.c_str());
+
+            // Files already in the set replace those of the image.
+            FileComparator comparator(false);
+            FileSet file_set(comparator);
+            file_set.insert(new FileDescriptor(ckT("/notes.txt"), &new_notes_source));
+            TS_ASSERT(image_source.add_files(file_set));
+            TS_ASSERT_EQUALS(file_set.size(), size_t(4));
+
+            // The recorded time stamps are kept. The original image holds
+            // local time without a zone offset, hence the margin.
+            for (FileSet::const_iterator it = file_set.begin(); it != file_set.end(); it++)
+            {
+                if ((*it)->internal_path_ != ckT("/generated.bin"))
+                    continue;
+
+                FileStat stat;
+                TS_ASSERT((*it)->data_source_->stat(stat));
+                TS_ASSERT(stat.valid() && !stat.hidden());
+                TS_ASSERT(stat.modify_time_ > 1234567890 - 15 * 3600 &&
+                          stat.modify_time_ < 1234567890 + 15 * 3600);
+            }
+
+            std::vector<unsigned char> remastered;
+            TS_ASSERT_EQUALS(write_image(file_set, types[i], false, remastered), RESULT_OK);
+            destroy_file_set(file_set);
+
+            long pos = find_data(remastered, readme_data);
+            TS_ASSERT(pos > 0 && pos % 2048 == 0);
+            pos = find_data(remastered, generated_data);
+            TS_ASSERT(pos > 0 && pos % 2048 == 0);
+            pos = find_data(remastered, new_notes_data);
+            TS_ASSERT(pos > 0 && pos % 2048 == 0);
+            TS_ASSERT_EQUALS(find_data(remastered, old_notes_data), -1);
+        }
+
+        // The image can be mapped to a sub directory.
+        {
+            DummyLogger dummy_logger;
+            IsoImageSource image_source(dummy_logger, image_path.c_str());
+
+            FileComparator comparator(false);
+            FileSet file_set(comparator);
+            TS_ASSERT(image_source.add_files(file_set, ckT("/vendor")));
+
+            FileDescriptor key(ckT("/vendor/docs/readme.txt"), ckT(""));
+            TS_ASSERT(file_set.find(&key) != file_set.end());
+            destroy_file_set(file_set);
+        }
+
+        // Only ISO9660 names lose the separator of an empty extension.
+        const FileSystem::Type name_types[] = { FileSystem::TYPE_ISO, FileSystem::TYPE_ISO_JOLIET };
+        const ckcore::tchar *names[][2] =
+        {
+            { ckT("/LICENSE"), ckT("/VERSION") },
+            { ckT("/license"), ckT("/version.") }
+        };
+
+        for (size_t i = 0; i < sizeof(name_types) / sizeof(FileSystem::Type); i++)
+        {
+            std::vector<unsigned char> name_image;
+            {
+                FileSet file_set(false);
+                file_set.insert(new FileDescriptor(ckT("/license"), &readme_source));
+                file_set.insert(new FileDescriptor(ckT("/version."), &old_notes_source));
+                TS_ASSERT_EQUALS(write_image(file_set, name_types[i], false, name_image), RESULT_OK);
+                destroy_file_set(file_set);
+            }
+
+            std::string name_image_file = temp_dir.file(i == 0 ? "iso.iso" : "joliet.iso");
+            TS_ASSERT(write_file(name_image_file, name_image));
+
+            DummyLogger dummy_logger;
+            IsoImageSource image_source(dummy_logger, ckcore::string::to_auto(name_image_file).c_str());
+
+            FileSet file_set(false);
+            TS_ASSERT(image_source.add_files(file_set));
+            TS_ASSERT_EQUALS(file_set.size(), size_t(2));
+
+            std::vector<ckcore::tstring> paths;
+            for (FileSet::const_iterator it = file_set.begin(); it != file_set.end(); it++)
+                paths.push_back((*it)->internal_path_);
+            std::sort(paths.begin(), paths.end());
+
+            TS_ASSERT(paths.size() == 2 && paths[0] == names[i][0] && paths[1] == names[i][1]);
+            destroy_file_set(file_set);
+        }
+
+        // Files with data beyond the end of the image are rejected.
+        long generated_pos = find_data(image, generated_data);
+        TS_ASSERT(generated_pos > 0);
+
+        std::string truncated_file = temp_dir.file("truncated.iso");
+        TS_ASSERT(write_file(truncated_file, std::vector<unsigned char>(image.begin(),
+                                                                        image.begin() + generated_pos + 1000)));
+        {
+            DummyLogger dummy_logger;
+            IsoImageSource truncated_source(dummy_logger, ckcore::string::to_auto(truncated_file).c_str());
+
+            FileSet file_set(false);
+            TS_ASSERT(!truncated_source.add_files(file_set));
+            destroy_file_set(file_set);
+        }
+
+        // A corrupt extent location.
+        std::vector<unsigned char> corrupt_image = image;
+        size_t record_count = 0;
+        for (size_t pos = 0; pos + ISO_SECTOR_SIZE <= corrupt_image.size(); pos += ISO_SECTOR_SIZE)
+        {
+            // Directory extents start with the record of the directory itself.
+            if (pos < 17 * ISO_SECTOR_SIZE || corrupt_image[pos] != 34 ||
+                corrupt_image[pos + 32] != 1 || corrupt_image[pos + 33] != 0)
+            {
+                continue;
+            }
+
+            // Directory records of the generated file point at its data.
+            for (size_t j = pos; j + 34 <= pos + ISO_SECTOR_SIZE && corrupt_image[j] >= 34;
+                 j += corrupt_image[j])
+            {
+                ckcore::tuint32 extent_loc = util::read733(&corrupt_image[j + 2]);
+                if (static_cast<long>(extent_loc) * ISO_SECTOR_SIZE == generated_pos)
+                {
+                    util::write733(&corrupt_image[j + 2], 0x00ffffff);
+                    record_count++;
+                }
+            }
+        }
+        TS_ASSERT(record_count > 0);
+
+        std::string corrupt_file = temp_dir.file("corrupt.iso");
+        TS_ASSERT(write_file(corrupt_file, corrupt_image));
+        {
+            DummyLogger dummy_logger;
+            IsoImageSource corrupt_source(dummy_logger, ckcore::string::to_auto(corrupt_file).c_str());
+
+            FileSet file_set(false);
+            TS_ASSERT(!corrupt_source.add_files(file_set));
+            destroy_file_set(file_set);
+        }
+
+        DummyLogger dummy_logger;
+        IsoImageSource missing_source(dummy_logger, ckcore::string::to_auto(temp_dir.file("missing.iso")).c_str());
+        FileComparator comparator(false);
+        FileSet file_set(comparator);
+        TS_ASSERT(!missing_source.add_files(file_set));
+        TS_ASSERT(file_set.empty());
+#endif
+    }
+
+    void test_iso_tree()
+    {
+        tiso_dir_record_datetime rec_timestamp;
+        memset(&rec_timestamp, 0, sizeof(tiso_dir_record_datetime));
+
+        IsoTree tree;
+        ckcore::tuint32 root = tree.add_root(20, 2048, 1, DIRRECORD_FILEFLAG_DIRECTORY, 0, 0, rec_timestamp);
+        ckcore::tuint32 dir1 = tree.add_node(root, ckT("DIR1"), 21, 2048, 1, DIRRECORD_FILEFLAG_DIRECTORY, 0, 0, rec_timestamp);
+        ckcore::tuint32 dir2 = tree.add_node(root, ckT("DIR2"), 22, 2048, 1, DIRRECORD_FILEFLAG_DIRECTORY, 0, 0, rec_timestamp);
+        ckcore::tuint32 file1 = tree.add_node(dir1, ckT("VIDEO.IFO"), 30, 100, 1, 0, 0, 0, rec_timestamp);
+        ckcore::tuint32 file2 = tree.add_node(dir2, ckT("VIDEO.IFO"), 31, 200, 1, 0, 0, 0, rec_timestamp);
+        ckcore::tuint32 file3 = tree.add_node(dir2, ckT("VIDEO.BUP"), 32, 300, 1, 0, 0, 0, rec_timestamp);
+
+        TS_ASSERT_EQUALS(root, IsoTree::ROOT_INDEX);
+        TS_ASSERT_EQUALS(tree.size(), ckcore::tuint32(6));
+        TS_ASSERT(tree.is_dir(dir1) && !tree.is_dir(file1));
+
+        // Identical names are stored once.
+        TS_ASSERT_EQUALS(tree.node(file1).name_off_, tree.node(file2).name_off_);
+        TS_ASSERT_DIFFERS(tree.node(file2).name_off_, tree.node(file3).name_off_);
+        TS_ASSERT_EQUALS(ckcore::tstring(tree.name(file3)), ckcore::tstring(ckT("VIDEO.BUP")));
+
+        // Children are linked in the order they were added.
+        TS_ASSERT_EQUALS(tree.node(root).first_child_, dir1);
+        TS_ASSERT_EQUALS(tree.node(dir1).next_sibling_, dir2);
+        TS_ASSERT_EQUALS(tree.node(dir2).first_child_, file2);
+        TS_ASSERT_EQUALS(tree.node(file2).next_sibling_, file3);
+        TS_ASSERT_EQUALS(tree.node(file3).next_sibling_, IsoTree::INVALID_INDEX);
+
+        FileSet file_set(false);
+        std::vector<IsoImportData> import_data;
+        tree.make_file_set(file_set, import_data, ckT("/old"));
+
+        TS_ASSERT_EQUALS(import_data.size(), size_t(6));
+        TS_ASSERT_EQUALS(file_set.size(), size_t(5));
+
+        std::map<ckcore::tstring, FileDescriptor *> files;
+        for (FileSet::const_iterator it = file_set.begin(); it != file_set.end(); it++)
+            files[(*it)->internal_path_] = *it;
+
+        TS_ASSERT(files.count(ckT("/old/DIR1")) == 1 && files.count(ckT("/old/DIR2/VIDEO.BUP")) == 1);
+        TS_ASSERT(files[ckT("/old/DIR1")]->flags_ & FileDescriptor::FLAG_DIRECTORY);
+
+        FileDescriptor *file = files[ckT("/old/DIR2/VIDEO.BUP")];
+        TS_ASSERT(file->flags_ == FileDescriptor::FLAG_IMPORTED);
+        TS_ASSERT_EQUALS(file->data_ptr_, &import_data[file3]);
+        TS_ASSERT_EQUALS(import_data[file3].extent_loc_, ckcore::tuint32(32));
+        TS_ASSERT_EQUALS(import_data[file3].extent_len_, ckcore::tuint32(300));
+
+        destroy_file_set(file_set);
+
+        // Read the tree back from a written image.
+        const char data[] = "imported";
+        const char readme[] = "read me first";
+        MemoryDataSource data_source(data, sizeof(data) - 1);
+        MemoryDataSource readme_source(readme, sizeof(readme) - 1);
+
+        FileSet src_set(false);
+        src_set.insert(new FileDescriptor(ckT("/Long directory name"), ckT(""), FileDescriptor::FLAG_DIRECTORY));
+        src_set.insert(new FileDescriptor(ckT("/Long directory name/Some file.txt"), &data_source));
+        src_set.insert(new FileDescriptor(ckT("/readme.txt"), &readme_source));
+
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(src_set, FileSystem::TYPE_ISO_JOLIET, false, image), RESULT_OK);
+        destroy_file_set(src_set);
+
+        DummyLogger dummy_logger;
+        MemoryDataSource image_stream(&image[0], image.size());
+        TS_ASSERT(image_stream.open());
+
+        IsoReader reader(dummy_logger);
+        TS_ASSERT(reader.read(image_stream, 0));
+
+        const IsoTree &read_tree = reader.get_tree();
+        TS_ASSERT_EQUALS(read_tree.size(), ckcore::tuint32(4));
+
+        ckcore::tuint32 dir = read_tree.node(IsoTree::ROOT_INDEX).first_child_;
+        TS_ASSERT(read_tree.is_dir(dir));
+        TS_ASSERT_EQUALS(ckcore::tstring(read_tree.name(dir)), ckcore::tstring(ckT("Long directory name")));
+
+        ckcore::tuint32 child = read_tree.node(dir).first_child_;
+        TS_ASSERT_EQUALS(ckcore::tstring(read_tree.name(child)), ckcore::tstring(ckT("Some file.txt")));
+        TS_ASSERT_EQUALS(read_tree.node(child).extent_len_, ckcore::tuint32(sizeof(data) - 1));
+        TS_ASSERT_EQUALS(read_tree.node(child).extent_loc_ * ISO_SECTOR_SIZE,
+                         ckcore::tuint32(find_data(image, std::vector<unsigned char>(data, data + sizeof(data) - 1))));
+    }
+
+    void test_iso_verifier()
+    {
+        const char data[] = "verified";
+        MemoryDataSource data_source(data, sizeof(data) - 1);
+
+        FileSet file_set(false);
+        file_set.insert(new FileDescriptor(ckT("/Some directory"), ckT(""), FileDescriptor::FLAG_DIRECTORY));
+        file_set.insert(new FileDescriptor(ckT("/Some directory/Some file.txt"), &data_source));
+
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, image), RESULT_OK);
+        destroy_file_set(file_set);
+
+        TS_ASSERT(verify_image(image, 0));
+        TS_ASSERT(verify_image(image, 4));
+
+        // The primary descriptor is followed by the Joliet descriptor.
+        tiso_voldesc_suppl *voldesc_suppl =
+            reinterpret_cast<tiso_voldesc_suppl *>(&image[17 * ISO_SECTOR_SIZE]);
+        TS_ASSERT_EQUALS(voldesc_suppl->type, VOLDESCTYPE_SUPPL_VOL_DESC);
+        TS_ASSERT(iso_is_joliet(*voldesc_suppl));
+
+        // Without the UCS-2 escape sequence the descriptor is not Joliet and
+        // the reader must use the ISO9660 names.
+        std::vector<unsigned char> no_joliet = image;
+        voldesc_suppl = reinterpret_cast<tiso_voldesc_suppl *>(&no_joliet[17 * ISO_SECTOR_SIZE]);
+        voldesc_suppl->esc_sec[2] = 'A';
+        TS_ASSERT(!iso_is_joliet(*voldesc_suppl));
+        TS_ASSERT(!verify_image(no_joliet, 0));
+
+        DummyLogger dummy_logger;
+        MemoryDataSource no_joliet_stream(&no_joliet[0], no_joliet.size());
+        TS_ASSERT(no_joliet_stream.open());
+
+        IsoReader reader(dummy_logger);
+        TS_ASSERT(reader.read(no_joliet_stream, 0));
+        const IsoTree &tree = reader.get_tree();
+        TS_ASSERT_EQUALS(ckcore::tstring(tree.name(tree.node(IsoTree::ROOT_INDEX).first_child_)),
+                         ckcore::tstring(ckT("SOME_DIR")));
+
+        // The mandatory path tables must be recorded.
+        tiso_voldesc_primary *voldesc_primary =
+            reinterpret_cast<tiso_voldesc_primary *>(&image[16 * ISO_SECTOR_SIZE]);
+        std::vector<unsigned char> no_path_table = image;
+        memset(&no_path_table[16 * ISO_SECTOR_SIZE +
+                              (voldesc_primary->path_table_type_l - reinterpret_cast<unsigned char *>(voldesc_primary))],
+               0, sizeof(voldesc_primary->path_table_type_l));
+        TS_ASSERT(!verify_image(no_path_table, 0));
+        TS_ASSERT(!verify_image(no_path_table, 4));
+
+        no_path_table = image;
+        memset(&no_path_table[16 * ISO_SECTOR_SIZE +
+                              (voldesc_primary->path_table_type_m - reinterpret_cast<unsigned char *>(voldesc_primary))],
+               0, sizeof(voldesc_primary->path_table_type_m));
+        TS_ASSERT(!verify_image(no_path_table, 0));
+
+        // A forged path table size must be rejected before the table is
+        // read, also when the volume space size has been forged to match.
+        std::vector<unsigned char> large_path_table = image;
+        voldesc_primary = reinterpret_cast<tiso_voldesc_primary *>(&large_path_table[16 * ISO_SECTOR_SIZE]);
+        util::write733(voldesc_primary->path_table_size, 0xfffff000);
+        util::write733(voldesc_primary->vol_space_size, 0xffffffff);
+
+        for (ckcore::tuint32 thread_count = 0; thread_count <= 4; thread_count += 4)
+        {
+            ckcore::tstring message, reference;
+            try
+            {
+                MemoryDataSource in_stream(&large_path_table[0], large_path_table.size());
+                in_stream.open();
+
+                IsoVerifier verifier(dummy_logger);
+                SectorInStream sector_stream(in_stream);
+                MemorySectorReader sector_reader(large_path_table);
+                if (thread_count > 0)
+                    verifier.verify(sector_stream, sector_reader, thread_count);
+                else
+                    verifier.verify(sector_stream);
+            }
+            catch (const VerificationException &e)
+            {
+                message = ckcore::get_except_msg(e);
+                reference = e.reference();
+            }
+
+            TS_ASSERT(message.find(ckT("path table size")) != ckcore::tstring::npos);
+            TS_ASSERT(reference == ckT("ECMA 119: 9.4."));
+        }
+
+        // Joliet identifiers are checked by UCS-2 character, a character
+        // containing the byte of a reserved character is valid.
+        const unsigned char joliet_name[] = { 0, 'S', 0, 'o', 0, 'm', 0, 'e', 0, ' ', 0, 'f' };
+        long name_pos = find_data(image, std::vector<unsigned char>(joliet_name, joliet_name + sizeof(joliet_name)));
+        TS_ASSERT(name_pos > 0);
+
+        const unsigned char joliet_chars[][2] = { { 0x4e, '*' }, { '/', 0x00 }, { 0, '*' }, { 0, 0x01 } };
+        for (size_t i = 0; i < sizeof(joliet_chars) / sizeof(joliet_chars[0]); i++)
+        {
+            std::vector<unsigned char> joliet_image = image;
+            joliet_image[name_pos + 8] = joliet_chars[i][0];
+            joliet_image[name_pos + 9] = joliet_chars[i][1];
+
+            TS_ASSERT_EQUALS(verify_image(joliet_image, 0), i < 2);
+            TS_ASSERT_EQUALS(verify_image(joliet_image, 4), i < 2);
+        }
+    }
+
+    void test_iso_verifier_dir_size()
+    {
+        const char data[] = "directory size";
+        MemoryDataSource data_source(data, sizeof(data) - 1);
+
+        FileSet file_set(false);
+        file_set.insert(new FileDescriptor(ckT("/file.txt"), &data_source));
+
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO, false, image), RESULT_OK);
+        destroy_file_set(file_set);
+
+        // A '.' record claiming a directory of almost 4 GiB must be rejected
+        // before the directory is read, in both modes.
+        tiso_voldesc_primary *voldesc_primary =
+            reinterpret_cast<tiso_voldesc_primary *>(&image[16 * ISO_SECTOR_SIZE]);
+        ckcore::tuint32 root_loc = util::read733(voldesc_primary->root_dir_record.extent_loc);
+
+        tiso_dir_record *dot_record = reinterpret_cast<tiso_dir_record *>(&image[root_loc * ISO_SECTOR_SIZE]);
+        util::write733(dot_record->data_len, 0xfffff000);
+
+        TS_ASSERT(!verify_image(image, 0));
+        TS_ASSERT(!verify_image(image, 4));
+
+        // Also when the volume space size has been forged to match, the
+        // directory is then read one sector at a time until the image ends.
+        util::write733(voldesc_primary->vol_space_size, 0xffffffff);
+
+        TS_ASSERT(!verify_image(image, 0));
+        TS_ASSERT(!verify_image(image, 4));
+    }
+
+    /*
+     * The verifier reports to the log it was given and the verification
+     * running while writing does not report anything to the writer's log.
+     */
+    void test_verification_log()
+    {
+        FileSet file_set(false);
+        file_set.insert(new FileDescriptor(ckT("/dummy"), ckT(TEST_SRC_DIR)ckT("/data/dummy")));
+
+        class LogConfig : public ImageConfig
+        {
+        public:
+            CountingLogger logger_;
+            bool verify_;
+
+            LogConfig(bool verify) : verify_(verify) {}
+
+            ckcore::Log &get_log() { return logger_; }
+
+            void configure_writer(FileSystemWriter &writer)
+            {
+                writer.set_verify_output(verify_);
+            }
+        };
+
+        int lines[2] = { 0, 0 };
+        std::vector<unsigned char> images[2];
+        for (int i = 0; i < 2; i++)
+        {
+            LogConfig log_config(i == 1);
+            TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, images[i], &log_config),
+                             RESULT_OK);
+
+            lines[i] = log_config.logger_.lines_;
+        }
+
+        TS_ASSERT_EQUALS(lines[0], lines[1]);
+        TS_ASSERT(images[0] == images[1]);
+
+        MemoryDataSource in_stream(&images[0][0], images[0].size());
+        in_stream.open();
+
+        CountingLogger logger;
+        IsoVerifier verifier(logger);
+        SectorInStream sector_stream(in_stream);
+        TS_ASSERT_THROWS_NOTHING(verifier.verify(sector_stream));
+        TS_ASSERT_LESS_THAN(0, logger.lines_);
+
+        destroy_file_set(file_set);
+    }
+
+    /*
+     * The snapshot must match stat. Files that exist but can't be read fail
+     * when their data is copied, or up front if requested.
+     */
+    void test_file_stat()
+    {
+        const ckcore::tchar *file_path = ckT(TEST_SRC_DIR)ckT("/data/dummy");
+
+        for (int check_readable = 0; check_readable < 2; check_readable++)
+        {
+            FileStat stat;
+            TS_ASSERT(stat.read(file_path, check_readable == 1));
+            TS_ASSERT(stat.valid());
+            TS_ASSERT(!stat.hidden());
+            TS_ASSERT_EQUALS(stat.size_, 21);
+
+#ifndef _WINDOWS
+            struct ::stat st;
+            TS_ASSERT_EQUALS(::stat(file_path, &st), 0);
+            TS_ASSERT_EQUALS(stat.size_, static_cast<ckcore::tuint64>(st.st_size));
+            TS_ASSERT_EQUALS(stat.access_time_, st.st_atime);
+            TS_ASSERT_EQUALS(stat.modify_time_, st.st_mtime);
+            TS_ASSERT_EQUALS(stat.create_time_, st.st_ctime);
+            TS_ASSERT_EQUALS(stat.inode_, st.st_ino);
+#endif
+        }
+
+        FileStat dir_stat;
+        TS_ASSERT(dir_stat.read(ckT(TEST_SRC_DIR)ckT("/data")));
+        TS_ASSERT(dir_stat.valid());
+
+        FileStat missing_stat;
+        TS_ASSERT(!missing_stat.read(ckT(TEST_SRC_DIR)ckT("/data/missing")));
+        TS_ASSERT(!missing_stat.read(ckT(TEST_SRC_DIR)ckT("/data/missing"), true));
+        TS_ASSERT(!missing_stat.valid());
+
+#ifndef _WINDOWS
+        // A socket has meta data but can't be opened, this is reported when
+        // the data is copied.
+        char dir_path[] = "/tmp/ckfilesystem-XXXXXX";
+        TS_ASSERT(mkdtemp(dir_path) != NULL);
+
+        std::string sock_path = std::string(dir_path) + "/socket";
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, sock_path.c_str(), sizeof(addr.sun_path) - 1);
+
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        TS_ASSERT_DIFFERS(sock, -1);
+        TS_ASSERT_EQUALS(bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)), 0);
+
+        FileStat sock_stat;
+        TS_ASSERT(sock_stat.read(sock_path.c_str()));
+
+        FileSet file_set(false);
+        file_set.insert(new FileDescriptor(ckT("/socket"), sock_path.c_str()));
+
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO, false, image), RESULT_FAIL);
+        destroy_file_set(file_set);
+
+        close(sock);
+        unlink(sock_path.c_str());
+
+        // Files without read permission are only rejected on request. The
+        // superuser may read anything.
+        std::string locked_path = std::string(dir_path) + "/locked";
+        TS_ASSERT(write_file(locked_path, std::vector<unsigned char>(10, 'l')));
+        TS_ASSERT_EQUALS(chmod(locked_path.c_str(), 0), 0);
+
+        FileStat locked_stat;
+        TS_ASSERT(locked_stat.read(locked_path.c_str()));
+        TS_ASSERT_EQUALS(locked_stat.read(locked_path.c_str(), true), geteuid() == 0);
+
+        FileSet locked_set(false);
+        locked_set.insert(new FileDescriptor(ckT("/locked"), locked_path.c_str()));
+
+        class ReadableConfig : public ImageConfig
+        {
+        public:
+            void configure_writer(FileSystemWriter &writer)
+            {
+                writer.set_check_readable(true);
+            }
+        } readable_config;
+
+        std::vector<unsigned char> locked_image;
+        TS_ASSERT_EQUALS(write_image(locked_set, FileSystem::TYPE_ISO, false, locked_image, &readable_config),
+                         geteuid() == 0 ? RESULT_OK : RESULT_FAIL);
+        destroy_file_set(locked_set);
+
+        unlink(locked_path.c_str());
+        rmdir(dir_path);
+#endif
+    }
+
+    /*
+     * Identifiers are encoded once and the cached bytes must be what ends up
+     * on disc, also for names that are truncated or made unique.
+     */
+    void test_file_identifiers()
+    {
+        const ckcore::tchar *long_name =
+            ckT("A file name long enough to be truncated in every file system, also in UDF ")
+            ckT("where identifiers are limited to one hundred and twenty seven characters.txt");
+
+        const char data[] = "identifiers";
+        MemoryDataSource data_source(data, sizeof(data) - 1);
+
+        FileSet file_set(false);
+        file_set.insert(new FileDescriptor((ckcore::tstring(ckT("/")) + long_name).c_str(), &data_source));
+        for (int i = 0; i < 3; i++)
+        {
+            std::stringstream file_path;
+            file_path << "/Same beginning of a name that is too long for Joliet, number " << i;
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto(file_path.str()).c_str(), &data_source));
+        }
+
+        VerifyConfig verify_config;
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_UDF_JOLIET, false, image, &verify_config), RESULT_OK);
+        destroy_file_set(file_set);
+
+        TS_ASSERT(verify_image(image, 0));
+
+        // The UDF identifier is truncated to 127 characters and its size
+        // calculated from the encoded bytes.
+        Udf udf(false);
+        unsigned char file_ident[255];
+        unsigned char file_ident_len = udf.make_file_ident(file_ident, long_name);
+        TS_ASSERT_EQUALS(file_ident_len, 255);
+        TS_ASSERT_EQUALS(udf.calc_file_ident_size(long_name), udf.calc_file_ident_size(file_ident_len));
+        TS_ASSERT_EQUALS(udf.calc_file_ident_size(file_ident_len) % 4, ckcore::tuint32(0));
+        TS_ASSERT(find_data(image, std::vector<unsigned char>(file_ident, file_ident + file_ident_len)) != -1);
+
+        // The Joliet names must all be different.
+        DummyLogger dummy_logger;
+        MemoryDataSource image_stream(&image[0], image.size());
+        TS_ASSERT(image_stream.open());
+
+        IsoReader reader(dummy_logger);
+        TS_ASSERT(reader.read(image_stream, 0));
+
+        const IsoTree &tree = reader.get_tree();
+        TS_ASSERT_EQUALS(tree.size(), ckcore::tuint32(5));
+
+        std::set<ckcore::tstring> names;
+        for (ckcore::tuint32 i = tree.node(IsoTree::ROOT_INDEX).first_child_;
+             i != IsoTree::INVALID_INDEX; i = tree.node(i).next_sibling_)
+        {
+            names.insert(tree.name(i));
+        }
+
+        TS_ASSERT_EQUALS(names.size(), size_t(4));
+    }
+
+    /*
+     * File identifier descriptors are collected in the scratch arena and
+     * written in batches, a directory larger than the batch size must still
+     * be recorded as one unbroken sequence of valid descriptors.
+     */
+    void test_udf_scratch()
+    {
+        const char data[] = "scratch";
+        MemoryDataSource data_source(data, sizeof(data) - 1);
+
+        const long file_count = 1500;
+
+        FileSet file_set(false);
+        file_set.insert(new FileDescriptor(ckT("/dir"), ckT(""), FileDescriptor::FLAG_DIRECTORY));
+        for (long i = 0; i < file_count; i++)
+        {
+            std::stringstream file_path;
+            file_path << "/dir/A rather long file name to fill the identifier descriptors " << i << ".dat";
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto(file_path.str()).c_str(), &data_source));
+        }
+
+        VerifyConfig verify_config;
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_UDF, false, image, &verify_config), RESULT_OK);
+
+        // The descriptors of the directory exceed the batch size several times.
+        Udf udf(false);
+        TS_ASSERT_LESS_THAN(UDF_SCRATCH_FLUSH_SIZE * 2,
+                            udf.calc_file_ident_size(ckT("A rather long file name to fill the identifier descriptors 0.dat")) * file_count);
+
+        // Find the largest directory, it has a parent entry too.
+        long max_count = 0;
+        for (size_t offset = 0; offset < image.size(); offset += UDF_SECTOR_SIZE)
+        {
+            long count = count_file_idents(image, offset);
+            TS_ASSERT_DIFFERS(count, -1);
+            if (count > max_count)
+                max_count = count;
+        }
+
+        TS_ASSERT_EQUALS(max_count, file_count + 1);
+
+        destroy_file_set(file_set);
+    }
+
+    /*
+     * Files fitting in the rest of the file entry sector are embedded in
+     * pure UDF file systems only, larger files and other file systems keep
+     * the data in separate sectors.
+     */
+    void test_udf_embedded_data()
+    {
+        FileSet size_set(false);
+        FileSystem size_sys(FileSystem::TYPE_UDF, size_set);
+        size_sys.set_embed_udf_data(true);
+        const ckcore::tuint32 max_size = size_sys.get_max_embedded_file_size();
+        TS_ASSERT_EQUALS(max_size, ckcore::tuint32(UDF_SECTOR_SIZE - sizeof(tudf_file_entry)));
+
+        std::vector<unsigned char> tiny_data(10, 't');
+        std::vector<unsigned char> max_data(max_size, 'm');
+        std::vector<unsigned char> big_data(max_size + 1, 'b');
+        MemoryDataSource tiny_source(&tiny_data[0], tiny_data.size());
+        MemoryDataSource max_source(&max_data[0], max_data.size());
+        MemoryDataSource big_source(&big_data[0], big_data.size());
+
+        const FileSystem::Type types[] =
+        {
+            FileSystem::TYPE_UDF,
+            FileSystem::TYPE_ISO_UDF_JOLIET
+        };
+
+        for (size_t i = 0; i < sizeof(types) / sizeof(FileSystem::Type); i++)
+        {
+            std::vector<unsigned char> images[2];
+            for (int embed = 0; embed < 2; embed++)
+            {
+                FileSet file_set(false);
+                file_set.insert(new FileDescriptor(ckT("/dir"), ckT(""), FileDescriptor::FLAG_DIRECTORY));
+                file_set.insert(new FileDescriptor(ckT("/dir/tiny.txt"), &tiny_source));
+                file_set.insert(new FileDescriptor(ckT("/max.bin"), &max_source));
+                file_set.insert(new FileDescriptor(ckT("/big.bin"), &big_source));
+
+                TS_ASSERT_EQUALS(write_image(file_set, types[i], embed == 1, images[embed]), RESULT_OK);
+                destroy_file_set(file_set);
+            }
+
+            bool embed_files = types[i] == FileSystem::TYPE_UDF;
+            TS_ASSERT_EQUALS(is_embedded(images[1], tiny_data), embed_files);
+            TS_ASSERT_EQUALS(is_embedded(images[1], max_data), embed_files);
+            TS_ASSERT(!is_embedded(images[1], big_data));
+            TS_ASSERT_EQUALS(find_data(images[1], big_data) % UDF_SECTOR_SIZE, 0);
+
+            TS_ASSERT(!is_embedded(images[0], tiny_data));
+            TS_ASSERT(!is_embedded(images[0], max_data));
+
+            // Embedded files and directories need no sectors of their own.
+            TS_ASSERT_LESS_THAN(images[1].size(), images[0].size());
+        }
+    }
+
+    /*
+     * Large file extents start on the alignment boundary while small files
+     * are still packed tightly.
+     */
+    void test_data_alignment()
+    {
+        SectorManager sec_manager(0);
+        TS_ASSERT_EQUALS(sec_manager.get_data_alignment(), ckcore::tuint32(1));
+        TS_ASSERT_EQUALS(sec_manager.calc_data_align_len(5, 1 << 20), ckcore::tuint32(0));
+
+        sec_manager.set_data_alignment(32768, 10000);
+        TS_ASSERT_EQUALS(sec_manager.get_data_alignment(), ckcore::tuint32(16));
+        TS_ASSERT_EQUALS(sec_manager.calc_data_align_len(5, 10000), ckcore::tuint32(11));
+        TS_ASSERT_EQUALS(sec_manager.calc_data_align_len(5, 9999), ckcore::tuint32(0));
+        TS_ASSERT_EQUALS(sec_manager.calc_data_align_len(32, 10000), ckcore::tuint32(0));
+        TS_ASSERT_EQUALS(sec_manager.calc_data_align_len(33, 0), ckcore::tuint32(0));
+
+        // A boundary of one sector or less disables alignment.
+        sec_manager.set_data_alignment(1000, 0);
+        TS_ASSERT_EQUALS(sec_manager.get_data_alignment(), ckcore::tuint32(1));
+
+        std::vector<unsigned char> small_data1(100, '1');
+        std::vector<unsigned char> small_data2(100, '2');
+        std::vector<unsigned char> large_data(20000, 'L');
+        MemoryDataSource small_source1(&small_data1[0], small_data1.size());
+        MemoryDataSource small_source2(&small_data2[0], small_data2.size());
+        MemoryDataSource large_source(&large_data[0], large_data.size());
+
+        FileSet file_set(false);
+        file_set.insert(new FileDescriptor(ckT("/a.txt"), &small_source1));
+        file_set.insert(new FileDescriptor(ckT("/b.bin"), &large_source));
+        file_set.insert(new FileDescriptor(ckT("/c.txt"), &small_source2));
+
+        class AlignConfig : public ImageConfig
+        {
+        public:
+            void configure_writer(FileSystemWriter &writer)
+            {
+                writer.set_data_alignment(32768, 10000);
+            }
+        } align_config;
+
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_UDF_JOLIET, false, image, &align_config),
+                         RESULT_OK);
+        destroy_file_set(file_set);
+
+        TS_ASSERT(verify_image(image, 0));
+
+        long large_pos = find_data(image, large_data);
+        TS_ASSERT(large_pos > 0 && large_pos % 32768 == 0);
+
+        // The files are placed in order, only the large file is padded.
+        long small_pos1 = find_data(image, small_data1);
+        long small_pos2 = find_data(image, small_data2);
+        TS_ASSERT(small_pos1 > 0 && small_pos1 % ISO_SECTOR_SIZE == 0);
+        TS_ASSERT_EQUALS(large_pos, (small_pos1 + ISO_SECTOR_SIZE + 32767) / 32768 * 32768);
+        TS_ASSERT_EQUALS(small_pos2, large_pos + 10 * ISO_SECTOR_SIZE);
+    }
+
+    /*
+     * File data written by reference must produce the same image as when
+     * copied through the writer, whichever of cloning, copy_file_range or
+     * the buffered copy the output file system supports.
+     */
+    void test_clone_stream()
+    {
+#ifndef _WINDOWS
+        TempDir temp_dir;
+        TS_ASSERT(temp_dir.valid());
+
+        // Sizes covering unaligned heads and tails and several blocks.
+        const size_t sizes[] = { 1, 2048, 4096, 10000, 300000 };
+        const size_t size_count = sizeof(sizes) / sizeof(size_t);
+
+        FileSet file_set(false);
+        ckcore::tuint64 total_size = 0;
+        for (size_t i = 0; i < size_count; i++)
+        {
+            std::vector<unsigned char> data(sizes[i]);
+            for (size_t j = 0; j < data.size(); j++)
+                data[j] = static_cast<unsigned char>((i + j * 13) % 253);
+
+            std::stringstream file_name;
+            file_name << "file" << i << ".bin";
+            std::string file_path = temp_dir.file(file_name.str().c_str());
+            TS_ASSERT(write_file(file_path, data));
+
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto("/" + file_name.str()).c_str(),
+                                               ckcore::string::to_auto(file_path).c_str()));
+            total_size += sizes[i];
+        }
+
+        std::vector<unsigned char> reference;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_UDF_JOLIET, false, reference), RESULT_OK);
+
+        // Every file can be cloned when aligned to the block size, otherwise
+        // every other file starts unaligned.
+        const ckcore::tuint32 alignments[] = { 0, 4096 };
+        class AlignConfig : public CloneConfig
+        {
+        public:
+            ckcore::tuint32 alignment_;
+
+            AlignConfig(const std::string &image_path, ckcore::tuint32 alignment) :
+                CloneConfig(image_path), alignment_(alignment) {}
+
+            void configure_writer(FileSystemWriter &writer)
+            {
+                if (alignment_ > 0)
+                    writer.set_data_alignment(alignment_, 0);
+            }
+        };
+
+        for (size_t i = 0; i < sizeof(alignments) / sizeof(ckcore::tuint32); i++)
+        {
+            AlignConfig align_config(temp_dir.file(i == 0 ? "unaligned.iso" : "aligned.iso"), alignments[i]);
+
+            std::vector<unsigned char> image;
+            TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_UDF_JOLIET, false, image, &align_config),
+                             RESULT_OK);
+
+            TS_ASSERT_EQUALS(align_config.file_bytes_, total_size);
+            TS_ASSERT_EQUALS(image.size(), static_cast<size_t>(align_config.stream_size_));
+            if (alignments[i] == 0)
+                TS_ASSERT(image == reference);
+            else
+                TS_ASSERT(verify_image(image, 0));
+        }
+
+        destroy_file_set(file_set);
+
+        // A range of a file written at an unaligned position.
+        std::vector<unsigned char> data(20000);
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = static_cast<unsigned char>(i % 251);
+
+        std::string src_path = temp_dir.file("range.bin");
+        TS_ASSERT(write_file(src_path, data));
+
+        std::string dst_path = temp_dir.file("range.out");
+        CloneOutStream out_stream(ckcore::string::to_auto(dst_path).c_str());
+        TS_ASSERT(out_stream.open());
+        TS_ASSERT_EQUALS(out_stream.write(&data[0], 100), 100);
+        TS_ASSERT_THROWS_NOTHING(out_stream.write_file(ckcore::string::to_auto(src_path).c_str(), 5000, 12000));
+        TS_ASSERT_EQUALS(out_stream.get_pos(), ckcore::tuint64(12100));
+        TS_ASSERT_THROWS_ANYTHING(out_stream.write_file(ckcore::string::to_auto(src_path).c_str(), 19000, 2000));
+        TS_ASSERT(out_stream.close());
+
+        std::vector<unsigned char> expected(data.begin(), data.begin() + 100);
+        expected.insert(expected.end(), data.begin() + 5000, data.begin() + 17000);
+
+        std::vector<unsigned char> written = read_file(dst_path);
+        written.resize(expected.size() <= written.size() ? expected.size() : written.size());
+        TS_ASSERT(written == expected);
+#endif
+    }
+
+    /*
+     * Page cache hints must not change the image, and source data must
+     * have been evicted once it has been copied.
+     */
+    void test_cache_policy()
+    {
+#ifndef _WINDOWS
+        TempDir temp_dir;
+        TS_ASSERT(temp_dir.valid());
+
+        const size_t sizes[] = { 100, 70000, 5000, 300000 };
+        const size_t size_count = sizeof(sizes) / sizeof(size_t);
+
+        FileSet file_set(false);
+        std::vector<std::string> file_paths;
+        for (size_t i = 0; i < size_count; i++)
+        {
+            std::vector<unsigned char> data(sizes[i], static_cast<unsigned char>('a' + i));
+
+            std::stringstream file_name;
+            file_name << "file" << i << ".bin";
+            file_paths.push_back(temp_dir.file(file_name.str().c_str()));
+            TS_ASSERT(write_file(file_paths.back(), data));
+
+            // Dirty pages can't be evicted.
+            TS_ASSERT(drop_file_cache(file_paths.back()));
+
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto("/" + file_name.str()).c_str(),
+                                               ckcore::string::to_auto(file_paths.back()).c_str()));
+        }
+
+        std::vector<unsigned char> reference;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, reference), RESULT_OK);
+
+        // A window smaller than the files makes them being copied in pieces.
+        CachePolicy policy;
+        policy.read_ahead_ = 16384;
+        policy.window_size_ = 8192;
+        policy.drop_source_ = true;
+        policy.drop_output_ = true;
+
+        // Written to memory, then through a clone stream.
+        class PolicyConfig : public CloneConfig
+        {
+        public:
+            const CachePolicy &policy_;
+            bool clone_;
+
+            PolicyConfig(const std::string &image_path, const CachePolicy &policy, bool clone) :
+                CloneConfig(image_path), policy_(policy), clone_(clone) {}
+
+            void configure_writer(FileSystemWriter &writer)
+            {
+                writer.set_cache_policy(policy_);
+            }
+
+            int write(FileSystemWriter &writer, ckcore::Progress &progress,
+                      std::vector<unsigned char> &image)
+            {
+                if (clone_)
+                    return CloneConfig::write(writer, progress, image);
+
+                return ImageConfig::write(writer, progress, image);
+            }
+        };
+
+        for (int clone = 0; clone < 2; clone++)
+        {
+            PolicyConfig policy_config(temp_dir.file("image.iso"), policy, clone == 1);
+
+            std::vector<unsigned char> image;
+            TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, image, &policy_config),
+                             RESULT_OK);
+            TS_ASSERT(image == reference);
+
+            for (size_t i = 0; i < file_paths.size(); i++)
+                TS_ASSERT_EQUALS(count_cached_pages(file_paths[i], sizes[i]), 0);
+        }
+
+        destroy_file_set(file_set);
+#endif
+    }
+
+    /*
+     * Profiles mixing sort weights and access traces must place files with
+     * higher weights first, files traced more than once by their first
+     * access.
+     */
+    void test_data_placement()
+    {
+#ifndef _WINDOWS
+        TempDir temp_dir;
+        TS_ASSERT(temp_dir.valid());
+
+        const char profile[] =
+            "# Sort weights and an access trace.\n"
+            "/b.txt 10\n"
+            "/e.txt -1\n"
+            "\n"
+            "  /c.txt\r\n"
+            "/a.txt\n"
+            "/c.txt\n";
+
+        std::string profile_path = temp_dir.file("profile.txt");
+        TS_ASSERT(write_file(profile_path, std::vector<unsigned char>(profile, profile + sizeof(profile) - 1)));
+
+        DataPlacement placement;
+        TS_ASSERT(placement.load(ckcore::string::to_auto(profile_path).c_str()));
+        TS_ASSERT(!placement.load(ckT(TEST_SRC_DIR)ckT("/data/missing")));
+
+        TS_ASSERT_EQUALS(placement.get_weight(ckT("/b.txt"), ckT("")), 10);
+        TS_ASSERT_EQUALS(placement.get_weight(ckT("/e.txt"), ckT("")), -1);
+        TS_ASSERT_EQUALS(placement.get_weight(ckT("/c.txt"), ckT("")), 3);
+        TS_ASSERT_EQUALS(placement.get_weight(ckT("/a.txt"), ckT("")), 2);
+        TS_ASSERT_EQUALS(placement.get_weight(ckT("/d.txt"), ckT("/src/d.txt")), 0);
+
+        // Source paths match too.
+        placement.set_weight(ckT("/src/d.txt"), 5);
+        TS_ASSERT_EQUALS(placement.get_weight(ckT("/d.txt"), ckT("/src/d.txt")), 5);
+        placement.set_weight(ckT("/src/d.txt"), 0);
+
+        const char *names[] = { "a", "b", "c", "d", "e" };
+        const size_t name_count = sizeof(names) / sizeof(const char *);
+
+        std::vector<std::vector<unsigned char> > data(name_count);
+        std::vector<MemoryDataSource *> sources;
+
+        FileSet file_set(false);
+        for (size_t i = 0; i < name_count; i++)
+        {
+            data[i].assign(3000, static_cast<unsigned char>(names[i][0]));
+            sources.push_back(new MemoryDataSource(&data[i][0], data[i].size()));
+
+            std::string file_path = std::string("/") + names[i] + ".txt";
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto(file_path).c_str(), sources.back()));
+        }
+
+        class PlacementConfig : public ImageConfig
+        {
+        public:
+            const DataPlacement &placement_;
+
+            PlacementConfig(const DataPlacement &placement) : placement_(placement) {}
+
+            void configure_writer(FileSystemWriter &writer)
+            {
+                writer.set_data_placement(placement_);
+            }
+        } placement_config(placement);
+
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, image, &placement_config),
+                         RESULT_OK);
+        TS_ASSERT(verify_image(image, 0));
+
+        // Expected order: b (10), c (3), a (2), d (0), e (-1).
+        long pos_a = find_data(image, data[0]);
+        long pos_b = find_data(image, data[1]);
+        long pos_c = find_data(image, data[2]);
+        long pos_d = find_data(image, data[3]);
+        long pos_e = find_data(image, data[4]);
+
+        TS_ASSERT(pos_b > 0);
+        TS_ASSERT_LESS_THAN(pos_b, pos_c);
+        TS_ASSERT_LESS_THAN(pos_c, pos_a);
+        TS_ASSERT_LESS_THAN(pos_a, pos_d);
+        TS_ASSERT_LESS_THAN(pos_d, pos_e);
+
+        destroy_file_set(file_set);
+        for (size_t i = 0; i < sources.size(); i++)
+            delete sources[i];
+#endif
+    }
+
+    /*
+     * A virtual image must read back exactly like the written image, and
+     * building it must leave the verification setting of the writer as it
+     * was.
+     */
+    void test_virtual_image()
+    {
+#ifndef _WINDOWS
+        TempDir temp_dir;
+        TS_ASSERT(temp_dir.valid());
+
+        const size_t sizes[] = { 0, 1, 2048, 10000, 100000 };
+        const size_t size_count = sizeof(sizes) / sizeof(size_t);
+
+        const char manifest[] = "virtual";
+        MemoryDataSource memory_source(manifest, sizeof(manifest) - 1);
+
+        FileSet file_set(false);
+        file_set.insert(new FileDescriptor(ckT("/manifest.txt"), &memory_source));
+
+        std::string last_path;
+        for (size_t i = 0; i < size_count; i++)
+        {
+            std::vector<unsigned char> data(sizes[i]);
+            for (size_t j = 0; j < data.size(); j++)
+                data[j] = static_cast<unsigned char>((i * 31 + j) % 241);
+
+            std::stringstream file_name;
+            file_name << "file" << i << ".bin";
+            last_path = temp_dir.file(file_name.str().c_str());
+            TS_ASSERT(write_file(last_path, data));
+
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto("/" + file_name.str()).c_str(),
+                                               ckcore::string::to_auto(last_path).c_str()));
+        }
+
+        std::vector<unsigned char> reference;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_UDF_JOLIET, false, reference), RESULT_OK);
+
+        // Builds the virtual image instead of writing one.
+        class VirtualConfig : public ImageConfig
+        {
+        public:
+            VirtualImage &image_;
+            bool verify_output_;
+
+            VirtualConfig(VirtualImage &image) : image_(image), verify_output_(false) {}
+
+            void configure_writer(FileSystemWriter &writer)
+            {
+                writer.set_verify_output(true);
+            }
+
+            int write(FileSystemWriter &writer, ckcore::Progress &progress,
+                      std::vector<unsigned char> &image)
+            {
+                return image_.build(writer, progress);
+            }
+
+            void written(FileSystemWriter &writer)
+            {
+                verify_output_ = writer.get_verify_output();
+            }
+        };
+
+        VirtualImage image;
+        VirtualConfig virtual_config(image);
+
+        std::vector<unsigned char> unused;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_UDF_JOLIET, false, unused, &virtual_config),
+                         RESULT_OK);
+        TS_ASSERT(virtual_config.verify_output_);
+        TS_ASSERT_EQUALS(image.size(), ckcore::tuint64(reference.size()));
+
+        // Read in pieces that don't line up with sectors or files.
+        std::vector<unsigned char> data(static_cast<size_t>(image.size()));
+        ckcore::tuint64 pos = 0;
+        while (pos < image.size())
+        {
+            ckcore::tuint32 read = image.read(pos, &data[static_cast<size_t>(pos)], 4097);
+            TS_ASSERT(read > 0);
+            if (read == 0)
+                break;
+
+            pos += read;
+        }
+
+        TS_ASSERT(data == reference);
+
+        unsigned char buffer[16];
+        TS_ASSERT_EQUALS(image.read(image.size(), buffer, sizeof(buffer)), ckcore::tuint32(0));
+        TS_ASSERT_EQUALS(image.read(image.size() - 4, buffer, sizeof(buffer)), ckcore::tuint32(4));
+
+        // Missing source files are detected when reading.
+        unlink(last_path.c_str());
+        TS_ASSERT_THROWS_ANYTHING(image.read(0, &data[0], static_cast<ckcore::tuint32>(data.size())));
+
+        // A failed build clears the image and restores the setting too.
+        FileSet bad_set(false);
+        bad_set.insert(new FileDescriptor(ckT("/missing.bin"), ckT(TEST_SRC_DIR)ckT("/data/missing")));
+
+        VirtualConfig bad_config(image);
+        TS_ASSERT_EQUALS(write_image(bad_set, FileSystem::TYPE_ISO, false, unused, &bad_config), RESULT_FAIL);
+        TS_ASSERT(bad_config.verify_output_);
+        TS_ASSERT_EQUALS(image.size(), ckcore::tuint64(0));
+
+        destroy_file_set(bad_set);
+        destroy_file_set(file_set);
+#endif
+    }
+
+    /*
+     * Unchanged files keep their extents and are copied from the previous
+     * image, opened once for all of them. Layout maps keep long paths and a
+     * layout that can't be padded makes all files placed again.
+     */
+    void test_incremental_build()
+    {
+#ifndef _WINDOWS
+        TempDir temp_dir;
+        TS_ASSERT(temp_dir.valid());
+
+        // Layout maps must not truncate paths.
+        ckcore::tstring long_path = ckT("/");
+        for (int i = 0; i < 300; i++)
+            long_path += ckT("long/");
+        long_path += ckT("file.txt");
+
+        LayoutMap long_map;
+        long_map.set_sec_offset(16);
+        long_map.add(long_path, 1234, 5678, 1234567890);
+        long_map.add(ckT("/short path.txt"), 20, 1, -1);
+
+        std::string long_map_path = temp_dir.file("long.map");
+        TS_ASSERT(long_map.save(ckcore::string::to_auto(long_map_path).c_str()));
+
+        LayoutMap loaded_map;
+        TS_ASSERT(loaded_map.load(ckcore::string::to_auto(long_map_path).c_str()));
+        TS_ASSERT_EQUALS(loaded_map.size(), size_t(2));
+        TS_ASSERT_EQUALS(loaded_map.get_sec_offset(), ckcore::tuint32(16));
+
+        const LayoutMap::Entry *entry = loaded_map.find(long_path);
+        TS_ASSERT(entry != NULL);
+        if (entry != NULL)
+        {
+            TS_ASSERT_EQUALS(entry->sector_, ckcore::tuint64(1234));
+            TS_ASSERT_EQUALS(entry->size_, ckcore::tuint64(5678));
+            TS_ASSERT_EQUALS(entry->modify_time_, 1234567890);
+        }
+
+        entry = loaded_map.find(ckT("/short path.txt"));
+        TS_ASSERT(entry != NULL && entry->modify_time_ == -1);
+
+        // The first image.
+        const char *names[] = { "a", "b", "c", "d" };
+        const size_t sizes[] = { 10000, 5000, 3000, 100 };
+        const size_t name_count = sizeof(names) / sizeof(const char *);
+
+        std::vector<std::vector<unsigned char> > data(name_count);
+        std::vector<std::string> file_paths;
+        for (size_t i = 0; i < name_count; i++)
+        {
+            data[i].assign(sizes[i], static_cast<unsigned char>(names[i][0]));
+            file_paths.push_back(temp_dir.file((std::string(names[i]) + ".bin").c_str()));
+            if (i < 3)
+                TS_ASSERT(write_file(file_paths[i], data[i]));
+        }
+
+        FileSet file_set(false);
+        for (size_t i = 0; i < 3; i++)
+        {
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto(std::string("/") + names[i] + ".bin").c_str(),
+                                               ckcore::string::to_auto(file_paths[i]).c_str()));
+        }
+
+        // Writes on top of a previous image if any, keeping the layout map
+        // and the statistics.
+        class IncrementConfig : public ImageConfig
+        {
+        public:
+            std::string prev_path_;
+            LayoutMap prev_layout_;
+            CachePolicy policy_;
+            LayoutMap layout_;
+            int layout_result_;
+            ckcore::tuint64 open_count_;
+
+            IncrementConfig() : layout_result_(RESULT_FAIL), open_count_(0) {}
+
+            IncrementConfig(const std::string &prev_path, const LayoutMap &prev_layout) :
+                prev_path_(prev_path), prev_layout_(prev_layout), layout_result_(RESULT_FAIL), open_count_(0) {}
+
+            void configure_writer(FileSystemWriter &writer)
+            {
+                if (!prev_path_.empty())
+                    writer.set_previous_image(ckcore::string::to_auto(prev_path_).c_str(), prev_layout_);
+
+                writer.set_cache_policy(policy_);
+            }
+
+            void written(FileSystemWriter &writer)
+            {
+                layout_result_ = writer.layout_map(layout_);
+                open_count_ = writer.get_stats().open_count_;
+            }
+        };
+
+        IncrementConfig first_config;
+        std::vector<unsigned char> prev_image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, prev_image, &first_config),
+                         RESULT_OK);
+
+        const LayoutMap &prev_layout = first_config.layout_;
+        TS_ASSERT_EQUALS(first_config.layout_result_, RESULT_OK);
+        TS_ASSERT_EQUALS(prev_layout.size(), size_t(3));
+
+        std::string prev_path = temp_dir.file("prev.iso");
+        TS_ASSERT(write_file(prev_path, prev_image));
+
+        // Modify one file and add another.
+        data[1].assign(9000, 'B');
+        TS_ASSERT(write_file(file_paths[1], data[1]));
+        TS_ASSERT(write_file(file_paths[3], data[3]));
+        file_set.insert(new FileDescriptor(ckT("/d.bin"), ckcore::string::to_auto(file_paths[3]).c_str()));
+
+        // Read-ahead must skip the unchanged files, their data is copied
+        // from the previous image.
+        TS_ASSERT(drop_file_cache(file_paths[0]));
+        TS_ASSERT(drop_file_cache(file_paths[2]));
+
+        IncrementConfig next_config(prev_path, prev_layout);
+        next_config.policy_.read_ahead_ = 1 << 20;
+
+        std::vector<unsigned char> next_image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, next_image, &next_config),
+                         RESULT_OK);
+        TS_ASSERT(verify_image(next_image, 0));
+        TS_ASSERT_EQUALS(count_cached_pages(file_paths[0], sizes[0]), 0);
+        TS_ASSERT_EQUALS(count_cached_pages(file_paths[2], sizes[2]), 0);
+
+        // The previous image and the two changed files are opened.
+        TS_ASSERT_EQUALS(next_config.open_count_, ckcore::tuint64(3));
+
+        for (size_t i = 0; i < name_count; i++)
+            TS_ASSERT(find_data(next_image, data[i]) > 0);
+
+        TS_ASSERT_EQUALS(find_data(next_image, data[0]), find_data(prev_image, data[0]));
+        TS_ASSERT_EQUALS(find_data(next_image, data[2]), find_data(prev_image, data[2]));
+
+        // A previous image smaller than its layout map fails the write.
+        std::string short_path = temp_dir.file("short.iso");
+        TS_ASSERT(write_file(short_path, std::vector<unsigned char>(prev_image.begin(),
+                                                                    prev_image.end() - ISO_SECTOR_SIZE)));
+
+        IncrementConfig short_config(short_path, prev_layout);
+        std::vector<unsigned char> short_image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, short_image, &short_config),
+                         RESULT_FAIL);
+
+        // Free space too large to pad, all files are placed like in a new
+        // image.
+        std::vector<unsigned char> reference;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, reference), RESULT_OK);
+
+        FileStat stat;
+        TS_ASSERT(stat.read(file_paths[0].c_str()));
+
+        LayoutMap far_layout;
+        far_layout.add(ckT("/a.bin"), ckcore::tuint64(0x180000000ULL), sizes[0], stat.modify_time_);
+
+        IncrementConfig far_config(prev_path, far_layout);
+        std::vector<unsigned char> far_image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, far_image, &far_config),
+                         RESULT_OK);
+        TS_ASSERT_EQUALS(far_image.size(), reference.size());
+        TS_ASSERT_EQUALS(find_data(far_image, data[0]), find_data(reference, data[0]));
+
+        destroy_file_set(file_set);
+#endif
+    }
+
+    void test_write_stats()
+    {
+#ifndef _WINDOWS
+        // Only time of tasks run on other threads is reported by the group.
+        ThreadPool pool(2);
+        SpinTask spin_tasks[4];
+        {
+            TaskGroup group(pool);
+            for (size_t i = 0; i < 4; i++)
+                group.submit(&spin_tasks[i]);
+            group.wait();
+            TS_ASSERT(group.get_cpu_time() > 0);
+        }
+
+        ThreadPool inline_pool(0);
+        {
+            TaskGroup group(inline_pool);
+            for (size_t i = 0; i < 4; i++)
+                group.submit(&spin_tasks[i]);
+            group.wait();
+            TS_ASSERT_EQUALS(group.get_cpu_time(), ckcore::tuint64(0));
+        }
+
+        TempDir temp_dir;
+        TS_ASSERT(temp_dir.valid());
+
+        // Count the stat calls needed for the snapshots of the source files.
+        ckcore::tuint64 stat_count = 0;
+        FileStat file_stat;
+
+        FileSet file_set(false);
+        std::string dir_path = temp_dir.file("dir");
+        TS_ASSERT(mkdir(dir_path.c_str(), 0700) == 0);
+        TS_ASSERT(file_stat.read(ckcore::string::to_auto(dir_path).c_str(), false, &stat_count));
+        file_set.insert(new FileDescriptor(ckT("/dir"), ckcore::string::to_auto(dir_path).c_str(),
+                                           FileDescriptor::FLAG_DIRECTORY));
+
+        const size_t file_count = 600;
+        std::vector<unsigned char> data(3000, 'x');
+        for (size_t i = 0; i < file_count; i++)
+        {
+            std::stringstream name;
+            name << "dir/" << i << ".bin";
+
+            std::string file_path = temp_dir.file(name.str().c_str());
+            TS_ASSERT(write_file(file_path, data));
+            TS_ASSERT(file_stat.read(ckcore::string::to_auto(file_path).c_str(), false, &stat_count));
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto("/" + name.str()).c_str(),
+                                               ckcore::string::to_auto(file_path).c_str()));
+        }
+
+        // Generated data has no meta data to read.
+        const char generated[] = "generated";
+        MemoryDataSource memory_source(generated, sizeof(generated) - 1);
+        file_set.insert(new FileDescriptor(ckT("/generated.txt"), &memory_source));
+
+        class StatsConfig : public ImageConfig
+        {
+        public:
+            WriteStats stats_;
+
+            void configure_writer(FileSystemWriter &writer)
+            {
+                writer.set_stat_thread_count(4);
+                writer.set_verify_output(true);
+            }
+
+            void written(FileSystemWriter &writer)
+            {
+                stats_ = writer.get_stats();
+            }
+        } stats_config;
+
+        std::vector<unsigned char> image;
+        ckcore::tuint64 wall_start = WriteStats::get_wall_time();
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_UDF, false, image, &stats_config), RESULT_OK);
+        ckcore::tuint64 wall_time = WriteStats::get_wall_time() - wall_start;
+
+        // The generated file is counted but not stat'ed.
+        const WriteStats &stats = stats_config.stats_;
+        TS_ASSERT_EQUALS(stats.file_count_, ckcore::tuint32(file_count + 1));
+        TS_ASSERT_EQUALS(stats.dir_count_, ckcore::tuint32(1));
+        TS_ASSERT(stat_count >= file_count + 1);
+        TS_ASSERT_EQUALS(stats.stat_count_, stat_count);
+
+        // The writer, four snapshot threads and the verification thread.
+        WriteStats::PhaseStats total = stats.get_total();
+        TS_ASSERT(total.cpu_time_ > 0);
+        TS_ASSERT(total.cpu_time_ <= wall_time * 6);
+        TS_ASSERT(stats.get_phase(WriteStats::PHASE_TREE).cpu_time_ > 0);
+#endif
+    }
+
+    void test_source_latency()
+    {
+        // Values are kept with a relative error below 1/16.
+        LatencyHistogram histogram;
+        TS_ASSERT_EQUALS(histogram.get_percentile(50), ckcore::tuint64(0));
+        for (ckcore::tuint64 i = 1; i <= 1000; i++)
+            histogram.record(i);
+
+        TS_ASSERT_EQUALS(histogram.get_count(), ckcore::tuint64(1000));
+        TS_ASSERT_EQUALS(histogram.get_min(), ckcore::tuint64(1));
+        TS_ASSERT_EQUALS(histogram.get_max(), ckcore::tuint64(1000));
+        TS_ASSERT_EQUALS(histogram.get_mean(), ckcore::tuint64(500));
+        TS_ASSERT(histogram.get_percentile(50) >= 500 && histogram.get_percentile(50) <= 500 + 500 / 16);
+        TS_ASSERT(histogram.get_percentile(99) >= 990 && histogram.get_percentile(99) <= 1000);
+        TS_ASSERT_EQUALS(histogram.get_percentile(100), ckcore::tuint64(1000));
+
+        histogram.record(ckcore::tuint64(1) << 40);
+        TS_ASSERT_EQUALS(histogram.get_percentile(100), ckcore::tuint64(1) << 40);
+
+        histogram.clear();
+        TS_ASSERT_EQUALS(histogram.get_count(), ckcore::tuint64(0));
+        TS_ASSERT_EQUALS(histogram.get_max(), ckcore::tuint64(0));
+
+        // The slowest files are kept in order of their total time.
+        WriteStats stats;
+        stats.set_slow_file_count(2);
+        stats.record_file(ckT("a"), 1024, 10, 20);
+        stats.record_file(ckT("b"), 1024, 5, 5);
+        stats.record_file(ckT("c"), 0, 15, 0);
+        TS_ASSERT_EQUALS(stats.open_latency_.get_count(), ckcore::tuint64(3));
+        TS_ASSERT_EQUALS(stats.read_rate_.get_count(), ckcore::tuint64(2));
+        TS_ASSERT_EQUALS(stats.slow_files_.size(), size_t(2));
+        TS_ASSERT(stats.slow_files_[0].file_path_ == ckT("a"));
+        TS_ASSERT(stats.slow_files_[1].file_path_ == ckT("c"));
+
+        stats.set_slow_file_count(1);
+        TS_ASSERT_EQUALS(stats.slow_files_.size(), size_t(1));
+        TS_ASSERT(stats.slow_files_[0].file_path_ == ckT("a"));
+
+#ifndef _WINDOWS
+        // Every source file is timed when written.
+        TempDir temp_dir;
+        TS_ASSERT(temp_dir.valid());
+
+        const size_t sizes[] = { 100, 5000, 70000, 200000, 1000 };
+        const size_t size_count = sizeof(sizes) / sizeof(size_t);
+
+        FileSet file_set(false);
+        std::map<ckcore::tstring, size_t> file_sizes;
+        for (size_t i = 0; i < size_count; i++)
+        {
+            std::stringstream file_name;
+            file_name << "file" << i << ".bin";
+            std::string file_path = temp_dir.file(file_name.str().c_str());
+            TS_ASSERT(write_file(file_path, std::vector<unsigned char>(sizes[i], 'x')));
+
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto("/" + file_name.str()).c_str(),
+                                               ckcore::string::to_auto(file_path).c_str()));
+            file_sizes[ckcore::string::to_auto(file_path)] = sizes[i];
+        }
+
+        // A source stalling in its read calls, like a degraded network mount.
+        CallbackDataSource stalled_source(3000, [](ckcore::tuint64, void *buffer, ckcore::tuint32 count) -> ckcore::tint64
+        {
+            usleep(20000);
+            memset(buffer, 's', count);
+            return count;
+        });
+        file_set.insert(new FileDescriptor(ckT("/stalled.bin"), &stalled_source));
+        file_sizes[ckT("/stalled.bin")] = 3000;
+
+        class LatencyConfig : public ImageConfig
+        {
+        public:
+            WriteStats stats_;
+
+            void configure_writer(FileSystemWriter &writer)
+            {
+                writer.set_slow_file_count(3);
+            }
+
+            void written(FileSystemWriter &writer)
+            {
+                stats_ = writer.get_stats();
+            }
+        } latency_config;
+
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_JOLIET, false, image, &latency_config), RESULT_OK);
+
+        const WriteStats &writer_stats = latency_config.stats_;
+        TS_ASSERT_EQUALS(writer_stats.open_latency_.get_count(), ckcore::tuint64(size_count + 1));
+        TS_ASSERT_EQUALS(writer_stats.read_latency_.get_count(), writer_stats.read_count_);
+        TS_ASSERT(writer_stats.read_count_ >= size_count + 1);
+        TS_ASSERT(writer_stats.read_latency_.get_max() >= 20000);
+        TS_ASSERT_EQUALS(writer_stats.slow_files_.size(), size_t(3));
+        TS_ASSERT(writer_stats.slow_files_[0].file_path_ == ckT("/stalled.bin"));
+        TS_ASSERT(writer_stats.slow_files_[0].read_time_ >= 20000);
+
+        for (size_t i = 0; i < writer_stats.slow_files_.size(); i++)
+        {
+            const WriteStats::FileTiming &timing = writer_stats.slow_files_[i];
+            TS_ASSERT(file_sizes.count(timing.file_path_) == 1);
+            TS_ASSERT_EQUALS(timing.file_size_, ckcore::tuint64(file_sizes[timing.file_path_]));
+            if (i > 0)
+                TS_ASSERT(writer_stats.slow_files_[i - 1].get_total_time() >= timing.get_total_time());
+        }
+#endif
+    }
+
+    void test_trace_log()
+    {
+#ifndef _WINDOWS
+        TempDir temp_dir;
+        TS_ASSERT(temp_dir.valid());
+
+        // The trace log is usable whether or not the library records events.
+        TraceLog trace_log;
+        TraceLog::set_active(&trace_log);
+        TraceLog::span("test", "span", 100, 250, ckT("a \"quoted\" file"));
+        TraceLog::counter("test", "counter", -5);
+
+        const char *names[] = { "a", "b" };
+        FileSet file_set(false);
+        for (size_t i = 0; i < 2; i++)
+        {
+            std::string file_path = temp_dir.file(names[i]);
+            TS_ASSERT(write_file(file_path, std::vector<unsigned char>(5000, names[i][0])));
+            file_set.insert(new FileDescriptor(ckcore::string::to_auto(std::string("/") + names[i]).c_str(),
+                                               ckcore::string::to_auto(file_path).c_str()));
+        }
+
+        std::vector<unsigned char> image;
+        TS_ASSERT_EQUALS(write_image(file_set, FileSystem::TYPE_ISO_UDF, false, image), RESULT_OK);
+        TraceLog::set_active(NULL);
+        TraceLog::counter("test", "inactive", 1);
+
+        std::string trace_path = temp_dir.file("trace.json");
+        TS_ASSERT(trace_log.save(ckcore::string::to_auto(trace_path).c_str()));
+
+        std::vector<unsigned char> json_data = read_file(trace_path);
+        std::string json(json_data.begin(), json_data.end());
+        TS_ASSERT_EQUALS(json.find("{\"traceEvents\":["), size_t(0));
+        TS_ASSERT(json.find("{\"name\":\"span\",\"cat\":\"test\",\"ph\":\"X\"") != std::string::npos);
+        TS_ASSERT(json.find("\"ts\":100,\"dur\":150,\"args\":{\"file\":\"a \\\"quoted\\\" file\"}") != std::string::npos);
+        TS_ASSERT(json.find("\"args\":{\"value\":-5}") != std::string::npos);
+        TS_ASSERT(json.find("inactive") == std::string::npos);
+
+        // The library's own events depend on how it was built.
+        TS_ASSERT_EQUALS(json.find("\"stat_nodes\"") != std::string::npos, TraceLog::enabled());
+
+        trace_log.clear();
+        TS_ASSERT(trace_log.save(ckcore::string::to_auto(trace_path).c_str()));
+        json_data = read_file(trace_path);
+        TS_ASSERT(std::string(json_data.begin(), json_data.end()).find("\"name\"") == std::string::npos);
+#endif
+    }
+
+    void test_task_group_exceptions()
+    {
+        const ckcore::tuint32 thread_counts[] = { 0, 3 };
+        for (size_t i = 0; i < sizeof(thread_counts) / sizeof(ckcore::tuint32); i++)
+        {
+            ThreadPool pool(thread_counts[i]);
+            TaskGroup group(pool, 1);
+
+            // The first exception is rethrown after all tasks have run.
+            Mutex mutex;
+            int run_count = 0;
+            std::vector<ThrowingTask> tasks;
+            tasks.push_back(ThrowingTask(-1, mutex, run_count));
+            tasks.push_back(ThrowingTask(0, mutex, run_count));
+            tasks.push_back(ThrowingTask(1, mutex, run_count));
+            tasks.push_back(ThrowingTask(-1, mutex, run_count));
+            for (size_t j = 0; j < tasks.size(); j++)
+                group.submit(&tasks[j]);
+
+            std::string message;
+            try
+            {
+                group.wait();
+            }
+            catch (const std::runtime_error &e)
+            {
+                message = e.what();
+            }
+            TS_ASSERT_EQUALS(message, std::string("first"));
+            TS_ASSERT_EQUALS(run_count, 4);
+
+            // The error is cleared once rethrown.
+            run_count = 0;
+            group.submit(&tasks[0]);
+            TS_ASSERT_THROWS_NOTHING(group.wait());
+            TS_ASSERT_EQUALS(run_count, 1);
+
+            ThrowingRange range;
+            TS_ASSERT_THROWS(group.parallel_for(0, 100, 10, range), std::out_of_range);
+
+            // Pending errors are discarded by the destructor.
+            {
+                TaskGroup pending_group(pool);
+                pending_group.submit(&tasks[1]);
+            }
+        }
+    }
 };
@@ -18,6 +18,9 @@
 
 #include <cxxtest/TestSuite.h>
 #include <string.h>
+#include <string>
+#include <vector>
+#include "ckfilesystem/charclass.hh"
 #include "ckfilesystem/iso.hh"
 
 using namespace ckfilesystem;
@@ -118,4 +121,105 @@ public:
             TS_ASSERT_EQUALS(buffer[0], static_cast<unsigned char>(expected_l2[i]));
         }
     }
+
+    void test_memcpy_long()
+    {
+        // Long enough to be processed in vector sized blocks, and with a
+        // remainder processed one character at a time.
+        char src[256 + 13];
+        for (size_t i = 0; i < sizeof(src); i++)
+            src[i] = static_cast<char>(i);
+
+        unsigned char dst[sizeof(src)];
+        iso_memcpy_a(dst, src, sizeof(src), CHARSET_ISO);
+        for (size_t i = 0; i < sizeof(src); i++)
+            TS_ASSERT_EQUALS(dst[i], static_cast<unsigned char>(iso_make_char_a(src[i], CHARSET_ISO)));
+
+        iso_memcpy_d(dst, src, sizeof(src), CHARSET_ISO);
+        for (size_t i = 0; i < sizeof(src); i++)
+            TS_ASSERT_EQUALS(dst[i], static_cast<unsigned char>(iso_make_char_d(src[i], CHARSET_ISO)));
+    }
+
+    void test_charclass_kernels()
+    {
+        // Lengths leaving a remainder after 16 and 32 byte blocks.
+        const size_t lens[] = { 1, 7, 15, 17, 31, 33, 47, 63, 65, 97, 255 };
+        const size_t len_count = sizeof(lens) / sizeof(size_t);
+
+        const charclass::CharClass classes[] =
+        {
+            charclass::CHARCLASS_A,
+            charclass::CHARCLASS_A_SAFE,
+            charclass::CHARCLASS_D,
+            charclass::CHARCLASS_D_SEP,
+            charclass::CHARCLASS_J
+        };
+        const size_t class_count = sizeof(classes) / sizeof(charclass::CharClass);
+
+        const char *kernels[] = { "scalar", "sse2", "avx2", "neon" };
+        const size_t kernel_count = sizeof(kernels) / sizeof(const char *);
+
+        std::string startup_kernel = charclass::kernel_name();
+        TS_ASSERT(charclass::set_kernel("scalar"));
+
+        for (size_t k = 0; k < kernel_count; k++)
+        {
+            // Kernels not built in or not supported by the processor.
+            if (!charclass::set_kernel(kernels[k]))
+                continue;
+
+            for (size_t c = 0; c < class_count; c++)
+            {
+                // The valid and invalid bytes according to the scalar kernel.
+                TS_ASSERT(charclass::set_kernel("scalar"));
+
+                std::vector<unsigned char> valid, invalid;
+                for (int i = 0; i < 256; i++)
+                {
+                    unsigned char b = static_cast<unsigned char>(i);
+                    if (charclass::find_invalid(classes[c], &b, 1) == 0)
+                        invalid.push_back(b);
+                    else
+                        valid.push_back(b);
+                }
+
+                TS_ASSERT(!valid.empty() && !invalid.empty());
+                TS_ASSERT(charclass::set_kernel(kernels[k]));
+
+                for (size_t l = 0; l < len_count; l++)
+                {
+                    std::vector<unsigned char> str(lens[l]);
+                    for (size_t i = 0; i < str.size(); i++)
+                        str[i] = valid[(i * 7) % valid.size()];
+
+                    TS_ASSERT_EQUALS(charclass::find_invalid(classes[c], &str[0], str.size()), str.size());
+
+                    for (size_t pos = 0; pos < str.size(); pos++)
+                    {
+                        unsigned char prev = str[pos];
+                        str[pos] = invalid[pos % invalid.size()];
+
+                        TS_ASSERT_EQUALS(charclass::find_invalid(classes[c], &str[0], str.size()), pos);
+
+                        // Every byte value, upper and lower case included.
+                        std::vector<char> src(str.size());
+                        for (size_t i = 0; i < src.size(); i++)
+                            src[i] = static_cast<char>(i == pos ? str[pos] : (i * 37 + pos) & 0xff);
+
+                        std::vector<unsigned char> expected(src.size()), dst(src.size());
+                        TS_ASSERT(charclass::set_kernel("scalar"));
+                        charclass::make_valid(classes[c], &expected[0], &src[0], src.size());
+                        TS_ASSERT(charclass::set_kernel(kernels[k]));
+                        charclass::make_valid(classes[c], &dst[0], &src[0], src.size());
+
+                        TS_ASSERT(dst == expected);
+
+                        str[pos] = prev;
+                    }
+                }
+            }
+        }
+
+        TS_ASSERT(charclass::set_kernel(startup_kernel.c_str()));
+    }
 };
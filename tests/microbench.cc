@@ -0,0 +1,546 @@
+/*
+ * The ckFileSystem library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/*
+ * Microbenchmarks of the name conversion, path table and UDF descriptor
+ * kernels. Each benchmark is repeated until it has run for at least the
+ * minimum time, the fastest of five such runs is reported in nanoseconds
+ * per operation. Benchmarks using the character classification are run once
+ * for each implementation supported by the processor, see
+ * charclass::set_kernel().
+ *
+ * Usage: microbench [-m min ms] [-s save file] [-c baseline file]
+ *                   [-t threshold percent] [filter]
+ *
+ * -s writes the results to a baseline file, one "name kernel ns" line per
+ * result. -c compares the results to such a file and fails if any result is
+ * slower than the baseline by more than the threshold (default 10%). Only
+ * benchmarks containing filter in their name are run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "ckcore/progress.hh"
+#include "ckfilesystem/charclass.hh"
+#include "ckfilesystem/fileset.hh"
+#include "ckfilesystem/filesystem.hh"
+#include "ckfilesystem/isopathtable.hh"
+#include "ckfilesystem/isowriter.hh"
+#include "ckfilesystem/joliet.hh"
+#include "ckfilesystem/sectormanager.hh"
+#include "ckfilesystem/sectorstream.hh"
+#include "ckfilesystem/udf.hh"
+
+using namespace ckfilesystem;
+
+class NullLog : public ckcore::Log
+{
+public:
+    void print(const ckcore::tchar *format,...) __attribute__ ((format (printf, 2, 3))) {}
+    void print_line(const ckcore::tchar *format,...) __attribute__ ((format (printf, 2, 3))) {}
+};
+
+class NullProgress : public ckcore::Progress
+{
+public:
+    void set_progress(unsigned char progress) {}
+    void set_status(const ckcore::tchar *format,...) {}
+    void notify(MessageType type,const ckcore::tchar *format,...) {}
+    bool cancelled() { return false; }
+};
+
+class NullStream : public ckcore::OutStream
+{
+public:
+    ckcore::tint64 write(const void *buffer, ckcore::tuint32 count) { return count; }
+};
+
+/*
+ * Accumulates the time spent between start() and stop().
+ */
+class Timer
+{
+private:
+    ckcore::tuint64 start_;
+    ckcore::tuint64 elapsed_;
+
+    static ckcore::tuint64 now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+        return (ckcore::tuint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+public:
+    Timer() : start_(0),elapsed_(0) {}
+
+    void start()
+    {
+        start_ = now();
+    }
+
+    void stop()
+    {
+        elapsed_ += now() - start_;
+    }
+
+    ckcore::tuint64 elapsed() const
+    {
+        return elapsed_;
+    }
+};
+
+// Results are accumulated here so that the compiler can't remove the
+// benchmarked calls.
+static volatile unsigned int sink = 0;
+
+static NullLog null_log;
+static NullProgress null_progress;
+
+/*
+ * File names of different length and character content, most of them are
+ * not valid ISO9660 identifiers and must be converted.
+ */
+static const std::vector<std::string> &names()
+{
+    static std::vector<std::string> names;
+    if (names.empty())
+    {
+        static const char *patterns[] =
+        {
+            "IMG_%04u.JPG",
+            "readme%u",
+            "Holiday photos from the summer of %u.jpeg",
+            "lower_case_source_file_%u.c",
+            "A very long file name with spaces, [brackets] and number %u.tar.gz",
+            "R\xc3\xa9sum\xc3\xa9 %u.doc",
+            "archive.%u.part.rar",
+            "no extension but quite a long name %u"
+        };
+
+        char name[256];
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            sprintf(name,patterns[i % (sizeof(patterns) / sizeof(const char *))],i);
+            names.push_back(name);
+        }
+    }
+
+    return names;
+}
+
+/*
+ * Name conversion.
+ */
+static ckcore::tuint64 bench_iso_file_name(Timer &timer,ckcore::tuint64 iterations,
+                                           unsigned char (*func)(unsigned char *,const ckcore::tchar *,
+                                                                 CharacterSet))
+{
+    const std::vector<std::string> &file_names = names();
+    unsigned char buffer[256];
+    unsigned int sum = 0;
+
+    timer.start();
+    for (ckcore::tuint64 i = 0; i < iterations; i++)
+        sum += func(buffer,file_names[i % file_names.size()].c_str(),CHARSET_ISO);
+    timer.stop();
+
+    sink += sum;
+    return iterations;
+}
+
+static ckcore::tuint64 bench_iso_file_name_l1(Timer &timer,ckcore::tuint64 iterations)
+{
+    return bench_iso_file_name(timer,iterations,iso_write_file_name_l1);
+}
+
+static ckcore::tuint64 bench_iso_file_name_l2(Timer &timer,ckcore::tuint64 iterations)
+{
+    return bench_iso_file_name(timer,iterations,iso_write_file_name_l2);
+}
+
+static ckcore::tuint64 bench_iso_file_name_1999(Timer &timer,ckcore::tuint64 iterations)
+{
+    return bench_iso_file_name(timer,iterations,iso_write_file_name_1999);
+}
+
+static ckcore::tuint64 bench_joliet_file_name(Timer &timer,ckcore::tuint64 iterations)
+{
+    const std::vector<std::string> &file_names = names();
+    unsigned char buffer[256];
+    unsigned int sum = 0;
+
+    Joliet joliet;
+
+    timer.start();
+    for (ckcore::tuint64 i = 0; i < iterations; i++)
+        sum += joliet.write_file_name(buffer,file_names[i % file_names.size()].c_str(),false);
+    timer.stop();
+
+    sink += sum;
+    return iterations;
+}
+
+/*
+ * Unique ISO9660 level 1 names for directories where all file names collide
+ * in 8.3 form. One operation is one file name. IsoWriter::make_unique_iso()
+ * supports at most 255 collisions per name so the files are spread over
+ * several directories.
+ */
+static ckcore::tuint64 bench_unique_iso(Timer &timer,ckcore::tuint64 iterations)
+{
+    const unsigned int dir_count = 4;
+    const unsigned int file_count = 250;
+
+    FileComparator comparator(false);
+    FileSet file_set(comparator);
+    FileSystem file_sys(FileSystem::TYPE_ISO,file_set);
+    file_sys.set_interchange_level(Iso::LEVEL_1);
+
+    NullStream null_stream;
+    SectorOutStream out_stream(null_stream);
+    SectorManager sec_manager(0);
+    IsoWriter iso_writer(null_log,out_stream,sec_manager,file_sys,true,false);
+
+    FileTree file_tree(null_log);
+    file_tree.create_from_file_set(file_set);
+
+    FileTreeNode *root_node = file_tree.get_root();
+    std::vector<FileTreeNode *> nodes;
+
+    char name[64];
+    for (unsigned int i = 0; i < dir_count; i++)
+    {
+        sprintf(name,"Directory %u",i);
+
+        FileTreeNode *dir_node = new FileTreeNode(root_node,name,ckT(""),true,0,
+                                                  FileTreeNode::FLAG_DIRECTORY);
+        root_node->children_.push_back(dir_node);
+        nodes.push_back(dir_node);
+
+        for (unsigned int j = 0; j < file_count; j++)
+        {
+            sprintf(name,"Collision number %03u.txt",j);
+
+            FileTreeNode *file_node = new FileTreeNode(dir_node,name,ckT(""),true,0);
+            dir_node->children_.push_back(file_node);
+            nodes.push_back(file_node);
+        }
+    }
+
+    for (ckcore::tuint64 i = 0; i < iterations; i++)
+    {
+        for (size_t j = 0; j < nodes.size(); j++)
+            nodes[j]->file_name_iso_.clear();
+
+        timer.start();
+        iso_writer.calc_names(file_tree);
+        timer.stop();
+    }
+
+    return iterations * nodes.size();
+}
+
+/*
+ * Path table sorting of a DVD-Video like directory structure. One operation
+ * is one sort of the complete table.
+ */
+static ckcore::tuint64 bench_path_table_sort(Timer &timer,ckcore::tuint64 iterations,
+                                             bool dvdvideo)
+{
+    const unsigned int dir_count = 40;
+    const unsigned int sub_dir_count = 50;
+
+    FileComparator comparator(false);
+    FileSet file_set(comparator);
+    FileSystem file_sys(FileSystem::TYPE_ISO,file_set);
+    file_sys.set_relax_max_dir_level(true);
+
+    NullStream null_stream;
+    SectorOutStream out_stream(null_stream);
+    SectorManager sec_manager(0);
+    IsoWriter iso_writer(null_log,out_stream,sec_manager,file_sys,true,false);
+
+    FileTree file_tree(null_log);
+    file_tree.create_from_file_set(file_set);
+
+    FileTreeNode *root_node = file_tree.get_root();
+    root_node->children_.push_back(new FileTreeNode(root_node,ckT("VIDEO_TS"),ckT(""),true,0,
+                                                    FileTreeNode::FLAG_DIRECTORY));
+    root_node->children_.push_back(new FileTreeNode(root_node,ckT("AUDIO_TS"),ckT(""),true,0,
+                                                    FileTreeNode::FLAG_DIRECTORY));
+
+    char name[64];
+    for (unsigned int i = 0; i < dir_count; i++)
+    {
+        sprintf(name,"dir%02u",i);
+
+        FileTreeNode *dir_node = new FileTreeNode(root_node,name,ckT(""),true,0,
+                                                  FileTreeNode::FLAG_DIRECTORY);
+        root_node->children_.push_back(dir_node);
+
+        for (unsigned int j = 0; j < sub_dir_count; j++)
+        {
+            sprintf(name,"sub%02u",j);
+            dir_node->children_.push_back(new FileTreeNode(dir_node,name,ckT(""),true,0,
+                                                           FileTreeNode::FLAG_DIRECTORY));
+        }
+    }
+
+    iso_writer.calc_names(file_tree);
+
+    IsoPathTable path_table;
+    iso_path_table_populate(path_table,file_tree,file_sys,null_progress);
+
+    for (ckcore::tuint64 i = 0; i < iterations; i++)
+    {
+        IsoPathTable pt = path_table;
+
+        timer.start();
+        iso_path_table_sort(pt,false,dvdvideo);
+        timer.stop();
+
+        sink += pt[0].second;
+    }
+
+    return iterations;
+}
+
+static ckcore::tuint64 bench_path_table_sort_plain(Timer &timer,ckcore::tuint64 iterations)
+{
+    return bench_path_table_sort(timer,iterations,false);
+}
+
+static ckcore::tuint64 bench_path_table_sort_dvd(Timer &timer,ckcore::tuint64 iterations)
+{
+    return bench_path_table_sort(timer,iterations,true);
+}
+
+/*
+ * UDF descriptors. Udf::make_tag_checksums() is private, it's measured
+ * through the terminating descriptor which consists of a tag only.
+ */
+static ckcore::tuint64 bench_udf_tag_checksums(Timer &timer,ckcore::tuint64 iterations)
+{
+    NullStream null_stream;
+    SectorOutStream out_stream(null_stream);
+    Udf udf(false);
+
+    timer.start();
+    for (ckcore::tuint64 i = 0; i < iterations; i++)
+        udf.write_vol_desc_term(out_stream,(ckcore::tuint32)i);
+    timer.stop();
+
+    return iterations;
+}
+
+static ckcore::tuint64 bench_udf_file_entry(Timer &timer,ckcore::tuint64 iterations)
+{
+    NullStream null_stream;
+    SectorOutStream out_stream(null_stream);
+    Udf udf(false);
+
+    time_t cur_time = 0;
+    struct tm file_time = *gmtime(&cur_time);
+
+    timer.start();
+    for (ckcore::tuint64 i = 0; i < iterations; i++)
+    {
+        udf.write_file_entry(out_stream,(ckcore::tuint32)i,false,1,i + 16,
+                             (ckcore::tuint32)i,(i & 0xffff) * 2048,
+                             file_time,file_time,file_time);
+    }
+    timer.stop();
+
+    return iterations;
+}
+
+struct Benchmark
+{
+    const char *name;
+    ckcore::tuint64 (*func)(Timer &timer,ckcore::tuint64 iterations);
+    bool charclass;     // Set if the result depends on charclass::set_kernel().
+};
+
+static const Benchmark benchmarks[] =
+{
+    { "iso_write_file_name_l1",bench_iso_file_name_l1,true },
+    { "iso_write_file_name_l2",bench_iso_file_name_l2,true },
+    { "iso_write_file_name_1999",bench_iso_file_name_1999,true },
+    { "joliet_write_file_name",bench_joliet_file_name,false },
+    { "iso_make_unique_l1",bench_unique_iso,true },
+    { "iso_path_table_sort",bench_path_table_sort_plain,false },
+    { "iso_path_table_sort_dvd",bench_path_table_sort_dvd,false },
+    { "udf_tag_checksums",bench_udf_tag_checksums,false },
+    { "udf_write_file_entry",bench_udf_file_entry,false }
+};
+
+/*
+ * Returns the fastest of five runs in nanoseconds per operation.
+ */
+static double run(const Benchmark &bench,ckcore::tuint64 min_time)
+{
+    // Find the number of iterations needed to reach the minimum run time.
+    ckcore::tuint64 iterations = 1;
+    while (true)
+    {
+        Timer timer;
+        bench.func(timer,iterations);
+        if (timer.elapsed() >= min_time || iterations >= ((ckcore::tuint64)1 << 40))
+            break;
+
+        iterations *= 2;
+    }
+
+    double best = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        Timer timer;
+        ckcore::tuint64 ops = bench.func(timer,iterations);
+
+        double ns_per_op = (double)timer.elapsed() / ops;
+        if (i == 0 || ns_per_op < best)
+            best = ns_per_op;
+    }
+
+    return best;
+}
+
+typedef std::map<std::string,double> Results;
+
+static bool load_baseline(const char *file_path,Results &results)
+{
+    FILE *file = fopen(file_path,"r");
+    if (file == NULL)
+        return false;
+
+    char name[128],kernel[32];
+    double ns_per_op;
+    while (fscanf(file,"%127s %31s %lf",name,kernel,&ns_per_op) == 3)
+        results[std::string(name) + " " + kernel] = ns_per_op;
+
+    fclose(file);
+    return true;
+}
+
+int main(int argc,const char *argv[])
+{
+    ckcore::tuint64 min_time = 100;
+    const char *save_path = NULL;
+    const char *baseline_path = NULL;
+    double threshold = 10.0;
+    const char *filter = "";
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i],"-m") && i + 1 < argc)
+            min_time = strtoull(argv[++i],NULL,10);
+        else if (!strcmp(argv[i],"-s") && i + 1 < argc)
+            save_path = argv[++i];
+        else if (!strcmp(argv[i],"-c") && i + 1 < argc)
+            baseline_path = argv[++i];
+        else if (!strcmp(argv[i],"-t") && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (argv[i][0] != '-')
+            filter = argv[i];
+        else
+        {
+            fprintf(stderr,"usage: microbench [-m min ms] [-s save file] [-c baseline file] "
+                           "[-t threshold percent] [filter]\n");
+            return 1;
+        }
+    }
+
+    Results baseline;
+    if (baseline_path != NULL && !load_baseline(baseline_path,baseline))
+    {
+        fprintf(stderr,"error: unable to read baseline %s.\n",baseline_path);
+        return 1;
+    }
+
+    FILE *save_file = NULL;
+    if (save_path != NULL && (save_file = fopen(save_path,"w")) == NULL)
+    {
+        fprintf(stderr,"error: unable to create %s.\n",save_path);
+        return 1;
+    }
+
+    // All implementations the library may have been built with.
+    static const char *kernel_names[] = { "scalar","sse2","avx2","neon" };
+    const std::string default_kernel = charclass::kernel_name();
+
+    int regressions = 0;
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(Benchmark); i++)
+    {
+        const Benchmark &bench = benchmarks[i];
+        if (strstr(bench.name,filter) == NULL)
+            continue;
+
+        for (size_t j = 0; j < sizeof(kernel_names) / sizeof(const char *); j++)
+        {
+            const char *kernel = "-";
+            if (bench.charclass)
+            {
+                if (!charclass::set_kernel(kernel_names[j]))
+                    continue;
+
+                kernel = kernel_names[j];
+            }
+            else if (j > 0)
+            {
+                break;
+            }
+
+            double ns_per_op = run(bench,min_time * 1000000);
+            printf("%-28s %-8s %12.1f ns/op",bench.name,kernel,ns_per_op);
+
+            if (save_file != NULL)
+                fprintf(save_file,"%s %s %.1f\n",bench.name,kernel,ns_per_op);
+
+            Results::const_iterator it = baseline.find(std::string(bench.name) + " " + kernel);
+            if (it != baseline.end() && it->second > 0)
+            {
+                double change = (ns_per_op - it->second) * 100.0 / it->second;
+                printf("  %12.1f  %+7.1f%%",it->second,change);
+
+                if (change > threshold)
+                {
+                    printf("  REGRESSION");
+                    regressions++;
+                }
+            }
+
+            printf("\n");
+        }
+
+        charclass::set_kernel(default_kernel.c_str());
+    }
+
+    if (save_file != NULL)
+        fclose(save_file);
+
+    return regressions > 0 ? 1 : 0;
+}
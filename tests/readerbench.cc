@@ -0,0 +1,713 @@
+/*
+ * The ckFileSystem library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/*
+ * Benchmark of IsoReader::read and IsoVerifier::verify. A reference image is
+ * first written using FileSystemWriter, it's then imported and verified
+ * through file, memory mapped and pipe backed streams. Each combination is
+ * run three times and the fastest run is printed as one line of JSON with
+ * the number of entries per second and the amount of data read. The image
+ * is written just before it is read, all figures are for a warm page cache.
+ *
+ * Usage: readerbench shape [count] [file size] [scratch directory]
+ *        readerbench image file
+ *
+ * Shapes:
+ *   flat       count files in a single directory (default 10000).
+ *   tree       count directories of 100 files each (default 100).
+ *   deep       a chain of count nested directories (default 100).
+ *
+ * Operations:
+ *   import_full    IsoReader::read of the complete hierarchy.
+ *   import_lazy    IsoReader::read of the root directory followed by
+ *                  IsoReader::read_dir of its first subdirectory.
+ *   verify         IsoVerifier::verify reading the stream sequentially.
+ *   verify_mt      IsoVerifier::verify using one thread per processor.
+ *
+ * IsoReader needs a seekable stream and verify_mt random access to the
+ * image, neither is run on pipes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "ckcore/filestream.hh"
+#include "ckcore/progress.hh"
+#include "ckfilesystem/const.hh"
+#include "ckfilesystem/fileset.hh"
+#include "ckfilesystem/filesystem.hh"
+#include "ckfilesystem/filesystemwriter.hh"
+#include "ckfilesystem/isoreader.hh"
+#include "ckfilesystem/isoverifier.hh"
+#include "ckfilesystem/sectorstream.hh"
+#include "ckfilesystem/threadpool.hh"
+#include "ckfilesystem/writestats.hh"
+
+using namespace ckfilesystem;
+
+class NullLog : public ckcore::Log
+{
+public:
+    void print(const ckcore::tchar *format,...) __attribute__ ((format (printf, 2, 3))) {}
+    void print_line(const ckcore::tchar *format,...) __attribute__ ((format (printf, 2, 3))) {}
+};
+
+class NullProgress : public ckcore::Progress
+{
+public:
+    void set_progress(unsigned char progress) {}
+    void set_status(const ckcore::tchar *format,...) {}
+    void notify(MessageType type,const ckcore::tchar *format,...) {}
+    bool cancelled() { return false; }
+};
+
+/*
+ * Counts the data read from another stream.
+ */
+class CountingInStream : public ckcore::InStream
+{
+private:
+    ckcore::InStream &stream_;
+
+public:
+    ckcore::tuint64 bytes_;
+    ckcore::tuint64 reads_;
+    ckcore::tuint64 seeks_;
+
+    CountingInStream(ckcore::InStream &stream) :
+        stream_(stream),bytes_(0),reads_(0),seeks_(0) {}
+
+    bool end()
+    {
+        return stream_.end();
+    }
+
+    bool seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence)
+    {
+        seeks_++;
+        return stream_.seek(distance,whence);
+    }
+
+    ckcore::tint64 read(void *buffer,ckcore::tuint32 count)
+    {
+        ckcore::tint64 res = stream_.read(buffer,count);
+        if (res > 0)
+            bytes_ += res;
+
+        reads_++;
+        return res;
+    }
+
+    ckcore::tint64 size()
+    {
+        return stream_.size();
+    }
+};
+
+/*
+ * Counts the data read by another sector reader, from any thread.
+ */
+class CountingSectorReader : public SectorReader
+{
+private:
+    SectorReader &reader_;
+    Mutex mutex_;
+
+public:
+    ckcore::tuint64 bytes_;
+    ckcore::tuint64 reads_;
+
+    CountingSectorReader(SectorReader &reader) :
+        reader_(reader),bytes_(0),reads_(0) {}
+
+    void read(ckcore::tuint64 sector,void *buffer,ckcore::tuint32 count)
+    {
+        reader_.read(sector,buffer,count);
+
+        MutexLock lock(mutex_);
+        bytes_ += count;
+        reads_++;
+    }
+};
+
+/*
+ * Read-only memory mapping of a complete file.
+ */
+class MappedFile
+{
+private:
+    const unsigned char *data_;
+    ckcore::tuint64 size_;
+
+public:
+    MappedFile() : data_(NULL),size_(0) {}
+
+    ~MappedFile()
+    {
+        if (data_ != NULL)
+            munmap(const_cast<unsigned char *>(data_),size_);
+    }
+
+    bool open(const std::string &file_path)
+    {
+        int fd = ::open(file_path.c_str(),O_RDONLY);
+        if (fd == -1)
+            return false;
+
+        struct stat st;
+        if (fstat(fd,&st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        void *data = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+        close(fd);
+
+        if (data == MAP_FAILED)
+            return false;
+
+        data_ = static_cast<const unsigned char *>(data);
+        size_ = st.st_size;
+        return true;
+    }
+
+    const unsigned char *data() const
+    {
+        return data_;
+    }
+
+    ckcore::tuint64 size() const
+    {
+        return size_;
+    }
+};
+
+class MappedInStream : public ckcore::InStream
+{
+private:
+    const MappedFile &file_;
+    ckcore::tuint64 pos_;
+
+public:
+    MappedInStream(const MappedFile &file) : file_(file),pos_(0) {}
+
+    bool end()
+    {
+        return pos_ >= file_.size();
+    }
+
+    bool seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence)
+    {
+        ckcore::tint64 pos = whence == ckcore::InStream::ckSTREAM_BEGIN ?
+            distance : (ckcore::tint64)pos_ + distance;
+        if (pos < 0 || pos > (ckcore::tint64)file_.size())
+            return false;
+
+        pos_ = pos;
+        return true;
+    }
+
+    ckcore::tint64 read(void *buffer,ckcore::tuint32 count)
+    {
+        ckcore::tuint64 remaining = file_.size() - pos_;
+        if (count > remaining)
+            count = (ckcore::tuint32)remaining;
+
+        memcpy(buffer,file_.data() + pos_,count);
+        pos_ += count;
+        return count;
+    }
+
+    ckcore::tint64 size()
+    {
+        return file_.size();
+    }
+};
+
+class MappedSectorReader : public SectorReader
+{
+private:
+    const MappedFile &file_;
+
+public:
+    MappedSectorReader(const MappedFile &file) : file_(file) {}
+
+    void read(ckcore::tuint64 sector,void *buffer,ckcore::tuint32 count)
+    {
+        ckcore::tuint64 pos = sector * ISO_SECTOR_SIZE;
+        if (pos > file_.size() || count > file_.size() - pos)
+            throw ckcore::Exception2(ckT("Read beyond the end of the image."));
+
+        memcpy(buffer,file_.data() + pos,count);
+    }
+};
+
+/*
+ * Reads the image from a pipe fed by a separate thread. Like any pipe it
+ * only supports seeking forward.
+ */
+class PipeInStream : public ckcore::InStream
+{
+private:
+    std::string file_path_;
+    int fds_[2];
+    pthread_t thread_;
+    ckcore::tuint64 pos_;
+    bool end_;
+
+    static void *feed(void *param)
+    {
+        PipeInStream *stream = static_cast<PipeInStream *>(param);
+
+        int fd = ::open(stream->file_path_.c_str(),O_RDONLY);
+        if (fd != -1)
+        {
+            std::vector<char> buffer(1024 * 1024);
+
+            ssize_t res;
+            while ((res = ::read(fd,&buffer[0],buffer.size())) > 0)
+            {
+                if (write(stream->fds_[1],&buffer[0],res) != res)
+                    break;
+            }
+
+            close(fd);
+        }
+
+        close(stream->fds_[1]);
+        return NULL;
+    }
+
+public:
+    PipeInStream(const std::string &file_path) :
+        file_path_(file_path),pos_(0),end_(false)
+    {
+        if (pipe(fds_) != 0 || pthread_create(&thread_,NULL,feed,this) != 0)
+        {
+            fprintf(stderr,"error: unable to create pipe.\n");
+            exit(1);
+        }
+    }
+
+    ~PipeInStream()
+    {
+        // Closing the read end stops the feeder if the image was not read
+        // completely.
+        close(fds_[0]);
+        pthread_join(thread_,NULL);
+    }
+
+    bool end()
+    {
+        return end_;
+    }
+
+    bool seek(ckcore::tint64 distance,ckcore::InStream::StreamWhence whence)
+    {
+        if (whence == ckcore::InStream::ckSTREAM_BEGIN)
+            distance -= pos_;
+
+        if (distance < 0)
+            return false;
+
+        char buffer[ISO_SECTOR_SIZE];
+        while (distance > 0)
+        {
+            ckcore::tuint32 count = distance > (ckcore::tint64)sizeof(buffer) ?
+                sizeof(buffer) : (ckcore::tuint32)distance;
+            if (read(buffer,count) != count)
+                return false;
+
+            distance -= count;
+        }
+
+        return true;
+    }
+
+    ckcore::tint64 read(void *buffer,ckcore::tuint32 count)
+    {
+        ckcore::tuint32 total = 0;
+        while (total < count)
+        {
+            ssize_t res = ::read(fds_[0],static_cast<char *>(buffer) + total,count - total);
+            if (res < 0)
+                return -1;
+
+            if (res == 0)
+            {
+                end_ = true;
+                break;
+            }
+
+            total += (ckcore::tuint32)res;
+        }
+
+        pos_ += total;
+        return total;
+    }
+
+    ckcore::tint64 size()
+    {
+        return -1;
+    }
+};
+
+enum StreamType
+{
+    STREAM_FILE,
+    STREAM_MMAP,
+    STREAM_PIPE
+};
+
+enum Operation
+{
+    OP_IMPORT_FULL,
+    OP_IMPORT_LAZY,
+    OP_VERIFY,
+    OP_VERIFY_MT
+};
+
+static const char *stream_names[] = { "file","mmap","pipe" };
+static const char *operation_names[] = { "import_full","import_lazy","verify","verify_mt" };
+
+struct Result
+{
+    bool ok_;
+    ckcore::tuint64 wall_time_;
+    ckcore::tuint64 entries_;
+    ckcore::tuint64 bytes_;
+    ckcore::tuint64 reads_;
+};
+
+static ckcore::tuint64 import(ckcore::InStream &in_stream,bool recursive,bool &ok)
+{
+    NullLog log;
+    IsoReader reader(log);
+
+    ok = reader.read(in_stream,0,recursive);
+    if (ok && !recursive)
+    {
+        const IsoTree &tree = reader.get_tree();
+        for (ckcore::tuint32 i = tree.node(IsoTree::ROOT_INDEX).first_child_;
+             i != IsoTree::INVALID_INDEX; i = tree.node(i).next_sibling_)
+        {
+            if (tree.is_dir(i))
+            {
+                ok = reader.read_dir(in_stream,i);
+                break;
+            }
+        }
+    }
+
+    return reader.get_tree().size();
+}
+
+static bool verify(ckcore::InStream &in_stream,SectorReader *reader)
+{
+    try
+    {
+        IsoVerifier verifier;
+        SectorInStream sector_stream(in_stream);
+
+        if (reader != NULL)
+            verifier.verify(sector_stream,*reader,ThreadPool::hardware_concurrency());
+        else
+            verifier.verify(sector_stream);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr,"error: %s\n",ckcore::get_except_msg(e).c_str());
+        return false;
+    }
+
+    return true;
+}
+
+static Result run(const std::string &image_path,const MappedFile &mapped_file,
+                  StreamType stream_type,Operation op,ckcore::tuint64 image_entries)
+{
+    Result result;
+    memset(&result,0,sizeof(Result));
+
+    ckcore::FileInStream file_stream(image_path.c_str());
+    FileSectorReader file_reader(image_path.c_str());
+    MappedSectorReader mapped_reader(mapped_file);
+
+    ckcore::tuint64 start_time = WriteStats::get_wall_time();
+
+    ckcore::InStream *base_stream = NULL;
+    PipeInStream *pipe_stream = NULL;
+    MappedInStream mapped_stream(mapped_file);
+
+    switch (stream_type)
+    {
+        case STREAM_FILE:
+            if (!file_stream.open() || !file_reader.open())
+                return result;
+
+            base_stream = &file_stream;
+            break;
+
+        case STREAM_MMAP:
+            base_stream = &mapped_stream;
+            break;
+
+        case STREAM_PIPE:
+            pipe_stream = new PipeInStream(image_path);
+            base_stream = pipe_stream;
+            break;
+    }
+
+    CountingInStream in_stream(*base_stream);
+    CountingSectorReader sector_reader(stream_type == STREAM_FILE ?
+        static_cast<SectorReader &>(file_reader) : mapped_reader);
+
+    switch (op)
+    {
+        case OP_IMPORT_FULL:
+        case OP_IMPORT_LAZY:
+            result.entries_ = import(in_stream,op == OP_IMPORT_FULL,result.ok_);
+            break;
+
+        case OP_VERIFY:
+            result.ok_ = verify(in_stream,NULL);
+            result.entries_ = image_entries;
+            break;
+
+        case OP_VERIFY_MT:
+            result.ok_ = verify(in_stream,&sector_reader);
+            result.entries_ = image_entries;
+            break;
+    }
+
+    delete pipe_stream;
+
+    result.wall_time_ = WriteStats::get_wall_time() - start_time;
+    result.bytes_ = in_stream.bytes_ + sector_reader.bytes_;
+    result.reads_ = in_stream.reads_ + sector_reader.reads_;
+    return result;
+}
+
+static void add_dir(FileSet &file_set,const std::string &internal_path)
+{
+    file_set.insert(new FileDescriptor(internal_path.c_str(),ckT(""),
+                                       FileDescriptor::FLAG_DIRECTORY));
+}
+
+static void add_file(FileSet &file_set,const std::string &internal_path,
+                     const std::string &file_path)
+{
+    file_set.insert(new FileDescriptor(internal_path.c_str(),file_path.c_str()));
+}
+
+/*
+ * Writes a reference image of the specified shape, all files refer to the
+ * same source file.
+ */
+static bool make_image(const std::string &shape,ckcore::tuint64 count,
+                       const std::string &file_path,const std::string &image_path)
+{
+    FileComparator comparator(false);
+    FileSet file_set(comparator);
+
+    char name[64];
+    if (shape == "flat")
+    {
+        add_dir(file_set,"/flat");
+        for (ckcore::tuint64 i = 0; i < (count > 0 ? count : 10000); i++)
+        {
+            sprintf(name,"/flat/file%llu.dat",(unsigned long long)i);
+            add_file(file_set,name,file_path);
+        }
+    }
+    else if (shape == "tree")
+    {
+        for (ckcore::tuint64 i = 0; i < (count > 0 ? count : 100); i++)
+        {
+            sprintf(name,"/dir%llu",(unsigned long long)i);
+            std::string dir_path = name;
+            add_dir(file_set,dir_path);
+
+            for (unsigned int j = 0; j < 100; j++)
+            {
+                sprintf(name,"/file%u.dat",j);
+                add_file(file_set,dir_path + name,file_path);
+            }
+        }
+    }
+    else if (shape == "deep")
+    {
+        std::string internal_path;
+        for (ckcore::tuint64 i = 0; i < (count > 0 ? count : 100); i++)
+        {
+            sprintf(name,"/level%llu",(unsigned long long)i);
+            internal_path += name;
+
+            add_dir(file_set,internal_path);
+            add_file(file_set,internal_path + "/file.dat",file_path);
+        }
+    }
+    else
+    {
+        fprintf(stderr,"error: unknown shape %s.\n",shape.c_str());
+        return false;
+    }
+
+    FileSystem file_sys(FileSystem::TYPE_ISO_JOLIET,file_set);
+    file_sys.set_volume_label(ckT("BENCH"));
+    file_sys.set_relax_max_dir_level(true);
+
+    ckcore::FileOutStream out_stream(image_path.c_str());
+    if (!out_stream.open())
+    {
+        fprintf(stderr,"error: unable to create %s.\n",image_path.c_str());
+        destroy_file_set(file_set);
+        return false;
+    }
+
+    NullLog log;
+    NullProgress progress;
+    FileSystemWriter writer(log,file_sys,true);
+    int res = writer.write(out_stream,progress);
+
+    out_stream.close();
+    destroy_file_set(file_set);
+    return res == RESULT_OK;
+}
+
+int main(int argc,const char *argv[])
+{
+    if (argc < 2 || (!strcmp(argv[1],"image") && argc < 3))
+    {
+        fprintf(stderr,"usage: readerbench flat|tree|deep [count] [file size] [scratch directory]\n"
+                       "       readerbench image file\n");
+        return 1;
+    }
+
+    signal(SIGPIPE,SIG_IGN);
+
+    std::string shape = argv[1];
+    std::string image_path,scratch_path;
+
+    if (shape == "image")
+    {
+        image_path = argv[2];
+    }
+    else
+    {
+        ckcore::tuint64 count = argc > 2 ? strtoull(argv[2],NULL,10) : 0;
+        ckcore::tuint64 file_size = argc > 3 ? strtoull(argv[3],NULL,10) : 4096;
+
+        char dir_path[64];
+        sprintf(dir_path,"/tmp/readerbench.%d",(int)getpid());
+        scratch_path = argc > 4 ? argv[4] : dir_path;
+        if (mkdir(scratch_path.c_str(),0755) != 0)
+        {
+            fprintf(stderr,"error: unable to create %s.\n",scratch_path.c_str());
+            return 1;
+        }
+
+        std::string file_path = scratch_path + "/file";
+        image_path = scratch_path + "/image.iso";
+
+        int fd = open(file_path.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+        bool res = fd != -1 && ftruncate(fd,file_size) == 0;
+        if (fd != -1)
+            close(fd);
+
+        res = res && make_image(shape,count,file_path,image_path);
+
+        unlink(file_path.c_str());
+        if (!res)
+        {
+            unlink(image_path.c_str());
+            rmdir(scratch_path.c_str());
+            return 1;
+        }
+    }
+
+    MappedFile mapped_file;
+    if (!mapped_file.open(image_path))
+    {
+        fprintf(stderr,"error: unable to map %s.\n",image_path.c_str());
+        return 1;
+    }
+
+    // The verifier logs to standard output, keep it for the results only.
+    FILE *out = fdopen(dup(fileno(stdout)),"w");
+    if (out == NULL || freopen("/dev/null","w",stdout) == NULL)
+        return 1;
+
+    // Count the entries once using a full import.
+    MappedInStream count_stream(mapped_file);
+    bool ok = false;
+    ckcore::tuint64 image_entries = import(count_stream,true,ok);
+
+    int failures = 0;
+    for (int op = OP_IMPORT_FULL; op <= OP_VERIFY_MT; op++)
+    {
+        for (int stream_type = STREAM_FILE; stream_type <= STREAM_PIPE; stream_type++)
+        {
+            if (stream_type == STREAM_PIPE && op != OP_VERIFY)
+                continue;
+
+            Result best = run(image_path,mapped_file,(StreamType)stream_type,
+                              (Operation)op,image_entries);
+            for (int i = 1; i < 3; i++)
+            {
+                Result result = run(image_path,mapped_file,(StreamType)stream_type,
+                                    (Operation)op,image_entries);
+                if (result.wall_time_ < best.wall_time_)
+                    best = result;
+            }
+
+            if (!best.ok_)
+                failures++;
+
+            double seconds = best.wall_time_ / 1000000.0;
+            fprintf(out,"{\"image\":\"%s\",\"size\":%llu,\"operation\":\"%s\",\"stream\":\"%s\","
+                        "\"result\":%d,\"wall_us\":%llu,\"entries\":%llu,\"entries_per_s\":%.0f,"
+                        "\"bytes_read\":%llu,\"reads\":%llu}\n",
+                    shape.c_str(),(unsigned long long)mapped_file.size(),
+                    operation_names[op],stream_names[stream_type],best.ok_ ? 1 : 0,
+                    (unsigned long long)best.wall_time_,(unsigned long long)best.entries_,
+                    seconds > 0 ? best.entries_ / seconds : 0,
+                    (unsigned long long)best.bytes_,(unsigned long long)best.reads_);
+            fflush(out);
+        }
+    }
+
+    if (!scratch_path.empty())
+    {
+        unlink(image_path.c_str());
+        rmdir(scratch_path.c_str());
+    }
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,378 @@
+/*
+ * The ckFileSystem library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Benchmark of FileSystemWriter::write on synthetic file trees. The image is
+ * written to a null stream, the source files are generated in a scratch
+ * directory. Each run prints one line of JSON with the per-phase statistics
+ * and the peak resident set size of the process, run one shape per process
+ * for meaningful memory figures.
+ *
+ * Usage: writerbench shape [count] [file size] [scratch directory]
+ *
+ * Shapes:
+ *   flat       count files in a single directory (default 1000000).
+ *   deep       a chain of count nested directories (default 100).
+ *   collide    count files whose names collide in 8.3 form (default 100000).
+ *   dvdvideo   a DVD-Video layout with count title sets (default 10).
+ *   huge       count sparse files of file size bytes (default 4 x 1 GiB).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+#include "ckcore/progress.hh"
+#include "ckfilesystem/const.hh"
+#include "ckfilesystem/fileset.hh"
+#include "ckfilesystem/filesystem.hh"
+#include "ckfilesystem/filesystemwriter.hh"
+
+using namespace ckfilesystem;
+
+class NullLog : public ckcore::Log
+{
+public:
+    void print(const ckcore::tchar *format,...) __attribute__ ((format (printf, 2, 3))) {}
+    void print_line(const ckcore::tchar *format,...) __attribute__ ((format (printf, 2, 3))) {}
+};
+
+class NullProgress : public ckcore::Progress
+{
+public:
+    void set_progress(unsigned char progress) {}
+    void set_status(const ckcore::tchar *format,...) {}
+    void notify(MessageType type,const ckcore::tchar *format,...) {}
+    bool cancelled() { return false; }
+};
+
+class NullStream : public ckcore::OutStream
+{
+public:
+    ckcore::tint64 write(const void *buffer, ckcore::tuint32 count) { return count; }
+};
+
+/*
+ * Scratch files, removed when the benchmark exits.
+ */
+class Scratch
+{
+private:
+    std::string dir_path_;
+    std::vector<std::string> files_;
+    std::vector<std::string> dirs_;
+
+public:
+    Scratch(const std::string &dir_path) : dir_path_(dir_path)
+    {
+        make_dir("");
+    }
+
+    ~Scratch()
+    {
+        for (size_t i = 0; i < files_.size(); i++)
+            unlink(files_[i].c_str());
+
+        for (size_t i = dirs_.size(); i > 0; i--)
+            rmdir(dirs_[i - 1].c_str());
+    }
+
+    std::string make_dir(const std::string &name)
+    {
+        std::string path = dir_path_ + name;
+        if (mkdir(path.c_str(),0755) == 0)
+            dirs_.push_back(path);
+
+        return path;
+    }
+
+    /*
+     * Creates a file of the specified size. Unless data is specified the
+     * file is sparse, reading it measures the writer rather than the disk.
+     */
+    std::string make_file(const std::string &name,ckcore::tuint64 size,
+                          const unsigned char *data = NULL,size_t data_size = 0)
+    {
+        std::string path = dir_path_ + name;
+
+        int fd = open(path.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+        if (fd == -1)
+        {
+            fprintf(stderr,"error: unable to create %s.\n",path.c_str());
+            exit(1);
+        }
+
+        files_.push_back(path);
+
+        if ((data_size > 0 && write(fd,data,data_size) != (ssize_t)data_size) ||
+            ftruncate(fd,size) != 0)
+        {
+            fprintf(stderr,"error: unable to write %s.\n",path.c_str());
+            exit(1);
+        }
+
+        close(fd);
+        return path;
+    }
+};
+
+static void put_be16(unsigned char *buffer,ckcore::tuint16 val)
+{
+    buffer[0] = (unsigned char)(val >> 8);
+    buffer[1] = (unsigned char)val;
+}
+
+static void put_be32(unsigned char *buffer,ckcore::tuint32 val)
+{
+    buffer[0] = (unsigned char)(val >> 24);
+    buffer[1] = (unsigned char)(val >> 16);
+    buffer[2] = (unsigned char)(val >> 8);
+    buffer[3] = (unsigned char)val;
+}
+
+static void add_dir(FileSet &file_set,const std::string &internal_path)
+{
+    file_set.insert(new FileDescriptor(internal_path.c_str(),ckT(""),
+                                       FileDescriptor::FLAG_DIRECTORY));
+}
+
+static void add_file(FileSet &file_set,const std::string &internal_path,
+                     const std::string &file_path)
+{
+    file_set.insert(new FileDescriptor(internal_path.c_str(),file_path.c_str()));
+}
+
+static void make_flat(FileSet &file_set,Scratch &scratch,ckcore::tuint64 count,
+                      ckcore::tuint64 file_size)
+{
+    std::string file_path = scratch.make_file("/file",file_size);
+
+    add_dir(file_set,"/flat");
+    for (ckcore::tuint64 i = 0; i < count; i++)
+    {
+        char name[64];
+        sprintf(name,"/flat/file%llu.dat",(unsigned long long)i);
+        add_file(file_set,name,file_path);
+    }
+}
+
+static void make_deep(FileSet &file_set,Scratch &scratch,ckcore::tuint64 count,
+                      ckcore::tuint64 file_size)
+{
+    std::string file_path = scratch.make_file("/file",file_size);
+
+    std::string internal_path;
+    for (ckcore::tuint64 i = 0; i < count; i++)
+    {
+        char name[32];
+        sprintf(name,"/level%llu",(unsigned long long)i);
+        internal_path += name;
+
+        add_dir(file_set,internal_path);
+        add_file(file_set,internal_path + "/file.dat",file_path);
+    }
+}
+
+static void make_collide(FileSet &file_set,Scratch &scratch,ckcore::tuint64 count,
+                         ckcore::tuint64 file_size)
+{
+    std::string file_path = scratch.make_file("/file",file_size);
+
+    // All names share the first eight characters and the extension.
+    add_dir(file_set,"/collide");
+    for (ckcore::tuint64 i = 0; i < count; i++)
+    {
+        char name[64];
+        sprintf(name,"/collide/longfilename%08llu.document",(unsigned long long)i);
+        add_file(file_set,name,file_path);
+    }
+}
+
+/*
+ * Generates a minimal but consistent DVD-Video layout without any padding:
+ * VIDEO_TS.IFO and .BUP of two blocks each, and for each title set a one
+ * block IFO and BUP together with a sparse title VOB of file size bytes.
+ */
+static void make_dvdvideo(FileSet &file_set,Scratch &scratch,ckcore::tuint64 count,
+                          ckcore::tuint64 file_size)
+{
+    const ckcore::tuint32 block_size = 2048;
+    const ckcore::tuint32 title_len = (ckcore::tuint32)(file_size / block_size);
+    if (count == 0 || count > 99 || title_len == 0)
+    {
+        fprintf(stderr,"error: invalid DVD-Video dimensions.\n");
+        exit(1);
+    }
+
+    std::string dir_path = scratch.make_dir("/VIDEO_TS");
+    add_dir(file_set,"/VIDEO_TS");
+
+    // Video manager, the title search pointer table is in the second block.
+    std::vector<unsigned char> vmg(2 * block_size,0);
+    memcpy(&vmg[0],"DVDVIDEO-VMG",12);
+    put_be32(&vmg[12],3);
+    put_be32(&vmg[28],1);
+    put_be16(&vmg[62],(ckcore::tuint16)count);
+    put_be32(&vmg[196],1);
+    put_be16(&vmg[block_size],(ckcore::tuint16)count);
+    for (ckcore::tuint64 i = 0; i < count; i++)
+        put_be32(&vmg[block_size + 8 + i * 12 + 8],(ckcore::tuint32)(4 + i * (title_len + 2)));
+
+    add_file(file_set,"/VIDEO_TS/VIDEO_TS.IFO",
+             scratch.make_file("/VIDEO_TS/VIDEO_TS.IFO",vmg.size(),&vmg[0],vmg.size()));
+    add_file(file_set,"/VIDEO_TS/VIDEO_TS.BUP",
+             scratch.make_file("/VIDEO_TS/VIDEO_TS.BUP",vmg.size(),&vmg[0],vmg.size()));
+
+    for (ckcore::tuint64 i = 1; i <= count; i++)
+    {
+        std::vector<unsigned char> vts(block_size,0);
+        memcpy(&vts[0],"DVDVIDEO-VTS",12);
+        put_be32(&vts[12],title_len + 1);
+        put_be32(&vts[28],0);
+        put_be32(&vts[192],1);
+        put_be32(&vts[196],1);
+
+        char name[32];
+        sprintf(name,"/VIDEO_TS/VTS_%02llu_0.IFO",(unsigned long long)i);
+        add_file(file_set,name,scratch.make_file(name,vts.size(),&vts[0],vts.size()));
+        sprintf(name,"/VIDEO_TS/VTS_%02llu_0.BUP",(unsigned long long)i);
+        add_file(file_set,name,scratch.make_file(name,vts.size(),&vts[0],vts.size()));
+        sprintf(name,"/VIDEO_TS/VTS_%02llu_1.VOB",(unsigned long long)i);
+        add_file(file_set,name,scratch.make_file(name,(ckcore::tuint64)title_len * block_size));
+    }
+}
+
+static void make_huge(FileSet &file_set,Scratch &scratch,ckcore::tuint64 count,
+                      ckcore::tuint64 file_size)
+{
+    scratch.make_dir("/huge");
+    add_dir(file_set,"/huge");
+
+    for (ckcore::tuint64 i = 0; i < count; i++)
+    {
+        char name[32];
+        sprintf(name,"/huge/file%llu.dat",(unsigned long long)i);
+        add_file(file_set,name,scratch.make_file(name,file_size));
+    }
+}
+
+int main(int argc,const char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr,"usage: writerbench flat|deep|collide|dvdvideo|huge [count] [file size] [scratch directory]\n");
+        return 1;
+    }
+
+    std::string shape = argv[1];
+    ckcore::tuint64 count = argc > 2 ? strtoull(argv[2],NULL,10) : 0;
+    ckcore::tuint64 file_size = argc > 3 ? strtoull(argv[3],NULL,10) : 0;
+
+    char dir_path[64];
+    sprintf(dir_path,"/tmp/writerbench.%d",(int)getpid());
+    Scratch scratch(argc > 4 ? argv[4] : dir_path);
+
+    FileSystem::Type type = FileSystem::TYPE_ISO_UDF_JOLIET;
+    bool dvdvideo = shape == "dvdvideo";
+
+    FileComparator comparator(dvdvideo);
+    FileSet file_set(comparator);
+    if (shape == "flat")
+    {
+        make_flat(file_set,scratch,count > 0 ? count : 1000000,file_size);
+    }
+    else if (shape == "deep")
+    {
+        make_deep(file_set,scratch,count > 0 ? count : 100,file_size);
+    }
+    else if (shape == "collide")
+    {
+        make_collide(file_set,scratch,count > 0 ? count : 100000,file_size);
+        type = FileSystem::TYPE_ISO;
+    }
+    else if (dvdvideo)
+    {
+        make_dvdvideo(file_set,scratch,count > 0 ? count : 10,
+                      file_size > 0 ? file_size : 64 * 1024 * 1024);
+        type = FileSystem::TYPE_DVDVIDEO;
+    }
+    else if (shape == "huge")
+    {
+        make_huge(file_set,scratch,count > 0 ? count : 4,
+                  file_size > 0 ? file_size : 1024 * 1024 * 1024);
+        type = FileSystem::TYPE_ISO_UDF;
+    }
+    else
+    {
+        fprintf(stderr,"error: unknown shape %s.\n",shape.c_str());
+        return 1;
+    }
+
+    FileSystem file_sys(type,file_set);
+    file_sys.set_volume_label(ckT("BENCH"));
+    file_sys.set_relax_max_dir_level(true);
+    if (type == FileSystem::TYPE_ISO)
+        file_sys.set_interchange_level(Iso::LEVEL_1);
+
+    NullLog log;
+    NullProgress progress;
+    NullStream out_stream;
+
+    FileSystemWriter writer(log,file_sys,true);
+    int res = writer.write(out_stream,progress);
+
+    const WriteStats &stats = writer.get_stats();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+
+    printf("{\"shape\":\"%s\",\"type\":%d,\"result\":%d,\"files\":%u,\"dirs\":%u,"
+           "\"peak_rss_kib\":%ld,\"tree_mem_kib\":%llu,\"phases\":[",
+           shape.c_str(),(int)type,res,stats.file_count_,stats.dir_count_,
+           usage.ru_maxrss,(unsigned long long)(stats.tree_mem_usage_ >> 10));
+
+    for (int i = 0; i < WriteStats::PHASE_COUNT; i++)
+    {
+        const WriteStats::PhaseStats &phase = stats.get_phase((WriteStats::Phase)i);
+
+        double seconds = phase.wall_time_ / 1000000.0;
+        double mib_per_sec = seconds > 0 ? phase.sectors_ * 2048.0 / (1024 * 1024) / seconds : 0;
+
+        printf("%s{\"name\":\"%s\",\"wall_us\":%llu,\"cpu_us\":%llu,\"sectors\":%llu,\"mib_per_s\":%.1f}",
+               i > 0 ? "," : "",WriteStats::get_phase_name((WriteStats::Phase)i),
+               (unsigned long long)phase.wall_time_,(unsigned long long)phase.cpu_time_,
+               (unsigned long long)phase.sectors_,mib_per_sec);
+    }
+
+    WriteStats::PhaseStats total = stats.get_total();
+    double seconds = total.wall_time_ / 1000000.0;
+
+    printf("],\"wall_us\":%llu,\"cpu_us\":%llu,\"sectors\":%llu,\"entries_per_s\":%.0f}\n",
+           (unsigned long long)total.wall_time_,(unsigned long long)total.cpu_time_,
+           (unsigned long long)total.sectors_,
+           seconds > 0 ? (stats.file_count_ + stats.dir_count_) / seconds : 0);
+
+    destroy_file_set(file_set);
+    return res == RESULT_OK ? 0 : 1;
+}